@@ -14,6 +14,7 @@
 #    include <synchapi.h>
 #    define sleep_s(SECONDS) Sleep((SECONDS)*1000)
 #else
+#    include <pthread.h>
 #    include <unistd.h>
 #    define sleep_s(SECONDS) sleep(SECONDS)
 #endif
@@ -40,6 +41,16 @@ has_arg(int argc, char **argv, const char *arg)
     return false;
 }
 
+#ifndef SENTRY_PLATFORM_WINDOWS
+static void *
+idle_thread(void *unused)
+{
+    (void)unused;
+    sleep_s(60);
+    return NULL;
+}
+#endif
+
 static void *invalid_mem = (void *)1;
 
 static void
@@ -58,7 +69,9 @@ main(int argc, char **argv)
     sentry_options_set_database_path(options, ".sentry-native");
 
     sentry_options_set_auto_session_tracking(options, false);
-    sentry_options_set_symbolize_stacktraces(options, true);
+    if (!has_arg(argc, argv, "no-symbolize")) {
+        sentry_options_set_symbolize_stacktraces(options, true);
+    }
 
     sentry_options_set_environment(options, "development");
     // sentry defaults this to the `SENTRY_RELEASE` env variable
@@ -76,6 +89,18 @@ main(int argc, char **argv)
         sentry_options_add_attachment(options, "./CMakeCache.txt");
     }
 
+    if (has_arg(argc, argv, "capture-threads")) {
+        sentry_options_set_capture_all_threads(options, true);
+    }
+
+    if (has_arg(argc, argv, "capture-minidump")) {
+        sentry_options_set_capture_minidump(options, true);
+    }
+
+    if (has_arg(argc, argv, "offload")) {
+        sentry_options_set_offload_crash_handling(options, true);
+    }
+
     if (has_arg(argc, argv, "stdout")) {
         sentry_options_set_transport(
             options, sentry_transport_new(print_envelope));
@@ -126,6 +151,11 @@ main(int argc, char **argv)
         sentry_add_breadcrumb(nl_crumb);
     }
 
+    if (has_arg(argc, argv, "local-scope")) {
+        sentry_push_scope();
+        sentry_set_tag("local-tag", "local value");
+    }
+
     if (has_arg(argc, argv, "start-session")) {
         sentry_start_session();
     }
@@ -153,6 +183,22 @@ main(int argc, char **argv)
         sleep_s(10);
     }
 
+#ifndef SENTRY_PLATFORM_WINDOWS
+    if (has_arg(argc, argv, "spawn-threads")) {
+        for (size_t i = 0; i < 3; i++) {
+            pthread_t thread;
+            if (pthread_create(&thread, NULL, idle_thread, NULL) == 0) {
+                pthread_detach(thread);
+            }
+        }
+    }
+#endif
+
+    if (has_arg(argc, argv, "sleep-before-crash")) {
+        // gives the background scope flush time to run
+        sleep_s(1);
+    }
+
     if (has_arg(argc, argv, "crash")) {
         trigger_crash();
     }
@@ -769,6 +769,70 @@ SENTRY_API void sentry_options_set_max_breadcrumbs(
 SENTRY_API size_t sentry_options_get_max_breadcrumbs(
     const sentry_options_t *opts);
 
+/**
+ * Sets the interval (in milliseconds) in which modifications of the scope are
+ * persisted to disk.
+ *
+ * Modifications such as `sentry_set_tag` are flushed on a background thread,
+ * and all the modifications happening within this interval are coalesced into
+ * a single flush. Crashes and `sentry_shutdown` always flush immediately.
+ * The `inproc` backend only writes its crash event prepared ahead of time when
+ * no flush is pending, and builds it from scratch otherwise. Setting this to
+ * `0` flushes synchronously on every modification.
+ *
+ * This has no effect with the crashpad backend on macOS, which can not flush
+ * the scope when crashing, and thus always flushes synchronously.
+ *
+ * Defaults to 100.
+ */
+SENTRY_API void sentry_options_set_scope_flush_interval(
+    sentry_options_t *opts, uint64_t interval_ms);
+
+/**
+ * Gets the interval (in milliseconds) in which scope modifications are
+ * persisted to disk.
+ */
+SENTRY_API uint64_t sentry_options_get_scope_flush_interval(
+    const sentry_options_t *opts);
+
+/**
+ * Sets the amount of memory (in bytes) which is reserved up front for the
+ * crash handler.
+ *
+ * On Unix platforms, crash handlers can not use `malloc`, and allocate from
+ * this reservation instead. Only memory which is actually touched is being
+ * committed. If the reservation is exhausted, additional pages are mapped
+ * from within the crash handler. Setting this to `0` disables the reservation.
+ *
+ * Defaults to 1 MiB.
+ */
+SENTRY_API void sentry_options_set_crash_memory_reserve(
+    sentry_options_t *opts, size_t bytes);
+
+/**
+ * Gets the amount of memory (in bytes) which is reserved for the crash
+ * handler.
+ */
+SENTRY_API size_t sentry_options_get_crash_memory_reserve(
+    const sentry_options_t *opts);
+
+/**
+ * Sets the interval (in milliseconds) in which the request session aggregates
+ * recorded via `sentry_record_request_session` are sent.
+ * Setting this to `0` only sends them on `sentry_shutdown`.
+ *
+ * Defaults to 60000.
+ */
+SENTRY_EXPERIMENTAL_API void sentry_options_set_request_session_flush_interval(
+    sentry_options_t *opts, uint64_t interval_ms);
+
+/**
+ * Gets the interval (in milliseconds) in which request session aggregates are
+ * sent.
+ */
+SENTRY_EXPERIMENTAL_API uint64_t
+sentry_options_get_request_session_flush_interval(const sentry_options_t *opts);
+
 /**
  * Type of the callback for logger function.
  */
@@ -834,6 +898,255 @@ SENTRY_API void sentry_options_set_symbolize_stacktraces(
 SENTRY_API int sentry_options_get_symbolize_stacktraces(
     const sentry_options_t *opts);
 
+/**
+ * Enables or disables offloading crash handling to a child process.
+ *
+ * With the `inproc` backend on Linux, the crash handler will then create a
+ * copy of the crashed process, and capture the crash event from within that
+ * copy, while the crashed process only waits for it to finish, up to a
+ * deadline. This shortens the time that other threads of the crashed process
+ * are blocked, and keeps them from modifying the state being captured.
+ *
+ * This is disabled by default, and has no effect with other backends or
+ * platforms.
+ */
+SENTRY_API void sentry_options_set_offload_crash_handling(
+    sentry_options_t *opts, int val);
+
+/**
+ * Returns true if crash handling is offloaded to a child process.
+ */
+SENTRY_API int sentry_options_get_offload_crash_handling(
+    const sentry_options_t *opts);
+
+/**
+ * Enables or disables capturing the stacks of all threads on crash.
+ *
+ * With the `inproc` backend on Linux, the crash handler will then signal every
+ * thread of the process to capture its stack, and add them to the crash event
+ * as a `threads` interface. This uses a realtime signal (`SIGRTMIN + 5`), and
+ * threads which do not respond within a deadline are reported without a
+ * stack.
+ *
+ * This is disabled by default, and has no effect with other backends or
+ * platforms.
+ */
+SENTRY_API void sentry_options_set_capture_all_threads(
+    sentry_options_t *opts, int val);
+
+/**
+ * Returns true if the stacks of all threads are captured on crash.
+ */
+SENTRY_API int sentry_options_get_capture_all_threads(
+    const sentry_options_t *opts);
+
+/**
+ * Sets the amount of stack memory (in bytes) of the crashed thread that is
+ * captured on crash.
+ *
+ * With the `inproc` backend on x86_64 and aarch64 Linux, the crash handler
+ * will then add the registers of the crashed thread to the stacktrace of the
+ * crash event, and copy this much memory starting at its stack pointer into a
+ * `stack_memory.bin` attachment. Together, they allow unwinding the crashed
+ * thread on the server, which is more accurate than the client-side stack
+ * trace for code without frame pointers. The memory for this is reserved at
+ * startup, and a size of 32 to 64 KiB is usually enough.
+ *
+ * This is disabled (`0`) by default, and has no effect with other backends or
+ * platforms.
+ */
+SENTRY_API void sentry_options_set_stack_capture_size(
+    sentry_options_t *opts, size_t bytes);
+
+/**
+ * Gets the amount of stack memory (in bytes) which is captured on crash.
+ */
+SENTRY_API size_t sentry_options_get_stack_capture_size(
+    const sentry_options_t *opts);
+
+/**
+ * Enables or disables writing a minidump on crash.
+ *
+ * With the `inproc` backend on x86_64 and aarch64 Linux, the crash handler
+ * will then write a minidump with the crashed thread, its registers and stack
+ * memory, the loaded modules and system information, and send it as an
+ * attachment of the crash event. Together with `capture_all_threads`, all the
+ * other threads are included as well. The minidump is written without any
+ * allocations, and does not need the `crashpad` or `breakpad` backends.
+ *
+ * This is disabled by default, and has no effect with other backends or
+ * platforms.
+ */
+SENTRY_API void sentry_options_set_capture_minidump(
+    sentry_options_t *opts, int val);
+
+/**
+ * Returns true if a minidump is written on crash.
+ */
+SENTRY_API int sentry_options_get_capture_minidump(
+    const sentry_options_t *opts);
+
+/**
+ * Enables or disables sending only the referenced images.
+ *
+ * By default, the `debug_meta` of every event contains all the loaded
+ * modules. With this enabled, events with stacktraces only contain the
+ * modules that any of their frames are in, plus the modules added via
+ * `sentry_options_add_debug_image`. Events without any stacktraces, like
+ * crash events of the `inproc` backend that are prepared ahead of time, still
+ * contain all the modules.
+ *
+ * This is disabled by default.
+ */
+SENTRY_API void sentry_options_set_referenced_images_only(
+    sentry_options_t *opts, int val);
+
+/**
+ * Returns true if only the referenced images are sent.
+ */
+SENTRY_API int sentry_options_get_referenced_images_only(
+    const sentry_options_t *opts);
+
+/**
+ * Adds a module that is always sent in `debug_meta`, even when it is not
+ * referenced by any frame and `referenced_images_only` is enabled.
+ *
+ * `name` is compared to the file name of the modules, for example
+ * `libfoo.so`, without any directories.
+ */
+SENTRY_API void sentry_options_add_debug_image(
+    sentry_options_t *opts, const char *name);
+
+/**
+ * Enables or disables prefetching the list of modules.
+ *
+ * With this enabled, `sentry_init` starts a background thread which reads the
+ * list of loaded modules, including their debug ids, right away. The result is
+ * cached, so neither the first event nor a crash need to read any module
+ * files. On Linux, the modules are inspected in parallel.
+ *
+ * This is disabled by default.
+ */
+SENTRY_API void sentry_options_set_prefetch_modules(
+    sentry_options_t *opts, int val);
+
+/**
+ * Returns true if the list of modules is prefetched on a background thread.
+ */
+SENTRY_API int sentry_options_get_prefetch_modules(
+    const sentry_options_t *opts);
+
+/**
+ * Enables or disables the log-structured database.
+ *
+ * By default, every envelope that is written to the database, for example
+ * because it could not be sent before shutdown, is a file of its own. With
+ * this enabled, all the envelopes and sessions of a run are appended as
+ * checksummed records to a single log file in the run directory instead,
+ * which avoids creating and deleting a file per envelope. Previous runs are
+ * then processed with a single sequential read of their log.
+ *
+ * This is disabled by default.
+ */
+SENTRY_API void sentry_options_set_database_log(
+    sentry_options_t *opts, int val);
+
+/**
+ * Returns true if the log-structured database is used.
+ */
+SENTRY_API int sentry_options_get_database_log(const sentry_options_t *opts);
+
+/**
+ * Sets the maximum size in bytes of the envelopes stored in the database, for
+ * example when they could not be sent before shutdown, or when crashing.
+ *
+ * The limit covers the whole database. The envelopes and minidumps that
+ * previous runs left behind are counted at startup, and are evicted like the
+ * ones of the current run until they are sent.
+ *
+ * Once the limit is exceeded, the lowest-priority envelopes are evicted, and
+ * the oldest first among those. Envelopes with crash events and minidumps have
+ * the highest priority, followed by the ones with other events, and then
+ * everything else, like sessions or transactions. The envelopes of previous
+ * runs are not inspected, and are treated as if they had an event.
+ *
+ * This is unlimited (0) by default.
+ */
+SENTRY_API void sentry_options_set_max_database_size(
+    sentry_options_t *opts, size_t max_bytes);
+
+/**
+ * Gets the maximum size in bytes of the envelopes stored in the database.
+ */
+SENTRY_API size_t sentry_options_get_max_database_size(
+    const sentry_options_t *opts);
+
+/**
+ * Sets the maximum number of envelopes stored in the database. The envelopes
+ * are counted and evicted like with `sentry_options_set_max_database_size`.
+ *
+ * This is unlimited (0) by default.
+ */
+SENTRY_API void sentry_options_set_max_database_items(
+    sentry_options_t *opts, size_t max_items);
+
+/**
+ * Gets the maximum number of envelopes stored in the database.
+ */
+SENTRY_API size_t sentry_options_get_max_database_items(
+    const sentry_options_t *opts);
+
+/**
+ * Sets the maximum age in milliseconds of the envelopes in the database.
+ * Older envelopes are evicted, and envelopes of previous runs that are older
+ * are dropped instead of being sent.
+ *
+ * This is unlimited (0) by default.
+ */
+SENTRY_API void sentry_options_set_max_database_age(
+    sentry_options_t *opts, uint64_t max_age_ms);
+
+/**
+ * Gets the maximum age in milliseconds of the envelopes in the database.
+ */
+SENTRY_API uint64_t sentry_options_get_max_database_age(
+    const sentry_options_t *opts);
+
+/**
+ * The durability policy of the files in the database.
+ */
+typedef enum {
+    // files are replaced atomically, but never synced to disk
+    SENTRY_DURABILITY_NONE = 0,
+    // only the files written when crashing are synced to disk
+    SENTRY_DURABILITY_CRASH = 1,
+    // every file is synced to disk when it is written
+    SENTRY_DURABILITY_ALWAYS = 2,
+} sentry_durability_t;
+
+/**
+ * Sets the durability policy of the files in the database.
+ *
+ * Files are always written to a temporary file first, which then replaces
+ * the previous version, so a crash while writing never leaves a partially
+ * written file behind. To also survive a power loss, the file contents have
+ * to be synced to disk before they replace the previous version, which is
+ * costly. With `SENTRY_DURABILITY_CRASH`, this only happens for the files
+ * written when crashing, while `SENTRY_DURABILITY_ALWAYS` syncs every file.
+ * The directories of the database are synced in a single batch when crashing
+ * and on shutdown.
+ *
+ * This is `SENTRY_DURABILITY_CRASH` by default.
+ */
+SENTRY_API void sentry_options_set_durability(
+    sentry_options_t *opts, sentry_durability_t durability);
+
+/**
+ * Gets the durability policy of the files in the database.
+ */
+SENTRY_API sentry_durability_t sentry_options_get_durability(
+    const sentry_options_t *opts);
+
 /**
  * Adds a new attachment to be sent along.
  *
@@ -960,6 +1273,9 @@ SENTRY_EXPERIMENTAL_API sentry_value_t sentry_get_modules_list(void);
  * libraries at runtime. It is therefore recommended to call
  * `sentry_clear_modulecache` when doing so, to make sure that the next call to
  * `sentry_capture_event` will have an up-to-date module list.
+ *
+ * On Linux, loading or unloading libraries is detected automatically, and only
+ * the newly loaded libraries are inspected when the list is refreshed.
  */
 SENTRY_EXPERIMENTAL_API void sentry_clear_modulecache(void);
 
@@ -1080,6 +1396,29 @@ SENTRY_API void sentry_remove_transaction(void);
  */
 SENTRY_API void sentry_set_level(sentry_level_t level);
 
+/**
+ * Pushes a new local scope for the current thread.
+ *
+ * Until it is popped again, all the scope modifications of the current thread,
+ * such as `sentry_set_tag`, `sentry_set_user` or `sentry_add_breadcrumb` only
+ * apply to this local scope, and to events captured on the current thread.
+ * The local scope is layered over the global scope, and starts out with all the
+ * data of the previously pushed local scope.
+ *
+ * Removing data on a local scope only affects data that was set on a local
+ * scope, and not data of the global scope.
+ *
+ * Every call to `sentry_push_scope` must be matched by a call to
+ * `sentry_pop_scope` on the same thread.
+ */
+SENTRY_EXPERIMENTAL_API void sentry_push_scope(void);
+
+/**
+ * Pops the innermost local scope of the current thread, discarding all the
+ * data that was set on it.
+ */
+SENTRY_EXPERIMENTAL_API void sentry_pop_scope(void);
+
 /**
  * Starts a new session.
  */
@@ -1090,6 +1429,35 @@ SENTRY_API void sentry_start_session(void);
  */
 SENTRY_API void sentry_end_session(void);
 
+/**
+ * The final status of a request-mode session.
+ */
+typedef enum {
+    SENTRY_REQUEST_SESSION_EXITED,
+    SENTRY_REQUEST_SESSION_ERRORED,
+    SENTRY_REQUEST_SESSION_CRASHED,
+    SENTRY_REQUEST_SESSION_ABNORMAL,
+} sentry_request_session_status_t;
+
+/**
+ * Records a finished request-mode session, such as one handled server request.
+ *
+ * As opposed to `sentry_start_session`, request-mode sessions are not
+ * persisted individually, but are rather counted in memory, per minute and
+ * `distinct_id`, which may be `NULL`. The aggregated counts are sent
+ * periodically in a single envelope item, see
+ * `sentry_options_set_request_session_flush_interval`.
+ *
+ * At most 1000 aggregates are kept between two flushes. Beyond that, new
+ * `distinct_id`s are counted as `NULL`, and sessions that fit none of the
+ * existing aggregates are dropped.
+ *
+ * Server applications will typically want to disable automatic session
+ * tracking when using request-mode sessions.
+ */
+SENTRY_EXPERIMENTAL_API void sentry_record_request_session(
+    sentry_request_session_status_t status, const char *distinct_id);
+
 #ifdef __cplusplus
 }
 #endif
@@ -8,6 +8,7 @@ extern "C" {
 #include "sentry_envelope.h"
 #include "sentry_options.h"
 #include "sentry_path.h"
+#include "sentry_scope.h"
 #include "sentry_string.h"
 #include "sentry_sync.h"
 #include "sentry_transport.h"
@@ -103,6 +104,8 @@ sentry__breakpad_backend_callback(
         sentry_session_t *session = sentry__end_current_session_with_status(
             SENTRY_SESSION_STATUS_CRASHED);
         sentry__envelope_add_session(envelope, session);
+        // scope flushes are deferred, so persist the ended session right away
+        sentry__scope_flush();
 
         // the minidump is added as an attachment, with type `event.minidump`
         sentry_envelope_item_t *item
@@ -136,6 +139,8 @@ sentry__breakpad_backend_callback(
         // data of the previous transports
         sentry__transport_dump_queue(options->transport, options->run);
         // and restore the old transport
+
+        sentry__database_sync(options);
     }
     SENTRY_DEBUG("crash has been captured");
 
@@ -185,6 +190,10 @@ sentry__breakpad_backend_startup(
 {
     sentry_path_t *current_run_folder = options->run->run_path;
 
+#ifndef SENTRY_PLATFORM_WINDOWS
+    sentry__page_allocator_reserve(options->crash_memory_reserve);
+#endif
+
 #ifdef SENTRY_PLATFORM_WINDOWS
     backend->data = new google_breakpad::ExceptionHandler(
         current_run_folder->path, NULL, sentry__breakpad_backend_callback, NULL,
@@ -8,6 +8,7 @@ extern "C" {
 #include "sentry_envelope.h"
 #include "sentry_options.h"
 #include "sentry_path.h"
+#include "sentry_scope.h"
 #include "sentry_sync.h"
 #include "sentry_transport.h"
 #include "sentry_unix_pageallocator.h"
@@ -46,11 +47,19 @@ extern "C" {
 static stack_t g_signal_stack;
 #endif
 
+// Most breadcrumbs fit into this, larger ones will grow the buffer.
+#define BREADCRUMB_BUFFER_SIZE 4096
+
 typedef struct {
     crashpad::CrashReportDatabase *db;
     sentry_path_t *event_path;
     sentry_path_t *breadcrumb1_path;
     sentry_path_t *breadcrumb2_path;
+    sentry_filewriter_t *breadcrumb1_writer;
+    sentry_filewriter_t *breadcrumb2_writer;
+    char *breadcrumb_buf;
+    size_t breadcrumb_buf_len;
+    sentry_mutex_t breadcrumb_lock;
     size_t num_breadcrumbs;
 } crashpad_state_t;
 
@@ -117,6 +126,9 @@ sentry__crashpad_handler(int UNUSED(signum), siginfo_t *UNUSED(info),
         sentry__record_errors_on_current_session(1);
         sentry_session_t *session = sentry__end_current_session_with_status(
             SENTRY_SESSION_STATUS_CRASHED);
+        // scope flushes are deferred, so make sure crashpad picks up the
+        // latest scope, and the ended session is persisted.
+        sentry__scope_flush();
         if (session) {
             sentry_envelope_t *envelope = sentry__envelope_new();
             sentry__envelope_add_session(envelope, session);
@@ -130,6 +142,7 @@ sentry__crashpad_handler(int UNUSED(signum), siginfo_t *UNUSED(info),
         }
 
         sentry__transport_dump_queue(options->transport, options->run);
+        sentry__database_sync(options);
     }
 
     SENTRY_DEBUG("handing control over to crashpad");
@@ -211,6 +224,14 @@ sentry__crashpad_backend_startup(
     sentry__path_touch(data->breadcrumb1_path);
     sentry__path_touch(data->breadcrumb2_path);
 
+    // the breadcrumb files are kept open, and breadcrumbs are serialized into
+    // a reusable buffer, so adding a breadcrumb is a single `write`.
+    data->breadcrumb1_writer = sentry__path_open_writer(data->breadcrumb1_path);
+    data->breadcrumb2_writer = sentry__path_open_writer(data->breadcrumb2_path);
+    data->breadcrumb_buf = (char *)sentry_malloc(BREADCRUMB_BUFFER_SIZE);
+    data->breadcrumb_buf_len
+        = data->breadcrumb_buf ? BREADCRUMB_BUFFER_SIZE : 0;
+
     attachments.push_back(base::FilePath(data->event_path->path));
     attachments.push_back(base::FilePath(data->breadcrumb1_path->path));
     attachments.push_back(base::FilePath(data->breadcrumb2_path->path));
@@ -246,6 +267,8 @@ sentry__crashpad_backend_startup(
         &sentry__crashpad_handler);
 #endif
 #ifdef SENTRY_PLATFORM_LINUX
+    sentry__page_allocator_reserve(options->crash_memory_reserve);
+
     // Crashpad was recently changed to register its own signal stack, which for
     // whatever reason is not compatible with our own handler. so we override
     // that stack yet again to be able to correctly flush things out.
@@ -289,29 +312,44 @@ sentry__crashpad_backend_add_breadcrumb(
     sentry_backend_t *backend, sentry_value_t breadcrumb)
 {
     crashpad_state_t *data = (crashpad_state_t *)backend->data;
+    sentry__mutex_lock(&data->breadcrumb_lock);
 
     bool first_breadcrumb = data->num_breadcrumbs % SENTRY_BREADCRUMBS_MAX == 0;
 
-    const sentry_path_t *breadcrumb_file
+    sentry_filewriter_t *breadcrumb_writer
         = data->num_breadcrumbs % (SENTRY_BREADCRUMBS_MAX * 2)
             < SENTRY_BREADCRUMBS_MAX
-        ? data->breadcrumb1_path
-        : data->breadcrumb2_path;
+        ? data->breadcrumb1_writer
+        : data->breadcrumb2_writer;
     data->num_breadcrumbs++;
-    if (!breadcrumb_file) {
+    if (!breadcrumb_writer) {
+        sentry__mutex_unlock(&data->breadcrumb_lock);
         return;
     }
 
-    size_t mpack_size;
-    char *mpack = sentry_value_to_msgpack(breadcrumb, &mpack_size);
-    if (!mpack) {
-        return;
+    char *mpack = data->breadcrumb_buf;
+    size_t mpack_size = mpack ? sentry__value_to_msgpack_buffer(
+                            breadcrumb, mpack, data->breadcrumb_buf_len)
+                              : 0;
+    if (!mpack_size) {
+        // the breadcrumb did not fit into the buffer, so serialize it into a
+        // new allocation, which then replaces the too small buffer.
+        mpack = sentry_value_to_msgpack(breadcrumb, &mpack_size);
+        if (!mpack) {
+            sentry__mutex_unlock(&data->breadcrumb_lock);
+            return;
+        }
+        sentry_free(data->breadcrumb_buf);
+        data->breadcrumb_buf = mpack;
+        data->breadcrumb_buf_len = mpack_size;
     }
 
-    int rv = first_breadcrumb
-        ? sentry__path_write_buffer(breadcrumb_file, mpack, mpack_size)
-        : sentry__path_append_buffer(breadcrumb_file, mpack, mpack_size);
-    sentry_free(mpack);
+    int rv = first_breadcrumb ? sentry__filewriter_truncate(breadcrumb_writer)
+                              : 0;
+    if (rv == 0) {
+        rv = sentry__filewriter_write(breadcrumb_writer, mpack, mpack_size);
+    }
+    sentry__mutex_unlock(&data->breadcrumb_lock);
 
     if (rv != 0) {
         SENTRY_DEBUG("flushing breadcrumb to msgpack failed");
@@ -325,6 +363,10 @@ sentry__crashpad_backend_free(sentry_backend_t *backend)
     sentry__path_free(data->event_path);
     sentry__path_free(data->breadcrumb1_path);
     sentry__path_free(data->breadcrumb2_path);
+    sentry__filewriter_free(data->breadcrumb1_writer);
+    sentry__filewriter_free(data->breadcrumb2_writer);
+    sentry_free(data->breadcrumb_buf);
+    sentry__mutex_free(&data->breadcrumb_lock);
     sentry_free(data);
 }
 
@@ -398,6 +440,7 @@ sentry__backend_new(void)
         return NULL;
     }
     memset(data, 0, sizeof(crashpad_state_t));
+    sentry__mutex_init(&data->breadcrumb_lock);
 
     backend->startup_func = sentry__crashpad_backend_startup;
     backend->shutdown_func = sentry__crashpad_backend_shutdown;
@@ -410,6 +453,10 @@ sentry__backend_new(void)
     backend->get_last_crash_func = sentry__crashpad_backend_last_crash;
     backend->data = data;
     backend->can_capture_after_shutdown = true;
+#if !defined(SENTRY_PLATFORM_LINUX) && !defined(SENTRY_PLATFORM_WINDOWS)
+    // there is no first-chance handler, see `sentry__crashpad_handler`
+    backend->needs_synchronous_scope_flush = true;
+#endif
 
     return backend;
 }
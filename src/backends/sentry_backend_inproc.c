@@ -5,14 +5,34 @@
 #include "sentry_core.h"
 #include "sentry_database.h"
 #include "sentry_envelope.h"
+#include "sentry_json.h"
 #include "sentry_options.h"
+#include "sentry_path.h"
+#include "sentry_random.h"
 #include "sentry_scope.h"
 #include "sentry_sync.h"
 #include "sentry_transport.h"
 #include "sentry_unix_pageallocator.h"
+#include "sentry_utils.h"
 #include "transports/sentry_disk_transport.h"
 #include <string.h>
 
+#ifdef SENTRY_PLATFORM_UNIX
+#    include <errno.h>
+#    include <fcntl.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+#ifdef SENTRY_PLATFORM_LINUX
+#    include <sched.h>
+#    include <sys/syscall.h>
+#    include <sys/wait.h>
+#    include <time.h>
+
+#    include "sentry_minidump_linux.h"
+#    include "unwinder/sentry_unwinder_memory.h"
+#endif
+
 #define SIGNAL_DEF(Sig, Desc)                                                  \
     {                                                                          \
         Sig, #Sig, Desc                                                        \
@@ -34,6 +54,12 @@ static struct sigaction g_sigaction;
 static struct sigaction g_previous_handlers[SIGNAL_COUNT];
 static stack_t g_signal_stack;
 
+#    ifdef SENTRY_PLATFORM_LINUX
+// the crash handling process is killed after this many milliseconds
+#        define CRASH_CHILD_TIMEOUT 10000
+static bool g_offload_crash_handling = false;
+#    endif
+
 static const struct signal_slot SIGNAL_DEFINITIONS[SIGNAL_COUNT] = {
     SIGNAL_DEF(SIGILL, "IllegalInstruction"),
     SIGNAL_DEF(SIGTRAP, "Trap"),
@@ -44,6 +70,241 @@ static const struct signal_slot SIGNAL_DEFINITIONS[SIGNAL_COUNT] = {
 };
 
 static void handle_signal(int signum, siginfo_t *info, void *user_context);
+static size_t unwind_thread(const sentry_ucontext_t *uctx, void **backtrace);
+
+/**
+ * The preallocated crash path:
+ *
+ * Building the crash event with the `sentry_value_t` machinery from inside the
+ * signal handler allocates, reads `/proc/self/maps` and serializes the whole
+ * scope, which is slow, and can fail for large scopes. Instead, the backend
+ * keeps a serialized skeleton of the crash event, which is updated on every
+ * scope flush, and serializes every breadcrumb when it is added. The module
+ * list is serialized separately, only when it changes, and spliced in after
+ * the skeleton. Together with the envelope file and all the buffers, which are
+ * set up at startup, the signal handler only formats the exception, and writes
+ * out all the prepared pieces. It never calls into the scope, so crashes with
+ * modifications which are still waiting for the background flush, or on a
+ * thread with local scopes, build the event from scratch instead.
+ *
+ * Published buffers are swapped atomically, and once the handler has set
+ * `g_crashing`, replaced buffers are not freed anymore, as the handler might
+ * still read them. This relies on the ordering of both sides: writers unpublish
+ * a buffer before checking `g_crashing`, and the handler sets `g_crashing`
+ * before loading any published buffer, including the minidump modules.
+ *
+ * This path is not used with a `before_send` hook or on-device symbolication,
+ * which both need the full event.
+ */
+#    define CRASH_BUFFER_SIZE 4096
+// room for the mechanism and registers, and up to 64 bytes per formatted frame
+#    define EXCEPTION_BUFFER_SIZE (4096 + MAX_FRAMES * 64)
+
+typedef struct {
+    sentry_path_t *path;
+    char *header;
+} crash_attachment_t;
+
+typedef struct {
+    bool enabled;
+    bool sampled_out;
+    bool durable;
+    int fd;
+    sentry_path_t *tmp_path;
+    sentry_path_t *envelope_path;
+    sentry_path_t *marker_path;
+    char *envelope_header;
+    char event_id[37];
+    crash_attachment_t *attachments;
+    size_t attachment_count;
+    char *volatile skeleton;
+    sentry_value_t module_list;
+    char *volatile debug_meta;
+    char *volatile *breadcrumbs;
+    char **breadcrumbs_snapshot;
+    size_t max_breadcrumbs;
+    volatile long breadcrumb_count;
+} crash_state_t;
+
+typedef struct {
+    int fd;
+    size_t len;
+    bool failed;
+    char buf[CRASH_BUFFER_SIZE];
+} crash_writer_t;
+
+static crash_state_t g_crash = { 0 };
+static volatile long g_crashing = 0;
+static crash_writer_t g_crash_writer;
+static char g_exception_buf[EXCEPTION_BUFFER_SIZE];
+static void *g_backtrace[MAX_FRAMES];
+
+/**
+ * Frees a buffer which was replaced by a newer one, unless the crash handler
+ * might still be reading it. The buffer must already be unpublished.
+ */
+static void
+retire_buffer(void *buf)
+{
+    if (!sentry__atomic_fetch(&g_crashing)) {
+        sentry_free(buf);
+    }
+}
+
+static size_t
+copy_str(char *dst, const char *src)
+{
+    size_t len = strlen(src);
+    memcpy(dst, src, len);
+    return len;
+}
+
+static size_t
+format_u64(char *buf, uint64_t value)
+{
+    char digits[20];
+    size_t len = 0;
+    do {
+        digits[len++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = digits[len - i - 1];
+    }
+    return len;
+}
+
+static size_t
+format_padded(char *buf, uint64_t value, size_t width)
+{
+    for (size_t i = width; i > 0; i--) {
+        buf[i - 1] = (char)('0' + value % 10);
+        value /= 10;
+    }
+    return width;
+}
+
+static size_t
+format_hex(char *buf, uint64_t value)
+{
+    static const char hex[] = "0123456789abcdef";
+    char digits[16];
+    size_t len = 0;
+    do {
+        digits[len++] = hex[value & 0xf];
+        value >>= 4;
+    } while (value);
+    buf[0] = '0';
+    buf[1] = 'x';
+    for (size_t i = 0; i < len; i++) {
+        buf[i + 2] = digits[len - i - 1];
+    }
+    return len + 2;
+}
+
+/**
+ * Formats `msec` as `YYYY-MM-DDTHH:MM:SS.mmmZ`, without `gmtime`, which is
+ * not async-signal-safe.
+ */
+static size_t
+format_iso8601(char *buf, uint64_t msec)
+{
+    uint64_t secs = msec / 1000;
+    uint64_t rem = secs % 86400;
+
+    // https://howardhinnant.github.io/date_algorithms.html#civil_from_days
+    uint64_t days = secs / 86400 + 719468;
+    uint64_t era = days / 146097;
+    uint64_t doe = days - era * 146097;
+    uint64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    uint64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    uint64_t mp = (5 * doy + 2) / 153;
+    uint64_t day = doy - (153 * mp + 2) / 5 + 1;
+    uint64_t month = mp < 10 ? mp + 3 : mp - 9;
+    uint64_t year = yoe + era * 400 + (month <= 2);
+
+    char *p = buf;
+    p += format_padded(p, year, 4);
+    *p++ = '-';
+    p += format_padded(p, month, 2);
+    *p++ = '-';
+    p += format_padded(p, day, 2);
+    *p++ = 'T';
+    p += format_padded(p, rem / 3600, 2);
+    *p++ = ':';
+    p += format_padded(p, rem / 60 % 60, 2);
+    *p++ = ':';
+    p += format_padded(p, rem % 60, 2);
+    *p++ = '.';
+    p += format_padded(p, msec % 1000, 3);
+    *p++ = 'Z';
+    return (size_t)(p - buf);
+}
+
+static size_t
+format_frames(char *buf, void **frames, size_t frame_count)
+{
+    char *p = buf;
+    p += copy_str(p, "{\"frames\":[");
+    for (size_t i = 0; i < frame_count; i++) {
+        if (i) {
+            *p++ = ',';
+        }
+        p += copy_str(p, "{\"instruction_addr\":\"");
+        p += format_hex(p, (uint64_t)(size_t)frames[frame_count - i - 1]);
+        p += copy_str(p, "\"}");
+    }
+    p += copy_str(p, "]}");
+    return (size_t)(p - buf);
+}
+
+static void
+crash_writer_flush(crash_writer_t *writer)
+{
+    const char *buf = writer->buf;
+    size_t len = writer->len;
+    while (len > 0 && !writer->failed) {
+        ssize_t n = write(writer->fd, buf, len);
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+            continue;
+        } else if (n <= 0) {
+            writer->failed = true;
+            break;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    writer->len = 0;
+}
+
+static void
+crash_writer_write(crash_writer_t *writer, const char *buf, size_t len)
+{
+    while (len > 0) {
+        if (writer->len == CRASH_BUFFER_SIZE) {
+            crash_writer_flush(writer);
+        }
+        size_t n = CRASH_BUFFER_SIZE - writer->len;
+        n = n < len ? n : len;
+        memcpy(writer->buf + writer->len, buf, n);
+        writer->len += n;
+        buf += n;
+        len -= n;
+    }
+}
+
+static void
+crash_writer_write_str(crash_writer_t *writer, const char *str)
+{
+    crash_writer_write(writer, str, strlen(str));
+}
+
+static void
+crash_writer_write_u64(crash_writer_t *writer, uint64_t value)
+{
+    char buf[20];
+    crash_writer_write(writer, buf, format_u64(buf, value));
+}
 
 static void
 reset_signal_handlers(void)
@@ -72,9 +333,953 @@ invoke_signal_handler(int signum, siginfo_t *info, void *user_context)
     }
 }
 
+static char *
+json_without_closing_brace(sentry_value_t value)
+{
+    char *json = sentry_value_to_json(value);
+    if (json) {
+        // the closing brace is written by the crash handler
+        json[strlen(json) - 1] = '\0';
+    }
+    return json;
+}
+
+static void
+startup_prepared_crash(const sentry_options_t *options)
+{
+    memset(&g_crash, 0, sizeof(g_crash));
+    g_crash.fd = -1;
+    g_crash.module_list = sentry_value_new_null();
+    g_crash.durable = options->durability != SENTRY_DURABILITY_NONE;
+    g_crash.marker_path
+        = sentry__path_join_str(options->database_path, "last_crash");
+    if (options->before_send_func || options->symbolize_stacktraces) {
+        return;
+    }
+
+    // sampling is decided up-front, there is only a single crash anyway
+    uint64_t rnd;
+    g_crash.sampled_out = options->sample_rate < 1.0
+        && !sentry__getrandom(&rnd, sizeof(rnd))
+        && ((double)rnd / (double)UINT64_MAX) > options->sample_rate;
+
+    sentry_uuid_t event_id = sentry__new_event_id();
+    sentry_uuid_as_string(&event_id, g_crash.event_id);
+
+    sentry_value_t header = sentry_value_new_object();
+    if (options->dsn && options->dsn->is_valid) {
+        sentry_value_set_by_key(header, "dsn",
+            sentry_value_new_string(sentry_options_get_dsn(options)));
+    }
+    sentry_value_set_by_key(
+        header, "event_id", sentry_value_new_string(g_crash.event_id));
+    g_crash.envelope_header = sentry_value_to_json(header);
+    sentry_value_decref(header);
+
+    char filename[64];
+    snprintf(filename, sizeof(filename), "%s.envelope", g_crash.event_id);
+    g_crash.envelope_path
+        = sentry__path_join_str(options->run->run_path, filename);
+    // the envelope is only renamed to its final name once it is complete
+    g_crash.tmp_path = sentry__path_append_str(g_crash.envelope_path, ".tmp");
+    if (!g_crash.envelope_header || !g_crash.tmp_path || !g_crash.marker_path) {
+        return;
+    }
+
+    for (sentry_attachment_t *attachment = options->attachments; attachment;
+         attachment = attachment->next) {
+        g_crash.attachment_count++;
+    }
+    if (g_crash.attachment_count) {
+        g_crash.attachments = sentry_malloc(
+            sizeof(crash_attachment_t) * g_crash.attachment_count);
+        if (!g_crash.attachments) {
+            return;
+        }
+        size_t i = 0;
+        for (sentry_attachment_t *attachment = options->attachments;
+             attachment; attachment = attachment->next, i++) {
+            sentry_value_t item_header = sentry_value_new_object();
+            sentry_value_set_by_key(
+                item_header, "type", sentry_value_new_string("attachment"));
+            sentry_value_set_by_key(item_header, "filename",
+                sentry_value_new_string(
+                    sentry__path_filename(attachment->path)));
+            g_crash.attachments[i].path = attachment->path;
+            g_crash.attachments[i].header
+                = json_without_closing_brace(item_header);
+            sentry_value_decref(item_header);
+        }
+    }
+
+    g_crash.max_breadcrumbs = options->max_breadcrumbs;
+    if (g_crash.max_breadcrumbs) {
+        size_t size = sizeof(char *) * g_crash.max_breadcrumbs;
+        g_crash.breadcrumbs = sentry_malloc(size);
+        g_crash.breadcrumbs_snapshot = sentry_malloc(size);
+        if (!g_crash.breadcrumbs || !g_crash.breadcrumbs_snapshot) {
+            return;
+        }
+        memset((void *)g_crash.breadcrumbs, 0, size);
+    }
+
+    g_crash.enabled = true;
+}
+
+static void
+shutdown_prepared_crash(void)
+{
+    g_crash.enabled = false;
+    if (g_crash.fd >= 0) {
+        close(g_crash.fd);
+    }
+    sentry__path_free(g_crash.tmp_path);
+    sentry__path_free(g_crash.envelope_path);
+    sentry__path_free(g_crash.marker_path);
+    sentry_free(g_crash.envelope_header);
+    for (size_t i = 0; g_crash.attachments && i < g_crash.attachment_count;
+         i++) {
+        sentry_free(g_crash.attachments[i].header);
+    }
+    sentry_free(g_crash.attachments);
+    for (size_t i = 0; g_crash.breadcrumbs && i < g_crash.max_breadcrumbs;
+         i++) {
+        sentry_free(g_crash.breadcrumbs[i]);
+    }
+    sentry_free((void *)g_crash.breadcrumbs);
+    sentry_free(g_crash.breadcrumbs_snapshot);
+    sentry_free(g_crash.skeleton);
+    sentry_free(g_crash.debug_meta);
+    sentry_value_decref(g_crash.module_list);
+    memset(&g_crash, 0, sizeof(g_crash));
+    g_crash.fd = -1;
+    g_crash.module_list = sentry_value_new_null();
+}
+
+/**
+ * Serializes the `debug_meta` of the crash event as `,"debug_meta":{...}`,
+ * which is written right after the skeleton.
+ */
+static void
+refresh_debug_meta(sentry_value_t module_list)
+{
+    // the module list is cached, so this only needs to be redone after the
+    // cache was cleared
+    if (module_list._bits == g_crash.module_list._bits) {
+        return;
+    }
+    char *debug_meta = NULL;
+    if (!sentry_value_is_null(module_list)) {
+        sentry_value_t images = sentry_value_new_object();
+        sentry_value_incref(module_list);
+        sentry_value_set_by_key(images, "images", module_list);
+        sentry_value_t wrapper = sentry_value_new_object();
+        sentry_value_set_by_key(wrapper, "debug_meta", images);
+        debug_meta = sentry_value_to_json(wrapper);
+        sentry_value_decref(wrapper);
+        if (!debug_meta) {
+            return;
+        }
+        // turn the surrounding braces into the separating comma
+        debug_meta[0] = ',';
+        debug_meta[strlen(debug_meta) - 1] = '\0';
+    }
+    sentry_value_incref(module_list);
+    sentry_value_decref(g_crash.module_list);
+    g_crash.module_list = module_list;
+    retire_buffer(sentry__atomic_exchange_ptr(
+        (void *volatile *)&g_crash.debug_meta, debug_meta));
+}
+
+#ifdef SENTRY_PLATFORM_LINUX
+static void refresh_minidump_modules(sentry_value_t module_list);
+#endif
+
+static sentry_mutex_t g_modules_lock = SENTRY__MUTEX_INIT;
+
+static void
+flush_scope_inproc_backend(sentry_backend_t *UNUSED(backend))
+{
+    sentry__mutex_lock(&g_modules_lock);
+    sentry_value_t module_list = sentry_get_modules_list();
+#ifdef SENTRY_PLATFORM_LINUX
+    refresh_minidump_modules(module_list);
+#endif
+    if (g_crash.enabled) {
+        refresh_debug_meta(module_list);
+    }
+    sentry_value_decref(module_list);
+    sentry__mutex_unlock(&g_modules_lock);
+    if (!g_crash.enabled) {
+        return;
+    }
+
+    // the skeleton has everything except for the breadcrumbs, the modules, and
+    // the crash specific `event_id`, `timestamp`, `level` and `exception`.
+    sentry_value_t event = sentry_value_new_object();
+    SENTRY_WITH_SCOPE (scope) {
+        sentry__scope_apply_to_event(scope, event, SENTRY_SCOPE_NONE);
+    }
+    sentry_value_remove_by_key(event, "level");
+    char *skeleton = json_without_closing_brace(event);
+    sentry_value_decref(event);
+    if (!skeleton) {
+        return;
+    }
+    retire_buffer(sentry__atomic_exchange_ptr(
+        (void *volatile *)&g_crash.skeleton, skeleton));
+}
+
+static void
+add_breadcrumb_inproc_backend(
+    sentry_backend_t *UNUSED(backend), sentry_value_t breadcrumb)
+{
+    if (!g_crash.enabled || !g_crash.max_breadcrumbs) {
+        return;
+    }
+    char *json = sentry_value_to_json(breadcrumb);
+    if (!json) {
+        return;
+    }
+    size_t idx
+        = (size_t)sentry__atomic_fetch_and_add(&g_crash.breadcrumb_count, 1)
+        % g_crash.max_breadcrumbs;
+    retire_buffer(sentry__atomic_exchange_ptr(
+        (void *volatile *)&g_crash.breadcrumbs[idx], json));
+}
+
+static uint64_t
+get_last_crash_inproc_backend(sentry_backend_t *UNUSED(backend))
+{
+    // the preallocated crash path does not end the session, so sessions
+    // that were still open at the time of the crash are marked as crashed
+    // based on the crash marker.
+    uint64_t last_crash = 0;
+    char *iso_time = g_crash.marker_path
+        ? sentry__path_read_to_buffer(g_crash.marker_path, NULL)
+        : NULL;
+    if (iso_time) {
+        last_crash = sentry__iso8601_to_msec(iso_time);
+        sentry_free(iso_time);
+    }
+    return last_crash;
+}
+
+#ifdef SENTRY_PLATFORM_LINUX
+/**
+ * All-thread capture:
+ *
+ * The crash handler enumerates `/proc/self/task`, and sends every other thread
+ * a dedicated realtime signal. The handler of that signal unwinds the thread
+ * from its own ucontext into a snapshot that was allocated at startup. Threads
+ * are captured one after the other, all within a global deadline, and threads
+ * which do not respond in time are reported without a stack.
+ */
+#    define MAX_THREADS 64
+// all the threads need to be captured within this many milliseconds
+#    define THREADS_TIMEOUT 1000
+#    define THREAD_SNAPSHOT_SIGNAL (SIGRTMIN + 5)
+// room for the thread attributes, and up to 64 bytes per formatted frame
+#    define THREAD_JSON_SIZE (256 + MAX_FRAMES * 64)
+
+typedef struct {
+    pid_t tid;
+    char name[16];
+    size_t frame_count;
+    void *frames[MAX_FRAMES];
+    bool has_context;
+    uint64_t stack_pointer;
+    char context[SENTRY_MINIDUMP_CONTEXT_SIZE];
+} thread_snapshot_t;
+
+typedef struct {
+    bool enabled;
+    bool with_contexts;
+    pid_t crashed_tid;
+    thread_snapshot_t *threads;
+    size_t thread_count;
+    char *json;
+    struct sigaction previous_handler;
+} thread_capture_t;
+
+struct thread_dirent {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+static thread_capture_t g_threads = { 0 };
+static thread_snapshot_t *volatile g_snapshot_request = NULL;
+static volatile long g_snapshot_done = 0;
+
+static void
+handle_snapshot_signal(int signum, siginfo_t *info, void *user_context)
+{
+    // only answer requests of our own crash handler
+    if (info->si_code != SI_TKILL || info->si_pid != getpid()) {
+        return;
+    }
+    thread_snapshot_t *snapshot = sentry__atomic_exchange_ptr(
+        (void *volatile *)&g_snapshot_request, NULL);
+    if (!snapshot) {
+        return;
+    }
+    int saved_errno = errno;
+    sentry_ucontext_t uctx;
+    uctx.signum = signum;
+    uctx.siginfo = info;
+    uctx.user_context = (ucontext_t *)user_context;
+    snapshot->frame_count = unwind_thread(&uctx, snapshot->frames);
+    if (g_threads.with_contexts) {
+        // the registers are needed for the minidump
+        snapshot->stack_pointer = sentry__minidump_fill_context(
+            snapshot->context, uctx.user_context);
+        snapshot->has_context = true;
+    }
+    sentry__atomic_store(&g_snapshot_done, 1);
+    errno = saved_errno;
+}
+
+static void
+startup_thread_capture(const sentry_options_t *options)
+{
+    memset(&g_threads, 0, sizeof(g_threads));
+    if (!options->capture_all_threads) {
+        return;
+    }
+    g_threads.with_contexts
+        = options->capture_minidump && SENTRY_MINIDUMP_SUPPORTED;
+    g_threads.threads = sentry_malloc(sizeof(thread_snapshot_t) * MAX_THREADS);
+    g_threads.json = sentry_malloc(THREAD_JSON_SIZE * MAX_THREADS);
+    if (!g_threads.threads || !g_threads.json) {
+        return;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sigemptyset(&sa.sa_mask);
+    sa.sa_sigaction = handle_snapshot_signal;
+    sa.sa_flags = SA_SIGINFO | SA_RESTART;
+    g_threads.enabled
+        = sigaction(THREAD_SNAPSHOT_SIGNAL, &sa, &g_threads.previous_handler)
+        == 0;
+}
+
+static void
+shutdown_thread_capture(void)
+{
+    if (g_threads.enabled) {
+        sigaction(THREAD_SNAPSHOT_SIGNAL, &g_threads.previous_handler, NULL);
+    }
+    sentry_free(g_threads.threads);
+    sentry_free(g_threads.json);
+    memset(&g_threads, 0, sizeof(g_threads));
+}
+
+static void
+read_thread_name(pid_t tid, char *name)
+{
+    char path[64];
+    char *p = path;
+    p += copy_str(p, "/proc/self/task/");
+    p += format_u64(p, (uint64_t)tid);
+    p += copy_str(p, "/comm");
+    *p = '\0';
+
+    name[0] = '\0';
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    ssize_t n = read(fd, name, 15);
+    close(fd);
+    n = n < 0 ? 0 : n;
+    if (n > 0 && name[n - 1] == '\n') {
+        n--;
+    }
+    name[n] = '\0';
+}
+
+/**
+ * Asks the thread of `snapshot` to unwind itself. Returns `false` if the
+ * thread picked up the request, but did not finish in time, so it might still
+ * write to the snapshot.
+ */
+static bool
+snapshot_thread(pid_t pid, thread_snapshot_t *snapshot, uint64_t deadline)
+{
+    sentry__atomic_store(&g_snapshot_done, 0);
+    sentry__atomic_exchange_ptr(
+        (void *volatile *)&g_snapshot_request, snapshot);
+    if (syscall(SYS_tgkill, pid, snapshot->tid, THREAD_SNAPSHOT_SIGNAL) != 0) {
+        // the thread has exited in the meantime
+        sentry__atomic_exchange_ptr(
+            (void *volatile *)&g_snapshot_request, NULL);
+        return true;
+    }
+    while (!sentry__atomic_fetch(&g_snapshot_done)) {
+        if (sentry__monotonic_time() >= deadline) {
+            // the thread might have the signal blocked, in which case it will
+            // find no request once it gets to handle it
+            return sentry__atomic_exchange_ptr(
+                       (void *volatile *)&g_snapshot_request, NULL)
+                != NULL;
+        }
+        sched_yield();
+    }
+    return true;
+}
+
+/**
+ * Captures the stacks of all the threads, except for the crashed one, which is
+ * unwound as part of the exception. This needs to happen in the crashed
+ * process itself, before crash handling is possibly offloaded to a child.
+ */
+static void
+capture_threads(void)
+{
+    g_threads.thread_count = 0;
+    g_threads.crashed_tid = (pid_t)syscall(SYS_gettid);
+    if (!g_threads.enabled) {
+        return;
+    }
+    pid_t pid = getpid();
+    uint64_t deadline = sentry__monotonic_time() + THREADS_TIMEOUT;
+
+    int fd = open("/proc/self/task", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    char dents[1024];
+    long n;
+    while ((n = syscall(SYS_getdents64, fd, dents, sizeof(dents))) > 0) {
+        for (long offset = 0; offset < n;) {
+            struct thread_dirent *dirent
+                = (struct thread_dirent *)(dents + offset);
+            offset += dirent->d_reclen;
+            if (dirent->d_name[0] < '0' || dirent->d_name[0] > '9') {
+                continue;
+            }
+            if (g_threads.thread_count == MAX_THREADS) {
+                goto done;
+            }
+
+            thread_snapshot_t *snapshot
+                = &g_threads.threads[g_threads.thread_count];
+            snapshot->tid = 0;
+            for (const char *c = dirent->d_name; *c >= '0' && *c <= '9'; c++) {
+                snapshot->tid = snapshot->tid * 10 + (*c - '0');
+            }
+            snapshot->frame_count = 0;
+            snapshot->has_context = false;
+            read_thread_name(snapshot->tid, snapshot->name);
+
+            if (snapshot->tid != g_threads.crashed_tid
+                && sentry__monotonic_time() < deadline
+                && !snapshot_thread(pid, snapshot, deadline)) {
+                // the snapshot is still being written to, so stop here
+                goto done;
+            }
+            g_threads.thread_count++;
+        }
+    }
+done:
+    close(fd);
+    SENTRY_TRACEF("captured %zu threads", g_threads.thread_count);
+}
+
+/**
+ * Formats the `threads` interface for the preallocated crash path.
+ */
+static size_t
+format_threads(char *buf)
+{
+    if (!g_threads.thread_count) {
+        return 0;
+    }
+    char *p = buf;
+    p += copy_str(p, ",\"threads\":{\"values\":[");
+    for (size_t i = 0; i < g_threads.thread_count; i++) {
+        const thread_snapshot_t *snapshot = &g_threads.threads[i];
+        bool crashed = snapshot->tid == g_threads.crashed_tid;
+        if (i) {
+            *p++ = ',';
+        }
+        p += copy_str(p, "{\"id\":");
+        p += format_u64(p, (uint64_t)snapshot->tid);
+        p += copy_str(p, ",\"name\":\"");
+        for (const char *c = snapshot->name; *c; c++) {
+            if (*c == '"' || *c == '\\') {
+                *p++ = '\\';
+                *p++ = *c;
+            } else {
+                *p++ = (unsigned char)*c < 0x20 ? '?' : *c;
+            }
+        }
+        p += copy_str(p,
+            crashed ? "\",\"crashed\":true,\"current\":true"
+                    : "\",\"crashed\":false");
+        if (snapshot->frame_count) {
+            p += copy_str(p, ",\"stacktrace\":");
+            p += format_frames(p, (void **)snapshot->frames,
+                snapshot->frame_count);
+        }
+        *p++ = '}';
+    }
+    p += copy_str(p, "]}");
+    return (size_t)(p - buf);
+}
+
+static void
+add_threads_to_event(sentry_value_t event, sentry_value_t exc)
+{
+    if (!g_threads.thread_count) {
+        return;
+    }
+    sentry_value_set_by_key(exc, "thread_id",
+        sentry_value_new_int32((int32_t)g_threads.crashed_tid));
+
+    sentry_value_t values
+        = sentry__value_new_list_with_size(g_threads.thread_count);
+    for (size_t i = 0; i < g_threads.thread_count; i++) {
+        const thread_snapshot_t *snapshot = &g_threads.threads[i];
+        bool crashed = snapshot->tid == g_threads.crashed_tid;
+        sentry_value_t thread = sentry_value_new_object();
+        sentry_value_set_by_key(
+            thread, "id", sentry_value_new_int32((int32_t)snapshot->tid));
+        sentry_value_set_by_key(
+            thread, "name", sentry_value_new_string(snapshot->name));
+        sentry_value_set_by_key(
+            thread, "crashed", sentry_value_new_bool(crashed));
+        if (crashed) {
+            sentry_value_set_by_key(
+                thread, "current", sentry_value_new_bool(true));
+        }
+        if (snapshot->frame_count) {
+            sentry_value_t frames
+                = sentry__value_new_list_with_size(snapshot->frame_count);
+            for (size_t j = 0; j < snapshot->frame_count; j++) {
+                sentry_value_t frame = sentry_value_new_object();
+                sentry_value_set_by_key(frame, "instruction_addr",
+                    sentry__value_new_addr((uint64_t)(size_t)
+                            snapshot->frames[snapshot->frame_count - j - 1]));
+                sentry_value_append(frames, frame);
+            }
+            sentry_value_t stacktrace = sentry_value_new_object();
+            sentry_value_set_by_key(stacktrace, "frames", frames);
+            sentry_value_set_by_key(thread, "stacktrace", stacktrace);
+        }
+        sentry_value_append(values, thread);
+    }
+
+    sentry_value_t threads = sentry_value_new_object();
+    sentry_value_set_by_key(threads, "values", values);
+    sentry_value_set_by_key(event, "threads", threads);
+}
+
+/**
+ * Stack memory capture:
+ *
+ * The crash handler copies the registers of the crashed thread, and a window
+ * of its stack memory starting at the stack pointer, into a buffer that was
+ * allocated at startup. The registers are added to the stacktrace of the
+ * exception, and the memory is sent as a `stack_memory.bin` attachment, so
+ * the crashed thread can be unwound on the server.
+ *
+ * The attachment starts with a `stack_memory_header_t` in native byte order,
+ * followed by `size` bytes of memory, which were read from `start_address`.
+ * The capture stops early at the first unreadable page.
+ */
+#    if defined(__x86_64__) || defined(__aarch64__)
+#        define WITH_STACK_CAPTURE
+#    endif
+#    define MAX_STACK_CAPTURE_SIZE (1024 * 1024)
+#    define STACK_MEMORY_MAGIC "SNTRYSTK"
+#    define STACK_MEMORY_VERSION 1
+
+#    if defined(__x86_64__)
+// leaf functions can use the 128 bytes below the stack pointer
+#        define STACK_RED_ZONE 128
+static const char *const REGISTER_NAMES[] = { "rax", "rbx", "rcx", "rdx",
+    "rsi", "rdi", "rbp", "rsp", "r8", "r9", "r10", "r11", "r12", "r13", "r14",
+    "r15", "rip" };
+static const int REGISTER_INDICES[] = { REG_RAX, REG_RBX, REG_RCX, REG_RDX,
+    REG_RSI, REG_RDI, REG_RBP, REG_RSP, REG_R8, REG_R9, REG_R10, REG_R11,
+    REG_R12, REG_R13, REG_R14, REG_R15, REG_RIP };
+#    elif defined(__aarch64__)
+#        define STACK_RED_ZONE 0
+static const char *const REGISTER_NAMES[] = { "x0", "x1", "x2", "x3", "x4",
+    "x5", "x6", "x7", "x8", "x9", "x10", "x11", "x12", "x13", "x14", "x15",
+    "x16", "x17", "x18", "x19", "x20", "x21", "x22", "x23", "x24", "x25", "x26",
+    "x27", "x28", "fp", "lr", "sp", "pc" };
+#    endif
+
+#    ifdef WITH_STACK_CAPTURE
+#        define REGISTER_COUNT                                                 \
+            (sizeof(REGISTER_NAMES) / sizeof(REGISTER_NAMES[0]))
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t size;
+    uint64_t start_address;
+} stack_memory_header_t;
+
+typedef struct {
+    size_t capacity;
+    char *buf;
+    size_t len;
+    bool has_registers;
+    uint64_t registers[REGISTER_COUNT];
+} stack_capture_t;
+
+static stack_capture_t g_stack = { 0 };
+#    endif
+
+static void
+startup_stack_capture(const sentry_options_t *options)
+{
+#    ifdef WITH_STACK_CAPTURE
+    memset(&g_stack, 0, sizeof(g_stack));
+    if (!options->stack_capture_size) {
+        return;
+    }
+    g_stack.capacity = options->stack_capture_size < MAX_STACK_CAPTURE_SIZE
+        ? options->stack_capture_size
+        : MAX_STACK_CAPTURE_SIZE;
+    g_stack.buf
+        = sentry_malloc(sizeof(stack_memory_header_t) + g_stack.capacity);
+#    else
+    (void)options;
+#    endif
+}
+
+static void
+shutdown_stack_capture(void)
+{
+#    ifdef WITH_STACK_CAPTURE
+    sentry_free(g_stack.buf);
+    memset(&g_stack, 0, sizeof(g_stack));
+#    endif
+}
+
+/**
+ * Copies the registers and stack memory of the crashed thread. This only
+ * validates memory reads via syscalls, and is thus async-signal-safe.
+ */
+static void
+capture_stack(const sentry_ucontext_t *uctx)
+{
+#    ifdef WITH_STACK_CAPTURE
+    g_stack.len = 0;
+    g_stack.has_registers = false;
+    if (!g_stack.buf || !uctx || !uctx->user_context) {
+        return;
+    }
+
+    const mcontext_t *mctx = &uctx->user_context->uc_mcontext;
+    for (size_t i = 0; i < REGISTER_COUNT; i++) {
+#        if defined(__x86_64__)
+        g_stack.registers[i] = (uint64_t)mctx->gregs[REGISTER_INDICES[i]];
+#        else
+        if (i < 31) {
+            g_stack.registers[i] = mctx->regs[i];
+        } else {
+            g_stack.registers[i] = i == 31 ? mctx->sp : mctx->pc;
+        }
+#        endif
+    }
+    g_stack.has_registers = true;
+
+#        if defined(__x86_64__)
+    uintptr_t start = (uintptr_t)mctx->gregs[REG_RSP] - STACK_RED_ZONE;
+#        else
+    uintptr_t start = (uintptr_t)mctx->sp - STACK_RED_ZONE;
+#        endif
+    sentry_memory_reader_t reader;
+    if (!sentry__memory_reader_init(&reader)) {
+        return;
+    }
+    char *memory = g_stack.buf + sizeof(stack_memory_header_t);
+    size_t size = 0;
+    while (size < g_stack.capacity) {
+        uintptr_t addr = start + size;
+        if (!sentry__memory_reader_probe(&reader, addr)) {
+            break;
+        }
+        size_t n = SENTRY_MEMORY_READER_PAGE_SIZE
+            - addr % SENTRY_MEMORY_READER_PAGE_SIZE;
+        n = n < g_stack.capacity - size ? n : g_stack.capacity - size;
+        memcpy(memory + size, (const void *)addr, n);
+        size += n;
+    }
+    sentry__memory_reader_close(&reader);
+
+    stack_memory_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, STACK_MEMORY_MAGIC, sizeof(header.magic));
+    header.version = STACK_MEMORY_VERSION;
+    header.size = (uint32_t)size;
+    header.start_address = (uint64_t)start;
+    memcpy(g_stack.buf, &header, sizeof(header));
+    g_stack.len = sizeof(header) + size;
+    SENTRY_TRACEF("captured %zu bytes of stack memory", size);
+#    else
+    (void)uctx;
+#    endif
+}
+
+/**
+ * Formats the `registers` of the stacktrace for the preallocated crash path.
+ */
+static size_t
+format_registers(char *buf)
+{
+    char *p = buf;
+#    ifdef WITH_STACK_CAPTURE
+    if (!g_stack.has_registers) {
+        return 0;
+    }
+    p += copy_str(p, ",\"registers\":{");
+    for (size_t i = 0; i < REGISTER_COUNT; i++) {
+        if (i) {
+            *p++ = ',';
+        }
+        *p++ = '"';
+        p += copy_str(p, REGISTER_NAMES[i]);
+        p += copy_str(p, "\":\"");
+        p += format_hex(p, g_stack.registers[i]);
+        *p++ = '"';
+    }
+    *p++ = '}';
+#    endif
+    return (size_t)(p - buf);
+}
+
+static void
+add_registers_to_stacktrace(sentry_value_t stacktrace)
+{
+#    ifdef WITH_STACK_CAPTURE
+    if (!g_stack.has_registers) {
+        return;
+    }
+    sentry_value_t registers = sentry_value_new_object();
+    for (size_t i = 0; i < REGISTER_COUNT; i++) {
+        sentry_value_set_by_key(registers, REGISTER_NAMES[i],
+            sentry__value_new_addr(g_stack.registers[i]));
+    }
+    sentry_value_set_by_key(stacktrace, "registers", registers);
+#    else
+    (void)stacktrace;
+#    endif
+}
+
+static void
+write_stack_memory(crash_writer_t *writer)
+{
+#    ifdef WITH_STACK_CAPTURE
+    if (!g_stack.len) {
+        return;
+    }
+    crash_writer_write_str(writer,
+        "{\"type\":\"attachment\",\"filename\":\"stack_memory.bin\","
+        "\"content_type\":\"application/octet-stream\",\"length\":");
+    crash_writer_write_u64(writer, g_stack.len);
+    crash_writer_write_str(writer, "}\n");
+    crash_writer_write(writer, g_stack.buf, g_stack.len);
+    crash_writer_write_str(writer, "\n");
+#    else
+    (void)writer;
+#    endif
+}
+
+static void
+add_stack_memory_to_envelope(sentry_envelope_t *envelope)
+{
+#    ifdef WITH_STACK_CAPTURE
+    if (!g_stack.len || !envelope) {
+        return;
+    }
+    sentry_envelope_item_t *item = sentry__envelope_add_from_buffer(
+        envelope, g_stack.buf, g_stack.len, "attachment");
+    if (item) {
+        sentry__envelope_item_set_header(
+            item, "filename", sentry_value_new_string("stack_memory.bin"));
+        sentry__envelope_item_set_header(item, "content_type",
+            sentry_value_new_string("application/octet-stream"));
+    }
+#    else
+    (void)envelope;
+#    endif
+}
+
+/**
+ * Minidumps:
+ *
+ * The module list is serialized into the minidump format ahead of time,
+ * whenever the list changes. The crash handler only creates the file, and adds
+ * the crashed thread, and the threads of the all-thread capture, which also
+ * record their registers in that case.
+ */
+typedef struct {
+    bool enabled;
+    bool written;
+    int fd;
+    crash_attachment_t attachment;
+    uint32_t cpu_count;
+    sentry_value_t module_list;
+    sentry_minidump_modules_t *volatile modules;
+    sentry_minidump_thread_t threads[MAX_THREADS + 1];
+    char crashed_context[SENTRY_MINIDUMP_CONTEXT_SIZE];
+} minidump_state_t;
+
+static minidump_state_t g_minidump = { 0 };
+
+static void
+refresh_minidump_modules(sentry_value_t module_list)
+{
+    if (!g_minidump.enabled) {
+        return;
+    }
+    // the module list is cached, so this only needs to be redone after the
+    // cache was cleared
+    if (module_list._bits == g_minidump.module_list._bits) {
+        return;
+    }
+    sentry_minidump_modules_t *modules
+        = sentry__minidump_modules_new(module_list);
+    if (!modules) {
+        return;
+    }
+    sentry_value_incref(module_list);
+    sentry_value_decref(g_minidump.module_list);
+    g_minidump.module_list = module_list;
+
+    sentry_minidump_modules_t *old_modules = sentry__atomic_exchange_ptr(
+        (void *volatile *)&g_minidump.modules, modules);
+    if (!sentry__atomic_fetch(&g_crashing)) {
+        sentry__minidump_modules_free(old_modules);
+    }
+}
+
+static void
+startup_minidump(const sentry_options_t *options)
+{
+    memset(&g_minidump, 0, sizeof(g_minidump));
+    g_minidump.fd = -1;
+    g_minidump.module_list = sentry_value_new_null();
+    if (!options->capture_minidump || !SENTRY_MINIDUMP_SUPPORTED) {
+        return;
+    }
+
+    g_minidump.attachment.path
+        = sentry__path_join_str(options->run->run_path, "minidump.dmp");
+    sentry_value_t item_header = sentry_value_new_object();
+    sentry_value_set_by_key(
+        item_header, "type", sentry_value_new_string("attachment"));
+    sentry_value_set_by_key(
+        item_header, "filename", sentry_value_new_string("minidump.dmp"));
+    sentry_value_set_by_key(item_header, "attachment_type",
+        sentry_value_new_string("event.minidump"));
+    g_minidump.attachment.header = json_without_closing_brace(item_header);
+    sentry_value_decref(item_header);
+    if (!g_minidump.attachment.path || !g_minidump.attachment.header) {
+        return;
+    }
+
+    long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    g_minidump.cpu_count = cpu_count > 0 ? (uint32_t)cpu_count : 0;
+    g_minidump.enabled = true;
+}
+
+static void
+shutdown_minidump(void)
+{
+    if (g_minidump.fd >= 0) {
+        close(g_minidump.fd);
+    }
+    sentry__path_free(g_minidump.attachment.path);
+    sentry_free(g_minidump.attachment.header);
+    sentry__minidump_modules_free(g_minidump.modules);
+    sentry_value_decref(g_minidump.module_list);
+    memset(&g_minidump, 0, sizeof(g_minidump));
+    g_minidump.fd = -1;
+    g_minidump.module_list = sentry_value_new_null();
+}
+
+static void
+capture_minidump(const sentry_ucontext_t *uctx)
+{
+    g_minidump.written = false;
+    if (!g_minidump.enabled || !uctx || !uctx->user_context) {
+        return;
+    }
+    g_minidump.fd = open(g_minidump.attachment.path->path,
+        O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+        S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH);
+    if (g_minidump.fd < 0) {
+        return;
+    }
+
+    size_t thread_count = 0;
+    sentry_minidump_thread_t *crashed = &g_minidump.threads[thread_count++];
+    crashed->tid = (uint32_t)g_threads.crashed_tid;
+    crashed->stack_pointer = sentry__minidump_fill_context(
+        g_minidump.crashed_context, uctx->user_context);
+    crashed->context = g_minidump.crashed_context;
+    for (size_t i = 0; i < g_threads.thread_count; i++) {
+        const thread_snapshot_t *snapshot = &g_threads.threads[i];
+        if (snapshot->tid == g_threads.crashed_tid || !snapshot->has_context) {
+            continue;
+        }
+        sentry_minidump_thread_t *thread = &g_minidump.threads[thread_count++];
+        thread->tid = (uint32_t)snapshot->tid;
+        thread->stack_pointer = snapshot->stack_pointer;
+        thread->context = snapshot->context;
+    }
+
+    sentry_minidump_t dump;
+    memset(&dump, 0, sizeof(dump));
+    dump.fd = g_minidump.fd;
+    dump.crashed_tid = (uint32_t)g_threads.crashed_tid;
+    dump.signum = (uint32_t)uctx->signum;
+    if (uctx->siginfo) {
+        dump.signal_code = (uint32_t)uctx->siginfo->si_code;
+        dump.fault_address = (uint64_t)(uintptr_t)uctx->siginfo->si_addr;
+    }
+    dump.cpu_count = g_minidump.cpu_count;
+    dump.threads = g_minidump.threads;
+    dump.thread_count = thread_count;
+    dump.modules
+        = sentry__atomic_fetch_ptr((void *volatile *)&g_minidump.modules);
+    g_minidump.written = sentry__minidump_write(&dump);
+    if (!g_minidump.written) {
+        unlink(g_minidump.attachment.path->path);
+    }
+}
+
+static void
+add_minidump_to_envelope(sentry_envelope_t *envelope)
+{
+    if (!g_minidump.written || !envelope) {
+        return;
+    }
+    sentry_envelope_item_t *item = sentry__envelope_add_from_path(
+        envelope, g_minidump.attachment.path, "attachment");
+    if (item) {
+        sentry__envelope_item_set_header(
+            item, "filename", sentry_value_new_string("minidump.dmp"));
+        sentry__envelope_item_set_header(item, "attachment_type",
+            sentry_value_new_string("event.minidump"));
+    }
+}
+#endif
+
 static int
 startup_inproc_backend(
-    sentry_backend_t *UNUSED(backend), const sentry_options_t *UNUSED(options))
+    sentry_backend_t *UNUSED(backend), const sentry_options_t *options)
 {
     // save the old signal handlers
     memset(g_previous_handlers, 0, sizeof(g_previous_handlers));
@@ -86,6 +1291,9 @@ startup_inproc_backend(
         }
     }
 
+    // reserve the memory the signal handler allocates from
+    sentry__page_allocator_reserve(options->crash_memory_reserve);
+
     // install our own signal handler
     g_signal_stack.ss_sp = sentry_malloc(SIGNAL_STACK_SIZE);
     if (!g_signal_stack.ss_sp) {
@@ -101,6 +1309,15 @@ startup_inproc_backend(
     for (size_t i = 0; i < SIGNAL_COUNT; ++i) {
         sigaction(SIGNAL_DEFINITIONS[i].signum, &g_sigaction, NULL);
     }
+
+#    ifdef SENTRY_PLATFORM_LINUX
+    g_offload_crash_handling = options->offload_crash_handling;
+    startup_thread_capture(options);
+    startup_stack_capture(options);
+    startup_minidump(options);
+#    endif
+
+    startup_prepared_crash(options);
     return 0;
 }
 
@@ -111,6 +1328,13 @@ shutdown_inproc_backend(sentry_backend_t *UNUSED(backend))
     sigaltstack(&g_signal_stack, 0);
     sentry_free(g_signal_stack.ss_sp);
     g_signal_stack.ss_sp = NULL;
+
+    shutdown_prepared_crash();
+#    ifdef SENTRY_PLATFORM_LINUX
+    shutdown_thread_capture();
+    shutdown_stack_capture();
+    shutdown_minidump();
+#    endif
 }
 
 #elif defined SENTRY_PLATFORM_WINDOWS
@@ -169,6 +1393,21 @@ shutdown_inproc_backend(sentry_backend_t *UNUSED(backend))
 }
 #endif
 
+static size_t
+unwind_thread(const sentry_ucontext_t *uctx, void **backtrace)
+{
+    size_t frame_count
+        = sentry_unwind_stack_from_ucontext(uctx, backtrace, MAX_FRAMES);
+    // if unwinding from a ucontext didn't yield any results, try again with a
+    // direct unwind. this is most likely the case when using `libbacktrace`,
+    // since that does not allow to unwind from a ucontext at all.
+    if (!frame_count) {
+        frame_count = sentry_unwind_stack(NULL, backtrace, MAX_FRAMES);
+    }
+    SENTRY_TRACEF("captured backtrace with %lu frames", frame_count);
+    return frame_count;
+}
+
 static sentry_value_t
 make_signal_event(
     const struct signal_slot *sig_slot, const sentry_ucontext_t *uctx)
@@ -207,15 +1446,7 @@ make_signal_event(
     sentry_value_set_by_key(mechanism, "meta", mechanism_meta);
 
     void *backtrace[MAX_FRAMES];
-    size_t frame_count
-        = sentry_unwind_stack_from_ucontext(uctx, &backtrace[0], MAX_FRAMES);
-    // if unwinding from a ucontext didn't yield any results, try again with a
-    // direct unwind. this is most likely the case when using `libbacktrace`,
-    // since that does not allow to unwind from a ucontext at all.
-    if (!frame_count) {
-        frame_count = sentry_unwind_stack(NULL, &backtrace[0], MAX_FRAMES);
-    }
-    SENTRY_TRACEF("captured backtrace with %lu frames", frame_count);
+    size_t frame_count = unwind_thread(uctx, &backtrace[0]);
 
     sentry_value_t frames = sentry__value_new_list_with_size(frame_count);
     for (size_t i = 0; i < frame_count; i++) {
@@ -228,6 +1459,9 @@ make_signal_event(
 
     sentry_value_t stacktrace = sentry_value_new_object();
     sentry_value_set_by_key(stacktrace, "frames", frames);
+#ifdef SENTRY_PLATFORM_LINUX
+    add_registers_to_stacktrace(stacktrace);
+#endif
 
     sentry_value_set_by_key(exc, "stacktrace", stacktrace);
 
@@ -237,36 +1471,269 @@ make_signal_event(
     sentry_value_append(values, exc);
     sentry_value_set_by_key(event, "exception", exceptions);
 
+#ifdef SENTRY_PLATFORM_LINUX
+    add_threads_to_event(event, exc);
+#endif
+
     return event;
 }
 
+#ifdef SENTRY_PLATFORM_UNIX
+static size_t
+format_exception(char *buf, const struct signal_slot *sig_slot,
+    void **backtrace, size_t frame_count)
+{
+    char *p = buf;
+    p += copy_str(p, ",\"exception\":{\"values\":[{\"type\":\"");
+    p += copy_str(p, sig_slot ? sig_slot->signame : "UNKNOWN_SIGNAL");
+    p += copy_str(p, "\",\"value\":\"");
+    p += copy_str(p, sig_slot ? sig_slot->sigdesc : "UnknownSignal");
+    *p++ = '"';
+#    ifdef SENTRY_PLATFORM_LINUX
+    if (g_threads.thread_count) {
+        p += copy_str(p, ",\"thread_id\":");
+        p += format_u64(p, (uint64_t)g_threads.crashed_tid);
+    }
+#    endif
+    p += copy_str(p,
+        ",\"mechanism\":{\"type\":\"signalhandler\",\"synthetic\":true,"
+        "\"handled\":false,\"meta\":{\"signal\":{");
+    if (sig_slot) {
+        p += copy_str(p, "\"name\":\"");
+        p += copy_str(p, sig_slot->signame);
+        p += copy_str(p, "\",\"number\":");
+        p += format_u64(p, (uint64_t)sig_slot->signum);
+    }
+    p += copy_str(p, "}}},\"stacktrace\":");
+    p += format_frames(p, backtrace, frame_count);
+#    ifdef SENTRY_PLATFORM_LINUX
+    // reopen the stacktrace object to add the registers
+    p--;
+    p += format_registers(p);
+    *p++ = '}';
+#    endif
+    p += copy_str(p, "}]}");
+    return (size_t)(p - buf);
+}
+
 static void
-handle_ucontext(const sentry_ucontext_t *uctx)
+write_crash_marker(const char *timestamp, size_t timestamp_len)
 {
-    SENTRY_DEBUG("entering signal handler");
+    int fd = open(g_crash.marker_path->path, O_WRONLY | O_CREAT | O_TRUNC,
+        S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH);
+    if (fd < 0) {
+        return;
+    }
+    crash_writer_t *writer = &g_crash_writer;
+    writer->fd = fd;
+    writer->len = 0;
+    writer->failed = false;
+    crash_writer_write(writer, timestamp, timestamp_len);
+    crash_writer_flush(writer);
+    if (g_crash.durable) {
+        fsync(fd);
+    }
+    close(fd);
+}
 
-    const struct signal_slot *sig_slot = NULL;
-    for (int i = 0; i < SIGNAL_COUNT; ++i) {
-#ifdef SENTRY_PLATFORM_UNIX
-        if (SIGNAL_DEFINITIONS[i].signum == uctx->signum) {
-#elif defined SENTRY_PLATFORM_WINDOWS
-        if (SIGNAL_DEFINITIONS[i].signum
-            == uctx->exception_ptrs.ExceptionRecord->ExceptionCode) {
-#else
-#    error Unsupported platform
-#endif
-            sig_slot = &SIGNAL_DEFINITIONS[i];
+static void
+write_attachment(crash_writer_t *writer, const crash_attachment_t *attachment)
+{
+    int fd = open(attachment->path->path, O_RDONLY);
+    struct stat st;
+    if (!attachment->header || fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) {
+            close(fd);
         }
+        return;
     }
+    size_t remaining = (size_t)st.st_size;
 
-#ifdef SENTRY_PLATFORM_UNIX
-    // give us an allocator we can use safely in signals before we tear down.
-    sentry__page_allocator_enable();
+    crash_writer_write_str(writer, attachment->header);
+    crash_writer_write_str(writer, ",\"length\":");
+    crash_writer_write_u64(writer, remaining);
+    crash_writer_write_str(writer, "}\n");
+    while (remaining > 0) {
+        if (writer->len == CRASH_BUFFER_SIZE) {
+            crash_writer_flush(writer);
+        }
+        size_t n = CRASH_BUFFER_SIZE - writer->len;
+        n = n < remaining ? n : remaining;
+        ssize_t rv = read(fd, writer->buf + writer->len, n);
+        if (rv < 0 && errno == EINTR) {
+            continue;
+        } else if (rv <= 0) {
+            // the file was truncated, so pad it to the announced length
+            memset(writer->buf + writer->len, 0, n);
+            rv = (ssize_t)n;
+        }
+        writer->len += (size_t)rv;
+        remaining -= (size_t)rv;
+    }
+    crash_writer_write_str(writer, "\n");
+    close(fd);
+}
 
-    // inform the sentry_sync system that we're in a signal handler.  This will
-    // make mutexes spin on a spinlock instead as it's no longer safe to use a
-    // pthread mutex.
-    sentry__enter_signal_handler();
+/**
+ * Writes the crash envelope out of the prepared pieces, only using bounded
+ * `memcpy`s and `write`s. Returns `false` if the preallocated crash path can
+ * not be used, in which case the crash event is built from scratch.
+ */
+static bool
+write_prepared_crash(
+    const struct signal_slot *sig_slot, const sentry_ucontext_t *uctx)
+{
+    // the skeleton only reflects the flushed global scope, so a crash on a
+    // thread with local scopes, or with modifications that are still waiting
+    // for the background flush, needs the full event.
+    if (!g_crash.enabled || sentry__scope_has_local()
+        || sentry__scope_flush_pending()) {
+        return false;
+    }
+    // the dumped envelopes are written with the usual functions, which need to
+    // sync as well.
+    if (g_crash.durable) {
+        sentry__path_set_durable(true);
+    }
+
+    const char *skeleton
+        = sentry__atomic_fetch_ptr((void *volatile *)&g_crash.skeleton);
+    if (!skeleton) {
+        return false;
+    }
+
+    char timestamp[32];
+    size_t timestamp_len = format_iso8601(timestamp, sentry__msec_time());
+    write_crash_marker(timestamp, timestamp_len);
+    if (g_crash.sampled_out) {
+        SENTRY_DEBUG("throwing away event due to sample rate");
+        return true;
+    }
+
+    size_t frame_count = unwind_thread(uctx, g_backtrace);
+    size_t exception_len = format_exception(
+        g_exception_buf, sig_slot, g_backtrace, frame_count);
+    size_t threads_len = 0;
+#    ifdef SENTRY_PLATFORM_LINUX
+    if (g_threads.json) {
+        threads_len = format_threads(g_threads.json);
+    }
+#    endif
+
+    char meta[128];
+    char *p = meta;
+    p += copy_str(p, ",\"event_id\":\"");
+    p += copy_str(p, g_crash.event_id);
+    p += copy_str(p, "\",\"timestamp\":\"");
+    memcpy(p, timestamp, timestamp_len);
+    p += timestamp_len;
+    p += copy_str(p, "\",\"level\":\"fatal\"");
+    size_t meta_len = (size_t)(p - meta);
+
+    // take a snapshot of the breadcrumbs, so the computed length matches what
+    // is being written, even if other threads add more breadcrumbs.
+    size_t breadcrumb_count = 0;
+    size_t breadcrumbs_len = 0;
+    size_t count = (size_t)sentry__atomic_fetch(&g_crash.breadcrumb_count);
+    size_t first = count > g_crash.max_breadcrumbs
+        ? count - g_crash.max_breadcrumbs
+        : 0;
+    for (size_t i = first; i < count; i++) {
+        size_t idx = i % g_crash.max_breadcrumbs;
+        char *breadcrumb = sentry__atomic_fetch_ptr(
+            (void *volatile *)&g_crash.breadcrumbs[idx]);
+        if (breadcrumb) {
+            g_crash.breadcrumbs_snapshot[breadcrumb_count++] = breadcrumb;
+            breadcrumbs_len += strlen(breadcrumb);
+        }
+    }
+    static const char breadcrumbs_start[] = ",\"breadcrumbs\":[";
+    if (breadcrumb_count) {
+        // the list brackets, and the separating commas
+        breadcrumbs_len += sizeof(breadcrumbs_start) - 1 + breadcrumb_count;
+    }
+
+    size_t skeleton_len = strlen(skeleton);
+    const char *debug_meta
+        = sentry__atomic_fetch_ptr((void *volatile *)&g_crash.debug_meta);
+    size_t debug_meta_len = debug_meta ? strlen(debug_meta) : 0;
+    size_t payload_len = skeleton_len + debug_meta_len + meta_len
+        + breadcrumbs_len + exception_len + threads_len + 1;
+
+    // the envelope file is only created when crashing, so clean runs do not
+    // leave an empty file behind.
+    g_crash.fd = open(g_crash.tmp_path->path,
+        O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+        S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH);
+    if (g_crash.fd < 0) {
+        return false;
+    }
+    crash_writer_t *writer = &g_crash_writer;
+    writer->fd = g_crash.fd;
+    writer->len = 0;
+    writer->failed = false;
+
+    crash_writer_write_str(writer, g_crash.envelope_header);
+    crash_writer_write_str(writer, "\n{\"type\":\"event\",\"length\":");
+    crash_writer_write_u64(writer, payload_len);
+    crash_writer_write_str(writer, "}\n");
+    crash_writer_write(writer, skeleton, skeleton_len);
+    crash_writer_write(writer, debug_meta, debug_meta_len);
+    crash_writer_write(writer, meta, meta_len);
+    if (breadcrumb_count) {
+        crash_writer_write_str(writer, breadcrumbs_start);
+        for (size_t i = 0; i < breadcrumb_count; i++) {
+            if (i) {
+                crash_writer_write_str(writer, ",");
+            }
+            crash_writer_write_str(writer, g_crash.breadcrumbs_snapshot[i]);
+        }
+        crash_writer_write_str(writer, "]");
+    }
+    crash_writer_write(writer, g_exception_buf, exception_len);
+#    ifdef SENTRY_PLATFORM_LINUX
+    crash_writer_write(writer, g_threads.json, threads_len);
+#    endif
+    crash_writer_write_str(writer, "}\n");
+
+    for (size_t i = 0; i < g_crash.attachment_count; i++) {
+        write_attachment(writer, &g_crash.attachments[i]);
+    }
+#    ifdef SENTRY_PLATFORM_LINUX
+    write_stack_memory(writer);
+    if (g_minidump.written) {
+        write_attachment(writer, &g_minidump.attachment);
+    }
+#    endif
+    crash_writer_flush(writer);
+
+    // the envelope is synced before the rename, so a power loss can not leave
+    // a truncated envelope behind under its final name.
+    if (writer->failed || (g_crash.durable && fsync(writer->fd) != 0)
+        || rename(g_crash.tmp_path->path, g_crash.envelope_path->path) != 0) {
+        unlink(g_crash.tmp_path->path);
+        return false;
+    }
+    return true;
+}
+#endif
+
+static void
+capture_crash(const struct signal_slot *sig_slot, const sentry_ucontext_t *uctx)
+{
+#ifdef SENTRY_PLATFORM_LINUX
+    capture_stack(uctx);
+    capture_minidump(uctx);
+#endif
+#ifdef SENTRY_PLATFORM_UNIX
+    if (write_prepared_crash(sig_slot, uctx)) {
+        // after capturing the crash event, dump all the envelopes to disk
+        SENTRY_WITH_OPTIONS (options) {
+            sentry__transport_dump_queue(options->transport, options->run);
+            sentry__database_sync(options);
+        }
+        goto done;
+    }
 #endif
 
     sentry_value_t event = make_signal_event(sig_slot, uctx);
@@ -276,10 +1743,16 @@ handle_ucontext(const sentry_ucontext_t *uctx)
 
         sentry_envelope_t *envelope
             = sentry__prepare_event(options, event, NULL);
+#ifdef SENTRY_PLATFORM_LINUX
+        add_stack_memory_to_envelope(envelope);
+        add_minidump_to_envelope(envelope);
+#endif
 
         sentry_session_t *session = sentry__end_current_session_with_status(
             SENTRY_SESSION_STATUS_CRASHED);
         sentry__envelope_add_session(envelope, session);
+        // scope flushes are deferred, so persist the ended session right away
+        sentry__scope_flush();
 
         // capture the envelope with the disk transport
         sentry_transport_t *disk_transport
@@ -290,10 +1763,121 @@ handle_ucontext(const sentry_ucontext_t *uctx)
 
         // after capturing the crash event, dump all the envelopes to disk
         sentry__transport_dump_queue(options->transport, options->run);
+        sentry__database_sync(options);
     }
 
+#ifdef SENTRY_PLATFORM_UNIX
+done:
+#endif
     SENTRY_DEBUG("crash has been captured");
 
+#ifdef SENTRY_PLATFORM_UNIX
+    sentry_page_allocator_stats_t stats;
+    sentry__page_allocator_get_stats(&stats);
+    SENTRY_TRACEF("signal handler used at most %zu bytes of %zu reserved, "
+                  "with %zu additional mmaps",
+        stats.high_water_bytes, stats.reserved_bytes, stats.overflow_maps);
+#endif
+}
+
+#ifdef SENTRY_PLATFORM_LINUX
+/**
+ * Runs `capture_crash` in a child process, which gets a frozen copy of the
+ * crashed address space, and waits for it with a deadline.
+ *
+ * The child is created with a raw `clone` syscall, because `fork` runs
+ * `pthread_atfork` handlers and takes libc internal locks, which might be held
+ * by the crashed thread. The child only has the crashed thread, so nothing
+ * else can modify the state it is working on. It still uses the page
+ * allocator, as the `malloc` state might be inconsistent.
+ *
+ * Returns `false` if the crash needs to be captured in-process, because
+ * offloading is disabled or the child could not be created.
+ */
+static bool
+capture_crash_in_child(
+    const struct signal_slot *sig_slot, const sentry_ucontext_t *uctx)
+{
+    if (!g_offload_crash_handling) {
+        return false;
+    }
+
+    pid_t pid = (pid_t)syscall(SYS_clone, (unsigned long)SIGCHLD, 0, 0, 0, 0);
+    if (pid < 0) {
+        SENTRY_WARN("failed to create crash handling process");
+        return false;
+    } else if (pid == 0) {
+        // a crash in the child should just terminate it
+        reset_signal_handlers();
+        capture_crash(sig_slot, uctx);
+        _exit(0);
+    }
+
+    uint64_t deadline = sentry__monotonic_time() + CRASH_CHILD_TIMEOUT;
+    int status;
+    pid_t rv;
+    while ((rv = waitpid(pid, &status, WNOHANG)) == 0
+        || (rv < 0 && errno == EINTR)) {
+        if (sentry__monotonic_time() >= deadline) {
+            SENTRY_WARN("crash handling process timed out");
+            kill(pid, SIGKILL);
+            waitpid(pid, &status, 0);
+            return true;
+        }
+        struct timespec delay = { 0, 1000000 };
+        nanosleep(&delay, NULL);
+    }
+    if (rv == pid && !(WIFEXITED(status) && WEXITSTATUS(status) == 0)) {
+        SENTRY_WARN("crash handling process failed");
+    }
+    return true;
+}
+#endif
+
+static void
+handle_ucontext(const sentry_ucontext_t *uctx)
+{
+    SENTRY_DEBUG("entering signal handler");
+
+    const struct signal_slot *sig_slot = NULL;
+    for (int i = 0; i < SIGNAL_COUNT; ++i) {
+#ifdef SENTRY_PLATFORM_UNIX
+        if (SIGNAL_DEFINITIONS[i].signum == uctx->signum) {
+#elif defined SENTRY_PLATFORM_WINDOWS
+        if (SIGNAL_DEFINITIONS[i].signum
+            == uctx->exception_ptrs.ExceptionRecord->ExceptionCode) {
+#else
+#    error Unsupported platform
+#endif
+            sig_slot = &SIGNAL_DEFINITIONS[i];
+        }
+    }
+
+#ifdef SENTRY_PLATFORM_UNIX
+    // give us an allocator we can use safely in signals before we tear down.
+    sentry__page_allocator_enable();
+
+    // inform the sentry_sync system that we're in a signal handler.  This will
+    // make mutexes spin on a spinlock instead as it's no longer safe to use a
+    // pthread mutex.
+    sentry__enter_signal_handler();
+
+    // from here on, buffers replaced by other threads are not freed anymore,
+    // so this has to happen before any of them is loaded.
+    sentry__atomic_store(&g_crashing, 1);
+#endif
+
+#ifdef SENTRY_PLATFORM_LINUX
+    // other threads are gone in the crash handling process
+    capture_threads();
+
+    if (!capture_crash_in_child(sig_slot, uctx)) {
+        capture_crash(sig_slot, uctx);
+    }
+#else
+    capture_crash(sig_slot, uctx);
+#endif
+
 #ifdef SENTRY_PLATFORM_UNIX
     // reset signal handlers and invoke the original ones.  This will then tear
     // down the process.  In theory someone might have some other handler here
@@ -352,6 +1936,11 @@ sentry__backend_new(void)
     backend->startup_func = startup_inproc_backend;
     backend->shutdown_func = shutdown_inproc_backend;
     backend->except_func = handle_except;
+#ifdef SENTRY_PLATFORM_UNIX
+    backend->flush_scope_func = flush_scope_inproc_backend;
+    backend->add_breadcrumb_func = add_breadcrumb_inproc_backend;
+    backend->get_last_crash_func = get_last_crash_inproc_backend;
+#endif
 
     return backend;
 }
@@ -0,0 +1,658 @@
+#include "sentry_minidump_linux.h"
+
+#include "sentry_alloc.h"
+#include "sentry_core.h"
+#include "sentry_string.h"
+#include "sentry_uuid.h"
+#include "unwinder/sentry_unwinder_memory.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/utsname.h>
+#include <time.h>
+
+#if SENTRY_MINIDUMP_SUPPORTED
+
+#    define MINIDUMP_SIGNATURE 0x504d444d
+#    define MINIDUMP_VERSION 0xa793
+#    define MINIDUMP_OS_LINUX 0x8201
+#    define MINIDUMP_CV_SIGNATURE_ELF 0x4270454c
+
+#    define STREAM_THREAD_LIST 3
+#    define STREAM_MODULE_LIST 4
+#    define STREAM_MEMORY_LIST 5
+#    define STREAM_EXCEPTION 6
+#    define STREAM_SYSTEM_INFO 7
+#    define STREAM_COUNT 5
+
+#    define HEADER_SIZE 32
+#    define DIRECTORY_ENTRY_SIZE 12
+#    define SYSTEM_INFO_SIZE 56
+#    define EXCEPTION_STREAM_SIZE 168
+#    define THREAD_SIZE 48
+#    define MEMORY_DESCRIPTOR_SIZE 16
+#    define MODULE_SIZE 108
+#    define MODULE_NAME_RVA_OFFSET 20
+#    define MODULE_CV_RECORD_OFFSET 76
+
+// the crashed thread, and up to this many other threads are written
+#    define MAX_THREADS 65
+// the amount of stack memory which is written per thread
+#    define MAX_STACK_SIZE (64 * 1024)
+#    define WRITER_BUFFER_SIZE 4096
+
+#    if defined(__x86_64__)
+#        define PROCESSOR_ARCHITECTURE 9
+// leaf functions can use the 128 bytes below the stack pointer
+#        define STACK_RED_ZONE 128
+// CONTEXT_AMD64 | CONTEXT_CONTROL | CONTEXT_INTEGER | CONTEXT_SEGMENTS
+#        define CONTEXT_FLAGS 0x00100007
+#        define CONTEXT_FLAG_FLOATING_POINT 0x8
+#    else
+#        define PROCESSOR_ARCHITECTURE 12
+#        define STACK_RED_ZONE 0
+// CONTEXT_ARM64 | CONTEXT_CONTROL | CONTEXT_INTEGER
+#        define CONTEXT_FLAGS 0x00400003
+#        define CONTEXT_FLAG_FLOATING_POINT 0x4
+#        define FPSIMD_MAGIC 0x46508001
+#    endif
+
+struct sentry_minidump_modules_s {
+    uint32_t count;
+    size_t len;
+    char *data;
+};
+
+typedef struct {
+    int fd;
+    uint32_t offset;
+    size_t len;
+    bool failed;
+    char buf[WRITER_BUFFER_SIZE];
+} dump_writer_t;
+
+static dump_writer_t g_writer;
+static uint64_t g_stack_starts[MAX_THREADS];
+static uint32_t g_stack_sizes[MAX_THREADS];
+
+static void
+put_u16(char *buf, size_t offset, uint16_t value)
+{
+    memcpy(buf + offset, &value, sizeof(value));
+}
+
+static void
+put_u32(char *buf, size_t offset, uint32_t value)
+{
+    memcpy(buf + offset, &value, sizeof(value));
+}
+
+static void
+put_u64(char *buf, size_t offset, uint64_t value)
+{
+    memcpy(buf + offset, &value, sizeof(value));
+}
+
+static uint32_t
+get_u32(const char *buf, size_t offset)
+{
+    uint32_t value;
+    memcpy(&value, buf + offset, sizeof(value));
+    return value;
+}
+
+static uint32_t
+align8(uint32_t value)
+{
+    return (value + 7) & ~(uint32_t)7;
+}
+
+uint64_t
+sentry__minidump_fill_context(char *context, const ucontext_t *user_context)
+{
+    memset(context, 0, SENTRY_MINIDUMP_CONTEXT_SIZE);
+    const mcontext_t *mctx = &user_context->uc_mcontext;
+    uint32_t flags = CONTEXT_FLAGS;
+#    if defined(__x86_64__)
+    static const int registers[] = { REG_RAX, REG_RCX, REG_RDX, REG_RBX,
+        REG_RSP, REG_RBP, REG_RSI, REG_RDI, REG_R8, REG_R9, REG_R10, REG_R11,
+        REG_R12, REG_R13, REG_R14, REG_R15, REG_RIP };
+    for (size_t i = 0; i < sizeof(registers) / sizeof(registers[0]); i++) {
+        put_u64(context, 120 + i * 8, (uint64_t)mctx->gregs[registers[i]]);
+    }
+    uint64_t csgsfs = (uint64_t)mctx->gregs[REG_CSGSFS];
+    put_u16(context, 56, (uint16_t)csgsfs);
+    put_u16(context, 62, (uint16_t)(csgsfs >> 32));
+    put_u16(context, 64, (uint16_t)(csgsfs >> 16));
+    put_u32(context, 68, (uint32_t)mctx->gregs[REG_EFL]);
+    if (mctx->fpregs) {
+        // both use the `fxsave` format
+        memcpy(context + 256, mctx->fpregs, 512);
+        put_u32(context, 52, mctx->fpregs->mxcsr);
+        flags |= CONTEXT_FLAG_FLOATING_POINT;
+    }
+    put_u32(context, 48, flags);
+    return (uint64_t)mctx->gregs[REG_RSP];
+#    else
+    put_u32(context, 4, (uint32_t)mctx->pstate);
+    for (size_t i = 0; i < 31; i++) {
+        put_u64(context, 8 + i * 8, mctx->regs[i]);
+    }
+    put_u64(context, 256, mctx->sp);
+    put_u64(context, 264, mctx->pc);
+
+    // the floating point registers are in one of the records that follow
+    const char *reserved = (const char *)mctx->__reserved;
+    size_t offset = 0;
+    while (offset + 8 <= sizeof(mctx->__reserved)) {
+        uint32_t magic = get_u32(reserved, offset);
+        uint32_t size = get_u32(reserved, offset + 4);
+        if (!magic || size < 8) {
+            break;
+        } else if (magic == FPSIMD_MAGIC && size >= 16 + 512
+            && offset + 16 + 512 <= sizeof(mctx->__reserved)) {
+            memcpy(context + 272, reserved + offset + 16, 512);
+            put_u32(context, 784, get_u32(reserved, offset + 12));
+            put_u32(context, 788, get_u32(reserved, offset + 8));
+            flags |= CONTEXT_FLAG_FLOATING_POINT;
+            break;
+        }
+        offset += size;
+    }
+    put_u32(context, 0, flags);
+    return mctx->sp;
+#    endif
+}
+
+static size_t
+decode_hex(const char *hex, uint8_t *out, size_t max_len)
+{
+    size_t len = 0;
+    while (hex[0] && hex[1] && len < max_len) {
+        char digits[3] = { hex[0], hex[1], '\0' };
+        char *end;
+        out[len++] = (uint8_t)strtoul(digits, &end, 16);
+        if (*end) {
+            return 0;
+        }
+        hex += 2;
+    }
+    return len;
+}
+
+/**
+ * Appends `str` as a `MINIDUMP_STRING`, which is UTF-16, to `sb`.
+ */
+static void
+append_minidump_string(sentry_stringbuilder_t *sb, const char *str)
+{
+    // each UTF-8 byte results in at most one UTF-16 code unit
+    uint16_t *units = sentry_malloc(sizeof(uint16_t) * (strlen(str) + 1));
+    size_t count = 0;
+    for (const uint8_t *c = (const uint8_t *)str; units && *c;) {
+        uint32_t cp = *c++;
+        size_t extra = cp >= 0xf0 ? 3 : cp >= 0xe0 ? 2 : cp >= 0xc0 ? 1 : 0;
+        if (extra) {
+            cp &= 0x3f >> extra;
+        }
+        for (; extra && (*c & 0xc0) == 0x80; extra--) {
+            cp = (cp << 6) | (*c++ & 0x3f);
+        }
+        if (cp >= 0x10000) {
+            cp -= 0x10000;
+            units[count++] = (uint16_t)(0xd800 + (cp >> 10));
+            units[count++] = (uint16_t)(0xdc00 + (cp & 0x3ff));
+        } else {
+            units[count++] = (uint16_t)cp;
+        }
+    }
+
+    uint32_t byte_len = (uint32_t)(count * sizeof(uint16_t));
+    uint16_t terminator = 0;
+    sentry__stringbuilder_append_buf(sb, (const char *)&byte_len, 4);
+    if (count) {
+        sentry__stringbuilder_append_buf(sb, (const char *)units, byte_len);
+    }
+    sentry__stringbuilder_append_buf(
+        sb, (const char *)&terminator, sizeof(terminator));
+    sentry_free(units);
+}
+
+static void
+append_padding(sentry_stringbuilder_t *sb)
+{
+    static const char zeros[4] = { 0 };
+    if (sb->len % 4) {
+        sentry__stringbuilder_append_buf(sb, zeros, 4 - sb->len % 4);
+    }
+}
+
+/**
+ * Appends the CodeView record, which is the build id for ELF files.
+ */
+static uint32_t
+append_cv_record(sentry_stringbuilder_t *sb, sentry_value_t module)
+{
+    uint8_t id[64];
+    size_t id_len = 0;
+    const char *code_id
+        = sentry_value_as_string(sentry_value_get_by_key(module, "code_id"));
+    if (*code_id) {
+        id_len = decode_hex(code_id, id, sizeof(id));
+    } else {
+        // the debug id is a hash of the text section, which was byte-flipped
+        // into a little-endian GUID
+        sentry_uuid_t uuid = sentry_uuid_from_string(sentry_value_as_string(
+            sentry_value_get_by_key(module, "debug_id")));
+        if (sentry_uuid_is_nil(&uuid)) {
+            return 0;
+        }
+        char *b = uuid.bytes;
+        char t;
+        t = b[0], b[0] = b[3], b[3] = t;
+        t = b[1], b[1] = b[2], b[2] = t;
+        t = b[4], b[4] = b[5], b[5] = t;
+        t = b[6], b[6] = b[7], b[7] = t;
+        memcpy(id, uuid.bytes, 16);
+        id_len = 16;
+    }
+    if (!id_len) {
+        return 0;
+    }
+    uint32_t signature = MINIDUMP_CV_SIGNATURE_ELF;
+    sentry__stringbuilder_append_buf(sb, (const char *)&signature, 4);
+    sentry__stringbuilder_append_buf(sb, (const char *)id, id_len);
+    return (uint32_t)(4 + id_len);
+}
+
+sentry_minidump_modules_t *
+sentry__minidump_modules_new(sentry_value_t modules)
+{
+    sentry_minidump_modules_t *rv = SENTRY_MAKE(sentry_minidump_modules_t);
+    if (!rv) {
+        return NULL;
+    }
+    rv->count = (uint32_t)sentry_value_get_length(modules);
+
+    // the records come first, followed by the names and CodeView records,
+    // which are referenced relative to the start of the records.
+    size_t records_len = (size_t)rv->count * MODULE_SIZE;
+    char *records = sentry_malloc(records_len ? records_len : 1);
+    sentry_stringbuilder_t sb;
+    sentry__stringbuilder_init(&sb);
+    if (!records) {
+        sentry_free(rv);
+        return NULL;
+    }
+    memset(records, 0, records_len);
+
+    for (uint32_t i = 0; i < rv->count; i++) {
+        sentry_value_t module = sentry_value_get_by_index(modules, i);
+        char *record = records + (size_t)i * MODULE_SIZE;
+        put_u64(record, 0,
+            (uint64_t)strtoull(sentry_value_as_string(sentry_value_get_by_key(
+                                   module, "image_addr")),
+                NULL, 16));
+        put_u32(record, 8,
+            (uint32_t)sentry_value_as_int32(
+                sentry_value_get_by_key(module, "image_size")));
+
+        put_u32(record, MODULE_NAME_RVA_OFFSET,
+            (uint32_t)(records_len + sb.len));
+        append_minidump_string(&sb,
+            sentry_value_as_string(
+                sentry_value_get_by_key(module, "code_file")));
+        append_padding(&sb);
+
+        uint32_t cv_rva = (uint32_t)(records_len + sb.len);
+        uint32_t cv_size = append_cv_record(&sb, module);
+        if (cv_size) {
+            put_u32(record, MODULE_CV_RECORD_OFFSET, cv_size);
+            put_u32(record, MODULE_CV_RECORD_OFFSET + 4, cv_rva);
+        }
+        append_padding(&sb);
+    }
+
+    rv->len = records_len + sb.len;
+    rv->data = sentry_malloc(rv->len ? rv->len : 1);
+    if (!rv->data) {
+        sentry__stringbuilder_cleanup(&sb);
+        sentry_free(records);
+        sentry_free(rv);
+        return NULL;
+    }
+    memcpy(rv->data, records, records_len);
+    if (sb.len) {
+        memcpy(rv->data + records_len, sb.buf, sb.len);
+    }
+    sentry__stringbuilder_cleanup(&sb);
+    sentry_free(records);
+    return rv;
+}
+
+void
+sentry__minidump_modules_free(sentry_minidump_modules_t *modules)
+{
+    if (!modules) {
+        return;
+    }
+    sentry_free(modules->data);
+    sentry_free(modules);
+}
+
+static void
+writer_flush(dump_writer_t *writer)
+{
+    const char *buf = writer->buf;
+    size_t len = writer->len;
+    while (len > 0 && !writer->failed) {
+        ssize_t n = write(writer->fd, buf, len);
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+            continue;
+        } else if (n <= 0) {
+            writer->failed = true;
+            break;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    writer->len = 0;
+}
+
+static void
+writer_write(dump_writer_t *writer, const void *data, size_t len)
+{
+    const char *buf = data;
+    writer->offset += (uint32_t)len;
+    while (len > 0) {
+        if (writer->len == WRITER_BUFFER_SIZE) {
+            writer_flush(writer);
+        }
+        size_t n = WRITER_BUFFER_SIZE - writer->len;
+        n = n < len ? n : len;
+        memcpy(writer->buf + writer->len, buf, n);
+        writer->len += n;
+        buf += n;
+        len -= n;
+    }
+}
+
+static void
+writer_write_u32(dump_writer_t *writer, uint32_t value)
+{
+    writer_write(writer, &value, sizeof(value));
+}
+
+static void
+writer_write_u64(dump_writer_t *writer, uint64_t value)
+{
+    writer_write(writer, &value, sizeof(value));
+}
+
+static void
+writer_pad_to(dump_writer_t *writer, uint32_t rva)
+{
+    static const char zeros[8] = { 0 };
+    while (writer->offset < rva) {
+        uint32_t n = rva - writer->offset;
+        writer_write(writer, zeros, n < sizeof(zeros) ? n : sizeof(zeros));
+    }
+}
+
+static void
+writer_write_directory_entry(
+    dump_writer_t *writer, uint32_t type, uint32_t size, uint32_t rva)
+{
+    writer_write_u32(writer, type);
+    writer_write_u32(writer, size);
+    writer_write_u32(writer, rva);
+}
+
+static uint32_t
+parse_version_part(const char **str)
+{
+    uint32_t value = 0;
+    while (**str >= '0' && **str <= '9') {
+        value = value * 10 + (uint32_t)(**str - '0');
+        (*str)++;
+    }
+    if (**str == '.') {
+        (*str)++;
+    }
+    return value;
+}
+
+static size_t
+append_str(char *buf, size_t len, size_t max_len, const char *str)
+{
+    while (*str && len < max_len) {
+        buf[len++] = *str++;
+    }
+    return len;
+}
+
+/**
+ * Determines the readable stack memory of every thread.
+ */
+static void
+measure_stacks(const sentry_minidump_t *dump, size_t thread_count)
+{
+    sentry_memory_reader_t reader;
+    bool has_reader = sentry__memory_reader_init(&reader);
+    for (size_t i = 0; i < thread_count; i++) {
+        uint64_t start = dump->threads[i].stack_pointer - STACK_RED_ZONE;
+        uint32_t size = 0;
+        while (has_reader && size < MAX_STACK_SIZE
+            && sentry__memory_reader_probe(&reader, (uintptr_t)start + size)) {
+            uint32_t n = SENTRY_MEMORY_READER_PAGE_SIZE
+                - (uint32_t)((start + size) % SENTRY_MEMORY_READER_PAGE_SIZE);
+            size += n < MAX_STACK_SIZE - size ? n : MAX_STACK_SIZE - size;
+        }
+        g_stack_starts[i] = start;
+        g_stack_sizes[i] = size;
+    }
+    if (has_reader) {
+        sentry__memory_reader_close(&reader);
+    }
+}
+
+bool
+sentry__minidump_write(const sentry_minidump_t *dump)
+{
+    size_t thread_count
+        = dump->thread_count < MAX_THREADS ? dump->thread_count : MAX_THREADS;
+    const sentry_minidump_modules_t *modules = dump->modules;
+    uint32_t module_count = modules ? modules->count : 0;
+    measure_stacks(dump, thread_count);
+
+    struct utsname uts;
+    if (uname(&uts) != 0) {
+        memset(&uts, 0, sizeof(uts));
+    }
+    char csd[256];
+    size_t csd_len = append_str(csd, 0, sizeof(csd), uts.sysname);
+    csd_len = append_str(csd, csd_len, sizeof(csd), " ");
+    csd_len = append_str(csd, csd_len, sizeof(csd), uts.release);
+    csd_len = append_str(csd, csd_len, sizeof(csd), " ");
+    csd_len = append_str(csd, csd_len, sizeof(csd), uts.version);
+    csd_len = append_str(csd, csd_len, sizeof(csd), " ");
+    csd_len = append_str(csd, csd_len, sizeof(csd), uts.machine);
+
+    // first, lay out all the streams and data
+    uint32_t system_info_rva
+        = align8(HEADER_SIZE + STREAM_COUNT * DIRECTORY_ENTRY_SIZE);
+    uint32_t csd_rva = system_info_rva + SYSTEM_INFO_SIZE;
+    uint32_t exception_rva
+        = align8(csd_rva + 4 + (uint32_t)(csd_len + 1) * sizeof(uint16_t));
+    uint32_t thread_list_rva = exception_rva + EXCEPTION_STREAM_SIZE;
+    uint32_t thread_list_size = 4 + (uint32_t)thread_count * THREAD_SIZE;
+    uint32_t contexts_rva = align8(thread_list_rva + thread_list_size);
+    uint32_t memory_list_rva = contexts_rva
+        + (uint32_t)thread_count * SENTRY_MINIDUMP_CONTEXT_SIZE;
+    uint32_t memory_list_size
+        = 4 + (uint32_t)thread_count * MEMORY_DESCRIPTOR_SIZE;
+    uint32_t module_list_rva = align8(memory_list_rva + memory_list_size);
+    uint32_t module_list_size = 4 + module_count * MODULE_SIZE;
+    uint32_t stacks_rva = align8(
+        module_list_rva + 4 + (uint32_t)(modules ? modules->len : 0));
+
+    uint32_t crashed_context_rva = 0;
+    for (size_t i = 0; i < thread_count; i++) {
+        if (dump->threads[i].tid == dump->crashed_tid) {
+            crashed_context_rva = contexts_rva
+                + (uint32_t)i * SENTRY_MINIDUMP_CONTEXT_SIZE;
+        }
+    }
+
+    dump_writer_t *writer = &g_writer;
+    writer->fd = dump->fd;
+    writer->offset = 0;
+    writer->len = 0;
+    writer->failed = false;
+
+    // header and stream directory
+    writer_write_u32(writer, MINIDUMP_SIGNATURE);
+    writer_write_u32(writer, MINIDUMP_VERSION);
+    writer_write_u32(writer, STREAM_COUNT);
+    writer_write_u32(writer, HEADER_SIZE);
+    writer_write_u32(writer, 0);
+    writer_write_u32(writer, (uint32_t)time(NULL));
+    writer_write_u64(writer, 0);
+    writer_write_directory_entry(
+        writer, STREAM_SYSTEM_INFO, SYSTEM_INFO_SIZE, system_info_rva);
+    writer_write_directory_entry(
+        writer, STREAM_EXCEPTION, EXCEPTION_STREAM_SIZE, exception_rva);
+    writer_write_directory_entry(
+        writer, STREAM_THREAD_LIST, thread_list_size, thread_list_rva);
+    writer_write_directory_entry(
+        writer, STREAM_MEMORY_LIST, memory_list_size, memory_list_rva);
+    writer_write_directory_entry(
+        writer, STREAM_MODULE_LIST, module_list_size, module_list_rva);
+
+    // system info, with the kernel version as CSD version
+    char system_info[SYSTEM_INFO_SIZE];
+    memset(system_info, 0, sizeof(system_info));
+    put_u16(system_info, 0, PROCESSOR_ARCHITECTURE);
+    system_info[6] = (char)(dump->cpu_count < 255 ? dump->cpu_count : 255);
+    const char *release = uts.release;
+    put_u32(system_info, 8, parse_version_part(&release));
+    put_u32(system_info, 12, parse_version_part(&release));
+    put_u32(system_info, 16, parse_version_part(&release));
+    put_u32(system_info, 20, MINIDUMP_OS_LINUX);
+    put_u32(system_info, 24, csd_rva);
+    writer_pad_to(writer, system_info_rva);
+    writer_write(writer, system_info, sizeof(system_info));
+    writer_write_u32(writer, (uint32_t)(csd_len * sizeof(uint16_t)));
+    for (size_t i = 0; i <= csd_len; i++) {
+        uint16_t unit = i < csd_len ? (uint8_t)csd[i] : 0;
+        writer_write(writer, &unit, sizeof(unit));
+    }
+
+    // the exception, with the signal as exception code
+    char exception[EXCEPTION_STREAM_SIZE];
+    memset(exception, 0, sizeof(exception));
+    put_u32(exception, 0, dump->crashed_tid);
+    put_u32(exception, 8, dump->signum);
+    put_u32(exception, 12, dump->signal_code);
+    put_u64(exception, 24, dump->fault_address);
+    if (crashed_context_rva) {
+        put_u32(exception, 160, SENTRY_MINIDUMP_CONTEXT_SIZE);
+        put_u32(exception, 164, crashed_context_rva);
+    }
+    writer_pad_to(writer, exception_rva);
+    writer_write(writer, exception, sizeof(exception));
+
+    // the threads, with their contexts and stack memory
+    writer_pad_to(writer, thread_list_rva);
+    writer_write_u32(writer, (uint32_t)thread_count);
+    uint32_t stack_rva = stacks_rva;
+    for (size_t i = 0; i < thread_count; i++) {
+        char thread[THREAD_SIZE];
+        memset(thread, 0, sizeof(thread));
+        put_u32(thread, 0, dump->threads[i].tid);
+        put_u64(thread, 24, g_stack_starts[i]);
+        put_u32(thread, 32, g_stack_sizes[i]);
+        put_u32(thread, 36, stack_rva);
+        put_u32(thread, 40, SENTRY_MINIDUMP_CONTEXT_SIZE);
+        put_u32(thread, 44,
+            contexts_rva + (uint32_t)i * SENTRY_MINIDUMP_CONTEXT_SIZE);
+        writer_write(writer, thread, sizeof(thread));
+        stack_rva += g_stack_sizes[i];
+    }
+    writer_pad_to(writer, contexts_rva);
+    for (size_t i = 0; i < thread_count; i++) {
+        writer_write(
+            writer, dump->threads[i].context, SENTRY_MINIDUMP_CONTEXT_SIZE);
+    }
+
+    // the stack memory is also part of the memory list
+    writer_pad_to(writer, memory_list_rva);
+    writer_write_u32(writer, (uint32_t)thread_count);
+    stack_rva = stacks_rva;
+    for (size_t i = 0; i < thread_count; i++) {
+        writer_write_u64(writer, g_stack_starts[i]);
+        writer_write_u32(writer, g_stack_sizes[i]);
+        writer_write_u32(writer, stack_rva);
+        stack_rva += g_stack_sizes[i];
+    }
+
+    // the prepared modules, with their references relocated
+    writer_pad_to(writer, module_list_rva);
+    writer_write_u32(writer, module_count);
+    uint32_t modules_base = module_list_rva + 4;
+    for (uint32_t i = 0; i < module_count; i++) {
+        char record[MODULE_SIZE];
+        memcpy(record, modules->data + (size_t)i * MODULE_SIZE, MODULE_SIZE);
+        put_u32(record, MODULE_NAME_RVA_OFFSET,
+            get_u32(record, MODULE_NAME_RVA_OFFSET) + modules_base);
+        if (get_u32(record, MODULE_CV_RECORD_OFFSET)) {
+            put_u32(record, MODULE_CV_RECORD_OFFSET + 4,
+                get_u32(record, MODULE_CV_RECORD_OFFSET + 4) + modules_base);
+        }
+        writer_write(writer, record, MODULE_SIZE);
+    }
+    if (modules) {
+        size_t records_len = (size_t)module_count * MODULE_SIZE;
+        writer_write(writer, modules->data + records_len,
+            modules->len - records_len);
+    }
+
+    writer_pad_to(writer, stacks_rva);
+    for (size_t i = 0; i < thread_count; i++) {
+        writer_write(writer, (const void *)(uintptr_t)g_stack_starts[i],
+            g_stack_sizes[i]);
+    }
+    writer_flush(writer);
+
+    SENTRY_TRACEF("wrote minidump with %zu threads and %u modules",
+        thread_count, module_count);
+    return !writer->failed;
+}
+
+#else
+
+uint64_t
+sentry__minidump_fill_context(
+    char *UNUSED(context), const ucontext_t *UNUSED(user_context))
+{
+    return 0;
+}
+
+sentry_minidump_modules_t *
+sentry__minidump_modules_new(sentry_value_t UNUSED(modules))
+{
+    return NULL;
+}
+
+void
+sentry__minidump_modules_free(sentry_minidump_modules_t *UNUSED(modules))
+{
+}
+
+bool
+sentry__minidump_write(const sentry_minidump_t *UNUSED(dump))
+{
+    return false;
+}
+
+#endif
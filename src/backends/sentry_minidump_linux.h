@@ -0,0 +1,77 @@
+#ifndef SENTRY_MINIDUMP_LINUX_H_INCLUDED
+#define SENTRY_MINIDUMP_LINUX_H_INCLUDED
+
+#include "sentry_boot.h"
+
+#include "sentry_value.h"
+
+/**
+ * A minimal minidump writer for x86_64 and aarch64 Linux, which is used by the
+ * `inproc` backend.
+ *
+ * The dump consists of the thread list with the thread contexts and a window
+ * of stack memory per thread, the module list including build ids, the
+ * exception and the system info. Everything that needs allocations, like the
+ * module list, is prepared ahead of time, so writing the dump only uses
+ * bounded `memcpy`s and `write`s to a file descriptor that was opened up
+ * front.
+ */
+#if defined(__x86_64__)
+#    define SENTRY_MINIDUMP_SUPPORTED 1
+#    define SENTRY_MINIDUMP_CONTEXT_SIZE 1232
+#elif defined(__aarch64__)
+#    define SENTRY_MINIDUMP_SUPPORTED 1
+#    define SENTRY_MINIDUMP_CONTEXT_SIZE 912
+#else
+#    define SENTRY_MINIDUMP_SUPPORTED 0
+#    define SENTRY_MINIDUMP_CONTEXT_SIZE 1
+#endif
+
+/**
+ * A thread to be written into the dump. The `context` is in the minidump
+ * format, as filled by `sentry__minidump_fill_context`.
+ */
+typedef struct {
+    uint32_t tid;
+    uint64_t stack_pointer;
+    const char *context;
+} sentry_minidump_thread_t;
+
+/**
+ * The module list, serialized into the minidump format.
+ */
+typedef struct sentry_minidump_modules_s sentry_minidump_modules_t;
+
+typedef struct {
+    int fd;
+    uint32_t crashed_tid;
+    uint32_t signum;
+    uint32_t signal_code;
+    uint64_t fault_address;
+    uint32_t cpu_count;
+    const sentry_minidump_thread_t *threads;
+    size_t thread_count;
+    const sentry_minidump_modules_t *modules;
+} sentry_minidump_t;
+
+/**
+ * Converts the registers of `user_context` into the minidump thread context
+ * format, and returns the stack pointer.
+ * `context` needs to have room for `SENTRY_MINIDUMP_CONTEXT_SIZE` bytes.
+ */
+uint64_t sentry__minidump_fill_context(
+    char *context, const ucontext_t *user_context);
+
+/**
+ * Serializes a list of modules, as returned by `sentry_get_modules_list`.
+ */
+sentry_minidump_modules_t *sentry__minidump_modules_new(sentry_value_t modules);
+
+void sentry__minidump_modules_free(sentry_minidump_modules_t *modules);
+
+/**
+ * Writes the minidump to `dump->fd`. This is async-signal-safe.
+ */
+bool sentry__minidump_write(const sentry_minidump_t *dump);
+
+#endif
@@ -1,6 +1,7 @@
 #include "sentry_boot.h"
 
 #include "sentry_core.h"
+#include "sentry_module_index.h"
 #include "sentry_string.h"
 #include "sentry_sync.h"
 #include "sentry_value.h"
@@ -85,13 +86,16 @@ add_image(const struct mach_header *mh, intptr_t UNUSED(vmaddr_slide))
     sentry_value_freeze(new_modules);
     sentry_value_decref(g_modules);
     g_modules = new_modules;
+    sentry_module_index_t *retired = sentry__module_index_publish(g_modules);
 
     sentry__mutex_unlock(&g_mutex);
+    sentry__module_index_retire(retired);
 }
 
 static void
 remove_image(const struct mach_header *mh, intptr_t UNUSED(vmaddr_slide))
 {
+    sentry_module_index_t *retired = NULL;
     sentry__mutex_lock(&g_mutex);
 
     if (sentry_value_is_null(g_modules)
@@ -122,9 +126,11 @@ remove_image(const struct mach_header *mh, intptr_t UNUSED(vmaddr_slide))
     sentry_value_decref(g_modules);
     sentry_value_freeze(new_modules);
     g_modules = new_modules;
+    retired = sentry__module_index_publish(g_modules);
 
 done:
     sentry__mutex_unlock(&g_mutex);
+    sentry__module_index_retire(retired);
 }
 
 sentry_value_t
@@ -155,5 +161,7 @@ sentry_clear_modulecache(void)
     sentry_value_decref(g_modules);
     g_modules = sentry_value_new_null();
     g_initialized = false;
+    sentry_module_index_t *retired = sentry__module_index_publish(g_modules);
     sentry__mutex_unlock(&g_mutex);
+    sentry__module_index_retire(retired);
 }
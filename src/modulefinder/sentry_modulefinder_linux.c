@@ -1,15 +1,20 @@
 #include "sentry_modulefinder_linux.h"
 
 #include "sentry_core.h"
+#include "sentry_module_index.h"
 #include "sentry_path.h"
 #include "sentry_string.h"
 #include "sentry_sync.h"
 #include "sentry_value.h"
+#include "unwinder/sentry_unwinder_cfi.h"
 
 #include <arpa/inet.h>
 #include <elf.h>
 #include <fcntl.h>
+#include <link.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/auxv.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -18,9 +23,76 @@
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 
+// the `dlpi_adds` and `dlpi_subs` counters were only added in Android 11
+#if !defined(SENTRY_PLATFORM_ANDROID) || __ANDROID_API__ >= 30
+#    define HAS_PHDR_COUNTERS
+#endif
+
+/**
+ * A module as enumerated by `dl_iterate_phdr`, which also serves as the cache
+ * entry for it. Modules are identified by their load address and name, and
+ * the cached `value` is `null` for modules that are not valid ELF files, so
+ * they are not inspected again either.
+ */
+typedef struct {
+    void *start;
+    void *end;
+    char *name;
+    sentry_value_t value;
+} phdr_module_t;
+
+typedef struct {
+    phdr_module_t *modules;
+    size_t count;
+    size_t capacity;
+} phdr_module_list_t;
+
+typedef struct {
+    unsigned long long adds;
+    unsigned long long subs;
+    bool valid;
+} phdr_counters_t;
+
 static bool g_initialized = false;
 static sentry_mutex_t g_mutex = SENTRY__MUTEX_INIT;
 static sentry_value_t g_modules = { 0 };
+static phdr_module_list_t g_phdr_modules = { NULL, 0, 0 };
+static phdr_counters_t g_phdr_counters = { 0, 0, false };
+
+#define MAX_ID_CACHE_ENTRIES 1024
+
+/**
+ * The ids of a module file, identified by its device, inode, modification
+ * time and size. `code_id` is `NULL` for modules without a build id note,
+ * whose `debug_id` is a hash of their `.text` section.
+ */
+typedef struct {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t mtime_sec;
+    uint64_t mtime_nsec;
+    uint64_t size;
+    char debug_id[37];
+    char *code_id;
+    bool used;
+} id_cache_entry_t;
+
+typedef struct {
+    sentry_path_t *path;
+    id_cache_entry_t *entries;
+    size_t count;
+    size_t capacity;
+    bool loaded;
+    bool dirty;
+} id_cache_t;
+
+static id_cache_t g_id_cache = { NULL, NULL, 0, 0, false, false };
+// modules can be inspected in parallel, which all read and add to the cache
+static sentry_mutex_t g_id_cache_lock = SENTRY__MUTEX_INIT;
+
+// the calling thread inspects modules as well
+#define MAX_INSPECT_THREADS 3
+#define MIN_MODULES_PER_INSPECT_THREAD 8
 
 static sentry_slice_t LINUX_GATE = { "linux-gate.so", 13 };
 
@@ -305,6 +377,240 @@ sentry__procmaps_read_ids_from_elf(sentry_value_t value, void *elf_ptr)
     return true;
 }
 
+static void
+id_cache_clear(id_cache_t *cache)
+{
+    for (size_t i = 0; i < cache->count; i++) {
+        sentry_free(cache->entries[i].code_id);
+    }
+    sentry_free(cache->entries);
+    cache->entries = NULL;
+    cache->count = 0;
+    cache->capacity = 0;
+    cache->loaded = false;
+    cache->dirty = false;
+}
+
+static id_cache_entry_t *
+id_cache_append(id_cache_t *cache)
+{
+    if (cache->count == cache->capacity) {
+        size_t capacity = cache->capacity ? cache->capacity * 2 : 64;
+        id_cache_entry_t *entries
+            = sentry_malloc(sizeof(id_cache_entry_t) * capacity);
+        if (!entries) {
+            return NULL;
+        }
+        if (cache->count) {
+            memcpy(entries, cache->entries,
+                sizeof(id_cache_entry_t) * cache->count);
+        }
+        sentry_free(cache->entries);
+        cache->entries = entries;
+        cache->capacity = capacity;
+    }
+    id_cache_entry_t *entry = &cache->entries[cache->count++];
+    memset(entry, 0, sizeof(id_cache_entry_t));
+    return entry;
+}
+
+/**
+ * Parses one line of the cache file, which looks like this:
+ * `<dev> <ino> <mtime_sec> <mtime_nsec> <size> <debug_id> <code_id or ->`.
+ * Lines that are malformed, for example because another process wrote the
+ * file at the same time, are ignored.
+ */
+static bool
+id_cache_parse_line(id_cache_t *cache, char *line)
+{
+    uint64_t numbers[5];
+    char *ptr = line;
+    for (size_t i = 0; i < 5; i++) {
+        char *end;
+        numbers[i] = strtoull(ptr, &end, 10);
+        if (end == ptr || *end != ' ') {
+            return false;
+        }
+        ptr = end + 1;
+    }
+
+    char *debug_id = ptr;
+    char *code_id = strchr(debug_id, ' ');
+    if (!code_id || code_id - debug_id != 36) {
+        return false;
+    }
+    *code_id++ = '\0';
+    if (!*code_id || strspn(code_id, "0123456789abcdef-") != strlen(code_id)) {
+        return false;
+    }
+
+    id_cache_entry_t *entry = id_cache_append(cache);
+    if (!entry) {
+        return false;
+    }
+    entry->dev = numbers[0];
+    entry->ino = numbers[1];
+    entry->mtime_sec = numbers[2];
+    entry->mtime_nsec = numbers[3];
+    entry->size = numbers[4];
+    memcpy(entry->debug_id, debug_id, 37);
+    entry->code_id
+        = strcmp(code_id, "-") == 0 ? NULL : sentry__string_clone(code_id);
+    return true;
+}
+
+static void
+id_cache_load(id_cache_t *cache)
+{
+    cache->loaded = true;
+    if (!cache->path) {
+        return;
+    }
+    char *contents = sentry__path_read_to_buffer(cache->path, NULL);
+    if (!contents) {
+        return;
+    }
+    char *line = contents;
+    while (*line && cache->count < MAX_ID_CACHE_ENTRIES) {
+        char *nl = strchr(line, '\n');
+        if (!nl) {
+            break;
+        }
+        *nl = '\0';
+        id_cache_parse_line(cache, line);
+        line = nl + 1;
+    }
+    sentry_free(contents);
+    SENTRY_TRACEF("loaded %zu cached module ids", cache->count);
+}
+
+/**
+ * Writes the cache file, with the entries that were used by this process
+ * first, so entries of files that are not loaded anymore are evicted first.
+ */
+static void
+id_cache_flush(id_cache_t *cache)
+{
+    if (!cache->dirty || !cache->path) {
+        return;
+    }
+    cache->dirty = false;
+
+    sentry_stringbuilder_t sb;
+    sentry__stringbuilder_init(&sb);
+    size_t written = 0;
+    for (int used = 1; used >= 0; used--) {
+        for (size_t i = 0; i < cache->count; i++) {
+            const id_cache_entry_t *entry = &cache->entries[i];
+            if (entry->used != (bool)used
+                || written == MAX_ID_CACHE_ENTRIES) {
+                continue;
+            }
+            char buf[128];
+            snprintf(buf, sizeof(buf),
+                "%" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64
+                " %s ",
+                entry->dev, entry->ino, entry->mtime_sec, entry->mtime_nsec,
+                entry->size, entry->debug_id);
+            sentry__stringbuilder_append(&sb, buf);
+            sentry__stringbuilder_append(
+                &sb, entry->code_id ? entry->code_id : "-");
+            sentry__stringbuilder_append_char(&sb, '\n');
+            written++;
+        }
+    }
+    size_t len = sentry__stringbuilder_len(&sb);
+    char *contents = sentry__stringbuilder_into_string(&sb);
+    if (contents) {
+        sentry__path_write_buffer(cache->path, contents, len);
+        sentry_free(contents);
+    }
+}
+
+static id_cache_entry_t *
+id_cache_find(id_cache_t *cache, const struct stat *sb)
+{
+    if (!cache->loaded) {
+        id_cache_load(cache);
+    }
+    for (size_t i = 0; i < cache->count; i++) {
+        id_cache_entry_t *entry = &cache->entries[i];
+        if (entry->dev == (uint64_t)sb->st_dev
+            && entry->ino == (uint64_t)sb->st_ino
+            && entry->mtime_sec == (uint64_t)sb->st_mtim.tv_sec
+            && entry->mtime_nsec == (uint64_t)sb->st_mtim.tv_nsec
+            && entry->size == (uint64_t)sb->st_size) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Sets the `debug_id` and `code_id` of `value` from the cache, without
+ * reading the module file at all.
+ */
+static bool
+id_cache_read_ids(
+    id_cache_t *cache, const struct stat *sb, sentry_value_t value)
+{
+    id_cache_entry_t *entry = id_cache_find(cache, sb);
+    if (!entry) {
+        return false;
+    }
+    if (!entry->used) {
+        entry->used = true;
+        // persist the order, so the next process evicts the right entries
+        cache->dirty = true;
+    }
+    if (entry->code_id) {
+        sentry_value_set_by_key(
+            value, "code_id", sentry_value_new_string(entry->code_id));
+    }
+    sentry_value_set_by_key(
+        value, "debug_id", sentry_value_new_string(entry->debug_id));
+    return true;
+}
+
+static void
+id_cache_store_ids(
+    id_cache_t *cache, const struct stat *sb, sentry_value_t value)
+{
+    const char *debug_id
+        = sentry_value_as_string(sentry_value_get_by_key(value, "debug_id"));
+    sentry_value_t code_id = sentry_value_get_by_key(value, "code_id");
+    if (strlen(debug_id) != 36 || id_cache_find(cache, sb)) {
+        return;
+    }
+    id_cache_entry_t *entry = id_cache_append(cache);
+    if (!entry) {
+        return;
+    }
+    entry->dev = (uint64_t)sb->st_dev;
+    entry->ino = (uint64_t)sb->st_ino;
+    entry->mtime_sec = (uint64_t)sb->st_mtim.tv_sec;
+    entry->mtime_nsec = (uint64_t)sb->st_mtim.tv_nsec;
+    entry->size = (uint64_t)sb->st_size;
+    memcpy(entry->debug_id, debug_id, 37);
+    entry->code_id = sentry_value_is_null(code_id)
+        ? NULL
+        : sentry__string_clone(sentry_value_as_string(code_id));
+    entry->used = true;
+    cache->dirty = true;
+}
+
+void
+sentry__modulefinder_set_id_cache_dir(const sentry_path_t *database_path)
+{
+    sentry__mutex_lock(&g_mutex);
+    id_cache_clear(&g_id_cache);
+    sentry__path_free(g_id_cache.path);
+    g_id_cache.path = database_path
+        ? sentry__path_join_str(database_path, "module-ids")
+        : NULL;
+    sentry__mutex_unlock(&g_mutex);
+}
+
 sentry_value_t
 sentry__procmaps_module_to_value(const sentry_module_t *module)
 {
@@ -333,6 +639,18 @@ sentry__procmaps_module_to_value(const sentry_module_t *module)
         sentry__procmaps_read_ids_from_elf(mod_val, module->start);
     } else {
         char *filename = sentry__slice_to_owned(module->file);
+        struct stat sb;
+        bool has_stat = filename && stat(filename, &sb) == 0;
+        if (has_stat) {
+            sentry__mutex_lock(&g_id_cache_lock);
+            bool cached = id_cache_read_ids(&g_id_cache, &sb, mod_val);
+            sentry__mutex_unlock(&g_id_cache_lock);
+            if (cached) {
+                sentry_free(filename);
+                return mod_val;
+            }
+        }
+
         sentry_mmap_t mm;
         if (!sentry__mmap_file(&mm, filename)) {
             sentry_free(filename);
@@ -346,6 +664,11 @@ sentry__procmaps_module_to_value(const sentry_module_t *module)
         }
 
         sentry__procmaps_read_ids_from_elf(mod_val, mm.ptr);
+        if (has_stat) {
+            sentry__mutex_lock(&g_id_cache_lock);
+            id_cache_store_ids(&g_id_cache, &sb, mod_val);
+            sentry__mutex_unlock(&g_id_cache_lock);
+        }
 
         sentry__mmap_close(&mm);
     }
@@ -358,7 +681,8 @@ fail:
 }
 
 static void
-try_append_module(sentry_value_t modules, const sentry_module_t *module)
+try_append_module(sentry_value_t modules, const sentry_module_t *module,
+    sentry_cfi_table_t *cfi_table)
 {
     if (!module->file.ptr) {
         return;
@@ -369,6 +693,8 @@ try_append_module(sentry_value_t modules, const sentry_module_t *module)
     sentry_value_t mod_val = sentry__procmaps_module_to_value(module);
     if (!sentry_value_is_null(mod_val)) {
         sentry_value_append(modules, mod_val);
+        // precompute the unwind tables, so crashes only need a lookup
+        sentry__cfi_table_add_module(cfi_table, module->start, module->end);
     }
 }
 
@@ -408,7 +734,7 @@ get_linux_vdso(void)
 }
 
 static void
-load_modules(sentry_value_t modules)
+load_modules(sentry_value_t modules, sentry_cfi_table_t *cfi_table)
 {
     int fd = open("/proc/self/maps", O_RDONLY);
     if (fd < 0) {
@@ -472,7 +798,7 @@ load_modules(sentry_value_t modules)
 
         if (last_module.file.len
             && !sentry__slice_eq(last_module.file, module.file)) {
-            try_append_module(modules, &last_module);
+            try_append_module(modules, &last_module, cfi_table);
             last_module = module;
         } else {
             // otherwise merge it
@@ -481,29 +807,330 @@ load_modules(sentry_value_t modules)
             last_module.file = module.file;
         }
     }
-    try_append_module(modules, &last_module);
+    try_append_module(modules, &last_module, cfi_table);
     sentry_free(contents);
 }
 
-sentry_value_t
-sentry_get_modules_list(void)
+static void
+phdr_module_list_free(phdr_module_list_t *list)
+{
+    for (size_t i = 0; i < list->count; i++) {
+        sentry_free(list->modules[i].name);
+        sentry_value_decref(list->modules[i].value);
+    }
+    sentry_free(list->modules);
+    list->modules = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+static int
+read_phdr_counters(struct dl_phdr_info *info, size_t size, void *data)
 {
+    phdr_counters_t *counters = data;
+#ifdef HAS_PHDR_COUNTERS
+    if (size >= offsetof(struct dl_phdr_info, dlpi_subs)
+            + sizeof(info->dlpi_subs)) {
+        counters->adds = info->dlpi_adds;
+        counters->subs = info->dlpi_subs;
+        counters->valid = true;
+    }
+#else
+    (void)info;
+    (void)size;
+    (void)counters;
+#endif
+    // the counters are the same for every module, so stop right away
+    return 1;
+}
+
+static int
+collect_phdr_module(struct dl_phdr_info *info, size_t UNUSED(size), void *data)
+{
+    phdr_module_list_t *list = data;
+
+    uintptr_t start = UINTPTR_MAX;
+    uintptr_t end = 0;
+    for (size_t i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+        if (phdr->p_type == PT_LOAD) {
+            uintptr_t segment_start = info->dlpi_addr + phdr->p_vaddr;
+            start = MIN(start, segment_start);
+            end = MAX(end, segment_start + phdr->p_memsz);
+        }
+    }
+    if (start >= end) {
+        return 0;
+    }
+
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 64;
+        phdr_module_t *modules
+            = sentry_malloc(sizeof(phdr_module_t) * capacity);
+        if (!modules) {
+            return 1;
+        }
+        if (list->count) {
+            memcpy(modules, list->modules, sizeof(phdr_module_t) * list->count);
+        }
+        sentry_free(list->modules);
+        list->modules = modules;
+        list->capacity = capacity;
+    }
+
+    phdr_module_t *module = &list->modules[list->count];
+    // the first segment starts at the page that has the ELF header
+    module->start = (void *)(start & ~(uintptr_t)(getpagesize() - 1));
+    module->end = (void *)end;
+    module->name = sentry__string_clone(info->dlpi_name ? info->dlpi_name : "");
+    module->value = sentry_value_new_null();
+    if (module->name) {
+        list->count++;
+    }
+    return 0;
+}
+
+static int
+compare_phdr_modules(const void *a, const void *b)
+{
+    const phdr_module_t *mod_a = a;
+    const phdr_module_t *mod_b = b;
+    if (mod_a->start != mod_b->start) {
+        return mod_a->start < mod_b->start ? -1 : 1;
+    }
+    return strcmp(mod_a->name, mod_b->name);
+}
+
+static sentry_value_t
+phdr_module_to_value(const phdr_module_t *phdr_module, void *linux_vdso)
+{
+    sentry_module_t module = { phdr_module->start, phdr_module->end,
+        sentry__slice_from_str(phdr_module->name) };
+    char exe_path[4096];
+
+    // the vdso is called `linux-vdso.so.1` here, and the main executable has
+    // no name at all. Everything else without a path is not a file we could
+    // read.
+    if (module.start == linux_vdso) {
+        module.file = LINUX_GATE;
+    } else if (!module.file.len) {
+        ssize_t len
+            = readlink("/proc/self/exe", exe_path, sizeof(exe_path) - 1);
+        if (len <= 0) {
+            return sentry_value_new_null();
+        }
+        module.file.ptr = exe_path;
+        module.file.len = (size_t)len;
+    } else if (!strchr(phdr_module->name, '/')) {
+        return sentry_value_new_null();
+    }
+
+    SENTRY_TRACEF(
+        "inspecting module \"%.*s\"", (int)module.file.len, module.file.ptr);
+    return sentry__procmaps_module_to_value(&module);
+}
+
+/**
+ * The modules that need to be inspected, which are handed out to the
+ * inspecting threads one at a time.
+ */
+typedef struct {
+    phdr_module_t **modules;
+    size_t count;
+    volatile long next;
+    void *linux_vdso;
+} inspect_queue_t;
+
+static void
+inspect_queued_modules(inspect_queue_t *queue)
+{
+    while (true) {
+        size_t i = (size_t)sentry__atomic_fetch_and_add(&queue->next, 1);
+        if (i >= queue->count) {
+            return;
+        }
+        phdr_module_t *module = queue->modules[i];
+        module->value = phdr_module_to_value(module, queue->linux_vdso);
+    }
+}
+
+static void *
+inspect_modules_thread(void *data)
+{
+    inspect_queued_modules(data);
+    return NULL;
+}
+
+/**
+ * Inspects all the queued modules. Reading the ids of a module is mostly
+ * waiting for its file to be paged in, so with `parallel`, a large number of
+ * modules is spread across a few threads. This is only done by the prefetcher,
+ * since any other caller might be holding locks the threads need.
+ */
+static void
+inspect_modules(inspect_queue_t *queue, bool parallel)
+{
+    sentry_threadid_t threads[MAX_INSPECT_THREADS];
+    size_t thread_count
+        = parallel ? queue->count / MIN_MODULES_PER_INSPECT_THREAD : 0;
+    thread_count = MIN(thread_count, MAX_INSPECT_THREADS);
+    size_t spawned = 0;
+    for (; spawned < thread_count; spawned++) {
+        sentry__thread_init(&threads[spawned]);
+        if (sentry__thread_spawn(
+                &threads[spawned], inspect_modules_thread, queue)
+            != 0) {
+            break;
+        }
+    }
+    if (spawned) {
+        SENTRY_TRACEF("inspecting %zu modules on %zu threads", queue->count,
+            spawned + 1);
+    }
+
+    inspect_queued_modules(queue);
+    for (size_t i = 0; i < spawned; i++) {
+        sentry__thread_join(threads[i]);
+        sentry__thread_free(&threads[i]);
+    }
+}
+
+/**
+ * Enumerates the modules using `dl_iterate_phdr`, which needs no file I/O.
+ * Modules that were already in `previous` reuse their cached value and unwind
+ * table, so only modules that were loaded since need to be inspected.
+ * Returns `false` if no modules could be enumerated.
+ */
+static bool
+load_modules_from_phdrs(sentry_value_t modules, sentry_cfi_table_t *cfi_table,
+    phdr_module_list_t *previous, phdr_module_list_t *current, bool parallel)
+{
+    dl_iterate_phdr(collect_phdr_module, current);
+    if (!current->count) {
+        return false;
+    }
+    qsort(current->modules, current->count, sizeof(phdr_module_t),
+        compare_phdr_modules);
+
+    inspect_queue_t queue = { NULL, 0, 0, NULL };
+    queue.modules = sentry_malloc(sizeof(phdr_module_t *) * current->count);
+    if (!queue.modules) {
+        return false;
+    }
+    queue.linux_vdso = (void *)getauxval(AT_SYSINFO_EHDR);
+
+    size_t j = 0;
+    for (size_t i = 0; i < current->count; i++) {
+        phdr_module_t *module = &current->modules[i];
+        // both lists are sorted, so this is a merge of the two
+        while (j < previous->count
+            && compare_phdr_modules(&previous->modules[j], module) < 0) {
+            j++;
+        }
+        if (j < previous->count
+            && compare_phdr_modules(&previous->modules[j], module) == 0
+            && previous->modules[j].end == module->end) {
+            module->value = previous->modules[j].value;
+            sentry_value_incref(module->value);
+            if (!sentry_value_is_null(module->value)) {
+                sentry__cfi_table_reuse_module(
+                    cfi_table, module->start, module->end);
+            }
+        } else {
+            queue.modules[queue.count++] = module;
+        }
+    }
+    SENTRY_TRACEF("reused %zu of %zu cached modules",
+        current->count - queue.count, current->count);
+
+    inspect_modules(&queue, parallel);
+    for (size_t i = 0; i < queue.count; i++) {
+        phdr_module_t *module = queue.modules[i];
+        if (!sentry_value_is_null(module->value)) {
+            sentry_value_freeze(module->value);
+            // precompute the unwind tables, so crashes only need a lookup
+            sentry__cfi_table_add_module(
+                cfi_table, module->start, module->end);
+        }
+    }
+    sentry_free(queue.modules);
+
+    for (size_t i = 0; i < current->count; i++) {
+        sentry_value_t value = current->modules[i].value;
+        if (!sentry_value_is_null(value)) {
+            sentry_value_incref(value);
+            sentry_value_append(modules, value);
+        }
+    }
+    return true;
+}
+
+static sentry_value_t
+get_modules_list(bool parallel)
+{
+    sentry_module_index_t *retired = NULL;
+    sentry_cfi_table_t *retired_cfi_table = NULL;
+    // `dl_iterate_phdr` takes the loader lock, which the crashed thread might
+    // be holding. A signal handler thus never refreshes the cached list, and
+    // only reads `/proc/self/maps` if there is no list yet.
+    bool in_signal_handler = !sentry__block_for_signal_handler();
     sentry__mutex_lock(&g_mutex);
+    // `dlpi_adds` and `dlpi_subs` count every `dlopen` and `dlclose`, so the
+    // list is only refreshed when a module was actually loaded or unloaded.
+    phdr_counters_t counters = g_phdr_counters;
+    if (!in_signal_handler) {
+        dl_iterate_phdr(read_phdr_counters, &counters);
+    }
+    if (g_initialized && counters.valid
+        && (counters.adds != g_phdr_counters.adds
+            || counters.subs != g_phdr_counters.subs)) {
+        SENTRY_TRACE("modules were loaded or unloaded, refreshing modules");
+        sentry_value_decref(g_modules);
+        g_initialized = false;
+    }
     if (!g_initialized) {
         g_modules = sentry_value_new_list();
-        SENTRY_TRACE("trying to read modules from /proc/self/maps");
-        load_modules(g_modules);
-        SENTRY_TRACEF("read %zu modules from /proc/self/maps",
-            sentry_value_get_length(g_modules));
+        sentry_cfi_table_t *cfi_table = sentry__cfi_table_new();
+        phdr_module_list_t current = { NULL, 0, 0 };
+        if (!in_signal_handler
+            && load_modules_from_phdrs(g_modules, cfi_table,
+                &g_phdr_modules, &current, parallel)) {
+            phdr_module_list_free(&g_phdr_modules);
+            g_phdr_modules = current;
+        } else {
+            SENTRY_TRACE("trying to read modules from /proc/self/maps");
+            phdr_module_list_free(&current);
+            phdr_module_list_free(&g_phdr_modules);
+            load_modules(g_modules, cfi_table);
+        }
+        retired_cfi_table = sentry__cfi_table_publish(cfi_table);
+        id_cache_flush(&g_id_cache);
+        SENTRY_TRACEF("read %zu modules", sentry_value_get_length(g_modules));
         sentry_value_freeze(g_modules);
+        retired = sentry__module_index_publish(g_modules);
+        g_phdr_counters = counters;
         g_initialized = true;
     }
     sentry_value_t modules = g_modules;
     sentry_value_incref(modules);
     sentry__mutex_unlock(&g_mutex);
+    sentry__cfi_table_retire(retired_cfi_table);
+    sentry__module_index_retire(retired);
     return modules;
 }
 
+sentry_value_t
+sentry_get_modules_list(void)
+{
+    return get_modules_list(false);
+}
+
+void
+sentry__modulefinder_prefetch(void)
+{
+    sentry_value_decref(get_modules_list(true));
+}
+
 void
 sentry_clear_modulecache(void)
 {
@@ -511,5 +1138,11 @@ sentry_clear_modulecache(void)
     sentry_value_decref(g_modules);
     g_modules = sentry_value_new_null();
     g_initialized = false;
+    phdr_module_list_free(&g_phdr_modules);
+    sentry_cfi_table_t *retired_cfi_table = sentry__cfi_table_publish(NULL);
+    sentry_module_index_t *retired
+        = sentry__module_index_publish(sentry_value_new_null());
     sentry__mutex_unlock(&g_mutex);
+    sentry__cfi_table_retire(retired_cfi_table);
+    sentry__module_index_retire(retired);
 }
@@ -2,6 +2,7 @@
 #define SENTRY_PROCMAPS_MODULEFINDER_H_INCLUDED
 
 #include "sentry_boot.h"
+#include "sentry_path.h"
 #include "sentry_slice.h"
 
 typedef struct {
@@ -16,10 +17,26 @@ typedef struct {
     int fd;
 } sentry_mmap_t;
 
-#if SENTRY_UNITTEST
+/**
+ * Maps the regular file at `path` read-only into memory.
+ */
 bool sentry__mmap_file(sentry_mmap_t *mapping, const char *path);
 void sentry__mmap_close(sentry_mmap_t *mapping);
 
+/**
+ * Sets the database directory, in which the ids of modules are cached, so
+ * modules only need to be read once across runs. `NULL` disables the cache.
+ */
+void sentry__modulefinder_set_id_cache_dir(const sentry_path_t *database_path);
+
+/**
+ * Warms up the cached list of modules, like `sentry_get_modules_list`, but
+ * inspects new modules on a few threads. This must only be called from the
+ * module prefetcher, and never while holding any lock.
+ */
+void sentry__modulefinder_prefetch(void);
+
+#if SENTRY_UNITTEST
 bool sentry__procmaps_read_ids_from_elf(sentry_value_t value, void *elf_ptr);
 
 int sentry__procmaps_parse_module_line(
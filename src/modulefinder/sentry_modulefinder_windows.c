@@ -1,5 +1,6 @@
 #include "sentry_boot.h"
 
+#include "sentry_module_index.h"
 #include "sentry_sync.h"
 #include "sentry_uuid.h"
 #include "sentry_value.h"
@@ -77,7 +78,11 @@ extract_pdb_info(uintptr_t module_addr, sentry_value_t module)
     sentry_value_set_by_key(module, "type", sentry_value_new_string("pe"));
 }
 
-static void
+/**
+ * Returns the replaced module index, which needs to be retired once `g_mutex`
+ * is released.
+ */
+static sentry_module_index_t *
 load_modules(void)
 {
     HANDLE snapshot
@@ -113,19 +118,22 @@ load_modules(void)
     CloseHandle(snapshot);
 
     sentry_value_freeze(g_modules);
+    return sentry__module_index_publish(g_modules);
 }
 
 sentry_value_t
 sentry_get_modules_list(void)
 {
+    sentry_module_index_t *retired = NULL;
     sentry__mutex_lock(&g_mutex);
     if (!g_initialized) {
-        load_modules();
+        retired = load_modules();
         g_initialized = true;
     }
     sentry_value_t modules = g_modules;
     sentry_value_incref(modules);
     sentry__mutex_unlock(&g_mutex);
+    sentry__module_index_retire(retired);
     return modules;
 }
 
@@ -136,5 +144,7 @@ sentry_clear_modulecache(void)
     sentry_value_decref(g_modules);
     g_modules = sentry_value_new_null();
     g_initialized = false;
+    sentry_module_index_t *retired = sentry__module_index_publish(g_modules);
     sentry__mutex_unlock(&g_mutex);
+    sentry__module_index_retire(retired);
 }
@@ -1,5 +1,51 @@
 #include "sentry_path.h"
 #include "sentry_alloc.h"
+#include "sentry_sync.h"
+
+#include <stdio.h>
+#include <string.h>
+#ifndef SENTRY_PLATFORM_WINDOWS
+#    include <unistd.h>
+#endif
+
+static volatile long g_durable = 0;
+static volatile long g_tmp_counter = 0;
+
+sentry_path_t *
+sentry__path_unique_tmp(const sentry_path_t *path)
+{
+#ifdef SENTRY_PLATFORM_WINDOWS
+    unsigned long pid = (unsigned long)GetCurrentProcessId();
+#else
+    unsigned long pid = (unsigned long)getpid();
+#endif
+    char suffix[64];
+    snprintf(suffix, sizeof(suffix), ".%lu.%ld.tmp", pid,
+        sentry__atomic_fetch_and_add(&g_tmp_counter, 1));
+    return sentry__path_append_str(path, suffix);
+}
+
+void
+sentry__path_set_durable(bool durable)
+{
+    sentry__atomic_store(&g_durable, durable ? 1 : 0);
+}
+
+bool
+sentry__path_is_durable(void)
+{
+    return sentry__atomic_fetch(&g_durable) != 0;
+}
+
+bool
+sentry__path_eq(const sentry_path_t *a, const sentry_path_t *b)
+{
+#ifdef SENTRY_PLATFORM_WINDOWS
+    return wcscmp(a->path, b->path) == 0;
+#else
+    return strcmp(a->path, b->path) == 0;
+#endif
+}
 
 void
 sentry__path_free(sentry_path_t *path)
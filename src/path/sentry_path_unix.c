@@ -12,6 +12,7 @@
 #include <string.h>
 #include <sys/errno.h>
 #include <sys/file.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -28,6 +29,21 @@ struct sentry_pathiter_s {
     DIR *dir_handle;
 };
 
+struct sentry_filewriter_s {
+    int fd;
+};
+
+#define EINTR_RETRY(X, Y)                                                      \
+    do {                                                                       \
+        int _tmp;                                                              \
+        do {                                                                   \
+            _tmp = (X);                                                        \
+        } while (_tmp == -1 && errno == EINTR);                                \
+        if (Y != 0) {                                                          \
+            *(int *)Y = _tmp;                                                  \
+        }                                                                      \
+    } while (false)
+
 static size_t
 write_loop(int fd, const char *buf, size_t buf_len)
 {
@@ -45,6 +61,23 @@ write_loop(int fd, const char *buf, size_t buf_len)
     return buf_len;
 }
 
+static int
+sync_fd(int fd)
+{
+    int status;
+#ifdef SENTRY_PLATFORM_DARWIN
+    // `fsync` on darwin does not flush the drive cache, only this does
+    if (fcntl(fd, F_FULLFSYNC) == 0) {
+        return 0;
+    }
+    EINTR_RETRY(fsync(fd), &status);
+#else
+    // the file size is part of the data, so this is enough for new files
+    EINTR_RETRY(fdatasync(fd), &status);
+#endif
+    return status == 0 ? 0 : 1;
+}
+
 bool
 sentry__filelock_try_lock(sentry_filelock_t *lock)
 {
@@ -224,6 +257,17 @@ sentry__path_get_size(const sentry_path_t *path)
     }
 }
 
+uint64_t
+sentry__path_get_mtime(const sentry_path_t *path)
+{
+    struct stat buf;
+    if (stat(path->path, &buf) == 0 && S_ISREG(buf.st_mode)) {
+        return (uint64_t)buf.st_mtime * 1000;
+    } else {
+        return 0;
+    }
+}
+
 sentry_path_t *
 sentry__path_append_str(const sentry_path_t *base, const char *suffix)
 {
@@ -267,17 +311,6 @@ sentry__path_clone(const sentry_path_t *path)
     return rv;
 }
 
-#define EINTR_RETRY(X, Y)                                                      \
-    do {                                                                       \
-        int _tmp;                                                              \
-        do {                                                                   \
-            _tmp = (X);                                                        \
-        } while (_tmp == -1 && errno == EINTR);                                \
-        if (Y != 0) {                                                          \
-            *(int *)Y = _tmp;                                                  \
-        }                                                                      \
-    } while (false)
-
 int
 sentry__path_remove(const sentry_path_t *path)
 {
@@ -299,6 +332,27 @@ sentry__path_remove(const sentry_path_t *path)
     return 1;
 }
 
+int
+sentry__path_rename(const sentry_path_t *src, const sentry_path_t *dst)
+{
+    int status;
+    EINTR_RETRY(rename(src->path, dst->path), &status);
+    return status == 0 ? 0 : 1;
+}
+
+int
+sentry__path_sync_dir(const sentry_path_t *path)
+{
+    int fd = open(path->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return 1;
+    }
+    int status;
+    EINTR_RETRY(fsync(fd), &status);
+    close(fd);
+    return status == 0 ? 0 : 1;
+}
+
 int
 sentry__path_create_dir_all(const sentry_path_t *path)
 {
@@ -446,8 +500,8 @@ sentry__path_read_to_buffer(const sentry_path_t *path, size_t *size_out)
 }
 
 static int
-write_buffer_with_flags(
-    const sentry_path_t *path, const char *buf, size_t buf_len, int flags)
+write_buffer_with_flags(const sentry_path_t *path, const char *buf,
+    size_t buf_len, int flags, bool durable)
 {
     int fd = open(
         path->path, flags, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH);
@@ -457,23 +511,137 @@ write_buffer_with_flags(
     }
 
     size_t remaining = write_loop(fd, buf, buf_len);
+    int rv = remaining == 0 ? 0 : 1;
+    if (rv == 0 && durable) {
+        rv = sync_fd(fd);
+    }
 
     close(fd);
-    return remaining == 0 ? 0 : 1;
+    return rv;
 }
 
 int
 sentry__path_write_buffer(
     const sentry_path_t *path, const char *buf, size_t buf_len)
 {
-    return write_buffer_with_flags(
-        path, buf, buf_len, O_RDWR | O_CREAT | O_TRUNC);
+    sentry_path_t *tmp_path = sentry__path_unique_tmp(path);
+    if (!tmp_path) {
+        return 1;
+    }
+    // without syncing, a power loss right after the rename could still leave
+    // an empty file behind, as the rename may reach the disk before the data.
+    int rv = write_buffer_with_flags(tmp_path, buf, buf_len,
+        O_RDWR | O_CREAT | O_TRUNC, sentry__path_is_durable());
+    if (rv == 0) {
+        rv = sentry__path_rename(tmp_path, path);
+    }
+    if (rv != 0) {
+        sentry__path_remove(tmp_path);
+    }
+    sentry__path_free(tmp_path);
+    return rv;
 }
 
 int
 sentry__path_append_buffer(
     const sentry_path_t *path, const char *buf, size_t buf_len)
 {
-    return write_buffer_with_flags(
-        path, buf, buf_len, O_RDWR | O_CREAT | O_APPEND);
+    return write_buffer_with_flags(path, buf, buf_len,
+        O_RDWR | O_CREAT | O_APPEND, sentry__path_is_durable());
+}
+
+sentry_filemap_t *
+sentry__path_map_file(const sentry_path_t *path, size_t size)
+{
+    sentry_filemap_t *map = SENTRY_MAKE(sentry_filemap_t);
+    if (!map) {
+        return NULL;
+    }
+
+    int fd = open(path->path, O_RDWR | O_CREAT,
+        S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH);
+    if (fd < 0) {
+        SENTRY_TRACEF("failed to open file \"%s\" for mapping", path->path);
+        sentry_free(map);
+        return NULL;
+    }
+    if (ftruncate(fd, (off_t)size) != 0) {
+        close(fd);
+        sentry_free(map);
+        return NULL;
+    }
+    void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    // the mapping stays valid after closing the file
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        sentry_free(map);
+        return NULL;
+    }
+
+    map->ptr = ptr;
+    map->size = size;
+    return map;
+}
+
+void
+sentry__filemap_free(sentry_filemap_t *map)
+{
+    if (!map) {
+        return;
+    }
+    munmap(map->ptr, map->size);
+    sentry_free(map);
+}
+
+int
+sentry__filemap_sync(sentry_filemap_t *map)
+{
+    return msync(map->ptr, map->size, MS_SYNC) == 0 ? 0 : 1;
+}
+
+sentry_filewriter_t *
+sentry__path_open_writer(const sentry_path_t *path)
+{
+    sentry_filewriter_t *writer = SENTRY_MAKE(sentry_filewriter_t);
+    if (!writer) {
+        return NULL;
+    }
+    writer->fd = open(path->path, O_WRONLY | O_CREAT | O_APPEND,
+        S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH);
+    if (writer->fd < 0) {
+        SENTRY_TRACEF("failed to open file \"%s\" for writing", path->path);
+        sentry_free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+int
+sentry__filewriter_write(
+    sentry_filewriter_t *writer, const char *buf, size_t buf_len)
+{
+    return write_loop(writer->fd, buf, buf_len) == 0 ? 0 : 1;
+}
+
+int
+sentry__filewriter_sync(sentry_filewriter_t *writer)
+{
+    return sync_fd(writer->fd);
+}
+
+int
+sentry__filewriter_truncate(sentry_filewriter_t *writer)
+{
+    // with `O_APPEND`, the next write will start at the new end of the file
+    return ftruncate(writer->fd, 0) == 0 ? 0 : 1;
+}
+
+void
+sentry__filewriter_free(sentry_filewriter_t *writer)
+{
+    if (!writer) {
+        return;
+    }
+    close(writer->fd);
+    sentry_free(writer);
 }
@@ -28,6 +28,10 @@ struct sentry_pathiter_s {
     sentry_path_t *current;
 };
 
+struct sentry_filewriter_s {
+    HANDLE handle;
+};
+
 static size_t
 write_loop(FILE *f, const char *buf, size_t buf_len)
 {
@@ -285,6 +289,17 @@ sentry__path_get_size(const sentry_path_t *path)
     }
 }
 
+uint64_t
+sentry__path_get_mtime(const sentry_path_t *path)
+{
+    struct _stat buf;
+    if (_wstat(path->path, &buf) == 0 && S_ISREG(buf.st_mode)) {
+        return (uint64_t)buf.st_mtime * 1000;
+    } else {
+        return 0;
+    }
+}
+
 sentry_path_t *
 sentry__path_append_str(const sentry_path_t *base, const char *suffix)
 {
@@ -348,6 +363,20 @@ sentry__path_remove(const sentry_path_t *path)
     }
 }
 
+int
+sentry__path_rename(const sentry_path_t *src, const sentry_path_t *dst)
+{
+    return MoveFileExW(src->path, dst->path, MOVEFILE_REPLACE_EXISTING) ? 0 : 1;
+}
+
+int
+sentry__path_sync_dir(const sentry_path_t *UNUSED(path))
+{
+    // directory entries can not be flushed on windows, `MoveFileExW` with
+    // `MOVEFILE_WRITE_THROUGH` already persists them when writing.
+    return 0;
+}
+
 int
 sentry__path_create_dir_all(const sentry_path_t *path)
 {
@@ -510,7 +539,7 @@ sentry__path_read_to_buffer(const sentry_path_t *path, size_t *size_out)
 
 static int
 write_buffer_with_mode(const sentry_path_t *path, const char *buf,
-    size_t buf_len, const wchar_t *mode)
+    size_t buf_len, const wchar_t *mode, bool durable)
 {
     FILE *f = _wfopen(path->path, mode);
     if (!f) {
@@ -518,21 +547,167 @@ write_buffer_with_mode(const sentry_path_t *path, const char *buf,
     }
 
     size_t remaining = write_loop(f, buf, buf_len);
+    int rv = remaining == 0 ? 0 : 1;
+    if (rv == 0 && durable) {
+        // `_commit` flushes the OS buffers, but not the ones of the stream
+        rv = fflush(f) == 0 && _commit(_fileno(f)) == 0 ? 0 : 1;
+    }
 
     fclose(f);
-    return remaining == 0 ? 0 : 1;
+    return rv;
 }
 
 int
 sentry__path_write_buffer(
     const sentry_path_t *path, const char *buf, size_t buf_len)
 {
-    return write_buffer_with_mode(path, buf, buf_len, L"wb");
+    sentry_path_t *tmp_path = sentry__path_unique_tmp(path);
+    if (!tmp_path) {
+        return 1;
+    }
+    bool durable = sentry__path_is_durable();
+    int rv = write_buffer_with_mode(tmp_path, buf, buf_len, L"wb", durable);
+    if (rv == 0) {
+        DWORD flags = MOVEFILE_REPLACE_EXISTING;
+        if (durable) {
+            flags |= MOVEFILE_WRITE_THROUGH;
+        }
+        rv = MoveFileExW(tmp_path->path, path->path, flags) ? 0 : 1;
+    }
+    if (rv != 0) {
+        sentry__path_remove(tmp_path);
+    }
+    sentry__path_free(tmp_path);
+    return rv;
 }
 
 int
 sentry__path_append_buffer(
     const sentry_path_t *path, const char *buf, size_t buf_len)
 {
-    return write_buffer_with_mode(path, buf, buf_len, L"ab");
+    return write_buffer_with_mode(
+        path, buf, buf_len, L"ab", sentry__path_is_durable());
+}
+
+sentry_filemap_t *
+sentry__path_map_file(const sentry_path_t *path, size_t size)
+{
+    sentry_filemap_t *map = SENTRY_MAKE(sentry_filemap_t);
+    if (!map) {
+        return NULL;
+    }
+
+    HANDLE file = CreateFileW(path->path, GENERIC_READ | GENERIC_WRITE,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+        OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        sentry_free(map);
+        return NULL;
+    }
+    LARGE_INTEGER file_size;
+    file_size.QuadPart = (LONGLONG)size;
+    if (!SetFilePointerEx(file, file_size, NULL, FILE_BEGIN)
+        || !SetEndOfFile(file)) {
+        CloseHandle(file);
+        sentry_free(map);
+        return NULL;
+    }
+    HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READWRITE,
+        (DWORD)(file_size.QuadPart >> 32), (DWORD)file_size.QuadPart, NULL);
+    void *ptr = mapping ? MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, size)
+                        : NULL;
+    // the view keeps the mapping and the file alive after closing the handles
+    if (mapping) {
+        CloseHandle(mapping);
+    }
+    CloseHandle(file);
+    if (!ptr) {
+        sentry_free(map);
+        return NULL;
+    }
+
+    map->ptr = ptr;
+    map->size = size;
+    return map;
+}
+
+void
+sentry__filemap_free(sentry_filemap_t *map)
+{
+    if (!map) {
+        return;
+    }
+    UnmapViewOfFile(map->ptr);
+    sentry_free(map);
+}
+
+int
+sentry__filemap_sync(sentry_filemap_t *map)
+{
+    // this writes the dirty pages, the metadata is updated by the kernel
+    return FlushViewOfFile(map->ptr, map->size) ? 0 : 1;
+}
+
+sentry_filewriter_t *
+sentry__path_open_writer(const sentry_path_t *path)
+{
+    sentry_filewriter_t *writer = SENTRY_MAKE(sentry_filewriter_t);
+    if (!writer) {
+        return NULL;
+    }
+    writer->handle = CreateFileW(path->path, GENERIC_WRITE,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+        OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (writer->handle == INVALID_HANDLE_VALUE) {
+        sentry_free(writer);
+        return NULL;
+    }
+    LARGE_INTEGER zero;
+    zero.QuadPart = 0;
+    SetFilePointerEx(writer->handle, zero, NULL, FILE_END);
+    return writer;
+}
+
+int
+sentry__filewriter_write(
+    sentry_filewriter_t *writer, const char *buf, size_t buf_len)
+{
+    while (buf_len > 0) {
+        DWORD written = 0;
+        DWORD to_write = buf_len > MAXDWORD ? MAXDWORD : (DWORD)buf_len;
+        if (!WriteFile(writer->handle, buf, to_write, &written, NULL)
+            || !written) {
+            return 1;
+        }
+        buf += written;
+        buf_len -= written;
+    }
+    return 0;
+}
+
+int
+sentry__filewriter_sync(sentry_filewriter_t *writer)
+{
+    return FlushFileBuffers(writer->handle) ? 0 : 1;
+}
+
+int
+sentry__filewriter_truncate(sentry_filewriter_t *writer)
+{
+    LARGE_INTEGER zero;
+    zero.QuadPart = 0;
+    return SetFilePointerEx(writer->handle, zero, NULL, FILE_BEGIN)
+            && SetEndOfFile(writer->handle)
+        ? 0
+        : 1;
+}
+
+void
+sentry__filewriter_free(sentry_filewriter_t *writer)
+{
+    if (!writer) {
+        return;
+    }
+    CloseHandle(writer->handle);
+    sentry_free(writer);
 }
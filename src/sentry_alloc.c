@@ -25,8 +25,10 @@ void
 sentry_free(void *ptr)
 {
 #ifdef WITH_PAGE_ALLOCATOR
-    /* page allocator can't free */
+    /* memory that was allocated by `malloc` is leaked once the page allocator
+       is enabled */
     if (sentry__page_allocator_enabled()) {
+        sentry__page_allocator_free(ptr);
         return;
     }
 #endif
@@ -28,6 +28,9 @@ typedef struct sentry_backend_s {
     uint64_t (*get_last_crash_func)(struct sentry_backend_s *);
     void *data;
     bool can_capture_after_shutdown;
+    // The backend has no hook to flush the scope when crashing, so every
+    // modification has to be flushed right away.
+    bool needs_synchronous_scope_flush;
 } sentry_backend_t;
 
 /**
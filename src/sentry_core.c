@@ -15,16 +15,23 @@
 #include "sentry_scope.h"
 #include "sentry_session.h"
 #include "sentry_string.h"
+#include "sentry_symbolizer.h"
 #include "sentry_sync.h"
 #include "sentry_transport.h"
 #include "sentry_value.h"
 
+#ifdef SENTRY_PLATFORM_LINUX
+#    include "modulefinder/sentry_modulefinder_linux.h"
+#endif
+
 #ifdef SENTRY_INTEGRATION_QT
 #    include "integrations/sentry_integration_qt.h"
 #endif
 
 static sentry_options_t *g_options = NULL;
 static sentry_mutex_t g_options_lock = SENTRY__MUTEX_INIT;
+static sentry_bgworker_t *g_module_prefetcher = NULL;
+static sentry_mutex_t g_module_prefetcher_lock = SENTRY__MUTEX_INIT;
 
 const sentry_options_t *
 sentry__options_getref(void)
@@ -69,6 +76,53 @@ sentry__should_skip_upload(void)
     return skip;
 }
 
+static void
+prefetch_modules_task(void *UNUSED(task_data), void *UNUSED(state))
+{
+    SENTRY_TRACE("prefetching modules");
+#ifdef SENTRY_PLATFORM_LINUX
+    sentry__modulefinder_prefetch();
+#else
+    // the list is cached, so this is all it takes to warm it up
+    sentry_value_decref(sentry_get_modules_list());
+#endif
+}
+
+static void
+module_prefetcher_start(void)
+{
+    sentry_bgworker_t *bgw = sentry__bgworker_new(NULL, NULL);
+    if (!bgw) {
+        return;
+    }
+    sentry__bgworker_setname(bgw, "sentry-modules");
+    // the task is queued up front, and picked up once the thread runs
+    if (sentry__bgworker_submit(bgw, prefetch_modules_task, NULL, NULL) != 0
+        || sentry__bgworker_start(bgw) != 0) {
+        SENTRY_WARN("failed to start module prefetcher");
+        sentry__bgworker_decref(bgw);
+        return;
+    }
+
+    sentry__mutex_lock(&g_module_prefetcher_lock);
+    g_module_prefetcher = bgw;
+    sentry__mutex_unlock(&g_module_prefetcher_lock);
+}
+
+static void
+module_prefetcher_shutdown(void)
+{
+    sentry__mutex_lock(&g_module_prefetcher_lock);
+    sentry_bgworker_t *bgw = g_module_prefetcher;
+    g_module_prefetcher = NULL;
+    sentry__mutex_unlock(&g_module_prefetcher_lock);
+
+    if (bgw) {
+        sentry__bgworker_shutdown(bgw, SENTRY_DEFAULT_SHUTDOWN_TIMEOUT);
+        sentry__bgworker_decref(bgw);
+    }
+}
+
 int
 sentry_init(sentry_options_t *options)
 {
@@ -100,6 +154,10 @@ sentry_init(sentry_options_t *options)
     SENTRY_DEBUGF("using database path \"%" SENTRY_PATH_PRI "\"",
         options->database_path->path);
 
+    // with `SENTRY_DURABILITY_CRASH`, writes only become durable once
+    // crashing, see `sentry__write_crash_marker`
+    sentry__path_set_durable(options->durability == SENTRY_DURABILITY_ALWAYS);
+
     // try to create and lock our run folder as early as possibly, since it is
     // fallible. since it does locking, it will not interfere with run folder
     // enumeration.
@@ -108,9 +166,22 @@ sentry_init(sentry_options_t *options)
         SENTRY_WARN("failed to initialize run directory");
         goto fail;
     }
+    if (options->database_log && !sentry__run_open_log(options->run)) {
+        SENTRY_WARN("failed to create database log, using individual files");
+    }
+    if (options->max_database_size || options->max_database_items
+        || options->max_database_age) {
+        sentry__run_set_quota(options->run, options->max_database_size,
+            options->max_database_items, options->max_database_age);
+    }
 
     load_user_consent(options);
 
+#ifdef SENTRY_PLATFORM_LINUX
+    // the backend might already enumerate the modules on startup
+    sentry__modulefinder_set_id_cache_dir(options->database_path);
+#endif
+
     if (!options->dsn || !options->dsn->is_valid) {
         const char *raw_dsn = sentry_options_get_dsn(options);
         SENTRY_WARNF(
@@ -154,14 +225,21 @@ sentry_init(sentry_options_t *options)
         backend->user_consent_changed_func(backend);
     }
 
+    // further scope flushes are coalesced on a background thread
+    sentry__scope_flusher_start(options);
+
+    if (options->prefetch_modules) {
+        module_prefetcher_start();
+    }
+
 #ifdef SENTRY_INTEGRATION_QT
     SENTRY_TRACE("setting up Qt integration");
     sentry_integration_setup_qt();
 #endif
 
     // after initializing the transport, we will submit all the unsent envelopes
-    // and handle remaining sessions.
-    sentry__process_old_runs(options, last_crash);
+    // and handle remaining sessions, in the background.
+    sentry__old_runs_processor_start(options, last_crash);
 
     if (options->auto_session_tracking) {
         sentry_start_session();
@@ -182,6 +260,10 @@ int
 sentry_shutdown(void)
 {
     sentry_end_session();
+    sentry__scope_flusher_shutdown();
+    sentry__session_aggregates_shutdown();
+    module_prefetcher_shutdown();
+    sentry__old_runs_processor_shutdown();
 
     sentry__mutex_lock(&g_options_lock);
     sentry_options_t *options = g_options;
@@ -205,6 +287,9 @@ sentry_shutdown(void)
             dumped_envelopes = sentry__transport_dump_queue(
                 options->transport, options->run);
         }
+        if (dumped_envelopes) {
+            sentry__database_sync(options);
+        }
         if (!dumped_envelopes
             && (!options->backend
                 || !options->backend->can_capture_after_shutdown)) {
@@ -213,9 +298,14 @@ sentry_shutdown(void)
 
         sentry_options_free(options);
     }
+    sentry__path_set_durable(false);
 
     sentry__scope_cleanup();
     sentry_clear_modulecache();
+#ifdef SENTRY_PLATFORM_LINUX
+    sentry__modulefinder_set_id_cache_dir(NULL);
+#endif
+    sentry__symbolizer_cleanup();
     return (int)dumped_envelopes;
 }
 
@@ -364,7 +454,7 @@ sentry__prepare_event(const sentry_options_t *options, sentry_value_t event,
         goto fail;
     }
 
-    SENTRY_WITH_SCOPE (scope) {
+    SENTRY_WITH_CURRENT_SCOPE (scope) {
         SENTRY_TRACE("merging scope into event");
         sentry_scope_mode_t mode = SENTRY_SCOPE_ALL;
         if (!options->symbolize_stacktraces) {
@@ -454,7 +544,7 @@ sentry__ensure_event_id(sentry_value_t event, sentry_uuid_t *uuid_out)
 void
 sentry_set_user(sentry_value_t user)
 {
-    SENTRY_WITH_SCOPE_MUT (scope) {
+    SENTRY_WITH_CURRENT_SCOPE_MUT (scope) {
         sentry_value_decref(scope->user);
         scope->user = user;
         sentry__scope_session_sync(scope);
@@ -481,7 +571,7 @@ sentry_add_breadcrumb(sentry_value_t breadcrumb)
 
     // the `no_flush` will avoid triggering *both* scope-change and
     // breadcrumb-add events.
-    SENTRY_WITH_SCOPE_MUT_NO_FLUSH (scope) {
+    SENTRY_WITH_CURRENT_SCOPE_MUT_NO_FLUSH (scope) {
         sentry__value_append_bounded(
             scope->breadcrumbs, breadcrumb, max_breadcrumbs);
     }
@@ -490,7 +580,7 @@ sentry_add_breadcrumb(sentry_value_t breadcrumb)
 void
 sentry_set_tag(const char *key, const char *value)
 {
-    SENTRY_WITH_SCOPE_MUT (scope) {
+    SENTRY_WITH_CURRENT_SCOPE_MUT (scope) {
         sentry_value_set_by_key(
             scope->tags, key, sentry_value_new_string(value));
     }
@@ -499,7 +589,7 @@ sentry_set_tag(const char *key, const char *value)
 void
 sentry_remove_tag(const char *key)
 {
-    SENTRY_WITH_SCOPE_MUT (scope) {
+    SENTRY_WITH_CURRENT_SCOPE_MUT (scope) {
         sentry_value_remove_by_key(scope->tags, key);
     }
 }
@@ -507,7 +597,7 @@ sentry_remove_tag(const char *key)
 void
 sentry_set_extra(const char *key, sentry_value_t value)
 {
-    SENTRY_WITH_SCOPE_MUT (scope) {
+    SENTRY_WITH_CURRENT_SCOPE_MUT (scope) {
         sentry_value_set_by_key(scope->extra, key, value);
     }
 }
@@ -515,7 +605,7 @@ sentry_set_extra(const char *key, sentry_value_t value)
 void
 sentry_remove_extra(const char *key)
 {
-    SENTRY_WITH_SCOPE_MUT (scope) {
+    SENTRY_WITH_CURRENT_SCOPE_MUT (scope) {
         sentry_value_remove_by_key(scope->extra, key);
     }
 }
@@ -523,7 +613,7 @@ sentry_remove_extra(const char *key)
 void
 sentry_set_context(const char *key, sentry_value_t value)
 {
-    SENTRY_WITH_SCOPE_MUT (scope) {
+    SENTRY_WITH_CURRENT_SCOPE_MUT (scope) {
         sentry_value_set_by_key(scope->contexts, key, value);
     }
 }
@@ -531,7 +621,7 @@ sentry_set_context(const char *key, sentry_value_t value)
 void
 sentry_remove_context(const char *key)
 {
-    SENTRY_WITH_SCOPE_MUT (scope) {
+    SENTRY_WITH_CURRENT_SCOPE_MUT (scope) {
         sentry_value_remove_by_key(scope->contexts, key);
     }
 }
@@ -549,7 +639,7 @@ sentry_set_fingerprint(const char *fingerprint, ...)
     }
     va_end(va);
 
-    SENTRY_WITH_SCOPE_MUT (scope) {
+    SENTRY_WITH_CURRENT_SCOPE_MUT (scope) {
         sentry_value_decref(scope->fingerprint);
         scope->fingerprint = fingerprint_value;
     };
@@ -558,7 +648,7 @@ sentry_set_fingerprint(const char *fingerprint, ...)
 void
 sentry_remove_fingerprint(void)
 {
-    SENTRY_WITH_SCOPE_MUT (scope) {
+    SENTRY_WITH_CURRENT_SCOPE_MUT (scope) {
         sentry_value_decref(scope->fingerprint);
         scope->fingerprint = sentry_value_new_null();
     };
@@ -567,7 +657,7 @@ sentry_remove_fingerprint(void)
 void
 sentry_set_transaction(const char *transaction)
 {
-    SENTRY_WITH_SCOPE_MUT (scope) {
+    SENTRY_WITH_CURRENT_SCOPE_MUT (scope) {
         sentry_free(scope->transaction);
         scope->transaction = sentry__string_clone(transaction);
     }
@@ -582,7 +672,7 @@ sentry_remove_transaction(void)
 void
 sentry_set_level(sentry_level_t level)
 {
-    SENTRY_WITH_SCOPE_MUT (scope) {
+    SENTRY_WITH_CURRENT_SCOPE_MUT (scope) {
         scope->level = level;
     }
 }
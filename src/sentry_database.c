@@ -4,6 +4,8 @@
 #include "sentry_json.h"
 #include "sentry_options.h"
 #include "sentry_session.h"
+#include "sentry_sync.h"
+#include <stdlib.h>
 #include <string.h>
 
 sentry_run_t *
@@ -45,6 +47,7 @@ sentry__run_new(const sentry_path_t *database_path)
         return NULL;
     }
 
+    memset(run, 0, sizeof(sentry_run_t));
     run->uuid = uuid;
     run->run_path = run_path;
     run->session_path = session_path;
@@ -55,12 +58,351 @@ sentry__run_new(const sentry_path_t *database_path)
     }
 
     sentry__path_create_dir_all(run->run_path);
+
+    // `<db>/<uuid>.run/session.bin`
+    sentry_path_t *record_path
+        = sentry__path_join_str(run_path, "session.bin");
+    if (record_path) {
+        run->session_record = sentry__path_map_file(
+            record_path, sizeof(sentry_session_record_t));
+        sentry__path_free(record_path);
+    }
+    if (run->session_record) {
+        sentry_session_record_t *record = run->session_record->ptr;
+        record->magic = SENTRY_SESSION_RECORD_MAGIC;
+        record->version = SENTRY_SESSION_RECORD_VERSION;
+    } else {
+        SENTRY_DEBUG("failed to map session record, using session.json");
+    }
     return run;
 }
 
+// The priority of envelopes in the database, lowest first.
+#define PRIORITY_OTHER 0
+#define PRIORITY_EVENT 1
+#define PRIORITY_CRASH 2
+
+typedef struct {
+    sentry_path_t *path;
+    // the directory of the previous run that the file belongs to
+    sentry_path_t *run_dir;
+    uint64_t log_id;
+    uint64_t size;
+    uint64_t timestamp;
+    int priority;
+} ledger_entry_t;
+
+struct sentry_ledger_s {
+    sentry_mutex_t lock;
+    ledger_entry_t *entries;
+    size_t count;
+    size_t capacity;
+    uint64_t bytes;
+    uint64_t max_bytes;
+    size_t max_items;
+    uint64_t max_age;
+};
+
+static volatile long g_evicted_count = 0;
+
+size_t
+sentry__database_evicted_count(void)
+{
+    return (size_t)sentry__atomic_fetch(&g_evicted_count);
+}
+
+static void
+ledger_free(sentry_ledger_t *ledger)
+{
+    if (!ledger) {
+        return;
+    }
+    for (size_t i = 0; i < ledger->count; i++) {
+        sentry__path_free(ledger->entries[i].path);
+        sentry__path_free(ledger->entries[i].run_dir);
+    }
+    sentry_free(ledger->entries);
+    sentry__mutex_free(&ledger->lock);
+    sentry_free(ledger);
+}
+
+/**
+ * Returns a new entry at the end of the ledger, which is only counted once
+ * the caller has filled it in, and incremented `count`.
+ */
+static ledger_entry_t *
+ledger_reserve(sentry_ledger_t *ledger)
+{
+    if (ledger->count == ledger->capacity) {
+        size_t capacity = ledger->capacity ? ledger->capacity * 2 : 16;
+        ledger_entry_t *entries
+            = sentry_malloc(sizeof(ledger_entry_t) * capacity);
+        if (!entries) {
+            return NULL;
+        }
+        if (ledger->count) {
+            memcpy(entries, ledger->entries,
+                sizeof(ledger_entry_t) * ledger->count);
+        }
+        sentry_free(ledger->entries);
+        ledger->entries = entries;
+        ledger->capacity = capacity;
+    }
+    ledger_entry_t *entry = &ledger->entries[ledger->count];
+    memset(entry, 0, sizeof(ledger_entry_t));
+    return entry;
+}
+
+static void
+ledger_remove(sentry_ledger_t *ledger, size_t index)
+{
+    ledger->bytes -= ledger->entries[index].size;
+    sentry__path_free(ledger->entries[index].path);
+    sentry__path_free(ledger->entries[index].run_dir);
+    ledger->count--;
+    // the entries are kept in the order they were written, oldest first
+    memmove(&ledger->entries[index], &ledger->entries[index + 1],
+        sizeof(ledger_entry_t) * (ledger->count - index));
+}
+
+static void
+ledger_evict(const sentry_run_t *run, size_t index)
+{
+    ledger_entry_t *entry = &run->ledger->entries[index];
+    SENTRY_DEBUGF("evicting envelope of %llu bytes from the database",
+        (unsigned long long)entry->size);
+    if (entry->path) {
+        sentry__path_remove(entry->path);
+    } else if (run->log) {
+        sentry__segment_log_remove(run->log, entry->log_id);
+    }
+    ledger_remove(run->ledger, index);
+    sentry__atomic_fetch_and_add(&g_evicted_count, 1);
+}
+
+static bool
+ledger_over_quota(const sentry_ledger_t *ledger)
+{
+    return (ledger->max_items && ledger->count > ledger->max_items)
+        || (ledger->max_bytes && ledger->bytes > ledger->max_bytes);
+}
+
+static void
+ledger_enforce(const sentry_run_t *run)
+{
+    sentry_ledger_t *ledger = run->ledger;
+    uint64_t now = sentry__msec_time();
+    while (ledger->count) {
+        const ledger_entry_t *oldest = &ledger->entries[0];
+        if (ledger->max_age && now > oldest->timestamp
+            && now - oldest->timestamp > ledger->max_age) {
+            ledger_evict(run, 0);
+            continue;
+        }
+        if (!ledger_over_quota(ledger)) {
+            break;
+        }
+        // the first entry with the lowest priority is the oldest one
+        size_t victim = 0;
+        for (size_t i = 1; i < ledger->count; i++) {
+            int priority = ledger->entries[i].priority;
+            if (priority < ledger->entries[victim].priority) {
+                victim = i;
+            }
+        }
+        ledger_evict(run, victim);
+    }
+}
+
+/**
+ * Adds the envelope that was just written to the ledger, and evicts envelopes
+ * until the run is within its quota again.
+ */
+static void
+ledger_add(const sentry_run_t *run, const sentry_path_t *path,
+    uint64_t log_id, size_t size, int priority)
+{
+    sentry_ledger_t *ledger = run->ledger;
+    sentry__mutex_lock(&ledger->lock);
+    // envelopes without an event id share the same file name
+    for (size_t i = 0; path && i < ledger->count; i++) {
+        const sentry_path_t *entry_path = ledger->entries[i].path;
+        if (entry_path && sentry__path_eq(entry_path, path)) {
+            ledger_remove(ledger, i);
+            break;
+        }
+    }
+    ledger_entry_t *entry = ledger_reserve(ledger);
+    if (!entry) {
+        goto done;
+    }
+    entry->path = path ? sentry__path_clone(path) : NULL;
+    entry->log_id = log_id;
+    entry->size = size;
+    entry->timestamp = sentry__msec_time();
+    entry->priority = priority;
+    if (path && !entry->path) {
+        goto done;
+    }
+    ledger->count++;
+    ledger->bytes += size;
+    ledger_enforce(run);
+
+done:
+    sentry__mutex_unlock(&ledger->lock);
+}
+
+/**
+ * Adds a file that a previous run left in the database to the ledger. The
+ * files are not parsed, so envelopes and logs count as events, and minidumps
+ * as crashes.
+ */
+static void
+ledger_add_old_file(sentry_ledger_t *ledger, const sentry_path_t *run_dir,
+    const sentry_path_t *file)
+{
+    int priority;
+    if (sentry__path_ends_with(file, ".dmp")) {
+        priority = PRIORITY_CRASH;
+    } else if (sentry__path_ends_with(file, ".envelope")
+        || sentry__path_filename_matches(file, "run.log")) {
+        priority = PRIORITY_EVENT;
+    } else {
+        return;
+    }
+    ledger_entry_t *entry = ledger_reserve(ledger);
+    if (!entry) {
+        return;
+    }
+    entry->path = sentry__path_clone(file);
+    entry->run_dir = sentry__path_clone(run_dir);
+    if (!entry->path || !entry->run_dir) {
+        sentry__path_free(entry->path);
+        sentry__path_free(entry->run_dir);
+        return;
+    }
+    entry->size = sentry__path_get_size(file);
+    entry->timestamp = sentry__path_get_mtime(file);
+    entry->priority = priority;
+    ledger->count++;
+    ledger->bytes += entry->size;
+}
+
+static int
+compare_ledger_entries(const void *a, const void *b)
+{
+    uint64_t timestamp_a = ((const ledger_entry_t *)a)->timestamp;
+    uint64_t timestamp_b = ((const ledger_entry_t *)b)->timestamp;
+    return timestamp_a < timestamp_b ? -1 : timestamp_a > timestamp_b;
+}
+
+/**
+ * Seeds the ledger with the files of previous runs, so the quota covers the
+ * whole database. Runs that are still locked by another process are skipped.
+ */
+static void
+ledger_seed(const sentry_run_t *run)
+{
+    sentry_path_t *database_path = sentry__path_dir(run->run_path);
+    sentry_pathiter_t *db_iter
+        = database_path ? sentry__path_iter_directory(database_path) : NULL;
+    const sentry_path_t *run_dir;
+    while (db_iter && (run_dir = sentry__pathiter_next(db_iter)) != NULL) {
+        if (!sentry__path_is_dir(run_dir)
+            || !sentry__path_ends_with(run_dir, ".run")
+            || sentry__path_eq(run_dir, run->run_path)) {
+            continue;
+        }
+        sentry_path_t *lockfile = sentry__path_append_str(run_dir, ".lock");
+        sentry_filelock_t *lock
+            = lockfile ? sentry__filelock_new(lockfile) : NULL;
+        if (!lock || !sentry__filelock_try_lock(lock)) {
+            sentry__filelock_free(lock);
+            continue;
+        }
+        sentry__filelock_free(lock);
+
+        sentry_pathiter_t *run_iter = sentry__path_iter_directory(run_dir);
+        const sentry_path_t *file;
+        while ((file = sentry__pathiter_next(run_iter)) != NULL) {
+            ledger_add_old_file(run->ledger, run_dir, file);
+        }
+        sentry__pathiter_free(run_iter);
+    }
+    sentry__pathiter_free(db_iter);
+    sentry__path_free(database_path);
+
+    // the entries are kept oldest first
+    if (run->ledger->count) {
+        qsort(run->ledger->entries, run->ledger->count, sizeof(ledger_entry_t),
+            compare_ledger_entries);
+    }
+}
+
+void
+sentry__run_set_quota(
+    sentry_run_t *run, size_t max_bytes, size_t max_items, uint64_t max_age)
+{
+    bool seed = !run->ledger;
+    if (!run->ledger) {
+        run->ledger = SENTRY_MAKE(sentry_ledger_t);
+        if (!run->ledger) {
+            return;
+        }
+        memset(run->ledger, 0, sizeof(sentry_ledger_t));
+        sentry__mutex_init(&run->ledger->lock);
+    }
+    sentry__mutex_lock(&run->ledger->lock);
+    run->ledger->max_bytes = max_bytes;
+    run->ledger->max_items = max_items;
+    run->ledger->max_age = max_age;
+    if (seed) {
+        ledger_seed(run);
+    }
+    ledger_enforce(run);
+    sentry__mutex_unlock(&run->ledger->lock);
+}
+
+void
+sentry__run_release_quota(const sentry_run_t *run, const sentry_path_t *path)
+{
+    sentry_ledger_t *ledger = run ? run->ledger : NULL;
+    if (!ledger) {
+        return;
+    }
+    sentry__mutex_lock(&ledger->lock);
+    size_t i = ledger->count;
+    while (i--) {
+        const ledger_entry_t *entry = &ledger->entries[i];
+        if ((entry->path && sentry__path_eq(entry->path, path))
+            || (entry->run_dir && sentry__path_eq(entry->run_dir, path))) {
+            ledger_remove(ledger, i);
+        }
+    }
+    sentry__mutex_unlock(&ledger->lock);
+}
+
+bool
+sentry__run_open_log(sentry_run_t *run)
+{
+    sentry_path_t *log_path = sentry__path_join_str(run->run_path, "run.log");
+    if (!log_path) {
+        return false;
+    }
+    sentry__segment_log_free(run->log);
+    run->log = sentry__segment_log_new(log_path);
+    sentry__path_free(log_path);
+    return run->log != NULL;
+}
+
 void
 sentry__run_clean(sentry_run_t *run)
 {
+    // the mapped and open files can not be removed on windows
+    sentry__filemap_free(run->session_record);
+    run->session_record = NULL;
+    sentry__segment_log_free(run->log);
+    run->log = NULL;
     sentry__path_remove_all(run->run_path);
     sentry__filelock_unlock(run->lock);
 }
@@ -73,14 +415,46 @@ sentry__run_free(sentry_run_t *run)
     }
     sentry__path_free(run->run_path);
     sentry__path_free(run->session_path);
+    sentry__filemap_free(run->session_record);
+    sentry__segment_log_free(run->log);
+    ledger_free(run->ledger);
     sentry__filelock_free(run->lock);
     sentry_free(run);
 }
 
+static int
+envelope_priority(const sentry_envelope_t *envelope)
+{
+    sentry_value_t event = sentry_envelope_get_event(envelope);
+    if (sentry_value_is_null(event)) {
+        return PRIORITY_OTHER;
+    }
+    const char *level
+        = sentry_value_as_string(sentry_value_get_by_key(event, "level"));
+    return strcmp(level, "fatal") == 0 ? PRIORITY_CRASH : PRIORITY_EVENT;
+}
+
 bool
 sentry__run_write_envelope(
     const sentry_run_t *run, const sentry_envelope_t *envelope)
 {
+    size_t buf_len = 0;
+    char *buf = sentry_envelope_serialize(envelope, &buf_len);
+    if (!buf) {
+        return false;
+    }
+
+    uint64_t log_id = 0;
+    if (run->log
+        && sentry__segment_log_append(
+            run->log, SENTRY_SEGMENT_RECORD_ENVELOPE, buf, buf_len, &log_id)) {
+        sentry_free(buf);
+        if (run->ledger) {
+            ledger_add(run, NULL, log_id, buf_len, envelope_priority(envelope));
+        }
+        return true;
+    }
+
     // 37 for the uuid, 9 for the `.envelope` suffix
     char envelope_filename[37 + 9];
     sentry_uuid_t event_id = sentry__envelope_get_event_id(envelope);
@@ -90,24 +464,44 @@ sentry__run_write_envelope(
     sentry_path_t *output_path
         = sentry__path_join_str(run->run_path, envelope_filename);
     if (!output_path) {
+        sentry_free(buf);
         return false;
     }
 
-    int rv = sentry_envelope_write_to_path(envelope, output_path);
-    sentry__path_free(output_path);
+    int rv = sentry__path_write_buffer(output_path, buf, buf_len);
+    sentry_free(buf);
 
     if (rv) {
         SENTRY_DEBUG("writing envelope to file failed");
+    } else if (run->ledger) {
+        ledger_add(run, output_path, 0, buf_len, envelope_priority(envelope));
     }
+    sentry__path_free(output_path);
 
-    // the `write_to_path` returns > 0 on failure, but we would like a real bool
+    // the `write_buffer` returns > 0 on failure, but we would like a real bool
     return !rv;
 }
 
 bool
-sentry__run_write_session(
-    const sentry_run_t *run, const sentry_session_t *session)
+sentry__run_write_session(sentry_run_t *run, const sentry_session_t *session)
 {
+    if (run->session_record
+        && sentry__session_to_record(session, run->session_record->ptr)) {
+        // a session that did not fit the record before is superseded now
+        if (run->log && sentry__segment_log_has_session(run->log)) {
+            sentry__segment_log_append(
+                run->log, SENTRY_SEGMENT_RECORD_SESSION_CLEAR, "", 0, NULL);
+        }
+        if (run->has_session_json) {
+            sentry__path_remove(run->session_path);
+            run->has_session_json = false;
+        }
+        return true;
+    }
+    if (run->session_record) {
+        ((sentry_session_record_t *)run->session_record->ptr)->active = 0;
+    }
+
     sentry_jsonwriter_t *jw = sentry__jsonwriter_new_in_memory();
     if (!jw) {
         return false;
@@ -119,117 +513,427 @@ sentry__run_write_session(
         return false;
     }
 
+    if (run->log
+        && sentry__segment_log_append(
+            run->log, SENTRY_SEGMENT_RECORD_SESSION, buf, buf_len, NULL)) {
+        sentry_free(buf);
+        if (run->has_session_json) {
+            sentry__path_remove(run->session_path);
+            run->has_session_json = false;
+        }
+        return true;
+    }
+
     int rv = sentry__path_write_buffer(run->session_path, buf, buf_len);
     sentry_free(buf);
 
     if (rv) {
         SENTRY_DEBUG("writing session to file failed");
+    } else {
+        run->has_session_json = true;
     }
     return !rv;
 }
 
 bool
-sentry__run_clear_session(const sentry_run_t *run)
+sentry__run_clear_session(sentry_run_t *run)
 {
+    if (run->session_record) {
+        ((sentry_session_record_t *)run->session_record->ptr)->active = 0;
+    }
+    if (run->log && sentry__segment_log_has_session(run->log)) {
+        sentry__segment_log_append(
+            run->log, SENTRY_SEGMENT_RECORD_SESSION_CLEAR, "", 0, NULL);
+    }
+    if (!run->has_session_json) {
+        return true;
+    }
     int rv = sentry__path_remove(run->session_path);
+    run->has_session_json = false;
     return !rv;
 }
 
-void
-sentry__process_old_runs(const sentry_options_t *options, uint64_t last_crash)
+static sentry_session_t *
+session_from_record_path(const sentry_path_t *path)
 {
-    sentry_pathiter_t *db_iter
-        = sentry__path_iter_directory(options->database_path);
-    if (!db_iter) {
-        return;
+    size_t buf_len;
+    char *buf = sentry__path_read_to_buffer(path, &buf_len);
+    if (!buf) {
+        return NULL;
     }
-    const sentry_path_t *run_dir;
-    sentry_envelope_t *session_envelope = NULL;
-    size_t session_num = 0;
 
-    while ((run_dir = sentry__pathiter_next(db_iter)) != NULL) {
-        // skip over other files such as the saved consent or the last_crash
-        // timestamp
-        if (!sentry__path_is_dir(run_dir)
-            || !sentry__path_ends_with(run_dir, ".run")) {
-            continue;
-        }
+    sentry_session_t *rv = sentry__session_from_record(buf, buf_len);
+    sentry_free(buf);
+    return rv;
+}
 
-        sentry_path_t *lockfile = sentry__path_append_str(run_dir, ".lock");
-        if (!lockfile) {
-            continue;
+// Envelopes of previous runs are submitted at most this often (in ms), so a
+// backlog, for example after a crash loop, does not flood the transport.
+#define OLD_RUNS_SEND_INTERVAL 50
+
+// Temporary files directly in the database are removed once they are older
+// than this (in ms), as they might still be written by another process.
+#define STALE_TMP_AGE (60 * 1000)
+
+typedef struct {
+    sentry_options_t *options;
+    uint64_t last_crash;
+    sentry_mutex_t lock;
+    sentry_cond_t signal;
+    bool flush_now;
+    bool stopped;
+} old_runs_state_t;
+
+static sentry_bgworker_t *g_old_runs_worker = NULL;
+static sentry_mutex_t g_old_runs_worker_lock = SENTRY__MUTEX_INIT;
+
+/**
+ * Sends the envelopes and sessions of previous runs, which is shared between
+ * the background worker, and the synchronous fallback when there is none.
+ */
+typedef struct {
+    const sentry_options_t *options;
+    uint64_t last_crash;
+    sentry_envelope_t *session_envelope;
+    size_t session_num;
+    old_runs_state_t *pacing;
+    bool sent_envelope;
+    bool stopped;
+    sentry_session_t *log_session;
+} old_runs_processor_t;
+
+/**
+ * Waits between two envelopes, unless the worker is asked to shut down, in
+ * which case the remaining envelopes are sent right away.
+ */
+static void
+pace_old_run_envelope(old_runs_processor_t *processor)
+{
+    old_runs_state_t *state = processor->pacing;
+    if (!state) {
+        return;
+    }
+    if (processor->sent_envelope) {
+        sentry__mutex_lock(&state->lock);
+        if (!state->flush_now) {
+            sentry__cond_wait_timeout(
+                &state->signal, &state->lock, OLD_RUNS_SEND_INTERVAL);
         }
-        sentry_filelock_t *lock = sentry__filelock_new(lockfile);
-        if (!lock) {
-            continue;
+        sentry__mutex_unlock(&state->lock);
+    }
+    processor->sent_envelope = true;
+}
+
+/**
+ * Submits an envelope of a previous run to the transport. Once the worker is
+ * stopped, the transport might already be shut down, so the envelope is
+ * dropped instead, and the processor stops, leaving the remaining runs on
+ * disk. Returns `false` in that case.
+ */
+static bool
+capture_old_run_envelope(
+    old_runs_processor_t *processor, sentry_envelope_t *envelope)
+{
+    pace_old_run_envelope(processor);
+    old_runs_state_t *state = processor->pacing;
+    if (state) {
+        // the lock makes the worker shutdown wait for this submission
+        sentry__mutex_lock(&state->lock);
+        processor->stopped = state->stopped;
+    }
+    if (processor->stopped) {
+        sentry_envelope_free(envelope);
+    } else {
+        sentry__capture_envelope(processor->options->transport, envelope);
+    }
+    if (state) {
+        sentry__mutex_unlock(&state->lock);
+    }
+    return !processor->stopped;
+}
+
+static bool
+flush_old_sessions(old_runs_processor_t *processor)
+{
+    sentry_envelope_t *envelope = processor->session_envelope;
+    processor->session_envelope = NULL;
+    processor->session_num = 0;
+    return !envelope || capture_old_run_envelope(processor, envelope);
+}
+
+static void
+add_old_session(old_runs_processor_t *processor, sentry_session_t *session)
+{
+    // inactive session records do not yield a session, so only create the
+    // envelope once there is one to send
+    if (!processor->session_envelope) {
+        processor->session_envelope = sentry__envelope_new();
+    }
+    // this is just a heuristic: whenever the session was not closed properly,
+    // and we do have a crash that happened *after* the session was started, we
+    // will assume that the crash corresponds to the session and flag it as
+    // crashed. this should only happen when using crashpad, or the
+    // preallocated crash path of inproc, and there should normally be only a
+    // single unclosed session at a time.
+    if (session->status == SENTRY_SESSION_STATUS_OK) {
+        uint64_t last_crash = processor->last_crash;
+        bool was_crash = last_crash && last_crash >= session->started_ms;
+        if (was_crash) {
+            session->duration_ms = last_crash - session->started_ms;
+            session->errors += 1;
+            // we only set at most one unclosed session as crashed
+            processor->last_crash = 0;
         }
-        bool did_lock = sentry__filelock_try_lock(lock);
-        // the file is locked by another process
-        if (!did_lock) {
-            sentry__filelock_free(lock);
-            continue;
+        session->status = was_crash ? SENTRY_SESSION_STATUS_CRASHED
+                                    : SENTRY_SESSION_STATUS_ABNORMAL;
+    }
+    sentry__envelope_add_session(processor->session_envelope, session);
+
+    sentry__session_free(session);
+    if ((++processor->session_num) >= SENTRY_MAX_ENVELOPE_ITEMS) {
+        flush_old_sessions(processor);
+    }
+}
+
+/**
+ * Envelopes of previous runs that exceed the age limit of the database are
+ * dropped instead of being sent.
+ */
+static bool
+is_expired(const old_runs_processor_t *processor, uint64_t timestamp)
+{
+    uint64_t max_age = processor->options->max_database_age;
+    uint64_t now = sentry__msec_time();
+    if (!max_age || !timestamp || now <= timestamp
+        || now - timestamp <= max_age) {
+        return false;
+    }
+    SENTRY_DEBUG("dropping envelope of previous run exceeding the age limit");
+    sentry__atomic_fetch_and_add(&g_evicted_count, 1);
+    return true;
+}
+
+static void
+process_old_log_record(sentry_segment_record_type_t type, const char *buf,
+    size_t buf_len, uint64_t timestamp, void *data)
+{
+    old_runs_processor_t *processor = data;
+    if (processor->stopped) {
+        return;
+    }
+    switch (type) {
+    case SENTRY_SEGMENT_RECORD_ENVELOPE: {
+        if (is_expired(processor, timestamp)) {
+            break;
         }
-        sentry_pathiter_t *run_iter = sentry__path_iter_directory(run_dir);
-        const sentry_path_t *file;
-        while ((file = sentry__pathiter_next(run_iter)) != NULL) {
-            if (sentry__path_filename_matches(file, "session.json")) {
-                if (!session_envelope) {
-                    session_envelope = sentry__envelope_new();
-                }
-                sentry_session_t *session = sentry__session_from_path(file);
-                if (session) {
-                    // this is just a heuristic: whenever the session was not
-                    // closed properly, and we do have a crash that happened
-                    // *after* the session was started, we will assume that the
-                    // crash corresponds to the session and flag it as crashed.
-                    // this should only happen when using crashpad, and there
-                    // should normally be only a single unclosed session at a
-                    // time.
-                    if (session->status == SENTRY_SESSION_STATUS_OK) {
-                        bool was_crash
-                            = last_crash && last_crash > session->started_ms;
-                        if (was_crash) {
-                            session->duration_ms
-                                = last_crash - session->started_ms;
-                            session->errors += 1;
-                            // we only set at most one unclosed session as
-                            // crashed
-                            last_crash = 0;
-                        }
-                        session->status = was_crash
-                            ? SENTRY_SESSION_STATUS_CRASHED
-                            : SENTRY_SESSION_STATUS_ABNORMAL;
-                    }
-                    sentry__envelope_add_session(session_envelope, session);
-
-                    sentry__session_free(session);
-                    if ((++session_num) >= SENTRY_MAX_ENVELOPE_ITEMS) {
-                        sentry__capture_envelope(
-                            options->transport, session_envelope);
-                        session_envelope = NULL;
-                        session_num = 0;
-                    }
-                }
-            } else if (sentry__path_ends_with(file, ".envelope")) {
-                sentry_envelope_t *envelope = sentry__envelope_from_path(file);
-                sentry__capture_envelope(options->transport, envelope);
-            }
+        capture_old_run_envelope(
+            processor, sentry__envelope_from_buffer(buf, buf_len));
+        break;
+    }
+    case SENTRY_SEGMENT_RECORD_SESSION:
+        // only the last session of the log counts
+        sentry__session_free(processor->log_session);
+        processor->log_session = sentry__session_from_json(buf, buf_len);
+        break;
+    case SENTRY_SEGMENT_RECORD_SESSION_CLEAR:
+        sentry__session_free(processor->log_session);
+        processor->log_session = NULL;
+        break;
+    case SENTRY_SEGMENT_RECORD_REMOVED:
+        // removed records are skipped by the reader
+        break;
+    }
+}
 
+static void
+process_old_run(old_runs_processor_t *processor, const sentry_path_t *run_dir)
+{
+    sentry_path_t *lockfile = sentry__path_append_str(run_dir, ".lock");
+    if (!lockfile) {
+        return;
+    }
+    sentry_filelock_t *lock = sentry__filelock_new(lockfile);
+    if (!lock) {
+        return;
+    }
+    bool did_lock = sentry__filelock_try_lock(lock);
+    // the file is locked by another process
+    if (!did_lock) {
+        sentry__filelock_free(lock);
+        return;
+    }
+    // only envelope files are removed once they are submitted. the sessions
+    // and the segment log are removed along with the run, once its sessions
+    // are submitted as well, so a stopped processor leaves them on disk.
+    sentry_pathiter_t *run_iter = sentry__path_iter_directory(run_dir);
+    const sentry_path_t *file;
+    while (!processor->stopped
+        && (file = sentry__pathiter_next(run_iter)) != NULL) {
+        bool is_session_json
+            = sentry__path_filename_matches(file, "session.json");
+        if (is_session_json
+            || sentry__path_filename_matches(file, "session.bin")) {
+            sentry_session_t *session = is_session_json
+                ? sentry__session_from_path(file)
+                : session_from_record_path(file);
+            if (session) {
+                add_old_session(processor, session);
+            }
+        } else if (sentry__path_filename_matches(file, "run.log")) {
+            sentry__segment_log_read(file, process_old_log_record, processor);
+            if (processor->log_session) {
+                add_old_session(processor, processor->log_session);
+                processor->log_session = NULL;
+            }
+        } else if (sentry__path_ends_with(file, ".tmp")) {
+            // the temporary file of a write that was interrupted, as the
+            // run is not locked by its writer anymore
             sentry__path_remove(file);
+        } else if (sentry__path_ends_with(file, ".envelope")) {
+            if (is_expired(processor, sentry__path_get_mtime(file))
+                || capture_old_run_envelope(
+                    processor, sentry__envelope_from_path(file))) {
+                sentry__path_remove(file);
+                sentry__run_release_quota(processor->options->run, file);
+            }
         }
-        sentry__pathiter_free(run_iter);
+    }
+    sentry__pathiter_free(run_iter);
 
+    if (!processor->stopped && flush_old_sessions(processor)) {
         sentry__path_remove_all(run_dir);
-        sentry__filelock_free(lock);
+        sentry__run_release_quota(processor->options->run, run_dir);
+    }
+    sentry__filelock_free(lock);
+}
+
+static void
+process_old_runs(old_runs_processor_t *processor)
+{
+    sentry_pathiter_t *db_iter
+        = sentry__path_iter_directory(processor->options->database_path);
+    if (!db_iter) {
+        return;
+    }
+    const sentry_path_t *entry;
+    uint64_t now = sentry__msec_time();
+    // the directory is read incrementally, so the runs are processed one at a
+    // time, without listing all of them up front.
+    while (!processor->stopped
+        && (entry = sentry__pathiter_next(db_iter)) != NULL) {
+        // skip over other files such as the saved consent or the last_crash
+        // timestamp, apart from the stale temporary files of their writes
+        if (sentry__path_is_dir(entry)
+            && sentry__path_ends_with(entry, ".run")) {
+            process_old_run(processor, entry);
+        } else if (sentry__path_ends_with(entry, ".tmp")) {
+            uint64_t mtime = sentry__path_get_mtime(entry);
+            if (mtime && now > mtime && now - mtime > STALE_TMP_AGE) {
+                sentry__path_remove(entry);
+            }
+        }
     }
     sentry__pathiter_free(db_iter);
+}
+
+void
+sentry__process_old_runs(const sentry_options_t *options, uint64_t last_crash)
+{
+    old_runs_processor_t processor
+        = { options, last_crash, NULL, 0, NULL, false, false, NULL };
+    process_old_runs(&processor);
+}
+
+static void
+old_runs_state_free(void *_state)
+{
+    old_runs_state_t *state = _state;
+    sentry_options_free(state->options);
+    sentry__mutex_free(&state->lock);
+    sentry_free(state);
+}
+
+static void
+process_old_runs_task(void *UNUSED(task_data), void *_state)
+{
+    old_runs_state_t *state = _state;
+    old_runs_processor_t processor = { state->options, state->last_crash,
+        NULL, 0, state, false, false, NULL };
+    process_old_runs(&processor);
+}
+
+void
+sentry__old_runs_processor_start(
+    sentry_options_t *options, uint64_t last_crash)
+{
+    old_runs_state_t *state = SENTRY_MAKE(old_runs_state_t);
+    if (!state) {
+        sentry__process_old_runs(options, last_crash);
+        return;
+    }
+    memset(state, 0, sizeof(old_runs_state_t));
+    sentry__mutex_init(&state->lock);
+    sentry__cond_init(&state->signal);
+    // the worker might outlive `sentry_shutdown` when it times out
+    state->options = sentry__options_incref(options);
+    state->last_crash = last_crash;
+
+    sentry_bgworker_t *bgw = sentry__bgworker_new(state, old_runs_state_free);
+    if (!bgw) {
+        sentry__process_old_runs(options, last_crash);
+        return;
+    }
+    sentry__bgworker_setname(bgw, "sentry-db");
+    if (sentry__bgworker_submit(bgw, process_old_runs_task, NULL, NULL) != 0
+        || sentry__bgworker_start(bgw) != 0) {
+        SENTRY_WARN("failed to start worker, processing previous runs "
+                    "synchronously");
+        sentry__bgworker_decref(bgw);
+        sentry__process_old_runs(options, last_crash);
+        return;
+    }
+
+    sentry__mutex_lock(&g_old_runs_worker_lock);
+    g_old_runs_worker = bgw;
+    sentry__mutex_unlock(&g_old_runs_worker_lock);
+}
 
-    sentry__capture_envelope(options->transport, session_envelope);
+void
+sentry__old_runs_processor_shutdown(void)
+{
+    sentry__mutex_lock(&g_old_runs_worker_lock);
+    sentry_bgworker_t *bgw = g_old_runs_worker;
+    g_old_runs_worker = NULL;
+    sentry__mutex_unlock(&g_old_runs_worker_lock);
+
+    if (bgw) {
+        // the remaining envelopes are submitted without any pacing, so they
+        // are sent, or dumped, along with the rest of the transport queue.
+        old_runs_state_t *state = sentry__bgworker_get_state(bgw);
+        sentry__mutex_lock(&state->lock);
+        state->flush_now = true;
+        sentry__cond_wake(&state->signal);
+        sentry__mutex_unlock(&state->lock);
+
+        sentry__bgworker_shutdown(bgw, SENTRY_DEFAULT_SHUTDOWN_TIMEOUT);
+
+        // if the worker timed out, it must not submit anything once the
+        // transport is shut down, and leaves the remaining runs for the next
+        // start instead.
+        sentry__mutex_lock(&state->lock);
+        state->stopped = true;
+        sentry__mutex_unlock(&state->lock);
+        sentry__bgworker_decref(bgw);
+    }
 }
 
 bool
 sentry__write_crash_marker(const sentry_options_t *options)
 {
+    if (options->durability != SENTRY_DURABILITY_NONE) {
+        sentry__path_set_durable(true);
+    }
+
     char *iso_time = sentry__msec_time_to_iso8601(sentry__msec_time());
     if (!iso_time) {
         return false;
@@ -252,3 +956,20 @@ sentry__write_crash_marker(const sentry_options_t *options)
     }
     return !rv;
 }
+
+void
+sentry__database_sync(const sentry_options_t *options)
+{
+    if (!sentry__path_is_durable()) {
+        return;
+    }
+    sentry_run_t *run = options->run;
+    if (run) {
+        if (run->session_record) {
+            sentry__filemap_sync(run->session_record);
+        }
+        sentry__path_sync_dir(run->run_path);
+    }
+    // the crash marker, and the new run directory itself
+    sentry__path_sync_dir(options->database_path);
+}
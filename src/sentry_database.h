@@ -4,12 +4,23 @@
 #include "sentry_boot.h"
 
 #include "sentry_path.h"
+#include "sentry_segment_log.h"
 #include "sentry_session.h"
 
+/**
+ * Tracks the envelopes that a run wrote to the database, for enforcing the
+ * database quota.
+ */
+typedef struct sentry_ledger_s sentry_ledger_t;
+
 typedef struct sentry_run_s {
     sentry_uuid_t uuid;
     sentry_path_t *run_path;
     sentry_path_t *session_path;
+    sentry_filemap_t *session_record;
+    bool has_session_json;
+    sentry_segment_log_t *log;
+    sentry_ledger_t *ledger;
     sentry_filelock_t *lock;
 } sentry_run_t;
 
@@ -18,9 +29,49 @@ typedef struct sentry_run_s {
  * lockfile:
  * * `<database>/<uuid>.run/`
  * * `<database>/<uuid>.run.lock`
+ * It also maps the binary session record at:
+ * * `<database>/<uuid>.run/session.bin`
  */
 sentry_run_t *sentry__run_new(const sentry_path_t *database_path);
 
+/**
+ * Makes the run write its envelopes and sessions as records of a single
+ * segment log at `<database>/<uuid>.run/run.log`, instead of creating a file
+ * for every envelope. Writes fall back to individual files in case appending
+ * to the log fails.
+ */
+bool sentry__run_open_log(sentry_run_t *run);
+
+/**
+ * Limits the envelopes in the database to `max_bytes` and `max_items` in
+ * total, and to an age of `max_age` milliseconds. A limit of 0 means
+ * unlimited.
+ *
+ * The sizes of the envelopes are tracked in a running ledger, so enforcing the
+ * quota does not need to look at the files at all. When the quota is first
+ * set, the ledger is seeded with the envelopes, segment logs and minidumps
+ * that previous runs left in the database, and the quota is enforced right
+ * away. Envelopes older than `max_age` are evicted first, followed by the
+ * lowest-priority, oldest envelopes while any of the other limits is
+ * exceeded. Envelopes with a crash have the highest priority, followed by the
+ * ones with other events.
+ */
+void sentry__run_set_quota(sentry_run_t *run, size_t max_bytes,
+    size_t max_items, uint64_t max_age);
+
+/**
+ * Removes the file or run directory of a previous run at `path` from the
+ * ledger of `run`, once the file has been sent and removed.
+ */
+void sentry__run_release_quota(
+    const sentry_run_t *run, const sentry_path_t *path);
+
+/**
+ * Returns the number of envelopes that were evicted from the database, or
+ * dropped because they exceeded the age limit when processing previous runs.
+ */
+size_t sentry__database_evicted_count(void);
+
 /**
  * This will clean up all the files belonging to this run.
  */
@@ -37,31 +88,40 @@ void sentry__run_free(sentry_run_t *run);
  * This will serialize and write the given envelope to disk into a file named
  * like so:
  * `<database>/<uuid>.run/<event-uuid>.envelope`
+ * or append it to the segment log of the run, if it has one.
  */
 bool sentry__run_write_envelope(
     const sentry_run_t *run, const sentry_envelope_t *envelope);
 
 /**
- * This will serialize and write the given session to disk into a file named:
+ * This will persist the given session to disk.
+ * The session is updated in place in the memory mapped session record
+ * `<database>/<uuid>.run/session.bin`, which does not involve any syscall.
+ * In case the record is not available, or the session does not fit into it,
+ * the session is serialized to a file named:
  * `<database>/<uuid>.run/session.json`
+ * or appended to the segment log of the run, if it has one.
  */
 bool sentry__run_write_session(
-    const sentry_run_t *run, const sentry_session_t *session);
+    sentry_run_t *run, const sentry_session_t *session);
 
 /**
- * This will remove any previously created session file.
+ * This will clear any previously persisted session.
  * See `sentry__run_write_session`.
  */
-bool sentry__run_clear_session(const sentry_run_t *run);
+bool sentry__run_clear_session(sentry_run_t *run);
 
 /**
  * This function is essential to send crash reports from previous runs of the
  * program.
  * More specifically, this function will iterate over all the  directories
  * inside the `database_path`. Directories matching `<database>/<uuid>.run/`
- * will be locked, and any files named  `<event-uuid>.envelope` or
- * `session.json` will be queued for sending to the  backend. The files and
+ * will be locked, and any files named  `<event-uuid>.envelope`, `session.bin`
+ * or `session.json`, as well as the records of a `run.log` segment log, will
+ * be queued for sending to the  backend. The files and
  * directories matching these criteria will be deleted afterwards.
+ * Left-over temporary `*.tmp` files of interrupted writes are removed as well,
+ * directly in the database only once they are older than a minute.
  * The following heuristic is applied to all unclosed sessions: If the session
  * was started before the timestamp given by `last_crash`, the session is closed
  * as "crashed" with an appropriate duration.
@@ -69,10 +129,37 @@ bool sentry__run_clear_session(const sentry_run_t *run);
 void sentry__process_old_runs(
     const sentry_options_t *options, uint64_t last_crash);
 
+/**
+ * Processes the previous runs like `sentry__process_old_runs`, but on a
+ * background worker, so `sentry_init` does not have to wait for it. Envelopes
+ * are submitted to the transport at a paced rate.
+ */
+void sentry__old_runs_processor_start(
+    sentry_options_t *options, uint64_t last_crash);
+
+/**
+ * Submits the remaining envelopes of previous runs without any pacing, and
+ * shuts down the background worker. This has to be called before the
+ * transport is shut down. Runs that are not processed by the time the worker
+ * times out are left on disk for the next start.
+ */
+void sentry__old_runs_processor_shutdown(void);
+
 /**
  * This will write the current ISO8601 formatted timestamp into the
  * `<database>/last_crash` file.
+ * Unless the durability policy is `SENTRY_DURABILITY_NONE`, all the writes
+ * from here on, including the marker itself, are durable.
  */
 bool sentry__write_crash_marker(const sentry_options_t *options);
 
+/**
+ * Makes everything written to the database so far durable, by syncing the
+ * session record and the directories of the run and the database in a single
+ * batch. The files themselves are already synced when they are written.
+ * This does nothing unless writes are currently durable, and is called once
+ * the crash was captured, and on shutdown.
+ */
+void sentry__database_sync(const sentry_options_t *options);
+
 #endif
@@ -72,7 +72,8 @@ envelope_item_get_ratelimiter_category(const sentry_envelope_item_t *item)
 {
     const char *ty = sentry_value_as_string(
         sentry_value_get_by_key(item->headers, "type"));
-    if (sentry__string_eq(ty, "session")) {
+    if (sentry__string_eq(ty, "session")
+        || sentry__string_eq(ty, "sessions")) {
         return SENTRY_RL_CATEGORY_SESSION;
     } else if (sentry__string_eq(ty, "transaction")) {
         return SENTRY_RL_CATEGORY_TRANSACTION;
@@ -155,6 +156,22 @@ sentry__envelope_new(void)
     return rv;
 }
 
+static sentry_envelope_t *
+envelope_from_raw(char *buf, size_t buf_len)
+{
+    sentry_envelope_t *envelope = SENTRY_MAKE(sentry_envelope_t);
+    if (!envelope) {
+        sentry_free(buf);
+        return NULL;
+    }
+
+    envelope->is_raw = true;
+    envelope->contents.raw.payload = buf;
+    envelope->contents.raw.payload_len = buf_len;
+
+    return envelope;
+}
+
 sentry_envelope_t *
 sentry__envelope_from_path(const sentry_path_t *path)
 {
@@ -167,17 +184,19 @@ sentry__envelope_from_path(const sentry_path_t *path)
         return NULL;
     }
 
-    sentry_envelope_t *envelope = SENTRY_MAKE(sentry_envelope_t);
-    if (!envelope) {
-        sentry_free(buf);
+    return envelope_from_raw(buf, buf_len);
+}
+
+sentry_envelope_t *
+sentry__envelope_from_buffer(const char *buf, size_t buf_len)
+{
+    char *copy = sentry_malloc(buf_len + 1);
+    if (!copy) {
         return NULL;
     }
-
-    envelope->is_raw = true;
-    envelope->contents.raw.payload = buf;
-    envelope->contents.raw.payload_len = buf_len;
-
-    return envelope;
+    memcpy(copy, buf, buf_len);
+    copy[buf_len] = '\0';
+    return envelope_from_raw(copy, buf_len);
 }
 
 sentry_uuid_t
@@ -23,6 +23,12 @@ sentry_envelope_t *sentry__envelope_new(void);
  */
 sentry_envelope_t *sentry__envelope_from_path(const sentry_path_t *path);
 
+/**
+ * This creates an envelope from a copy of the previously serialized `buf`.
+ */
+sentry_envelope_t *sentry__envelope_from_buffer(
+    const char *buf, size_t buf_len);
+
 /**
  * This returns the UUID of the event associated with this envelope.
  * If there is no event inside this envelope, or the envelope was previously
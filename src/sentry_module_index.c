@@ -0,0 +1,156 @@
+#include "sentry_module_index.h"
+
+#include "sentry_alloc.h"
+#include "sentry_sync.h"
+#include "sentry_value.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct sentry_module_index_s {
+    sentry_value_t modules;
+    sentry_module_range_t *ranges;
+    size_t count;
+    long refcount;
+    long retired_epoch;
+};
+
+/**
+ * The index is published in the same way as scope snapshots, via
+ * `sentry_published_t`. Waiting for the readers of a replaced index is left to
+ * `sentry__module_index_retire`, so the modulefinder does not need to hold its
+ * lock while doing so.
+ */
+static sentry_published_t g_index = SENTRY__PUBLISHED_INIT;
+
+static int
+compare_ranges(const void *a, const void *b)
+{
+    const sentry_module_range_t *range_a = a;
+    const sentry_module_range_t *range_b = b;
+    return range_a->start < range_b->start ? -1
+                                           : range_a->start > range_b->start;
+}
+
+static const char *
+get_string(sentry_value_t module, const char *key)
+{
+    sentry_value_t value = sentry_value_get_by_key(module, key);
+    return sentry_value_get_type(value) == SENTRY_VALUE_TYPE_STRING
+        ? sentry_value_as_string(value)
+        : NULL;
+}
+
+static sentry_module_index_t *
+index_new(sentry_value_t modules)
+{
+    size_t len = sentry_value_get_length(modules);
+    sentry_module_index_t *index = SENTRY_MAKE(sentry_module_index_t);
+    if (!index) {
+        return NULL;
+    }
+    memset(index, 0, sizeof(sentry_module_index_t));
+    index->refcount = 1;
+    index->ranges = sentry_malloc(sizeof(sentry_module_range_t) * (len + 1));
+    if (!index->ranges) {
+        sentry_free(index);
+        return NULL;
+    }
+    sentry_value_incref(modules);
+    index->modules = modules;
+
+    for (size_t i = 0; i < len; i++) {
+        sentry_value_t module = sentry_value_get_by_index(modules, i);
+        const char *image_addr = get_string(module, "image_addr");
+        int32_t image_size = sentry_value_as_int32(
+            sentry_value_get_by_key(module, "image_size"));
+        if (!image_addr || image_size <= 0) {
+            continue;
+        }
+        sentry_module_range_t *range = &index->ranges[index->count++];
+        range->start = (uintptr_t)strtoull(image_addr, NULL, 0);
+        range->end = range->start + (uintptr_t)image_size;
+        range->code_file = get_string(module, "code_file");
+        range->code_id = get_string(module, "code_id");
+    }
+    qsort(index->ranges, index->count, sizeof(sentry_module_range_t),
+        compare_ranges);
+    return index;
+}
+
+void
+sentry__module_index_release(sentry_module_index_t *index)
+{
+    if (!index || sentry__atomic_fetch_and_add(&index->refcount, -1) != 1) {
+        return;
+    }
+#ifdef SENTRY_PLATFORM_UNIX
+    // freeing is not async-signal-safe, so an index that is released last by
+    // a signal handler is leaked instead.
+    if (!sentry__block_for_signal_handler()) {
+        return;
+    }
+#endif
+    sentry_value_decref(index->modules);
+    sentry_free(index->ranges);
+    sentry_free(index);
+}
+
+static void
+index_incref(void *ptr)
+{
+    sentry_module_index_t *index = ptr;
+    sentry__atomic_fetch_and_add(&index->refcount, 1);
+}
+
+sentry_module_index_t *
+sentry__module_index_acquire(void)
+{
+    return sentry__published_acquire(&g_index, index_incref);
+}
+
+sentry_module_index_t *
+sentry__module_index_publish(sentry_value_t modules)
+{
+    sentry_module_index_t *index
+        = sentry_value_is_null(modules) ? NULL : index_new(modules);
+    long epoch;
+    sentry_module_index_t *previous
+        = sentry__published_exchange(&g_index, index, &epoch);
+    if (previous) {
+        previous->retired_epoch = epoch;
+    }
+    return previous;
+}
+
+void
+sentry__module_index_retire(sentry_module_index_t *index)
+{
+    if (!index) {
+        return;
+    }
+    sentry__published_wait(&g_index, index->retired_epoch);
+    sentry__module_index_release(index);
+}
+
+const sentry_module_range_t *
+sentry__module_index_find(const sentry_module_index_t *index, uintptr_t addr)
+{
+    if (!index) {
+        return NULL;
+    }
+    size_t lo = 0;
+    size_t hi = index->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (index->ranges[mid].start <= addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (!lo || addr >= index->ranges[lo - 1].end) {
+        return NULL;
+    }
+    return &index->ranges[lo - 1];
+}
@@ -0,0 +1,60 @@
+#ifndef SENTRY_MODULE_INDEX_H_INCLUDED
+#define SENTRY_MODULE_INDEX_H_INCLUDED
+
+#include "sentry_boot.h"
+
+/**
+ * The address range of a loaded module. The strings point into the module
+ * list the index was built from, and are valid as long as the index is.
+ * `code_id` is `NULL` for modules without one.
+ */
+typedef struct {
+    uintptr_t start;
+    uintptr_t end;
+    const char *code_file;
+    const char *code_id;
+} sentry_module_range_t;
+
+/**
+ * A sorted index over the address ranges of the cached module list, which
+ * answers "which module is this address in" with a binary search.
+ *
+ * The modulefinder publishes a new index whenever its module list changes.
+ * Readers acquire the published index without taking any lock, so this can
+ * also be used from within a signal handler.
+ */
+typedef struct sentry_module_index_s sentry_module_index_t;
+
+/**
+ * Builds an index over the frozen `modules` list, as returned by
+ * `sentry_get_modules_list`, and publishes it. A `null` list clears the
+ * published index. This must only be called by the modulefinder, while
+ * holding its lock.
+ *
+ * Returns the previous index, which needs to be passed to
+ * `sentry__module_index_retire` after the lock is released.
+ */
+sentry_module_index_t *sentry__module_index_publish(sentry_value_t modules);
+
+/**
+ * Waits for the readers that might still be acquiring the replaced `index`,
+ * and drops the reference that was published.
+ */
+void sentry__module_index_retire(sentry_module_index_t *index);
+
+/**
+ * Acquires a reference to the published index, which needs to be released
+ * with `sentry__module_index_release`. Returns `NULL` if the modules have not
+ * been loaded yet.
+ */
+sentry_module_index_t *sentry__module_index_acquire(void);
+
+void sentry__module_index_release(sentry_module_index_t *index);
+
+/**
+ * Returns the module that contains `addr`, or `NULL`.
+ */
+const sentry_module_range_t *sentry__module_index_find(
+    const sentry_module_index_t *index, uintptr_t addr);
+
+#endif
@@ -34,7 +34,12 @@ sentry_options_new(void)
     opts->environment = sentry__string_clone(getenv("SENTRY_ENVIRONMENT"));
 #endif
     opts->max_breadcrumbs = SENTRY_BREADCRUMBS_MAX;
+    opts->scope_flush_interval = SENTRY_DEFAULT_SCOPE_FLUSH_INTERVAL;
+    opts->crash_memory_reserve = SENTRY_DEFAULT_CRASH_MEMORY_RESERVE;
+    opts->request_session_flush_interval
+        = SENTRY_DEFAULT_REQUEST_SESSION_FLUSH_INTERVAL;
     opts->user_consent = SENTRY_USER_CONSENT_UNKNOWN;
+    opts->durability = SENTRY_DURABILITY_CRASH;
     opts->auto_session_tracking = true;
     opts->system_crash_reporter_enabled = false;
     opts->symbolize_stacktraces =
@@ -91,6 +96,14 @@ sentry_options_free(sentry_options_t *opts)
 
         sentry__attachment_free(attachment);
     }
+    sentry_debug_image_t *next_image = opts->debug_images;
+    while (next_image) {
+        sentry_debug_image_t *image = next_image;
+        next_image = image->next;
+
+        sentry_free(image->name);
+        sentry_free(image);
+    }
     sentry__run_free(opts->run);
 
     sentry_free(opts);
@@ -246,6 +259,44 @@ sentry_options_get_max_breadcrumbs(const sentry_options_t *opts)
     return opts->max_breadcrumbs;
 }
 
+void
+sentry_options_set_scope_flush_interval(
+    sentry_options_t *opts, uint64_t interval_ms)
+{
+    opts->scope_flush_interval = interval_ms;
+}
+
+uint64_t
+sentry_options_get_scope_flush_interval(const sentry_options_t *opts)
+{
+    return opts->scope_flush_interval;
+}
+
+void
+sentry_options_set_crash_memory_reserve(sentry_options_t *opts, size_t bytes)
+{
+    opts->crash_memory_reserve = bytes;
+}
+
+size_t
+sentry_options_get_crash_memory_reserve(const sentry_options_t *opts)
+{
+    return opts->crash_memory_reserve;
+}
+
+void
+sentry_options_set_request_session_flush_interval(
+    sentry_options_t *opts, uint64_t interval_ms)
+{
+    opts->request_session_flush_interval = interval_ms;
+}
+
+uint64_t
+sentry_options_get_request_session_flush_interval(const sentry_options_t *opts)
+{
+    return opts->request_session_flush_interval;
+}
+
 void
 sentry_options_set_logger(
     sentry_options_t *opts, sentry_logger_function_t func, void *userdata)
@@ -290,6 +341,54 @@ sentry_options_get_symbolize_stacktraces(const sentry_options_t *opts)
     return opts->symbolize_stacktraces;
 }
 
+void
+sentry_options_set_offload_crash_handling(sentry_options_t *opts, int val)
+{
+    opts->offload_crash_handling = !!val;
+}
+
+int
+sentry_options_get_offload_crash_handling(const sentry_options_t *opts)
+{
+    return opts->offload_crash_handling;
+}
+
+void
+sentry_options_set_capture_all_threads(sentry_options_t *opts, int val)
+{
+    opts->capture_all_threads = !!val;
+}
+
+int
+sentry_options_get_capture_all_threads(const sentry_options_t *opts)
+{
+    return opts->capture_all_threads;
+}
+
+void
+sentry_options_set_capture_minidump(sentry_options_t *opts, int val)
+{
+    opts->capture_minidump = !!val;
+}
+
+int
+sentry_options_get_capture_minidump(const sentry_options_t *opts)
+{
+    return opts->capture_minidump;
+}
+
+void
+sentry_options_set_stack_capture_size(sentry_options_t *opts, size_t bytes)
+{
+    opts->stack_capture_size = bytes;
+}
+
+size_t
+sentry_options_get_stack_capture_size(const sentry_options_t *opts)
+{
+    return opts->stack_capture_size;
+}
+
 void
 sentry_options_set_system_crash_reporter_enabled(
     sentry_options_t *opts, int enabled)
@@ -297,6 +396,111 @@ sentry_options_set_system_crash_reporter_enabled(
     opts->system_crash_reporter_enabled = !!enabled;
 }
 
+void
+sentry_options_set_referenced_images_only(sentry_options_t *opts, int val)
+{
+    opts->referenced_images_only = !!val;
+}
+
+int
+sentry_options_get_referenced_images_only(const sentry_options_t *opts)
+{
+    return opts->referenced_images_only;
+}
+
+void
+sentry_options_add_debug_image(sentry_options_t *opts, const char *name)
+{
+    if (!name || !*name) {
+        return;
+    }
+    sentry_debug_image_t *image = SENTRY_MAKE(sentry_debug_image_t);
+    if (!image) {
+        return;
+    }
+    image->name = sentry__string_clone(name);
+    if (!image->name) {
+        sentry_free(image);
+        return;
+    }
+    image->next = opts->debug_images;
+    opts->debug_images = image;
+}
+
+void
+sentry_options_set_prefetch_modules(sentry_options_t *opts, int val)
+{
+    opts->prefetch_modules = !!val;
+}
+
+int
+sentry_options_get_prefetch_modules(const sentry_options_t *opts)
+{
+    return opts->prefetch_modules;
+}
+
+void
+sentry_options_set_database_log(sentry_options_t *opts, int val)
+{
+    opts->database_log = !!val;
+}
+
+int
+sentry_options_get_database_log(const sentry_options_t *opts)
+{
+    return opts->database_log;
+}
+
+void
+sentry_options_set_max_database_size(sentry_options_t *opts, size_t max_bytes)
+{
+    opts->max_database_size = max_bytes;
+}
+
+size_t
+sentry_options_get_max_database_size(const sentry_options_t *opts)
+{
+    return opts->max_database_size;
+}
+
+void
+sentry_options_set_max_database_items(
+    sentry_options_t *opts, size_t max_items)
+{
+    opts->max_database_items = max_items;
+}
+
+size_t
+sentry_options_get_max_database_items(const sentry_options_t *opts)
+{
+    return opts->max_database_items;
+}
+
+void
+sentry_options_set_max_database_age(sentry_options_t *opts, uint64_t max_age_ms)
+{
+    opts->max_database_age = max_age_ms;
+}
+
+uint64_t
+sentry_options_get_max_database_age(const sentry_options_t *opts)
+{
+    return opts->max_database_age;
+}
+
+void
+sentry_options_set_durability(
+    sentry_options_t *opts, sentry_durability_t durability)
+{
+    opts->durability = durability;
+}
+
+sentry_durability_t
+sentry_options_get_durability(const sentry_options_t *opts)
+{
+    return opts->durability;
+}
+
 static void
 add_attachment(sentry_options_t *opts, sentry_path_t *path)
 {
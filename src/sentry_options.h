@@ -10,6 +10,15 @@
 // https://docs.sentry.io/error-reporting/configuration/?platform=native#shutdown-timeout
 #define SENTRY_DEFAULT_SHUTDOWN_TIMEOUT 2000
 
+// Scope modifications within this interval (in ms) are flushed all at once.
+#define SENTRY_DEFAULT_SCOPE_FLUSH_INTERVAL 100
+
+// Request session aggregates are bucketed by the minute, so flush as often.
+#define SENTRY_DEFAULT_REQUEST_SESSION_FLUSH_INTERVAL 60000
+
+// Memory (in bytes) reserved for allocations inside of crash handlers.
+#define SENTRY_DEFAULT_CRASH_MEMORY_RESERVE (1024 * 1024)
+
 typedef struct sentry_path_s sentry_path_t;
 typedef struct sentry_run_s sentry_run_t;
 struct sentry_backend_s;
@@ -24,6 +33,16 @@ struct sentry_attachment_s {
     sentry_attachment_t *next;
 };
 
+/**
+ * This is a linked list of all the module file names registered via
+ * `sentry_options_add_debug_image`.
+ */
+typedef struct sentry_debug_image_s sentry_debug_image_t;
+struct sentry_debug_image_s {
+    char *name;
+    sentry_debug_image_t *next;
+};
+
 /**
  * This is the main options struct, which is being accessed throughout all of
  * the sentry internals.
@@ -41,13 +60,28 @@ typedef struct sentry_options_s {
     sentry_path_t *handler_path;
     sentry_logger_t logger;
     size_t max_breadcrumbs;
+    uint64_t scope_flush_interval;
+    uint64_t request_session_flush_interval;
+    size_t crash_memory_reserve;
+    size_t stack_capture_size;
+    size_t max_database_size;
+    size_t max_database_items;
+    uint64_t max_database_age;
+    sentry_durability_t durability;
     bool debug;
     bool auto_session_tracking;
     bool require_user_consent;
     bool symbolize_stacktraces;
+    bool offload_crash_handling;
+    bool capture_all_threads;
+    bool capture_minidump;
     bool system_crash_reporter_enabled;
+    bool referenced_images_only;
+    bool prefetch_modules;
+    bool database_log;
 
     sentry_attachment_t *attachments;
+    sentry_debug_image_t *debug_images;
     sentry_run_t *run;
 
     sentry_transport_t *transport;
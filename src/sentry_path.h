@@ -23,9 +23,16 @@ struct sentry_filelock_s {
     bool is_locked;
 };
 
+struct sentry_filemap_s {
+    void *ptr;
+    size_t size;
+};
+
 typedef struct sentry_path_s sentry_path_t;
 typedef struct sentry_pathiter_s sentry_pathiter_t;
 typedef struct sentry_filelock_s sentry_filelock_t;
+typedef struct sentry_filemap_s sentry_filemap_t;
+typedef struct sentry_filewriter_s sentry_filewriter_t;
 
 /**
  * NOTE on encodings:
@@ -90,6 +97,11 @@ void sentry__path_free(sentry_path_t *path);
  */
 const sentry_pathchar_t *sentry__path_filename(const sentry_path_t *path);
 
+/**
+ * Returns whether both paths are the same, without resolving them.
+ */
+bool sentry__path_eq(const sentry_path_t *a, const sentry_path_t *b);
+
 /**
  * Returns whether the last path segment matches `filename`.
  */
@@ -125,6 +137,40 @@ int sentry__path_remove(const sentry_path_t *path);
  */
 int sentry__path_remove_all(const sentry_path_t *path);
 
+/**
+ * Renames the file at `src` to `dst`, replacing any existing file at `dst`.
+ * Returns 0 on success.
+ */
+int sentry__path_rename(const sentry_path_t *src, const sentry_path_t *dst);
+
+/**
+ * Returns a path for a temporary file next to `path`, with a `.tmp` suffix.
+ * The name contains the id of the calling process and a process-wide counter,
+ * so concurrent writers of the same file, within one process or across
+ * processes, never share their temporary file.
+ */
+sentry_path_t *sentry__path_unique_tmp(const sentry_path_t *path);
+
+/**
+ * Sets whether writes are durable, meaning that files are synced to disk
+ * before they replace their previous version, so they survive a power loss.
+ * This is process-wide, and can be changed at any time, even when crashing.
+ */
+void sentry__path_set_durable(bool durable);
+
+/**
+ * Returns true if writes are currently durable.
+ */
+bool sentry__path_is_durable(void);
+
+/**
+ * Syncs the entries of the directory at `path` to disk, which persists the
+ * files that were created, renamed or removed in it. Syncing the directory
+ * once covers all the files written to it before.
+ * Returns 0 on success.
+ */
+int sentry__path_sync_dir(const sentry_path_t *path);
+
 /**
  * This will create the directory referred to by `path`, and any non-existing
  * parent directory.
@@ -143,6 +189,12 @@ int sentry__path_touch(const sentry_path_t *path);
  */
 size_t sentry__path_get_size(const sentry_path_t *path);
 
+/**
+ * Returns the last modification time of the file at `path`, in milliseconds
+ * since the unix epoch, or 0 in case of an error.
+ */
+uint64_t sentry__path_get_mtime(const sentry_path_t *path);
+
 /**
  * This will read all the content of `path` into a newly allocated buffer, and
  * write its size into `size_out`.
@@ -150,7 +202,11 @@ size_t sentry__path_get_size(const sentry_path_t *path);
 char *sentry__path_read_to_buffer(const sentry_path_t *path, size_t *size_out);
 
 /**
- * This will truncate the given file and write the given `buf` into it.
+ * This will replace the given file with the given `buf`.
+ * The content is written to a unique temporary file next to it first, which
+ * then replaces the file atomically, so a crash never leaves a partially
+ * written file behind. In durable mode, the temporary file is also synced to
+ * disk before that.
  */
 int sentry__path_write_buffer(
     const sentry_path_t *path, const char *buf, size_t buf_len);
@@ -161,6 +217,54 @@ int sentry__path_write_buffer(
 int sentry__path_append_buffer(
     const sentry_path_t *path, const char *buf, size_t buf_len);
 
+/**
+ * This will create or open the file at `path`, resize it to `size` bytes, and
+ * map it into memory for reading and writing.
+ * Writes to the mapped memory end up in the file without any further syscall,
+ * and are persisted even if the process crashes.
+ */
+sentry_filemap_t *sentry__path_map_file(const sentry_path_t *path, size_t size);
+
+/**
+ * This will unmap and free the file mapping. Modifications are persisted.
+ */
+void sentry__filemap_free(sentry_filemap_t *map);
+
+/**
+ * This will sync the modifications of the mapped memory to disk.
+ * Returns 0 on success.
+ */
+int sentry__filemap_sync(sentry_filemap_t *map);
+
+/**
+ * This will create or open the file at `path` and keep it open for repeated
+ * writes, which avoids re-opening the file for every write.
+ */
+sentry_filewriter_t *sentry__path_open_writer(const sentry_path_t *path);
+
+/**
+ * This will append `buf` to the file of the given `writer`.
+ */
+int sentry__filewriter_write(
+    sentry_filewriter_t *writer, const char *buf, size_t buf_len);
+
+/**
+ * This will sync the data written by the given `writer` to disk.
+ * Returns 0 on success.
+ */
+int sentry__filewriter_sync(sentry_filewriter_t *writer);
+
+/**
+ * This will truncate the file of the given `writer`. Subsequent writes start
+ * at the beginning of the file.
+ */
+int sentry__filewriter_truncate(sentry_filewriter_t *writer);
+
+/**
+ * This will close the file and free the `writer`.
+ */
+void sentry__filewriter_free(sentry_filewriter_t *writer);
+
 /**
  * Create a new directory iterator for `path`.
  */
@@ -1,12 +1,15 @@
 #include "sentry_scope.h"
+#include "sentry_alloc.h"
 #include "sentry_backend.h"
 #include "sentry_core.h"
 #include "sentry_database.h"
+#include "sentry_module_index.h"
 #include "sentry_options.h"
 #include "sentry_os.h"
 #include "sentry_string.h"
 #include "sentry_symbolizer.h"
 #include "sentry_sync.h"
+#include "sentry_value.h"
 #include <stdlib.h>
 
 #ifdef SENTRY_BACKEND_CRASHPAD
@@ -21,6 +24,28 @@ static bool g_scope_initialized = false;
 static sentry_scope_t g_scope = { 0 };
 static sentry_mutex_t g_lock = SENTRY__MUTEX_INIT;
 
+/**
+ * Scope Snapshots:
+ *
+ * Writers mutate `g_scope` while holding `g_lock`, and mark it as dirty when
+ * unlocking. Readers never look at `g_scope` directly, but rather at an
+ * immutable, refcounted copy of it, which is published via `g_snapshot`.
+ * Only the first reader after a modification will take `g_lock` to create and
+ * publish a new snapshot. All other readers acquire the published snapshot
+ * without taking any lock.
+ *
+ * The snapshot is published via `sentry_published_t`, so a writer that
+ * replaces it waits for all the readers that might still be acquiring the
+ * previous snapshot, before dropping its reference to it.
+ */
+typedef struct {
+    sentry_scope_t scope;
+    long refcount;
+} scope_snapshot_t;
+
+static sentry_published_t g_snapshot = SENTRY__PUBLISHED_INIT;
+static volatile long g_snapshot_dirty = 1;
+
 static sentry_value_t
 get_client_sdk(void)
 {
@@ -80,10 +105,95 @@ get_scope(void)
     return &g_scope;
 }
 
+static sentry_value_t
+snapshot_value(sentry_value_t value)
+{
+    // freezing is recursive, so nested values are copied as well, otherwise
+    // they would be frozen in the live scope too.
+    sentry_value_t rv = sentry__value_clone_deep(value);
+    sentry_value_freeze(rv);
+    return rv;
+}
+
+static scope_snapshot_t *
+snapshot_new(const sentry_scope_t *scope)
+{
+    scope_snapshot_t *snapshot = SENTRY_MAKE(scope_snapshot_t);
+    if (!snapshot) {
+        return NULL;
+    }
+    memset(snapshot, 0, sizeof(scope_snapshot_t));
+    snapshot->refcount = 1;
+
+    sentry_scope_t *rv = &snapshot->scope;
+    rv->transaction = sentry__string_clone(scope->transaction);
+    rv->fingerprint = snapshot_value(scope->fingerprint);
+    rv->user = snapshot_value(scope->user);
+    rv->tags = snapshot_value(scope->tags);
+    rv->extra = snapshot_value(scope->extra);
+    rv->contexts = snapshot_value(scope->contexts);
+    rv->breadcrumbs = snapshot_value(scope->breadcrumbs);
+    rv->level = scope->level;
+    sentry_value_incref(scope->client_sdk);
+    rv->client_sdk = scope->client_sdk;
+    // the session is mutable and not part of the snapshot
+    rv->session = NULL;
+
+    return snapshot;
+}
+
+static void
+snapshot_decref(scope_snapshot_t *snapshot)
+{
+    if (!snapshot
+        || sentry__atomic_fetch_and_add(&snapshot->refcount, -1) != 1) {
+        return;
+    }
+    sentry_scope_t *scope = &snapshot->scope;
+    sentry_free(scope->transaction);
+    sentry_value_decref(scope->fingerprint);
+    sentry_value_decref(scope->user);
+    sentry_value_decref(scope->tags);
+    sentry_value_decref(scope->extra);
+    sentry_value_decref(scope->contexts);
+    sentry_value_decref(scope->breadcrumbs);
+    sentry_value_decref(scope->client_sdk);
+    sentry_free(snapshot);
+}
+
+static void
+snapshot_incref(void *ptr)
+{
+    scope_snapshot_t *snapshot = ptr;
+    sentry__atomic_fetch_and_add(&snapshot->refcount, 1);
+}
+
+static scope_snapshot_t *
+snapshot_acquire_published(void)
+{
+    return sentry__published_acquire(&g_snapshot, snapshot_incref);
+}
+
+/**
+ * Replaces the published snapshot. This must be called while holding
+ * `g_lock`, as concurrent writers are not supported.
+ */
+static void
+snapshot_publish(scope_snapshot_t *snapshot)
+{
+    long epoch;
+    scope_snapshot_t *previous
+        = sentry__published_exchange(&g_snapshot, snapshot, &epoch);
+    sentry__published_wait(&g_snapshot, epoch);
+    snapshot_decref(previous);
+}
+
 void
 sentry__scope_cleanup(void)
 {
     sentry__mutex_lock(&g_lock);
+    snapshot_publish(NULL);
+    sentry__atomic_store(&g_snapshot_dirty, 1);
     if (g_scope_initialized) {
         g_scope_initialized = false;
         sentry_free(g_scope.transaction);
@@ -108,36 +218,543 @@ sentry__scope_lock(void)
 void
 sentry__scope_unlock(void)
 {
+    sentry__atomic_store(&g_snapshot_dirty, 1);
     sentry__mutex_unlock(&g_lock);
 }
 
+const sentry_scope_t *
+sentry__scope_acquire(void)
+{
+    scope_snapshot_t *snapshot = NULL;
+#ifdef SENTRY_PLATFORM_UNIX
+    // A signal handler might have interrupted a reader of the previous epoch
+    // on this very thread, so publishing would spin forever. Instead, the
+    // signal handler gets its own private snapshot.
+    if (!sentry__block_for_signal_handler()) {
+        snapshot = snapshot_new(get_scope());
+        return snapshot ? &snapshot->scope : NULL;
+    }
+#endif
+    if (!sentry__atomic_fetch(&g_snapshot_dirty)) {
+        snapshot = snapshot_acquire_published();
+        if (snapshot) {
+            return &snapshot->scope;
+        }
+    }
+
+    sentry__mutex_lock(&g_lock);
+    if (sentry__atomic_store(&g_snapshot_dirty, 0)
+        || !sentry__atomic_fetch_ptr(&g_snapshot.ptr)) {
+        scope_snapshot_t *new_snapshot = snapshot_new(get_scope());
+        if (new_snapshot) {
+            snapshot_publish(new_snapshot);
+        } else {
+            sentry__atomic_store(&g_snapshot_dirty, 1);
+        }
+    }
+    snapshot = snapshot_acquire_published();
+    sentry__mutex_unlock(&g_lock);
+
+    return snapshot ? &snapshot->scope : NULL;
+}
+
 void
-sentry__scope_flush_unlock(const sentry_scope_t *scope)
+sentry__scope_release(const sentry_scope_t *scope)
+{
+    // the scope is the first member of the snapshot
+    snapshot_decref((scope_snapshot_t *)scope);
+}
+
+/**
+ * Local Scopes:
+ *
+ * Each thread has its own stack of local scopes, which are pushed and popped
+ * via `sentry_push_scope` and `sentry_pop_scope`. A local scope only holds the
+ * data that was set while it was active, and layers over the global scope.
+ * Both are only merged when an event is being captured, so modifying a local
+ * scope never touches the global scope or its lock.
+ *
+ * Pushing a new local scope just shares all the values of its parent, and a
+ * value is only copied when it is modified while being shared.
+ */
+typedef struct local_scope_s {
+    sentry_scope_t scope;
+    struct local_scope_s *parent;
+} local_scope_t;
+
+// A level that was not explicitly set on a local scope.
+#define LOCAL_LEVEL_UNSET ((sentry_level_t)-100)
+
+static SENTRY_THREAD_LOCAL local_scope_t *g_local_scope = NULL;
+
+// The stack of local scopes is also registered with a thread-specific key,
+// only to free it once its thread exits.
+#ifdef SENTRY_PLATFORM_WINDOWS
+static DWORD g_local_scope_key = FLS_OUT_OF_INDEXES;
+#else
+static pthread_key_t g_local_scope_key;
+#endif
+static volatile long g_local_scope_key_created = 0;
+static sentry_mutex_t g_local_scope_key_lock = SENTRY__MUTEX_INIT;
+
+static local_scope_t *
+local_scope_new(const local_scope_t *parent)
+{
+    local_scope_t *local = SENTRY_MAKE(local_scope_t);
+    if (!local) {
+        return NULL;
+    }
+    memset(local, 0, sizeof(local_scope_t));
+    local->parent = (local_scope_t *)parent;
+
+    sentry_scope_t *scope = &local->scope;
+    if (!parent) {
+        scope->fingerprint = sentry_value_new_null();
+        scope->user = sentry_value_new_null();
+        scope->tags = sentry_value_new_object();
+        scope->extra = sentry_value_new_object();
+        scope->contexts = sentry_value_new_object();
+        scope->breadcrumbs = sentry_value_new_list();
+        scope->level = LOCAL_LEVEL_UNSET;
+        return local;
+    }
+
+    const sentry_scope_t *parent_scope = &parent->scope;
+    scope->transaction = sentry__string_clone(parent_scope->transaction);
+#define SHARE(Key)                                                             \
+    do {                                                                       \
+        sentry_value_incref(parent_scope->Key);                                \
+        scope->Key = parent_scope->Key;                                        \
+    } while (0)
+    SHARE(fingerprint);
+    SHARE(user);
+    SHARE(tags);
+    SHARE(extra);
+    SHARE(contexts);
+    SHARE(breadcrumbs);
+#undef SHARE
+    scope->level = parent_scope->level;
+    return local;
+}
+
+static void
+local_scope_free(local_scope_t *local)
 {
-    bool did_unlock = false;
+    sentry_scope_t *scope = &local->scope;
+    sentry_free(scope->transaction);
+    sentry_value_decref(scope->fingerprint);
+    sentry_value_decref(scope->user);
+    sentry_value_decref(scope->tags);
+    sentry_value_decref(scope->extra);
+    sentry_value_decref(scope->contexts);
+    sentry_value_decref(scope->breadcrumbs);
+    sentry_free(local);
+}
+
+#ifdef SENTRY_PLATFORM_WINDOWS
+static void NTAPI
+#else
+static void
+#endif
+local_scope_thread_exit(void *value)
+{
+    local_scope_t *local = value;
+    while (local) {
+        local_scope_t *parent = local->parent;
+        local_scope_free(local);
+        local = parent;
+    }
+}
+
+/**
+ * Registers `local` as the top of the stack of local scopes of this thread,
+ * so the stack is freed when the thread exits without popping it.
+ */
+static void
+local_scope_register(local_scope_t *local)
+{
+    if (!sentry__atomic_fetch(&g_local_scope_key_created)) {
+        sentry__mutex_lock(&g_local_scope_key_lock);
+        if (!sentry__atomic_fetch(&g_local_scope_key_created)) {
+#ifdef SENTRY_PLATFORM_WINDOWS
+            g_local_scope_key = FlsAlloc(local_scope_thread_exit);
+            bool created = g_local_scope_key != FLS_OUT_OF_INDEXES;
+#else
+            bool created = pthread_key_create(
+                               &g_local_scope_key, local_scope_thread_exit)
+                == 0;
+#endif
+            sentry__atomic_store(&g_local_scope_key_created, created ? 1 : 0);
+        }
+        sentry__mutex_unlock(&g_local_scope_key_lock);
+        if (!sentry__atomic_fetch(&g_local_scope_key_created)) {
+            return;
+        }
+    }
+#ifdef SENTRY_PLATFORM_WINDOWS
+    FlsSetValue(g_local_scope_key, local);
+#else
+    pthread_setspecific(g_local_scope_key, local);
+#endif
+}
+
+/**
+ * Makes sure that all the values which are modified in place are not shared
+ * with a parent scope or a merged snapshot anymore.
+ */
+static void
+local_scope_make_unique(sentry_scope_t *scope)
+{
+#define MAKE_UNIQUE(Key)                                                       \
+    do {                                                                       \
+        if (sentry_value_refcount(scope->Key) > 1) {                           \
+            sentry_value_t unique = sentry__value_clone(scope->Key);           \
+            sentry_value_decref(scope->Key);                                   \
+            scope->Key = unique;                                               \
+        }                                                                      \
+    } while (0)
+    MAKE_UNIQUE(tags);
+    MAKE_UNIQUE(extra);
+    MAKE_UNIQUE(contexts);
+    MAKE_UNIQUE(breadcrumbs);
+#undef MAKE_UNIQUE
+}
+
+static sentry_value_t
+merge_objects(sentry_value_t global, sentry_value_t local)
+{
+    if (sentry_value_get_length(local) == 0) {
+        sentry_value_incref(global);
+        return global;
+    }
+    sentry_value_t rv = sentry__value_clone(global);
+    sentry__value_merge_objects(rv, local);
+    return rv;
+}
+
+static int
+compare_breadcrumbs(sentry_value_t a, sentry_value_t b)
+{
+    // timestamps are in ISO 8601 format, which sorts lexicographically
+    return strcmp(
+        sentry_value_as_string(sentry_value_get_by_key(a, "timestamp")),
+        sentry_value_as_string(sentry_value_get_by_key(b, "timestamp")));
+}
+
+static sentry_value_t
+merge_breadcrumbs(sentry_value_t global, sentry_value_t local)
+{
+    size_t global_len = sentry_value_get_length(global);
+    size_t local_len = sentry_value_get_length(local);
+    if (local_len == 0) {
+        sentry_value_incref(global);
+        return global;
+    }
+
+    size_t max_breadcrumbs = SENTRY_BREADCRUMBS_MAX;
     SENTRY_WITH_OPTIONS (options) {
+        max_breadcrumbs = options->max_breadcrumbs;
+    }
+
+    // both lists are ordered chronologically, so we merge them as such
+    sentry_value_t rv
+        = sentry__value_new_list_with_size(global_len + local_len);
+    size_t i = 0;
+    size_t j = 0;
+    while (i < global_len || j < local_len) {
+        sentry_value_t breadcrumb;
+        if (j >= local_len
+            || (i < global_len
+                && compare_breadcrumbs(sentry_value_get_by_index(global, i),
+                       sentry_value_get_by_index(local, j))
+                    <= 0)) {
+            breadcrumb = sentry_value_get_by_index(global, i++);
+        } else {
+            breadcrumb = sentry_value_get_by_index(local, j++);
+        }
+        sentry_value_incref(breadcrumb);
+        sentry__value_append_bounded(rv, breadcrumb, max_breadcrumbs);
+    }
+    return rv;
+}
+
+static scope_snapshot_t *
+snapshot_merge(const sentry_scope_t *global, const sentry_scope_t *local)
+{
+    scope_snapshot_t *snapshot = SENTRY_MAKE(scope_snapshot_t);
+    if (!snapshot) {
+        return NULL;
+    }
+    memset(snapshot, 0, sizeof(scope_snapshot_t));
+    snapshot->refcount = 1;
+
+    sentry_scope_t *rv = &snapshot->scope;
+    rv->transaction = sentry__string_clone(
+        local->transaction ? local->transaction : global->transaction);
+    rv->fingerprint = sentry_value_is_null(local->fingerprint)
+        ? global->fingerprint
+        : local->fingerprint;
+    sentry_value_incref(rv->fingerprint);
+    rv->user
+        = sentry_value_is_null(local->user) ? global->user : local->user;
+    sentry_value_incref(rv->user);
+    rv->tags = merge_objects(global->tags, local->tags);
+    rv->extra = merge_objects(global->extra, local->extra);
+    rv->contexts = merge_objects(global->contexts, local->contexts);
+    rv->breadcrumbs
+        = merge_breadcrumbs(global->breadcrumbs, local->breadcrumbs);
+    rv->level
+        = local->level != LOCAL_LEVEL_UNSET ? local->level : global->level;
+    sentry_value_incref(global->client_sdk);
+    rv->client_sdk = global->client_sdk;
+    rv->session = NULL;
+
+    return snapshot;
+}
+
+const sentry_scope_t *
+sentry__scope_acquire_current(void)
+{
+    const sentry_scope_t *global = sentry__scope_acquire();
+    if (!global || !g_local_scope) {
+        return global;
+    }
+    scope_snapshot_t *merged = snapshot_merge(global, &g_local_scope->scope);
+    if (!merged) {
+        return global;
+    }
+    sentry__scope_release(global);
+    return &merged->scope;
+}
+
+bool
+sentry__scope_has_local(void)
+{
+    return g_local_scope != NULL;
+}
+
+sentry_scope_t *
+sentry__scope_lock_current(void)
+{
+    if (g_local_scope) {
+        local_scope_make_unique(&g_local_scope->scope);
+        return &g_local_scope->scope;
+    }
+    return sentry__scope_lock();
+}
+
+void
+sentry__scope_unlock_current(const sentry_scope_t *scope)
+{
+    if (scope == &g_scope) {
+        sentry__scope_unlock();
+    }
+}
+
+void
+sentry__scope_flush_unlock_current(const sentry_scope_t *scope)
+{
+    if (scope == &g_scope) {
+        sentry__scope_flush_unlock(scope);
+    }
+}
+
+void
+sentry_push_scope(void)
+{
+    local_scope_t *local = local_scope_new(g_local_scope);
+    if (local) {
+        g_local_scope = local;
+        local_scope_register(local);
+    }
+}
+
+void
+sentry_pop_scope(void)
+{
+    local_scope_t *local = g_local_scope;
+    if (!local) {
+        SENTRY_WARN("trying to pop the global scope");
+        return;
+    }
+    g_local_scope = local->parent;
+    local_scope_register(g_local_scope);
+    local_scope_free(local);
+}
+
+/**
+ * Scope Flushing:
+ *
+ * Persisting the scope means writing the session file, and for some backends
+ * serializing the whole scope to disk. Instead of doing that for each and
+ * every modification, modifications only mark the scope as pending to be
+ * flushed, and a background worker coalesces all the modifications within
+ * `scope_flush_interval` into a single flush. The crash handlers and
+ * `sentry_shutdown` flush immediately, except for the preallocated crash path
+ * of the inproc backend, which never calls into the scope, and is only used
+ * when no flush is pending. Backends without a crash hook, like crashpad on
+ * macOS, could not flush the pending modifications when crashing, so they
+ * always flush synchronously.
+ */
+typedef struct {
+    sentry_mutex_t lock;
+    sentry_cond_t signal;
+    uint64_t interval;
+    bool flush_now;
+} scope_flusher_state_t;
+
+static sentry_bgworker_t *g_flusher = NULL;
+static sentry_mutex_t g_flusher_lock = SENTRY__MUTEX_INIT;
+static volatile long g_flush_pending = 0;
+
+static void
+scope_flusher_state_free(void *_state)
+{
+    scope_flusher_state_t *state = _state;
+    sentry__mutex_free(&state->lock);
+    sentry_free(state);
+}
+
+static void
+scope_flush_task(void *UNUSED(task_data), void *_state)
+{
+    scope_flusher_state_t *state = _state;
+    sentry__mutex_lock(&state->lock);
+    if (!state->flush_now) {
+        // wait for more modifications to accumulate, unless we are woken up
+        // because of a shutdown.
+        sentry__cond_wait_timeout(
+            &state->signal, &state->lock, state->interval);
+    }
+    sentry__mutex_unlock(&state->lock);
+
+    sentry__scope_flush();
+}
+
+void
+sentry__scope_flusher_start(const sentry_options_t *options)
+{
+    if (!options->scope_flush_interval) {
+        return;
+    }
+    if (options->backend && options->backend->needs_synchronous_scope_flush) {
+        SENTRY_DEBUG("backend can not flush the scope when crashing, "
+                     "flushing every scope modification synchronously");
+        return;
+    }
+    scope_flusher_state_t *state = SENTRY_MAKE(scope_flusher_state_t);
+    if (!state) {
+        return;
+    }
+    memset(state, 0, sizeof(scope_flusher_state_t));
+    sentry__mutex_init(&state->lock);
+    sentry__cond_init(&state->signal);
+    state->interval = options->scope_flush_interval;
+
+    sentry_bgworker_t *bgw
+        = sentry__bgworker_new(state, scope_flusher_state_free);
+    if (!bgw) {
+        scope_flusher_state_free(state);
+        return;
+    }
+    sentry__bgworker_setname(bgw, "sentry-scope");
+    if (sentry__bgworker_start(bgw) != 0) {
+        SENTRY_WARN("failed to start scope flusher, flushing synchronously");
+        sentry__bgworker_decref(bgw);
+        return;
+    }
+
+    sentry__mutex_lock(&g_flusher_lock);
+    g_flusher = bgw;
+    sentry__mutex_unlock(&g_flusher_lock);
+}
+
+void
+sentry__scope_flusher_shutdown(void)
+{
+    sentry__mutex_lock(&g_flusher_lock);
+    sentry_bgworker_t *bgw = g_flusher;
+    g_flusher = NULL;
+    sentry__mutex_unlock(&g_flusher_lock);
+
+    if (bgw) {
+        scope_flusher_state_t *state = sentry__bgworker_get_state(bgw);
+        sentry__mutex_lock(&state->lock);
+        state->flush_now = true;
+        sentry__cond_wake(&state->signal);
+        sentry__mutex_unlock(&state->lock);
+
+        sentry__bgworker_shutdown(bgw, SENTRY_DEFAULT_SHUTDOWN_TIMEOUT);
+        sentry__bgworker_decref(bgw);
+    }
+
+    // in case the flusher did not get to it in time
+    if (sentry__atomic_fetch(&g_flush_pending)) {
+        sentry__scope_flush();
+    }
+}
+
+void
+sentry__scope_flush(void)
+{
+    sentry__atomic_store(&g_flush_pending, 0);
+    SENTRY_WITH_OPTIONS (options) {
+        // this only reads the scope, so the lock is released directly, without
+        // invalidating the published snapshot.
+        const sentry_scope_t *scope = sentry__scope_lock();
         if (scope->session) {
             sentry__run_write_session(options->run, scope->session);
-            sentry__scope_unlock();
+            sentry__mutex_unlock(&g_lock);
         } else {
-            sentry__scope_unlock();
+            sentry__mutex_unlock(&g_lock);
             sentry__run_clear_session(options->run);
         }
-        did_unlock = true;
         // we try to unlock the scope/session lock as soon as possible. The
         // backend will do its own `WITH_SCOPE` internally.
         if (options->backend && options->backend->flush_scope_func) {
             options->backend->flush_scope_func(options->backend);
         }
     }
-    if (!did_unlock) {
-        sentry__scope_unlock();
+}
+
+bool
+sentry__scope_flush_pending(void)
+{
+    return sentry__atomic_fetch(&g_flush_pending) != 0;
+}
+
+void
+sentry__scope_flush_unlock(const sentry_scope_t *UNUSED(scope))
+{
+    sentry__scope_unlock();
+    if (sentry__atomic_store(&g_flush_pending, 1)) {
+        // there is already a flush scheduled which will pick this up
+        return;
+    }
+#ifdef SENTRY_PLATFORM_UNIX
+    if (!sentry__block_for_signal_handler()) {
+        // signal handlers flush explicitly once they are done, see
+        // `sentry__scope_flush`.
+        return;
+    }
+#endif
+    bool scheduled = false;
+    sentry__mutex_lock(&g_flusher_lock);
+    if (g_flusher) {
+        scheduled
+            = sentry__bgworker_submit(g_flusher, scope_flush_task, NULL, NULL)
+            == 0;
+    }
+    sentry__mutex_unlock(&g_flusher_lock);
+
+    if (!scheduled) {
+        sentry__scope_flush();
     }
 }
 
 static void
-sentry__foreach_stacktrace(
-    sentry_value_t event, void (*func)(sentry_value_t stacktrace))
+sentry__foreach_stacktrace(sentry_value_t event,
+    void (*func)(sentry_value_t stacktrace, void *data), void *data)
 {
     // We have stacktraces at the following locations:
     // * `exception[.values].X.stacktrace`:
@@ -155,7 +772,7 @@ sentry__foreach_stacktrace(
             sentry_value_t stacktrace = sentry_value_get_by_key(
                 sentry_value_get_by_index(exception, i), "stacktrace");
             if (!sentry_value_is_null(stacktrace)) {
-                func(stacktrace);
+                func(stacktrace, data);
             }
         }
     }
@@ -170,7 +787,7 @@ sentry__foreach_stacktrace(
             sentry_value_t stacktrace = sentry_value_get_by_key(
                 sentry_value_get_by_index(threads, i), "stacktrace");
             if (!sentry_value_is_null(stacktrace)) {
-                func(stacktrace);
+                func(stacktrace, data);
             }
         }
     }
@@ -209,7 +826,16 @@ sentry__symbolize_frame(const sentry_frame_info_t *info, void *data)
 }
 
 static void
-sentry__symbolize_stacktrace(sentry_value_t stacktrace)
+sentry__symbolize_batch_frame(
+    const sentry_frame_info_t *info, size_t index, void *data)
+{
+    sentry_value_t frame
+        = sentry_value_get_by_index(*(sentry_value_t *)data, index);
+    sentry__symbolize_frame(info, &frame);
+}
+
+static void
+sentry__symbolize_stacktrace(sentry_value_t stacktrace, void *UNUSED(data))
 {
     sentry_value_t frames = sentry_value_get_by_key(stacktrace, "frames");
     if (sentry_value_get_type(frames) != SENTRY_VALUE_TYPE_LIST) {
@@ -217,8 +843,13 @@ sentry__symbolize_stacktrace(sentry_value_t stacktrace)
     }
 
     size_t len = sentry_value_get_length(frames);
+    void **addrs = sentry_malloc(sizeof(void *) * (len ? len : 1));
+    if (!addrs) {
+        return;
+    }
     for (size_t i = 0; i < len; i++) {
         sentry_value_t frame = sentry_value_get_by_index(frames, i);
+        addrs[i] = NULL;
 
         sentry_value_t addr_value
             = sentry_value_get_by_key(frame, "instruction_addr");
@@ -227,13 +858,158 @@ sentry__symbolize_stacktrace(sentry_value_t stacktrace)
         }
 
         // The addr is saved as a hex-number inside the value.
-        size_t addr
-            = (size_t)strtoll(sentry_value_as_string(addr_value), NULL, 0);
-        if (!addr) {
+        addrs[i] = (void *)(size_t)strtoll(
+            sentry_value_as_string(addr_value), NULL, 0);
+    }
+
+    // All the frames are symbolized at once, so the symbolizer can share the
+    // module lookups between them.
+    sentry__symbolize_batch(addrs, len, sentry__symbolize_batch_frame, &frames);
+
+    // frames that could not be symbolized still get their module
+    sentry_module_index_t *index = sentry__module_index_acquire();
+    for (size_t i = 0; index && i < len; i++) {
+        const sentry_module_range_t *module
+            = sentry__module_index_find(index, (uintptr_t)addrs[i]);
+        if (!module) {
+            continue;
+        }
+        sentry_frame_info_t info;
+        memset(&info, 0, sizeof(sentry_frame_info_t));
+        info.load_addr = (void *)module->start;
+        info.instruction_addr = addrs[i];
+        info.object_name = module->code_file;
+        sentry_value_t frame = sentry_value_get_by_index(frames, i);
+        sentry__symbolize_frame(&info, &frame);
+    }
+    sentry__module_index_release(index);
+    sentry_free(addrs);
+}
+
+typedef struct {
+    const sentry_module_index_t *index;
+    uintptr_t *starts;
+    size_t count;
+    size_t capacity;
+    size_t frame_count;
+} referenced_images_t;
+
+static void
+collect_referenced_images(sentry_value_t stacktrace, void *data)
+{
+    referenced_images_t *images = data;
+    sentry_value_t frames = sentry_value_get_by_key(stacktrace, "frames");
+    size_t len = sentry_value_get_length(frames);
+    for (size_t i = 0; i < len; i++) {
+        sentry_value_t addr_value = sentry_value_get_by_key(
+            sentry_value_get_by_index(frames, i), "instruction_addr");
+        if (sentry_value_is_null(addr_value)) {
             continue;
         }
-        sentry__symbolize((void *)addr, sentry__symbolize_frame, &frame);
+        images->frame_count++;
+        const sentry_module_range_t *module = sentry__module_index_find(
+            images->index,
+            (uintptr_t)strtoull(sentry_value_as_string(addr_value), NULL, 0));
+        if (!module) {
+            continue;
+        }
+        // frames are mostly in a handful of modules, often in a row
+        if (images->count
+            && images->starts[images->count - 1] == module->start) {
+            continue;
+        }
+        if (images->count == images->capacity) {
+            size_t capacity = images->capacity ? images->capacity * 2 : 16;
+            uintptr_t *starts = sentry_malloc(sizeof(uintptr_t) * capacity);
+            if (!starts) {
+                continue;
+            }
+            if (images->count) {
+                memcpy(starts, images->starts,
+                    sizeof(uintptr_t) * images->count);
+            }
+            sentry_free(images->starts);
+            images->starts = starts;
+            images->capacity = capacity;
+        }
+        images->starts[images->count++] = module->start;
+    }
+}
+
+static bool
+is_referenced_image(const referenced_images_t *images, uintptr_t start)
+{
+    for (size_t i = 0; i < images->count; i++) {
+        if (images->starts[i] == start) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool
+is_allowed_image(const sentry_options_t *options, const char *code_file)
+{
+    if (!options->debug_images || !code_file) {
+        return false;
+    }
+    const char *name = code_file;
+    for (const char *ptr = code_file; *ptr; ptr++) {
+        if (*ptr == '/' || *ptr == '\\') {
+            name = ptr + 1;
+        }
+    }
+    for (const sentry_debug_image_t *image = options->debug_images; image;
+         image = image->next) {
+        if (strcmp(image->name, name) == 0) {
+            return true;
+        }
     }
+    return false;
+}
+
+/**
+ * Returns the subset of `modules` that frames of `event` are in, or that are
+ * on the allow-list, or a new reference to all of `modules` if the event has
+ * no frames at all.
+ */
+static sentry_value_t
+filter_referenced_images(const sentry_options_t *options, sentry_value_t event,
+    sentry_value_t modules)
+{
+    referenced_images_t images;
+    memset(&images, 0, sizeof(referenced_images_t));
+    sentry_module_index_t *index = sentry__module_index_acquire();
+    images.index = index;
+    if (index) {
+        sentry__foreach_stacktrace(event, collect_referenced_images, &images);
+    }
+    sentry__module_index_release(index);
+    if (!images.frame_count) {
+        sentry_free(images.starts);
+        sentry_value_incref(modules);
+        return modules;
+    }
+
+    sentry_value_t referenced = sentry_value_new_list();
+    size_t len = sentry_value_get_length(modules);
+    for (size_t i = 0; i < len; i++) {
+        sentry_value_t module = sentry_value_get_by_index(modules, i);
+        const char *image_addr = sentry_value_as_string(
+            sentry_value_get_by_key(module, "image_addr"));
+        const char *code_file = sentry_value_as_string(
+            sentry_value_get_by_key(module, "code_file"));
+        if (is_referenced_image(
+                &images, (uintptr_t)strtoull(image_addr, NULL, 0))
+            || is_allowed_image(options, code_file)) {
+            sentry_value_incref(module);
+            sentry_value_append(referenced, module);
+        }
+    }
+    sentry_free(images.starts);
+    SENTRY_TRACEF("sending %zu of %zu images",
+        sentry_value_get_length(referenced), len);
+    return referenced;
 }
 
 void
@@ -274,8 +1050,10 @@ sentry__scope_apply_to_event(
         SET("level", sentry__value_new_level(scope->level));
     }
 
-    PLACE_VALUE("user", scope->user);
-    PLACE_VALUE("fingerprint", scope->fingerprint);
+    // the values of a scope snapshot are frozen, so the event gets its own
+    // copy of the values it might want to modify.
+    PLACE_CLONED_VALUE("user", scope->user);
+    PLACE_CLONED_VALUE("fingerprint", scope->fingerprint);
     PLACE_STRING("transaction", scope->transaction);
     PLACE_VALUE("sdk", scope->client_sdk);
 
@@ -290,6 +1068,15 @@ sentry__scope_apply_to_event(
 
     if (mode & SENTRY_SCOPE_MODULES) {
         sentry_value_t modules = sentry_get_modules_list();
+        SENTRY_WITH_OPTIONS (options) {
+            if (options->referenced_images_only
+                && !sentry_value_is_null(modules)) {
+                sentry_value_t referenced
+                    = filter_referenced_images(options, event, modules);
+                sentry_value_decref(modules);
+                modules = referenced;
+            }
+        }
         if (!sentry_value_is_null(modules)) {
             sentry_value_t debug_meta = sentry_value_new_object();
             sentry_value_set_by_key(debug_meta, "images", modules);
@@ -298,7 +1085,7 @@ sentry__scope_apply_to_event(
     }
 
     if (mode & SENTRY_SCOPE_STACKTRACES) {
-        sentry__foreach_stacktrace(event, sentry__symbolize_stacktrace);
+        sentry__foreach_stacktrace(event, sentry__symbolize_stacktrace, NULL);
     }
 
 #undef PLACE_STRING
@@ -306,23 +1093,39 @@ sentry__scope_apply_to_event(
 #undef SET
 }
 
-void
-sentry__scope_session_sync(sentry_scope_t *scope)
+static void
+session_sync_user(sentry_session_t *session, sentry_value_t user)
 {
-    if (!scope->session) {
-        return;
-    }
-
-    if (!sentry_value_is_null(scope->user)) {
-        sentry_value_t did = sentry_value_get_by_key(scope->user, "id");
+    if (!sentry_value_is_null(user)) {
+        sentry_value_t did = sentry_value_get_by_key(user, "id");
         if (sentry_value_is_null(did)) {
-            did = sentry_value_get_by_key(scope->user, "email");
+            did = sentry_value_get_by_key(user, "email");
         }
         if (sentry_value_is_null(did)) {
-            did = sentry_value_get_by_key(scope->user, "username");
+            did = sentry_value_get_by_key(user, "username");
         }
-        sentry_value_decref(scope->session->distinct_id);
+        sentry_value_decref(session->distinct_id);
         sentry_value_incref(did);
-        scope->session->distinct_id = did;
+        session->distinct_id = did;
+    }
+}
+
+void
+sentry__scope_session_sync(sentry_scope_t *scope)
+{
+    if (scope != &g_scope) {
+        // the session only lives on the global scope, but it is attributed to
+        // the user of the local scope it was set on.
+        sentry_scope_t *global = sentry__scope_lock();
+        if (global->session) {
+            session_sync_user(global->session, scope->user);
+            sentry__scope_flush_unlock(global);
+        } else {
+            sentry__scope_unlock();
+        }
+        return;
+    }
+    if (scope->session) {
+        session_sync_user(scope->session, scope->user);
     }
 }
@@ -45,21 +45,100 @@ sentry_scope_t *sentry__scope_lock(void);
 
 /**
  * Release the lock on the global scope.
+ * This also marks the scope as modified, so that the next call to
+ * `sentry__scope_acquire` will publish a new snapshot.
  */
 void sentry__scope_unlock(void);
 
+/**
+ * This returns a reference to an immutable snapshot of the global scope.
+ *
+ * Snapshots are published with an atomic pointer swap, and acquiring one does
+ * not take the scope lock, unless the scope was modified since the last
+ * snapshot was published. All the values of the snapshot are frozen.
+ * The reference needs to be released with `sentry__scope_release`.
+ */
+const sentry_scope_t *sentry__scope_acquire(void);
+
+/**
+ * Release a reference to a snapshot acquired via `sentry__scope_acquire`.
+ */
+void sentry__scope_release(const sentry_scope_t *scope);
+
+/**
+ * This returns a reference to an immutable scope, which merges the local
+ * scopes of the current thread on top of a snapshot of the global scope.
+ * Without any local scope, this is the same as `sentry__scope_acquire`.
+ * The reference needs to be released with `sentry__scope_release`.
+ */
+const sentry_scope_t *sentry__scope_acquire_current(void);
+
+/**
+ * Returns whether the current thread has pushed any local scope. This only
+ * reads a thread-local, and is safe to call from a signal handler.
+ */
+bool sentry__scope_has_local(void);
+
+/**
+ * This returns the innermost local scope of the current thread for
+ * modification, or locks the global scope when there is no local scope.
+ * Local scopes are thread-local, and are not locked.
+ */
+sentry_scope_t *sentry__scope_lock_current(void);
+
+/**
+ * Releases a scope returned by `sentry__scope_lock_current`.
+ */
+void sentry__scope_unlock_current(const sentry_scope_t *scope);
+
+/**
+ * Releases a scope returned by `sentry__scope_lock_current`, and flushes it
+ * in case it is the global scope. See `sentry__scope_flush_unlock`.
+ */
+void sentry__scope_flush_unlock_current(const sentry_scope_t *scope);
+
 /**
  * This will free all the data attached to the global scope
  */
 void sentry__scope_cleanup(void);
 
 /**
- * This will notify any backend of scope changes, and persist session
- * information to disk. This function must be called while holding the scope
- * lock, and it will be unlocked internally.
+ * This will schedule a flush of the scope, which notifies any backend of scope
+ * changes, and persists session information to disk. This function must be
+ * called while holding the scope lock, and it will be unlocked internally.
+ *
+ * Multiple modifications within the configured `scope_flush_interval` are
+ * coalesced into a single flush on the background flusher. Without a running
+ * flusher, the scope is flushed synchronously. Inside of a signal handler, the
+ * flush is only marked as pending.
  */
 void sentry__scope_flush_unlock(const sentry_scope_t *scope);
 
+/**
+ * This will immediately notify any backend of scope changes, and persist
+ * session information to disk. This needs to be called explicitly by crash
+ * handlers, after they are done modifying the scope.
+ */
+void sentry__scope_flush(void);
+
+/**
+ * Returns whether there are scope modifications which have not been flushed
+ * yet. This is safe to call from a signal handler.
+ */
+bool sentry__scope_flush_pending(void);
+
+/**
+ * Starts the background worker which coalesces scope flushes, unless the
+ * `scope_flush_interval` of the given `options` is `0`.
+ */
+void sentry__scope_flusher_start(const sentry_options_t *options);
+
+/**
+ * Shuts down the background scope flusher, flushing any pending modifications
+ * immediately.
+ */
+void sentry__scope_flusher_shutdown(void);
+
 /**
  * This will merge the requested data which is in the given `scope` to the given
  * `event`.
@@ -71,22 +150,36 @@ void sentry__scope_apply_to_event(const sentry_scope_t *scope,
 
 /**
  * This will update a sessions `distinct_id`, which is generated out of other
- * scope data.
+ * scope data. For a local scope, this updates the session of the global
+ * scope, which must not be locked.
  */
 void sentry__scope_session_sync(sentry_scope_t *scope);
 
 /**
  * These are convenience macros to automatically lock/unlock a scope inside a
  * code block.
+ * The read-only `SENTRY_WITH_SCOPE` does not lock, but rather works on an
+ * immutable snapshot of the scope. See `sentry__scope_acquire`.
+ * The `CURRENT` variants work on the innermost local scope of the current
+ * thread instead, if there is one.
  */
 #define SENTRY_WITH_SCOPE(Scope)                                               \
-    for (const sentry_scope_t *Scope = sentry__scope_lock(); Scope;            \
-         sentry__scope_unlock(), Scope = NULL)
+    for (const sentry_scope_t *Scope = sentry__scope_acquire(); Scope;         \
+         sentry__scope_release(Scope), Scope = NULL)
+#define SENTRY_WITH_CURRENT_SCOPE(Scope)                                       \
+    for (const sentry_scope_t *Scope = sentry__scope_acquire_current(); Scope; \
+         sentry__scope_release(Scope), Scope = NULL)
 #define SENTRY_WITH_SCOPE_MUT(Scope)                                           \
     for (sentry_scope_t *Scope = sentry__scope_lock(); Scope;                  \
          sentry__scope_flush_unlock(Scope), Scope = NULL)
 #define SENTRY_WITH_SCOPE_MUT_NO_FLUSH(Scope)                                  \
     for (sentry_scope_t *Scope = sentry__scope_lock(); Scope;                  \
          sentry__scope_unlock(), Scope = NULL)
+#define SENTRY_WITH_CURRENT_SCOPE_MUT(Scope)                                   \
+    for (sentry_scope_t *Scope = sentry__scope_lock_current(); Scope;          \
+         sentry__scope_flush_unlock_current(Scope), Scope = NULL)
+#define SENTRY_WITH_CURRENT_SCOPE_MUT_NO_FLUSH(Scope)                          \
+    for (sentry_scope_t *Scope = sentry__scope_lock_current(); Scope;          \
+         sentry__scope_unlock_current(Scope), Scope = NULL)
 
 #endif
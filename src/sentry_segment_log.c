@@ -0,0 +1,408 @@
+#include "sentry_segment_log.h"
+
+#include "sentry_alloc.h"
+#include "sentry_core.h"
+#include "sentry_sync.h"
+#include "sentry_utils.h"
+
+#include <string.h>
+
+// "SLOG" in little endian
+#define RECORD_MAGIC 0x474f4c53
+
+// The log is compacted once this many bytes (at least) are superseded, and
+// they make up more than half of the log.
+#define COMPACT_MIN_DEAD_BYTES (64 * 1024)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t type;
+    uint32_t length;
+    uint32_t checksum;
+    uint64_t timestamp;
+} record_header_t;
+
+typedef struct {
+    uint64_t id;
+    uint64_t offset;
+    uint64_t size;
+    uint32_t type;
+    bool live;
+} record_index_t;
+
+struct sentry_segment_log_s {
+    sentry_path_t *path;
+    sentry_filewriter_t *writer;
+    sentry_mutex_t lock;
+    record_index_t *records;
+    size_t record_count;
+    size_t record_capacity;
+    uint64_t size;
+    uint64_t dead_bytes;
+    uint64_t next_id;
+    bool has_session;
+};
+
+static uint32_t
+crc32(const char *buf, size_t buf_len)
+{
+    // the reflected CRC-32 polynomial, processed a nibble at a time
+    static const uint32_t table[16] = { 0x00000000, 0x1db71064, 0x3b6e20c8,
+        0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c, 0xedb88320,
+        0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278,
+        0xbdbdf21c };
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < buf_len; i++) {
+        crc ^= (uint8_t)buf[i];
+        crc = (crc >> 4) ^ table[crc & 0xf];
+        crc = (crc >> 4) ^ table[crc & 0xf];
+    }
+    return ~crc;
+}
+
+sentry_segment_log_t *
+sentry__segment_log_new(const sentry_path_t *path)
+{
+    sentry_segment_log_t *log = SENTRY_MAKE(sentry_segment_log_t);
+    if (!log) {
+        return NULL;
+    }
+    memset(log, 0, sizeof(sentry_segment_log_t));
+    sentry__mutex_init(&log->lock);
+    log->path = sentry__path_clone(path);
+    log->writer = log->path ? sentry__path_open_writer(log->path) : NULL;
+    if (!log->writer || sentry__filewriter_truncate(log->writer) != 0) {
+        sentry__segment_log_free(log);
+        return NULL;
+    }
+    return log;
+}
+
+void
+sentry__segment_log_free(sentry_segment_log_t *log)
+{
+    if (!log) {
+        return;
+    }
+    sentry__filewriter_free(log->writer);
+    sentry__path_free(log->path);
+    sentry_free(log->records);
+    sentry__mutex_free(&log->lock);
+    sentry_free(log);
+}
+
+static record_index_t *
+index_append(sentry_segment_log_t *log)
+{
+    if (log->record_count == log->record_capacity) {
+        size_t capacity = log->record_capacity ? log->record_capacity * 2 : 16;
+        record_index_t *records
+            = sentry_malloc(sizeof(record_index_t) * capacity);
+        if (!records) {
+            return NULL;
+        }
+        if (log->record_count) {
+            memcpy(records, log->records,
+                sizeof(record_index_t) * log->record_count);
+        }
+        sentry_free(log->records);
+        log->records = records;
+        log->record_capacity = capacity;
+    }
+    return &log->records[log->record_count++];
+}
+
+/**
+ * Rewrites the log with only the live records. The file is replaced
+ * atomically, so a crash in between leaves either of them behind, but never a
+ * partial one.
+ */
+static void
+compact(sentry_segment_log_t *log)
+{
+    // without any live records, there is nothing to copy, and the file is
+    // truncated in place, which leaves either all or none of its dead records.
+    if (log->size == log->dead_bytes) {
+        if (!log->writer || sentry__filewriter_truncate(log->writer) != 0) {
+            return;
+        }
+        SENTRY_TRACEF("truncated segment log of %llu dead bytes",
+            (unsigned long long)log->size);
+        log->record_count = 0;
+        log->size = 0;
+        log->dead_bytes = 0;
+        return;
+    }
+
+    size_t buf_len;
+    char *buf = sentry__path_read_to_buffer(log->path, &buf_len);
+    if (!buf) {
+        return;
+    }
+    char *compacted = sentry_malloc((size_t)(log->size - log->dead_bytes));
+    if (!compacted || buf_len != log->size) {
+        goto done;
+    }
+
+    uint64_t offset = 0;
+    for (size_t i = 0; i < log->record_count; i++) {
+        record_index_t *record = &log->records[i];
+        if (record->live) {
+            memcpy(compacted + offset, buf + record->offset,
+                (size_t)record->size);
+            offset += record->size;
+        }
+    }
+
+    // the writer is closed first, since open files can not be replaced on
+    // windows.
+    sentry__filewriter_free(log->writer);
+    log->writer = NULL;
+    int rv = sentry__path_write_buffer(log->path, compacted, (size_t)offset);
+    log->writer = sentry__path_open_writer(log->path);
+    if (rv != 0) {
+        goto done;
+    }
+
+    size_t count = 0;
+    offset = 0;
+    for (size_t i = 0; i < log->record_count; i++) {
+        record_index_t record = log->records[i];
+        if (record.live) {
+            record.offset = offset;
+            offset += record.size;
+            log->records[count++] = record;
+        }
+    }
+    SENTRY_TRACEF("compacted segment log from %llu to %llu bytes",
+        (unsigned long long)log->size, (unsigned long long)offset);
+    log->record_count = count;
+    log->size = offset;
+    log->dead_bytes = 0;
+
+done:
+    sentry_free(compacted);
+    sentry_free(buf);
+}
+
+/**
+ * Appends a record while holding the lock, and updates the index. Records
+ * other than envelopes and sessions are only markers, which are dead from the
+ * start, and are compacted away along with the records they supersede.
+ */
+static record_index_t *
+append_record(sentry_segment_log_t *log, sentry_segment_record_type_t type,
+    const char *buf, size_t buf_len)
+{
+    record_header_t header;
+    header.magic = RECORD_MAGIC;
+    header.type = (uint32_t)type;
+    header.length = (uint32_t)buf_len;
+    header.checksum = crc32(buf, buf_len);
+    header.timestamp = sentry__msec_time();
+
+    record_index_t *record = index_append(log);
+    if (!log->writer || !record) {
+        return NULL;
+    }
+    if (sentry__filewriter_write(
+            log->writer, (const char *)&header, sizeof(header))
+            != 0
+        || sentry__filewriter_write(log->writer, buf, buf_len) != 0) {
+        // a partial record fails its checksum, so nothing after it could be
+        // read anyway. the log is closed, and callers fall back to files.
+        SENTRY_WARN("failed to append to segment log, closing it");
+        sentry__filewriter_free(log->writer);
+        log->writer = NULL;
+        log->record_count--;
+        return NULL;
+    }
+    if (sentry__path_is_durable()) {
+        sentry__filewriter_sync(log->writer);
+    }
+    record->id = ++log->next_id;
+    record->offset = log->size;
+    record->size = sizeof(header) + buf_len;
+    record->type = header.type;
+    record->live = type == SENTRY_SEGMENT_RECORD_ENVELOPE
+        || type == SENTRY_SEGMENT_RECORD_SESSION;
+    log->size += record->size;
+    if (!record->live) {
+        log->dead_bytes += record->size;
+    }
+    return record;
+}
+
+static void
+maybe_compact(sentry_segment_log_t *log)
+{
+    if (log->dead_bytes >= COMPACT_MIN_DEAD_BYTES
+        && log->dead_bytes * 2 > log->size) {
+        compact(log);
+    }
+}
+
+bool
+sentry__segment_log_append(sentry_segment_log_t *log,
+    sentry_segment_record_type_t type, const char *buf, size_t buf_len,
+    uint64_t *id_out)
+{
+    if (buf_len > UINT32_MAX) {
+        return false;
+    }
+
+    sentry__mutex_lock(&log->lock);
+    record_index_t *record = append_record(log, type, buf, buf_len);
+    if (!record) {
+        sentry__mutex_unlock(&log->lock);
+        return false;
+    }
+    uint64_t id = record->id;
+    if (type == SENTRY_SEGMENT_RECORD_SESSION
+        || type == SENTRY_SEGMENT_RECORD_SESSION_CLEAR) {
+        // the new record supersedes all the previous session records
+        for (size_t i = 0; i + 1 < log->record_count; i++) {
+            record_index_t *previous = &log->records[i];
+            if (previous->live
+                && previous->type == SENTRY_SEGMENT_RECORD_SESSION) {
+                previous->live = false;
+                log->dead_bytes += previous->size;
+            }
+        }
+        log->has_session = type == SENTRY_SEGMENT_RECORD_SESSION;
+    }
+    maybe_compact(log);
+    if (id_out) {
+        *id_out = id;
+    }
+    sentry__mutex_unlock(&log->lock);
+    return true;
+}
+
+void
+sentry__segment_log_remove(sentry_segment_log_t *log, uint64_t id)
+{
+    sentry__mutex_lock(&log->lock);
+    for (size_t i = 0; i < log->record_count; i++) {
+        record_index_t *record = &log->records[i];
+        if (record->id == id && record->live) {
+            record->live = false;
+            log->dead_bytes += record->size;
+            // the record stays in the file until the next compaction, so a
+            // marker with its offset tells readers to skip it.
+            uint64_t offset = record->offset;
+            append_record(log, SENTRY_SEGMENT_RECORD_REMOVED,
+                (const char *)&offset, sizeof(offset));
+            maybe_compact(log);
+            break;
+        }
+    }
+    sentry__mutex_unlock(&log->lock);
+}
+
+bool
+sentry__segment_log_has_session(sentry_segment_log_t *log)
+{
+    sentry__mutex_lock(&log->lock);
+    bool has_session = log->has_session;
+    sentry__mutex_unlock(&log->lock);
+    return has_session;
+}
+
+/**
+ * Returns the length of the valid records at the start of `buf`, up to the
+ * first one that is incomplete or corrupted.
+ */
+static size_t
+valid_length(const char *buf, size_t buf_len)
+{
+    size_t offset = 0;
+    while (buf_len - offset >= sizeof(record_header_t)) {
+        record_header_t header;
+        memcpy(&header, buf + offset, sizeof(header));
+        size_t payload = offset + sizeof(header);
+        if (header.magic != RECORD_MAGIC || header.length > buf_len - payload
+            || crc32(buf + payload, header.length) != header.checksum) {
+            SENTRY_WARN("segment log is corrupted, skipping remaining records");
+            break;
+        }
+        offset = payload + header.length;
+    }
+    return offset;
+}
+
+/**
+ * Collects the offsets of the records that were removed, which are rare,
+ * since the log is compacted once they add up.
+ */
+static uint64_t *
+collect_removed(const char *buf, size_t buf_len, size_t *count_out)
+{
+    size_t count = 0;
+    size_t offset = 0;
+    while (offset < buf_len) {
+        record_header_t header;
+        memcpy(&header, buf + offset, sizeof(header));
+        if (header.type == SENTRY_SEGMENT_RECORD_REMOVED
+            && header.length == sizeof(uint64_t)) {
+            count++;
+        }
+        offset += sizeof(header) + header.length;
+    }
+    uint64_t *removed = count ? sentry_malloc(sizeof(uint64_t) * count) : NULL;
+    if (!removed) {
+        *count_out = 0;
+        return NULL;
+    }
+
+    count = 0;
+    offset = 0;
+    while (offset < buf_len) {
+        record_header_t header;
+        memcpy(&header, buf + offset, sizeof(header));
+        offset += sizeof(header);
+        if (header.type == SENTRY_SEGMENT_RECORD_REMOVED
+            && header.length == sizeof(uint64_t)) {
+            memcpy(&removed[count++], buf + offset, sizeof(uint64_t));
+        }
+        offset += header.length;
+    }
+    *count_out = count;
+    return removed;
+}
+
+size_t
+sentry__segment_log_read(const sentry_path_t *path,
+    sentry_segment_record_func_t func, void *data)
+{
+    size_t buf_len;
+    char *buf = sentry__path_read_to_buffer(path, &buf_len);
+    if (!buf) {
+        return 0;
+    }
+    buf_len = valid_length(buf, buf_len);
+    size_t removed_count;
+    uint64_t *removed = collect_removed(buf, buf_len, &removed_count);
+
+    size_t count = 0;
+    size_t offset = 0;
+    while (offset < buf_len) {
+        record_header_t header;
+        memcpy(&header, buf + offset, sizeof(header));
+        bool skip = header.type == SENTRY_SEGMENT_RECORD_REMOVED;
+        for (size_t i = 0; !skip && i < removed_count; i++) {
+            skip = removed[i] == offset;
+        }
+        if (!skip) {
+            func((sentry_segment_record_type_t)header.type,
+                buf + offset + sizeof(header), header.length,
+                header.timestamp, data);
+            count++;
+        }
+        offset += sizeof(header) + header.length;
+    }
+
+    sentry_free(removed);
+    sentry_free(buf);
+    return count;
+}
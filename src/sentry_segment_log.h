@@ -0,0 +1,80 @@
+#ifndef SENTRY_SEGMENT_LOG_H_INCLUDED
+#define SENTRY_SEGMENT_LOG_H_INCLUDED
+
+#include "sentry_boot.h"
+
+#include "sentry_path.h"
+
+/**
+ * An append-only log of length-prefixed and checksummed records, which stores
+ * all the envelopes and sessions of a run in a single file, instead of one
+ * file per envelope.
+ *
+ * Every record consists of a header with a magic, its type, the length and a
+ * CRC32 of its payload and the time it was appended, followed by the payload.
+ * A torn write at the end of the log, for example after a power loss, fails
+ * the checksum, so reading stops at the last complete record.
+ *
+ * The log keeps a small in-memory index of its records, which tracks the
+ * records that were superseded, like previous sessions. Once those make up
+ * most of the log, it is compacted by rewriting only the live records.
+ *
+ * There is one log per run, inside the run directory, so a database still has
+ * a directory, a lock file, and a `session.bin` record file for every run.
+ * The log only replaces the files of the individual envelopes and sessions.
+ */
+typedef struct sentry_segment_log_s sentry_segment_log_t;
+
+typedef enum {
+    SENTRY_SEGMENT_RECORD_ENVELOPE = 1,
+    // supersedes all previous session records
+    SENTRY_SEGMENT_RECORD_SESSION = 2,
+    // marks all previous session records as removed
+    SENTRY_SEGMENT_RECORD_SESSION_CLEAR = 3,
+    // marks the record at the offset in its payload as removed. these are
+    // never passed to a `sentry_segment_record_func_t`.
+    SENTRY_SEGMENT_RECORD_REMOVED = 4,
+} sentry_segment_record_type_t;
+
+typedef void (*sentry_segment_record_func_t)(sentry_segment_record_type_t type,
+    const char *buf, size_t buf_len, uint64_t timestamp, void *data);
+
+/**
+ * Creates a new, empty log at `path`, replacing any existing file.
+ */
+sentry_segment_log_t *sentry__segment_log_new(const sentry_path_t *path);
+
+/**
+ * Closes the log, and frees its index. The file is kept.
+ */
+void sentry__segment_log_free(sentry_segment_log_t *log);
+
+/**
+ * Appends a record of the given `type` and payload to the log. This is
+ * thread-safe. The id of the record is written to `id_out`, if given.
+ */
+bool sentry__segment_log_append(sentry_segment_log_t *log,
+    sentry_segment_record_type_t type, const char *buf, size_t buf_len,
+    uint64_t *id_out);
+
+/**
+ * Removes the record with the given `id` from the log. The record is skipped
+ * by readers right away, and dropped from the file with the next compaction.
+ */
+void sentry__segment_log_remove(sentry_segment_log_t *log, uint64_t id);
+
+/**
+ * Returns true if the log currently has a session that was not cleared.
+ */
+bool sentry__segment_log_has_session(sentry_segment_log_t *log);
+
+/**
+ * Reads the log at `path` with a single sequential read, and calls `func` for
+ * every complete record that was not removed, in the order they were
+ * appended. Reading stops at the first record that is incomplete or
+ * corrupted. Returns the number of records that were passed to `func`.
+ */
+size_t sentry__segment_log_read(const sentry_path_t *path,
+    sentry_segment_record_func_t func, void *data);
+
+#endif
@@ -5,6 +5,7 @@
 #include "sentry_options.h"
 #include "sentry_scope.h"
 #include "sentry_string.h"
+#include "sentry_sync.h"
 #include "sentry_utils.h"
 #include "sentry_value.h"
 
@@ -208,6 +209,128 @@ sentry__session_from_path(const sentry_path_t *path)
     return rv;
 }
 
+static bool
+fits_record_string(const char *src)
+{
+    return !src || strlen(src) < SENTRY_SESSION_RECORD_STRING_MAX;
+}
+
+static void
+update_record_string(char *dst, const char *src)
+{
+    // strings rarely change, so avoid dirtying the mapped memory
+    src = src ? src : "";
+    size_t len = strlen(src) + 1;
+    if (memcmp(dst, src, len) != 0) {
+        memcpy(dst, src, len);
+    }
+}
+
+static void
+record_fence(void)
+{
+#ifdef SENTRY_PLATFORM_WINDOWS
+    MemoryBarrier();
+#else
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+}
+
+bool
+sentry__session_to_record(
+    const sentry_session_t *session, sentry_session_record_t *record)
+{
+    char *did = NULL;
+    if (!sentry_value_is_null(session->distinct_id)) {
+        did = sentry__value_stringify(session->distinct_id);
+    }
+    if (!fits_record_string(session->release)
+        || !fits_record_string(session->environment)
+        || !fits_record_string(did)) {
+        sentry_free(did);
+        return false;
+    }
+
+    // an update that was interrupted by the crash handler leaves an odd
+    // sequence behind, which the crash handler then completes.
+    uint32_t sequence = record->sequence | 1;
+    record->sequence = sequence;
+    record_fence();
+
+    update_record_string(record->release, session->release);
+    update_record_string(record->environment, session->environment);
+    update_record_string(record->distinct_id, did);
+    sentry_free(did);
+
+    record->session_id = session->session_id;
+    record->status = (uint32_t)session->status;
+    record->init = session->init;
+    record->errors = session->errors;
+    record->started_ms = session->started_ms;
+    // like the json of a session, the record stores the elapsed time at the
+    // time of writing, so a session restored at the next launch does not
+    // count the time in between.
+    record->duration_ms = session->duration_ms != (uint64_t)-1
+        ? session->duration_ms
+        : sentry__msec_time() - session->started_ms;
+    record->active = 1;
+
+    record_fence();
+    record->sequence = sequence + 1;
+
+    return true;
+}
+
+static char *
+record_string(const char *buf)
+{
+    size_t len = strnlen(buf, SENTRY_SESSION_RECORD_STRING_MAX);
+    if (len == 0 || len >= SENTRY_SESSION_RECORD_STRING_MAX) {
+        return NULL;
+    }
+    return sentry__string_clonen(buf, len);
+}
+
+sentry_session_t *
+sentry__session_from_record(const char *buf, size_t buf_len)
+{
+    if (buf_len < sizeof(sentry_session_record_t)) {
+        return NULL;
+    }
+    const sentry_session_record_t *record
+        = (const sentry_session_record_t *)buf;
+    if (record->magic != SENTRY_SESSION_RECORD_MAGIC
+        || record->version != SENTRY_SESSION_RECORD_VERSION || !record->active
+        || (record->sequence & 1)
+        || record->status > SENTRY_SESSION_STATUS_EXITED) {
+        return NULL;
+    }
+
+    char *release = record_string(record->release);
+    if (!release) {
+        return NULL;
+    }
+
+    sentry_session_t *rv = SENTRY_MAKE(sentry_session_t);
+    if (!rv) {
+        sentry_free(release);
+        return NULL;
+    }
+    rv->release = release;
+    rv->environment = record_string(record->environment);
+    rv->session_id = record->session_id;
+    char *did = record_string(record->distinct_id);
+    rv->distinct_id
+        = did ? sentry__value_new_string_owned(did) : sentry_value_new_null();
+    rv->status = (sentry_session_status_t)record->status;
+    rv->init = record->init;
+    rv->errors = record->errors;
+    rv->started_ms = record->started_ms;
+    rv->duration_ms = record->duration_ms;
+
+    return rv;
+}
+
 void
 sentry_start_session(void)
 {
@@ -283,3 +406,339 @@ sentry__add_current_session_to_envelope(sentry_envelope_t *envelope)
         }
     }
 }
+
+/**
+ * Request Session Aggregates:
+ *
+ * Request-mode sessions are never persisted individually. Instead, they are
+ * counted in buckets, keyed by the start of the minute they were recorded in,
+ * and their `distinct_id`. The buckets live in an open-addressing hash table,
+ * which is swapped out and sent as a single `sessions` envelope item whenever
+ * it is flushed periodically by a background worker, and on shutdown.
+ */
+typedef struct {
+    uint64_t started;
+    uint64_t hash;
+    char *distinct_id;
+    uint32_t counts[4];
+} session_bucket_t;
+
+typedef struct {
+    session_bucket_t *buckets;
+    size_t len;
+    size_t capacity;
+} session_aggregates_t;
+
+typedef struct {
+    sentry_mutex_t lock;
+    sentry_cond_t signal;
+    uint64_t interval;
+    bool shutdown;
+} aggregates_flusher_state_t;
+
+// The aggregates never hold more than this many buckets. Beyond that, new
+// `distinct_id`s are not tracked any more, and sessions that do not fit any
+// existing bucket are dropped until the next flush.
+#define MAX_SESSION_AGGREGATES 1000
+
+static session_aggregates_t g_aggregates = { NULL, 0, 0 };
+static sentry_bgworker_t *g_aggregates_flusher = NULL;
+static sentry_mutex_t g_aggregates_lock = SENTRY__MUTEX_INIT;
+
+static uint64_t
+bucket_hash(uint64_t started, const char *distinct_id)
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < sizeof(started); i++) {
+        hash ^= (started >> (i * 8)) & 0xff;
+        hash *= 1099511628211ULL;
+    }
+    for (const char *c = distinct_id; c && *c; c++) {
+        hash ^= (uint8_t)*c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static session_bucket_t *
+aggregates_find_slot(session_bucket_t *buckets, size_t capacity,
+    uint64_t started, uint64_t hash, const char *distinct_id)
+{
+    size_t mask = capacity - 1;
+    for (size_t i = (size_t)hash & mask;; i = (i + 1) & mask) {
+        session_bucket_t *bucket = &buckets[i];
+        if (!bucket->started
+            || (bucket->hash == hash && bucket->started == started
+                && (bucket->distinct_id == distinct_id
+                    || (bucket->distinct_id && distinct_id
+                        && sentry__string_eq(
+                            bucket->distinct_id, distinct_id))))) {
+            return bucket;
+        }
+    }
+}
+
+static bool
+aggregates_grow(session_aggregates_t *aggregates)
+{
+    size_t capacity = aggregates->capacity ? aggregates->capacity * 2 : 16;
+    session_bucket_t *buckets
+        = sentry_malloc(sizeof(session_bucket_t) * capacity);
+    if (!buckets) {
+        return false;
+    }
+    memset(buckets, 0, sizeof(session_bucket_t) * capacity);
+    for (size_t i = 0; i < aggregates->capacity; i++) {
+        session_bucket_t *bucket = &aggregates->buckets[i];
+        if (bucket->started) {
+            *aggregates_find_slot(buckets, capacity, bucket->started,
+                bucket->hash, bucket->distinct_id)
+                = *bucket;
+        }
+    }
+    sentry_free(aggregates->buckets);
+    aggregates->buckets = buckets;
+    aggregates->capacity = capacity;
+    return true;
+}
+
+/**
+ * Returns the bucket for `started` and `distinct_id`, which is only created
+ * if `create` is set. Returns `NULL` otherwise.
+ */
+static session_bucket_t *
+aggregates_get_bucket(session_aggregates_t *aggregates, uint64_t started,
+    const char *distinct_id, bool create)
+{
+    // keep the load factor below 3/4
+    if ((aggregates->len + 1) * 4 > aggregates->capacity * 3
+        && !aggregates_grow(aggregates)) {
+        return NULL;
+    }
+    uint64_t hash = bucket_hash(started, distinct_id);
+    session_bucket_t *bucket = aggregates_find_slot(aggregates->buckets,
+        aggregates->capacity, started, hash, distinct_id);
+    if (!bucket->started) {
+        if (!create) {
+            return NULL;
+        }
+        bucket->started = started;
+        bucket->hash = hash;
+        bucket->distinct_id = sentry__string_clone(distinct_id);
+        aggregates->len++;
+    }
+    return bucket;
+}
+
+static void
+aggregates_free(session_aggregates_t *aggregates)
+{
+    for (size_t i = 0; i < aggregates->capacity; i++) {
+        sentry_free(aggregates->buckets[i].distinct_id);
+    }
+    sentry_free(aggregates->buckets);
+}
+
+static void
+aggregates_to_json(const session_aggregates_t *aggregates,
+    const char *release, const char *environment, sentry_jsonwriter_t *jw)
+{
+    static const char *status_keys[]
+        = { "exited", "errored", "crashed", "abnormal" };
+
+    sentry__jsonwriter_write_object_start(jw);
+    sentry__jsonwriter_write_key(jw, "aggregates");
+    sentry__jsonwriter_write_list_start(jw);
+    for (size_t i = 0; i < aggregates->capacity; i++) {
+        const session_bucket_t *bucket = &aggregates->buckets[i];
+        if (!bucket->started) {
+            continue;
+        }
+        sentry__jsonwriter_write_object_start(jw);
+        sentry__jsonwriter_write_key(jw, "started");
+        sentry__jsonwriter_write_msec_timestamp(jw, bucket->started);
+        if (bucket->distinct_id) {
+            sentry__jsonwriter_write_key(jw, "did");
+            sentry__jsonwriter_write_str(jw, bucket->distinct_id);
+        }
+        for (size_t j = 0; j < 4; j++) {
+            if (bucket->counts[j]) {
+                sentry__jsonwriter_write_key(jw, status_keys[j]);
+                sentry__jsonwriter_write_int32(jw, (int32_t)bucket->counts[j]);
+            }
+        }
+        sentry__jsonwriter_write_object_end(jw);
+    }
+    sentry__jsonwriter_write_list_end(jw);
+
+    sentry__jsonwriter_write_key(jw, "attrs");
+    sentry__jsonwriter_write_object_start(jw);
+    sentry__jsonwriter_write_key(jw, "release");
+    sentry__jsonwriter_write_str(jw, release);
+    sentry__jsonwriter_write_key(jw, "environment");
+    sentry__jsonwriter_write_str(jw, environment);
+    sentry__jsonwriter_write_object_end(jw);
+    sentry__jsonwriter_write_object_end(jw);
+}
+
+void
+sentry__session_aggregates_flush(void)
+{
+    sentry__mutex_lock(&g_aggregates_lock);
+    session_aggregates_t aggregates = g_aggregates;
+    memset(&g_aggregates, 0, sizeof(session_aggregates_t));
+    sentry__mutex_unlock(&g_aggregates_lock);
+
+    if (!aggregates.len) {
+        aggregates_free(&aggregates);
+        return;
+    }
+
+    SENTRY_WITH_OPTIONS (options) {
+        // just like normal sessions, aggregates require a release
+        if (!options->release) {
+            break;
+        }
+        sentry_jsonwriter_t *jw = sentry__jsonwriter_new_in_memory();
+        if (!jw) {
+            break;
+        }
+        aggregates_to_json(
+            &aggregates, options->release, options->environment, jw);
+        size_t payload_len = 0;
+        char *payload = sentry__jsonwriter_into_string(jw, &payload_len);
+        if (!payload) {
+            break;
+        }
+
+        sentry_envelope_t *envelope = sentry__envelope_new();
+        sentry__envelope_add_from_buffer(
+            envelope, payload, payload_len, "sessions");
+        sentry_free(payload);
+        sentry__capture_envelope(options->transport, envelope);
+    }
+    aggregates_free(&aggregates);
+}
+
+static void
+aggregates_flusher_state_free(void *_state)
+{
+    aggregates_flusher_state_t *state = _state;
+    sentry__mutex_free(&state->lock);
+    sentry_free(state);
+}
+
+static void
+aggregates_flush_task(void *UNUSED(task_data), void *_state)
+{
+    aggregates_flusher_state_t *state = _state;
+    uint64_t next_flush = sentry__monotonic_time() + state->interval;
+
+    sentry__mutex_lock(&state->lock);
+    while (!state->shutdown) {
+        uint64_t now = sentry__monotonic_time();
+        if (now < next_flush) {
+            sentry__cond_wait_timeout(
+                &state->signal, &state->lock, next_flush - now);
+            continue;
+        }
+        sentry__mutex_unlock(&state->lock);
+        sentry__session_aggregates_flush();
+        sentry__mutex_lock(&state->lock);
+        next_flush = now + state->interval;
+    }
+    sentry__mutex_unlock(&state->lock);
+}
+
+/**
+ * Lazily starts the periodic flusher. Must be called with `g_aggregates_lock`
+ * being held.
+ */
+static void
+aggregates_flusher_start(void)
+{
+    uint64_t interval = 0;
+    SENTRY_WITH_OPTIONS (options) {
+        interval = options->request_session_flush_interval;
+    }
+    if (!interval) {
+        return;
+    }
+
+    aggregates_flusher_state_t *state
+        = SENTRY_MAKE(aggregates_flusher_state_t);
+    if (!state) {
+        return;
+    }
+    memset(state, 0, sizeof(aggregates_flusher_state_t));
+    sentry__mutex_init(&state->lock);
+    sentry__cond_init(&state->signal);
+    state->interval = interval;
+
+    sentry_bgworker_t *bgw
+        = sentry__bgworker_new(state, aggregates_flusher_state_free);
+    if (!bgw) {
+        aggregates_flusher_state_free(state);
+        return;
+    }
+    sentry__bgworker_setname(bgw, "sentry-sessions");
+    if (sentry__bgworker_start(bgw) != 0
+        || sentry__bgworker_submit(bgw, aggregates_flush_task, NULL, NULL)
+            != 0) {
+        SENTRY_WARN("failed to start the session aggregates flusher");
+        sentry__bgworker_decref(bgw);
+        return;
+    }
+    g_aggregates_flusher = bgw;
+}
+
+void
+sentry__session_aggregates_shutdown(void)
+{
+    sentry__mutex_lock(&g_aggregates_lock);
+    sentry_bgworker_t *bgw = g_aggregates_flusher;
+    g_aggregates_flusher = NULL;
+    sentry__mutex_unlock(&g_aggregates_lock);
+
+    if (bgw) {
+        aggregates_flusher_state_t *state = sentry__bgworker_get_state(bgw);
+        sentry__mutex_lock(&state->lock);
+        state->shutdown = true;
+        sentry__cond_wake(&state->signal);
+        sentry__mutex_unlock(&state->lock);
+
+        sentry__bgworker_shutdown(bgw, SENTRY_DEFAULT_SHUTDOWN_TIMEOUT);
+        sentry__bgworker_decref(bgw);
+    }
+
+    sentry__session_aggregates_flush();
+}
+
+void
+sentry_record_request_session(
+    sentry_request_session_status_t status, const char *distinct_id)
+{
+    if ((unsigned)status > SENTRY_REQUEST_SESSION_ABNORMAL) {
+        return;
+    }
+    // aggregates are bucketed by the minute
+    uint64_t started = sentry__msec_time() / 60000 * 60000;
+
+    sentry__mutex_lock(&g_aggregates_lock);
+    bool is_full = g_aggregates.len >= MAX_SESSION_AGGREGATES;
+    session_bucket_t *bucket = aggregates_get_bucket(
+        &g_aggregates, started, distinct_id, !is_full);
+    if (!bucket && is_full) {
+        bucket = aggregates_get_bucket(&g_aggregates, started, NULL, false);
+    }
+    if (bucket) {
+        bucket->counts[status]++;
+    } else if (is_full) {
+        SENTRY_DEBUG("dropping request session exceeding the aggregates limit");
+    }
+    if (!g_aggregates_flusher) {
+        aggregates_flusher_start();
+    }
+    sentry__mutex_unlock(&g_aggregates_lock);
+}
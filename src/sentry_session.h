@@ -31,6 +31,34 @@ typedef struct sentry_session_s {
     bool init;
 } sentry_session_t;
 
+#define SENTRY_SESSION_RECORD_MAGIC 0x52535353 // `SSSR` in little endian
+#define SENTRY_SESSION_RECORD_VERSION 1
+#define SENTRY_SESSION_RECORD_STRING_MAX 256
+
+/**
+ * This is a fixed-layout binary representation of a session, which is
+ * persisted in a memory mapped file, and is updated in place.
+ * The record only holds a session when `active` is set.
+ *
+ * `sequence` is odd while an update is in progress, so a record that was torn
+ * by a crash or power loss in the middle of an update can be detected.
+ */
+typedef struct sentry_session_record_s {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t active;
+    uint32_t status;
+    uint32_t init;
+    uint32_t sequence;
+    uint64_t errors;
+    uint64_t started_ms;
+    uint64_t duration_ms;
+    sentry_uuid_t session_id;
+    char release[SENTRY_SESSION_RECORD_STRING_MAX];
+    char environment[SENTRY_SESSION_RECORD_STRING_MAX];
+    char distinct_id[SENTRY_SESSION_RECORD_STRING_MAX];
+} sentry_session_record_t;
+
 /**
  * This creates a new session.
  */
@@ -59,6 +87,21 @@ sentry_session_t *sentry__session_from_json(const char *buf, size_t buf_len);
  */
 sentry_session_t *sentry__session_from_path(const sentry_path_t *path);
 
+/**
+ * This will update the `record` in place to hold the given `session`.
+ * Strings are only written when they changed.
+ * Returns false if the session does not fit into the fixed-size record, in
+ * which case the record is left untouched.
+ */
+bool sentry__session_to_record(
+    const sentry_session_t *session, sentry_session_record_t *record);
+
+/**
+ * This will create a session out of the binary session record in `buf`, or
+ * return NULL if the record is invalid or does not hold a session.
+ */
+sentry_session_t *sentry__session_from_record(const char *buf, size_t buf_len);
+
 /**
  * This will end the current session with an explicit `status` code.
  */
@@ -75,4 +118,16 @@ void sentry__record_errors_on_current_session(uint32_t error_count);
  */
 void sentry__add_current_session_to_envelope(sentry_envelope_t *envelope);
 
+/**
+ * This will send all the request session aggregates recorded so far as a
+ * single `sessions` envelope item.
+ */
+void sentry__session_aggregates_flush(void);
+
+/**
+ * This will stop the periodic flush of the request session aggregates, and
+ * flush all remaining aggregates immediately.
+ */
+void sentry__session_aggregates_shutdown(void);
+
 #endif
@@ -18,4 +18,20 @@ typedef struct sentry_frame_info_s {
 bool sentry__symbolize(
     void *addr, void (*func)(const sentry_frame_info_t *, void *), void *data);
 
+typedef void (*sentry_symbolize_batch_func_t)(
+    const sentry_frame_info_t *info, size_t index, void *data);
+
+/**
+ * This will symbolize all of the `count` provided `addrs`, and call `func`
+ * with a populated frame info and the index of the address for every address
+ * that could be symbolized. `NULL` addresses are skipped.
+ */
+void sentry__symbolize_batch(void *const *addrs, size_t count,
+    sentry_symbolize_batch_func_t func, void *data);
+
+/**
+ * Frees all the state that the symbolizer has cached.
+ */
+void sentry__symbolizer_cleanup(void);
+
 #endif
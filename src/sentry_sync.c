@@ -446,3 +446,51 @@ sentry__leave_signal_handler(void)
     __sync_fetch_and_and(&g_in_signal_handler, 0);
 }
 #endif
+
+#ifdef SENTRY_PLATFORM_WINDOWS
+#    define sentry__cpu_relax() YieldProcessor()
+#endif
+
+void *
+sentry__published_acquire(
+    sentry_published_t *published, void (*incref_func)(void *ptr))
+{
+    // register as a reader of the current epoch, making sure that the epoch
+    // has not been flipped concurrently.
+    long epoch;
+    while (true) {
+        epoch = sentry__atomic_fetch(&published->epoch) & 1;
+        sentry__atomic_fetch_and_add(&published->readers[epoch], 1);
+        if ((sentry__atomic_fetch(&published->epoch) & 1) == epoch) {
+            break;
+        }
+        sentry__atomic_fetch_and_add(&published->readers[epoch], -1);
+    }
+
+    void *ptr = sentry__atomic_fetch_ptr(&published->ptr);
+    if (ptr) {
+        incref_func(ptr);
+    }
+
+    sentry__atomic_fetch_and_add(&published->readers[epoch], -1);
+    return ptr;
+}
+
+void *
+sentry__published_exchange(
+    sentry_published_t *published, void *ptr, long *epoch_out)
+{
+    void *previous = sentry__atomic_exchange_ptr(&published->ptr, ptr);
+    *epoch_out = sentry__atomic_fetch_and_add(&published->epoch, 1) & 1;
+    return previous;
+}
+
+void
+sentry__published_wait(sentry_published_t *published, long epoch)
+{
+    // readers of a later epoch with the same parity might be waited for as
+    // well, which is harmless, as they leave just as quickly.
+    while (sentry__atomic_fetch(&published->readers[epoch & 1])) {
+        sentry__cpu_relax();
+    }
+}
@@ -311,6 +311,76 @@ sentry__atomic_fetch(volatile long *val)
     return sentry__atomic_fetch_and_add(val, 0);
 }
 
+static inline void *
+sentry__atomic_exchange_ptr(void *volatile *ptr, void *value)
+{
+#ifdef SENTRY_PLATFORM_WINDOWS
+    return InterlockedExchangePointer((PVOID volatile *)ptr, value);
+#else
+    return __atomic_exchange_n(ptr, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static inline void *
+sentry__atomic_fetch_ptr(void *volatile *ptr)
+{
+#ifdef SENTRY_PLATFORM_WINDOWS
+    return InterlockedCompareExchangePointer((PVOID volatile *)ptr, NULL, NULL);
+#else
+    return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/**
+ * A published pointer to an immutable, refcounted object, which readers can
+ * acquire without taking any lock, also from within signal handlers.
+ *
+ * Acquiring means loading the pointer *and* incrementing the refcount of the
+ * object, which is not atomic as a whole. To avoid freeing an object that a
+ * reader has just loaded but not yet incref-ed, readers register themselves in
+ * one of two counters, selected by the current `epoch`. Replacing the pointer
+ * flips the epoch, and the previous object may only be released once all the
+ * readers of the previous epoch have left. Readers only stay registered for a
+ * handful of instructions.
+ */
+typedef struct {
+    void *volatile ptr;
+    volatile long epoch;
+    volatile long readers[2];
+} sentry_published_t;
+
+#define SENTRY__PUBLISHED_INIT { NULL, 0, { 0, 0 } }
+
+/**
+ * Loads the published pointer, and increments the refcount of the object via
+ * `incref_func`, unless the pointer is `NULL`.
+ */
+void *sentry__published_acquire(
+    sentry_published_t *published, void (*incref_func)(void *ptr));
+
+/**
+ * Replaces the published pointer, and returns the previous one, which readers
+ * might still be about to incref. The previous epoch is written to
+ * `epoch_out`, which needs to be waited for via `sentry__published_wait`
+ * before the previous object can be released. Concurrent writers need to be
+ * serialized by the caller.
+ */
+void *sentry__published_exchange(
+    sentry_published_t *published, void *ptr, long *epoch_out);
+
+/**
+ * Waits for all the readers of `epoch` to leave. This does not need to be
+ * serialized with the writers, so it can happen after the writer lock is
+ * released.
+ */
+void sentry__published_wait(sentry_published_t *published, long epoch);
+
+#ifdef _MSC_VER
+#    define SENTRY_THREAD_LOCAL __declspec(thread)
+#else
+#    define SENTRY_THREAD_LOCAL __thread
+#endif
+
 struct sentry_bgworker_s;
 typedef struct sentry_bgworker_s sentry_bgworker_t;
 
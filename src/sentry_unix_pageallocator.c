@@ -2,6 +2,7 @@
 #include "sentry_core.h"
 #include "sentry_unix_spinlock.h"
 
+#include <string.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
@@ -10,7 +11,15 @@
 #    define MAP_ANONYMOUS MAP_ANON
 #endif
 
-#define ALIGN 8
+#define ALIGN 16
+#define ALIGN_UP(Size) (((Size) + ALIGN - 1) & ~(size_t)(ALIGN - 1))
+
+// blocks are sized in powers of two, starting at 32 bytes including the header
+#define MIN_CLASS_SHIFT 5
+#define NUM_CLASSES 32
+
+// when the reserved memory is exhausted, map at least this many bytes at once
+#define MIN_CHUNK_SIZE (64 * 1024)
 
 struct page_header;
 struct page_header {
@@ -18,12 +27,24 @@ struct page_header {
     size_t num_pages;
 };
 
+/**
+ * Every allocation is prefixed with this header. Freed blocks are put onto the
+ * free list of their size class, which is linked through the header, so the
+ * memory of a freed block itself stays untouched.
+ */
+struct block_header;
+struct block_header {
+    struct block_header *next;
+    size_t size_class;
+};
+
 struct page_allocator_s {
     size_t page_size;
     struct page_header *last_page;
     char *current_page;
-    size_t page_offset;
-    size_t pages_allocated;
+    char *current_page_end;
+    struct block_header *free_lists[NUM_CLASSES];
+    sentry_page_allocator_stats_t stats;
 };
 
 static struct page_allocator_s g_page_allocator_backing = { 0 };
@@ -36,44 +57,77 @@ sentry__page_allocator_enabled(void)
     return !!g_alloc;
 }
 
+static void
+init_page_size(void)
+{
+    if (!g_page_allocator_backing.page_size) {
+        g_page_allocator_backing.page_size = getpagesize();
+    }
+}
+
 void
 sentry__page_allocator_enable(void)
 {
     sentry__spinlock_lock(&g_lock);
     if (!g_alloc) {
+        init_page_size();
         g_alloc = &g_page_allocator_backing;
-        g_alloc->page_size = getpagesize();
-        g_alloc->last_page = NULL;
-        g_alloc->current_page = NULL;
-        g_alloc->page_offset = 0;
-        g_alloc->pages_allocated = 0;
     }
     sentry__spinlock_unlock(&g_lock);
 }
 
-static void *
-get_pages(size_t num_pages)
+static bool
+get_pages(struct page_allocator_s *alloc, size_t num_pages)
 {
-    void *rv = mmap(NULL, g_alloc->page_size * num_pages,
-        PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    size_t size = alloc->page_size * num_pages;
+    void *rv = mmap(NULL, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
     if (rv == MAP_FAILED) {
-        return NULL;
+        return false;
     }
 
 #if defined(__has_feature)
 #    if __has_feature(memory_sanitizer)
-    __msan_unpoison(rv, g_alloc->page_size * num_pages);
+    __msan_unpoison(rv, size);
 #    endif
 #endif
 
     struct page_header *header = (struct page_header *)rv;
-    header->next = g_alloc->last_page;
+    header->next = alloc->last_page;
     header->num_pages = num_pages;
-    g_alloc->last_page = header;
+    alloc->last_page = header;
+
+    // the rest of the previous chunk is abandoned
+    alloc->current_page = (char *)rv + ALIGN_UP(sizeof(struct page_header));
+    alloc->current_page_end = (char *)rv + size;
+    alloc->stats.mapped_bytes += size;
 
-    g_alloc->pages_allocated += num_pages;
+    return true;
+}
+
+static size_t
+pages_for(const struct page_allocator_s *alloc, size_t size)
+{
+    return (ALIGN_UP(sizeof(struct page_header)) + size + alloc->page_size - 1)
+        / alloc->page_size;
+}
 
-    return rv;
+void
+sentry__page_allocator_reserve(size_t size)
+{
+    if (!size) {
+        return;
+    }
+    sentry__spinlock_lock(&g_lock);
+    init_page_size();
+    struct page_allocator_s *alloc = &g_page_allocator_backing;
+    // a previous reservation is still unused, as the allocator is only enabled
+    // once we crash, so it can be reused on repeated initialization.
+    if (alloc->stats.reserved_bytes < size
+        && get_pages(alloc, pages_for(alloc, size))) {
+        alloc->stats.reserved_bytes = size;
+    }
+    sentry__spinlock_unlock(&g_lock);
 }
 
 void *
@@ -83,60 +137,110 @@ sentry__page_allocator_alloc(size_t size)
         return NULL;
     }
 
-    // make sure the requested size is correctly aligned
-    size_t diff = size % ALIGN;
-    size = size + ALIGN - diff;
+    size_t size_class = 0;
+    size_t block_size = (size_t)1 << MIN_CLASS_SHIFT;
+    while (block_size - sizeof(struct block_header) < size) {
+        if (++size_class == NUM_CLASSES) {
+            return NULL;
+        }
+        block_size <<= 1;
+    }
 
-    char *rv = NULL;
+    struct block_header *block = NULL;
 
     sentry__spinlock_lock(&g_lock);
 
-    // current page is large enough
-    if (g_alloc->current_page
-        && g_alloc->page_size - g_alloc->page_offset >= size) {
-        rv = g_alloc->current_page + g_alloc->page_offset;
-        g_alloc->page_offset += size;
-        if (g_alloc->page_offset == g_alloc->page_size) {
-            g_alloc->page_offset = 0;
-            g_alloc->current_page = NULL;
-        }
+    if (g_alloc->free_lists[size_class]) {
+        // recycle a previously freed block of the same size class
+        block = g_alloc->free_lists[size_class];
+        g_alloc->free_lists[size_class] = block->next;
     } else {
-        // allocate new pages
-
-        size_t requested_size = size + sizeof(struct page_header);
-        size_t pages
-            = (requested_size + g_alloc->page_size - 1) / g_alloc->page_size;
-        size_t actual_size = g_alloc->page_size * pages;
-
-        rv = get_pages(pages);
-
-        if (rv) {
-            size_t diff = actual_size - requested_size;
-            g_alloc->page_offset
-                = (g_alloc->page_size - diff) % g_alloc->page_size;
-            g_alloc->current_page = g_alloc->page_offset
-                ? rv + g_alloc->page_size * (pages - 1)
-                : NULL;
-            rv += sizeof(struct page_header);
+        if (!g_alloc->current_page
+            || (size_t)(g_alloc->current_page_end - g_alloc->current_page)
+                < block_size) {
+            // allocate new pages
+            size_t chunk_size
+                = block_size > MIN_CHUNK_SIZE ? block_size : MIN_CHUNK_SIZE;
+            if (get_pages(g_alloc, pages_for(g_alloc, chunk_size))) {
+                g_alloc->stats.overflow_maps++;
+            } else {
+                g_alloc->current_page = NULL;
+            }
+        }
+        if (g_alloc->current_page) {
+            block = (struct block_header *)g_alloc->current_page;
+            g_alloc->current_page += block_size;
         }
     }
 
+    if (block) {
+        block->next = NULL;
+        block->size_class = size_class;
+        g_alloc->stats.allocations++;
+        g_alloc->stats.in_use_bytes += block_size;
+        if (g_alloc->stats.in_use_bytes > g_alloc->stats.high_water_bytes) {
+            g_alloc->stats.high_water_bytes = g_alloc->stats.in_use_bytes;
+        }
+    }
+
+    sentry__spinlock_unlock(&g_lock);
+    return block ? (char *)block + sizeof(struct block_header) : NULL;
+}
+
+bool
+sentry__page_allocator_free(void *ptr)
+{
+    if (!ptr) {
+        return true;
+    }
+
+    bool owned = false;
+    sentry__spinlock_lock(&g_lock);
+
+    // memory that was allocated before the allocator was enabled does not
+    // live in one of our chunks
+    for (struct page_header *cur = g_alloc->last_page; cur; cur = cur->next) {
+        char *start = (char *)cur;
+        char *end = start + cur->num_pages * g_alloc->page_size;
+        if ((char *)ptr > start && (char *)ptr < end) {
+            owned = true;
+            break;
+        }
+    }
+
+    if (owned) {
+        struct block_header *block = (struct block_header *)((char *)ptr
+            - sizeof(struct block_header));
+        block->next = g_alloc->free_lists[block->size_class];
+        g_alloc->free_lists[block->size_class] = block;
+        g_alloc->stats.frees++;
+        g_alloc->stats.in_use_bytes
+            -= (size_t)1 << (block->size_class + MIN_CLASS_SHIFT);
+    }
+
+    sentry__spinlock_unlock(&g_lock);
+    return owned;
+}
+
+void
+sentry__page_allocator_get_stats(sentry_page_allocator_stats_t *stats)
+{
+    sentry__spinlock_lock(&g_lock);
+    *stats = g_page_allocator_backing.stats;
     sentry__spinlock_unlock(&g_lock);
-    return rv;
 }
 
 #if SENTRY_UNITTEST
 void
 sentry__page_allocator_disable(void)
 {
-    if (!g_alloc) {
-        return;
-    }
+    struct page_allocator_s *alloc = &g_page_allocator_backing;
     struct page_header *next;
-    for (struct page_header *cur = g_alloc->last_page; cur; cur = next) {
+    for (struct page_header *cur = alloc->last_page; cur; cur = next) {
         next = cur->next;
-        munmap(cur, cur->num_pages * g_alloc->page_size);
+        munmap(cur, cur->num_pages * alloc->page_size);
     }
+    memset(alloc, 0, sizeof(struct page_allocator_s));
     g_alloc = NULL;
 }
 #endif
@@ -3,6 +3,21 @@
 
 #include "sentry_boot.h"
 
+/**
+ * Statistics of the page allocator, which are useful to tune the size of the
+ * reserved memory.
+ */
+typedef struct {
+    size_t reserved_bytes;
+    size_t mapped_bytes;
+    size_t in_use_bytes;
+    size_t high_water_bytes;
+    size_t allocations;
+    size_t frees;
+    // number of `mmap`s that happened because the reservation was exhausted
+    size_t overflow_maps;
+} sentry_page_allocator_stats_t;
+
 /**
  * Returns the state of the page allocator.
  */
@@ -15,12 +30,33 @@ bool sentry__page_allocator_enabled(void);
  */
 void sentry__page_allocator_enable(void);
 
+/**
+ * Reserves `size` bytes of memory up front, which the page allocator will use
+ * once it is enabled, so that it does not need to map new pages inside of a
+ * signal handler. This should be called when starting up a backend.
+ */
+void sentry__page_allocator_reserve(size_t size);
+
 /**
  * This is a replacement for `malloc`, but will return an allocation from
  * anonymously mapped pages.
  */
 void *sentry__page_allocator_alloc(size_t size);
 
+/**
+ * This is a replacement for `free`. Freed blocks are recycled for allocations
+ * of the same size class.
+ * Returns `false` if `ptr` was not allocated by the page allocator, in which
+ * case it is left alone, as it is not safe to call `free` inside of a signal
+ * handler.
+ */
+bool sentry__page_allocator_free(void *ptr);
+
+/**
+ * Copies the current allocator statistics into `stats`.
+ */
+void sentry__page_allocator_get_stats(sentry_page_allocator_stats_t *stats);
+
 #if SENTRY_UNITTEST
 /**
  * This disables the page allocator, which invalidates every allocation that was
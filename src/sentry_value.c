@@ -586,6 +586,57 @@ sentry__value_clone(sentry_value_t value)
     }
 }
 
+sentry_value_t
+sentry__value_clone_deep(sentry_value_t value)
+{
+    const thing_t *thing = value_as_thing(value);
+    if (!thing || thing_is_frozen(thing)) {
+        // frozen values can never change, so they are safe to share
+        sentry_value_incref(value);
+        return value;
+    }
+    switch (thing_get_type(thing)) {
+    case THING_TYPE_LIST: {
+        const list_t *list = thing->payload._ptr;
+        sentry_value_t rv = sentry__value_new_list_with_size(list->len);
+        for (size_t i = 0; i < list->len; i++) {
+            sentry_value_append(rv, sentry__value_clone_deep(list->items[i]));
+        }
+        return rv;
+    }
+    case THING_TYPE_OBJECT: {
+        const obj_t *obj = thing->payload._ptr;
+        sentry_value_t rv = sentry__value_new_object_with_size(obj->len);
+        for (size_t i = 0; i < obj->len; i++) {
+            sentry_value_set_by_key(rv, obj->pairs[i].k,
+                sentry__value_clone_deep(obj->pairs[i].v));
+        }
+        return rv;
+    }
+    default:
+        sentry_value_incref(value);
+        return value;
+    }
+}
+
+int
+sentry__value_merge_objects(sentry_value_t dst, sentry_value_t src)
+{
+    const thing_t *thing = value_as_thing(src);
+    if (!thing || thing_get_type(thing) != THING_TYPE_OBJECT) {
+        return 1;
+    }
+    const obj_t *obj = thing->payload._ptr;
+    for (size_t i = 0; i < obj->len; i++) {
+        sentry_value_incref(obj->pairs[i].v);
+        if (sentry_value_set_by_key(dst, obj->pairs[i].k, obj->pairs[i].v)
+            != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 int
 sentry__value_append_bounded(sentry_value_t value, sentry_value_t v, size_t max)
 {
@@ -900,6 +951,20 @@ sentry_value_to_msgpack(sentry_value_t value, size_t *size_out)
     return buf;
 }
 
+size_t
+sentry__value_to_msgpack_buffer(
+    sentry_value_t value, char *buf, size_t buf_len)
+{
+    mpack_writer_t writer;
+    mpack_writer_init(&writer, buf, buf_len);
+    value_to_msgpack(&writer, value);
+    size_t size = mpack_writer_buffer_used(&writer);
+    if (mpack_writer_destroy(&writer) != mpack_ok) {
+        return 0;
+    }
+    return size;
+}
+
 sentry_value_t
 sentry__value_new_string_owned(char *s)
 {
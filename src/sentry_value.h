@@ -65,6 +65,29 @@ char *sentry__value_stringify(sentry_value_t value);
  */
 sentry_value_t sentry__value_clone(sentry_value_t value);
 
+/**
+ * Performs a deep clone, which copies all nested lists and objects. Frozen
+ * values are shared instead of being copied, as they can not change anyway.
+ */
+sentry_value_t sentry__value_clone_deep(sentry_value_t value);
+
+/**
+ * This sets all the key-value pairs of the Object `src` on the Object `dst`,
+ * overwriting keys which already exist in `dst`.
+ *
+ * Returns 0 on success.
+ */
+int sentry__value_merge_objects(sentry_value_t dst, sentry_value_t src);
+
+/**
+ * Serializes `value` to msgpack into the given fixed-size buffer, without
+ * allocating any memory.
+ *
+ * Returns the number of bytes written, or 0 if `buf` was too small.
+ */
+size_t sentry__value_to_msgpack_buffer(
+    sentry_value_t value, char *buf, size_t buf_len);
+
 /**
  * This appends `v` to the List `value`.
  * It will remove the first value of the list, is case the total number if items
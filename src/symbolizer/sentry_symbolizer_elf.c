@@ -0,0 +1,433 @@
+#include "sentry_symbolizer_elf.h"
+
+#include "modulefinder/sentry_modulefinder_linux.h"
+#include "sentry_alloc.h"
+#include "sentry_core.h"
+#include "sentry_module_index.h"
+#include "sentry_string.h"
+#include "sentry_sync.h"
+
+#include <elf.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct {
+    uint64_t addr;
+    uint64_t size;
+    uint32_t name;
+} elf_symbol_t;
+
+/**
+ * The sorted function symbols of one ELF file, keyed by its code id, or its
+ * path if it has none. The addresses are the ones from the file, which are
+ * relative to `load_vaddr` once the file is loaded.
+ */
+typedef struct elf_symtab_s {
+    struct elf_symtab_s *next;
+    char *key;
+    uint64_t load_vaddr;
+    elf_symbol_t *symbols;
+    size_t symbol_count;
+    char *names;
+} elf_symtab_t;
+
+static sentry_mutex_t g_symtabs_lock = SENTRY__MUTEX_INIT;
+static elf_symtab_t *g_symtabs = NULL;
+
+/**
+ * Reads the section header at `idx` of either ELF class.
+ */
+static bool
+read_section(
+    const sentry_mmap_t *mm, bool is_64, size_t idx, Elf64_Shdr *shdr_out)
+{
+    const uint8_t *base = mm->ptr;
+    if (is_64) {
+        const Elf64_Ehdr *ehdr = mm->ptr;
+        size_t offset = ehdr->e_shoff + idx * ehdr->e_shentsize;
+        if (idx >= ehdr->e_shnum || offset + sizeof(Elf64_Shdr) > mm->len) {
+            return false;
+        }
+        memcpy(shdr_out, base + offset, sizeof(Elf64_Shdr));
+    } else {
+        const Elf32_Ehdr *ehdr = mm->ptr;
+        size_t offset = ehdr->e_shoff + idx * ehdr->e_shentsize;
+        if (idx >= ehdr->e_shnum || offset + sizeof(Elf32_Shdr) > mm->len) {
+            return false;
+        }
+        Elf32_Shdr shdr;
+        memcpy(&shdr, base + offset, sizeof(Elf32_Shdr));
+        memset(shdr_out, 0, sizeof(Elf64_Shdr));
+        shdr_out->sh_type = shdr.sh_type;
+        shdr_out->sh_offset = shdr.sh_offset;
+        shdr_out->sh_size = shdr.sh_size;
+        shdr_out->sh_link = shdr.sh_link;
+        shdr_out->sh_entsize = shdr.sh_entsize;
+    }
+    return shdr_out->sh_offset + shdr_out->sh_size <= mm->len;
+}
+
+static bool
+read_symbol(const uint8_t *ptr, bool is_64, Elf64_Sym *sym_out)
+{
+    if (is_64) {
+        memcpy(sym_out, ptr, sizeof(Elf64_Sym));
+    } else {
+        Elf32_Sym sym;
+        memcpy(&sym, ptr, sizeof(Elf32_Sym));
+        sym_out->st_name = sym.st_name;
+        sym_out->st_info = sym.st_info;
+        sym_out->st_shndx = sym.st_shndx;
+        sym_out->st_value = sym.st_value;
+        sym_out->st_size = sym.st_size;
+    }
+    int type = ELF64_ST_TYPE(sym_out->st_info);
+    return (type == STT_FUNC || type == STT_GNU_IFUNC) && sym_out->st_name
+        && sym_out->st_value && sym_out->st_shndx != SHN_UNDEF;
+}
+
+static int
+compare_symbols(const void *a, const void *b)
+{
+    const elf_symbol_t *sym_a = a;
+    const elf_symbol_t *sym_b = b;
+    if (sym_a->addr != sym_b->addr) {
+        return sym_a->addr < sym_b->addr ? -1 : 1;
+    }
+    // prefer symbols with a size
+    return sym_a->size > sym_b->size ? -1 : sym_a->size < sym_b->size;
+}
+
+/**
+ * Collects the function symbols of all the symbol tables of `mm`, with their
+ * names pointing into the mapped file.
+ */
+static size_t
+collect_symbols(const sentry_mmap_t *mm, elf_symbol_t *symbols,
+    const char **names, size_t capacity)
+{
+    const Elf64_Ehdr *ehdr = mm->ptr;
+    bool is_64 = ehdr->e_ident[EI_CLASS] == ELFCLASS64;
+    size_t section_count
+        = is_64 ? ehdr->e_shnum : ((const Elf32_Ehdr *)mm->ptr)->e_shnum;
+    size_t sym_size = is_64 ? sizeof(Elf64_Sym) : sizeof(Elf32_Sym);
+
+    size_t count = 0;
+    for (size_t i = 0; i < section_count; i++) {
+        Elf64_Shdr shdr;
+        Elf64_Shdr strtab;
+        if (!read_section(mm, is_64, i, &shdr)
+            || (shdr.sh_type != SHT_SYMTAB && shdr.sh_type != SHT_DYNSYM)
+            || !read_section(mm, is_64, shdr.sh_link, &strtab)) {
+            continue;
+        }
+        const uint8_t *ptr = (const uint8_t *)mm->ptr + shdr.sh_offset;
+        const char *strings = (const char *)mm->ptr + strtab.sh_offset;
+        for (size_t j = 0; j + sym_size <= shdr.sh_size; j += sym_size) {
+            Elf64_Sym sym;
+            if (!read_symbol(ptr + j, is_64, &sym)
+                || sym.st_name >= strtab.sh_size) {
+                continue;
+            }
+            if (symbols && count < capacity) {
+                symbols[count].addr = sym.st_value;
+                symbols[count].size = sym.st_size;
+                names[count] = strings + sym.st_name;
+            }
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * Returns the page aligned address of the first loaded segment, which the
+ * module finder reports as the load address of the module.
+ */
+static uint64_t
+find_load_vaddr(const sentry_mmap_t *mm)
+{
+    const Elf64_Ehdr *ehdr64 = mm->ptr;
+    const Elf32_Ehdr *ehdr32 = mm->ptr;
+    bool is_64 = ehdr64->e_ident[EI_CLASS] == ELFCLASS64;
+    uint64_t phoff = is_64 ? ehdr64->e_phoff : ehdr32->e_phoff;
+    size_t phnum = is_64 ? ehdr64->e_phnum : ehdr32->e_phnum;
+    size_t phentsize = is_64 ? ehdr64->e_phentsize : ehdr32->e_phentsize;
+
+    uint64_t load_vaddr = UINT64_MAX;
+    for (size_t i = 0; i < phnum; i++) {
+        size_t offset = phoff + i * phentsize;
+        uint32_t type;
+        uint64_t vaddr;
+        if (is_64) {
+            Elf64_Phdr phdr;
+            if (offset + sizeof(phdr) > mm->len) {
+                break;
+            }
+            memcpy(&phdr, (const char *)mm->ptr + offset, sizeof(phdr));
+            type = phdr.p_type;
+            vaddr = phdr.p_vaddr;
+        } else {
+            Elf32_Phdr phdr;
+            if (offset + sizeof(phdr) > mm->len) {
+                break;
+            }
+            memcpy(&phdr, (const char *)mm->ptr + offset, sizeof(phdr));
+            type = phdr.p_type;
+            vaddr = phdr.p_vaddr;
+        }
+        if (type == PT_LOAD && vaddr < load_vaddr) {
+            load_vaddr = vaddr;
+        }
+    }
+    return load_vaddr == UINT64_MAX
+        ? 0
+        : load_vaddr & ~(uint64_t)(getpagesize() - 1);
+}
+
+static bool
+parse_symbols(elf_symtab_t *symtab, const sentry_mmap_t *mm)
+{
+    const Elf64_Ehdr *ehdr = mm->ptr;
+    if (mm->len < sizeof(Elf64_Ehdr) || memcmp(ehdr->e_ident, ELFMAG, SELFMAG)
+        || (ehdr->e_ident[EI_CLASS] != ELFCLASS64
+            && ehdr->e_ident[EI_CLASS] != ELFCLASS32)) {
+        return false;
+    }
+
+    symtab->load_vaddr = find_load_vaddr(mm);
+    size_t capacity = collect_symbols(mm, NULL, NULL, 0);
+    if (!capacity) {
+        return false;
+    }
+    elf_symbol_t *symbols = sentry_malloc(sizeof(elf_symbol_t) * capacity);
+    const char **names = sentry_malloc(sizeof(char *) * capacity);
+    if (!symbols || !names) {
+        sentry_free(symbols);
+        sentry_free(names);
+        return false;
+    }
+    collect_symbols(mm, symbols, names, capacity);
+
+    // the name is temporarily the index into `names`, so the names can be
+    // copied in sorted order, and duplicates from `.dynsym` are dropped.
+    for (size_t i = 0; i < capacity; i++) {
+        symbols[i].name = (uint32_t)i;
+    }
+    qsort(symbols, capacity, sizeof(elf_symbol_t), compare_symbols);
+    size_t count = 0;
+    size_t names_len = 0;
+    for (size_t i = 0; i < capacity; i++) {
+        if (count && symbols[count - 1].addr == symbols[i].addr) {
+            continue;
+        }
+        symbols[count++] = symbols[i];
+        names_len += strlen(names[symbols[i].name]) + 1;
+    }
+
+    symtab->names = sentry_malloc(names_len);
+    if (!symtab->names) {
+        sentry_free(symbols);
+        sentry_free(names);
+        return false;
+    }
+    size_t offset = 0;
+    for (size_t i = 0; i < count; i++) {
+        const char *name = names[symbols[i].name];
+        size_t len = strlen(name) + 1;
+        memcpy(symtab->names + offset, name, len);
+        symbols[i].name = (uint32_t)offset;
+        offset += len;
+    }
+    sentry_free(names);
+
+    symtab->symbols = symbols;
+    symtab->symbol_count = count;
+    return true;
+}
+
+static void
+symtab_free(elf_symtab_t *symtab)
+{
+    sentry_free(symtab->key);
+    sentry_free(symtab->symbols);
+    sentry_free(symtab->names);
+    sentry_free(symtab);
+}
+
+/**
+ * Returns the cached symtab with `key`. This needs to be called while holding
+ * `g_symtabs_lock`.
+ */
+static elf_symtab_t *
+find_symtab(const char *key)
+{
+    for (elf_symtab_t *symtab = g_symtabs; symtab; symtab = symtab->next) {
+        if (strcmp(symtab->key, key) == 0) {
+            return symtab;
+        }
+    }
+    return NULL;
+}
+
+static const elf_symtab_t *
+get_symtab(const sentry_module_range_t *module)
+{
+    const char *key = module->code_id ? module->code_id : module->code_file;
+    if (!key) {
+        return NULL;
+    }
+    sentry__mutex_lock(&g_symtabs_lock);
+    const elf_symtab_t *rv = find_symtab(key);
+    sentry__mutex_unlock(&g_symtabs_lock);
+    if (rv) {
+        return rv;
+    }
+
+    // the file is parsed without holding the lock, so other threads can
+    // still symbolize with the symtabs that are already loaded. modules
+    // without symbols are remembered as well, so they are not parsed over and
+    // over.
+    elf_symtab_t *symtab = SENTRY_MAKE(elf_symtab_t);
+    if (!symtab) {
+        return NULL;
+    }
+    memset(symtab, 0, sizeof(elf_symtab_t));
+    symtab->key = sentry__string_clone(key);
+    if (!symtab->key) {
+        symtab_free(symtab);
+        return NULL;
+    }
+    sentry_mmap_t mm;
+    if (module->code_file && sentry__mmap_file(&mm, module->code_file)) {
+        parse_symbols(symtab, &mm);
+        sentry__mmap_close(&mm);
+    }
+    SENTRY_TRACEF("loaded %zu symbols of \"%s\"", symtab->symbol_count,
+        module->code_file ? module->code_file : "");
+
+    // another thread might have loaded the same file in the meantime
+    sentry__mutex_lock(&g_symtabs_lock);
+    rv = find_symtab(key);
+    if (!rv) {
+        symtab->next = g_symtabs;
+        g_symtabs = symtab;
+        rv = symtab;
+        symtab = NULL;
+    }
+    sentry__mutex_unlock(&g_symtabs_lock);
+    if (symtab) {
+        symtab_free(symtab);
+    }
+    return rv;
+}
+
+static const elf_symbol_t *
+find_symbol(const elf_symtab_t *symtab, uint64_t addr)
+{
+    size_t lo = 0;
+    size_t hi = symtab->symbol_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (symtab->symbols[mid].addr <= addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (!lo) {
+        return NULL;
+    }
+    const elf_symbol_t *symbol = &symtab->symbols[lo - 1];
+    if (symbol->size && addr >= symbol->addr + symbol->size) {
+        return NULL;
+    }
+    return symbol;
+}
+
+typedef struct {
+    uintptr_t addr;
+    size_t idx;
+} sorted_addr_t;
+
+static int
+compare_sorted_addrs(const void *a, const void *b)
+{
+    uintptr_t addr_a = ((const sorted_addr_t *)a)->addr;
+    uintptr_t addr_b = ((const sorted_addr_t *)b)->addr;
+    return addr_a < addr_b ? -1 : addr_a > addr_b;
+}
+
+void
+sentry__elf_symbolize_batch(void *const *addrs, size_t count, bool *resolved,
+    sentry_symbolize_batch_func_t func, void *data)
+{
+    // this refreshes the module index, in case modules were loaded since
+    sentry_value_decref(sentry_get_modules_list());
+    sentry_module_index_t *index = sentry__module_index_acquire();
+    sorted_addr_t *order
+        = sentry_malloc(sizeof(sorted_addr_t) * (count ? count : 1));
+    if (!index || !order) {
+        sentry__module_index_release(index);
+        sentry_free(order);
+        return;
+    }
+
+    // the addresses are resolved in sorted order, so every module only needs
+    // to be looked up once
+    for (size_t i = 0; i < count; i++) {
+        order[i].addr = (uintptr_t)addrs[i];
+        order[i].idx = i;
+    }
+    qsort(order, count, sizeof(sorted_addr_t), compare_sorted_addrs);
+
+    const sentry_module_range_t *module = NULL;
+    const elf_symtab_t *symtab = NULL;
+    for (size_t i = 0; i < count; i++) {
+        size_t idx = order[i].idx;
+        uintptr_t addr = order[i].addr;
+        if (!addr) {
+            continue;
+        }
+        if (!module || addr < module->start || addr >= module->end) {
+            module = sentry__module_index_find(index, addr);
+            symtab = module ? get_symtab(module) : NULL;
+        }
+        if (!symtab) {
+            continue;
+        }
+        uintptr_t bias = module->start - (uintptr_t)symtab->load_vaddr;
+        const elf_symbol_t *symbol = find_symbol(symtab, addr - bias);
+        if (!symbol) {
+            continue;
+        }
+
+        sentry_frame_info_t frame_info;
+        memset(&frame_info, 0, sizeof(sentry_frame_info_t));
+        frame_info.load_addr = (void *)module->start;
+        frame_info.symbol_addr = (void *)(bias + symbol->addr);
+        frame_info.instruction_addr = addrs[idx];
+        frame_info.symbol = symtab->names + symbol->name;
+        frame_info.object_name = module->code_file;
+        func(&frame_info, idx, data);
+        resolved[idx] = true;
+    }
+
+    sentry_free(order);
+    sentry__module_index_release(index);
+}
+
+void
+sentry__elf_symbols_cleanup(void)
+{
+    sentry__mutex_lock(&g_symtabs_lock);
+    elf_symtab_t *symtab = g_symtabs;
+    g_symtabs = NULL;
+    sentry__mutex_unlock(&g_symtabs_lock);
+    while (symtab) {
+        elf_symtab_t *next = symtab->next;
+        symtab_free(symtab);
+        symtab = next;
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef SENTRY_SYMBOLIZER_ELF_H_INCLUDED
+#define SENTRY_SYMBOLIZER_ELF_H_INCLUDED
+
+#include "sentry_boot.h"
+
+#include "sentry_symbolizer.h"
+
+/**
+ * Symbolizes `addrs` using the `.symtab` and `.dynsym` sections of the loaded
+ * ELF modules, which unlike `dladdr` also contain local symbols.
+ *
+ * The symbol tables are parsed once per module into a sorted list, and are
+ * cached by code id. The modules are looked up in the module index, and the
+ * addresses are sorted, so every module only needs to be looked up once per
+ * batch.
+ *
+ * `resolved` is set for every address that `func` was called with.
+ */
+void sentry__elf_symbolize_batch(void *const *addrs, size_t count,
+    bool *resolved, sentry_symbolize_batch_func_t func, void *data);
+
+/**
+ * Frees all the cached symbol tables.
+ */
+void sentry__elf_symbols_cleanup(void);
+
+#endif
@@ -1,13 +1,18 @@
 #include "sentry_boot.h"
 
+#include "sentry_alloc.h"
+#include "sentry_core.h"
 #include "sentry_symbolizer.h"
 
+#ifdef SENTRY_PLATFORM_LINUX
+#    include "sentry_symbolizer_elf.h"
+#endif
+
 #include <dlfcn.h>
 #include <string.h>
 
-bool
-sentry__symbolize(
-    void *addr, void (*func)(const sentry_frame_info_t *, void *), void *data)
+static bool
+symbolize_dladdr(void *addr, sentry_frame_info_t *frame_info)
 {
     Dl_info info;
 
@@ -15,14 +20,75 @@ sentry__symbolize(
         return false;
     }
 
-    sentry_frame_info_t frame_info;
-    memset(&frame_info, 0, sizeof(sentry_frame_info_t));
-    frame_info.load_addr = info.dli_fbase;
-    frame_info.symbol_addr = info.dli_saddr;
-    frame_info.instruction_addr = addr;
-    frame_info.symbol = info.dli_sname;
-    frame_info.object_name = info.dli_fname;
-    func(&frame_info, data);
+    memset(frame_info, 0, sizeof(sentry_frame_info_t));
+    frame_info->load_addr = info.dli_fbase;
+    frame_info->symbol_addr = info.dli_saddr;
+    frame_info->instruction_addr = addr;
+    frame_info->symbol = info.dli_sname;
+    frame_info->object_name = info.dli_fname;
+    return true;
+}
+
+typedef struct {
+    void (*func)(const sentry_frame_info_t *, void *);
+    void *data;
+} single_symbolize_t;
+
+static void
+call_single(const sentry_frame_info_t *info, size_t UNUSED(index), void *data)
+{
+    single_symbolize_t *single = data;
+    single->func(info, single->data);
+}
 
+bool
+sentry__symbolize(
+    void *addr, void (*func)(const sentry_frame_info_t *, void *), void *data)
+{
+    bool resolved = false;
+#ifdef SENTRY_PLATFORM_LINUX
+    single_symbolize_t single = { func, data };
+    sentry__elf_symbolize_batch(&addr, 1, &resolved, call_single, &single);
+#endif
+    if (!resolved) {
+        sentry_frame_info_t frame_info;
+        if (!symbolize_dladdr(addr, &frame_info)) {
+            return false;
+        }
+        func(&frame_info, data);
+    }
     return true;
 }
+
+void
+sentry__symbolize_batch(void *const *addrs, size_t count,
+    sentry_symbolize_batch_func_t func, void *data)
+{
+    bool *resolved = sentry_malloc(sizeof(bool) * (count ? count : 1));
+    if (!resolved) {
+        return;
+    }
+    memset(resolved, 0, sizeof(bool) * count);
+#ifdef SENTRY_PLATFORM_LINUX
+    sentry__elf_symbolize_batch(addrs, count, resolved, func, data);
+#endif
+
+    // `dladdr` is the fallback for everything that the symbol tables could
+    // not resolve, and the only symbolizer on other platforms.
+    for (size_t i = 0; i < count; i++) {
+        sentry_frame_info_t frame_info;
+        if (!resolved[i] && addrs[i]
+            && symbolize_dladdr(addrs[i], &frame_info)) {
+            func(&frame_info, i, data);
+        }
+    }
+    sentry_free(resolved);
+}
+
+void
+sentry__symbolizer_cleanup(void)
+{
+#ifdef SENTRY_PLATFORM_LINUX
+    sentry__elf_symbols_cleanup();
+#endif
+}
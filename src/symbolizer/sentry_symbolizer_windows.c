@@ -38,3 +38,33 @@ sentry__symbolize(
 
     return true;
 }
+
+typedef struct {
+    sentry_symbolize_batch_func_t func;
+    size_t index;
+    void *data;
+} batch_item_t;
+
+static void
+call_batch(const sentry_frame_info_t *info, void *data)
+{
+    batch_item_t *item = data;
+    item->func(info, item->index, item->data);
+}
+
+void
+sentry__symbolize_batch(void *const *addrs, size_t count,
+    sentry_symbolize_batch_func_t func, void *data)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (addrs[i]) {
+            batch_item_t item = { func, i, data };
+            sentry__symbolize(addrs[i], call_batch, &item);
+        }
+    }
+}
+
+void
+sentry__symbolizer_cleanup(void)
+{
+}
@@ -13,6 +13,8 @@
     } while (0)
 
 DEFINE_UNWINDER(libunwindstack);
+DEFINE_UNWINDER(cfi);
+DEFINE_UNWINDER(fp);
 DEFINE_UNWINDER(libbacktrace);
 DEFINE_UNWINDER(dbghelp);
 
@@ -23,6 +25,12 @@ unwind_stack(
 #ifdef SENTRY_WITH_UNWINDER_LIBUNWINDSTACK
     TRY_UNWINDER(libunwindstack);
 #endif
+#ifdef SENTRY_WITH_UNWINDER_CFI
+    TRY_UNWINDER(cfi);
+#endif
+#ifdef SENTRY_WITH_UNWINDER_FP
+    TRY_UNWINDER(fp);
+#endif
 #ifdef SENTRY_WITH_UNWINDER_LIBBACKTRACE
     TRY_UNWINDER(libbacktrace);
 #endif
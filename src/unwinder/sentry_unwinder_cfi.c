@@ -0,0 +1,1044 @@
+#include "sentry_unwinder_cfi.h"
+
+#include "sentry_alloc.h"
+#include "sentry_core.h"
+#include "sentry_sync.h"
+#include "sentry_unwinder_memory.h"
+
+#include <elf.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__aarch64__)
+#    define WITH_CFI_UNWINDER
+#endif
+
+#ifdef WITH_CFI_UNWINDER
+
+#    if defined(__x86_64__)
+#        define DWARF_REG_FP 6
+#        define DWARF_REG_SP 7
+#        define DWARF_REG_RA 16
+#    else
+#        define DWARF_REG_FP 29
+#        define DWARF_REG_RA 30
+#        define DWARF_REG_SP 31
+#    endif
+
+#    define DW_EH_PE_omit 0xff
+#    define DW_EH_PE_absptr 0x00
+#    define DW_EH_PE_pcrel 0x10
+#    define DW_EH_PE_datarel 0x30
+#    define DW_EH_PE_sdata4 0x0b
+
+#    define CFA_REG_SP 0
+#    define CFA_REG_FP 1
+#    define CFA_INVALID 2
+
+#    define MAX_REMEMBERED_STATES 8
+
+/**
+ * A row of the unwind table, which is valid from its `offset` up to the offset
+ * of the next row. The CFA register is saved in the low 2 bits of `cfa`, and
+ * the CFA offset in the remaining ones. The return address and frame pointer
+ * offsets are relative to the CFA, with `0` meaning that the register was not
+ * saved.
+ */
+typedef struct {
+    uint32_t offset;
+    int32_t cfa;
+    int16_t ra_offset;
+    int16_t fp_offset;
+} cfi_row_t;
+
+/**
+ * The rows of a module are shared with the next table when the module list is
+ * refreshed, so they are refcounted separately from the tables.
+ */
+typedef struct {
+    cfi_row_t *rows;
+    size_t count;
+    long refcount;
+} cfi_rows_t;
+
+typedef struct {
+    uintptr_t start;
+    uintptr_t end;
+    cfi_rows_t *rows;
+} cfi_module_t;
+
+struct sentry_cfi_table_s {
+    cfi_module_t *modules;
+    size_t module_count;
+    size_t module_capacity;
+    long refcount;
+    long retired_epoch;
+};
+
+/**
+ * The table is published in the same way as the module index, so an unwinder
+ * that is still using a replaced table keeps it alive via its refcount.
+ */
+static sentry_published_t g_table = SENTRY__PUBLISHED_INIT;
+
+enum {
+    RULE_SAME,
+    RULE_OFFSET,
+    RULE_UNSUPPORTED,
+};
+
+typedef struct {
+    uint64_t cfa_reg;
+    int64_t cfa_offset;
+    bool cfa_expression;
+    int ra_rule;
+    int64_t ra_offset;
+    int fp_rule;
+    int64_t fp_offset;
+} cfi_state_t;
+
+typedef struct {
+    cfi_row_t *rows;
+    size_t len;
+    size_t capacity;
+    uintptr_t module_start;
+    bool failed;
+} row_builder_t;
+
+typedef struct {
+    const uint8_t *ptr;
+    const uint8_t *end;
+    bool error;
+} cursor_t;
+
+typedef struct {
+    uint64_t code_align;
+    int64_t data_align;
+    uint8_t fde_encoding;
+    bool has_augmentation_data;
+    const uint8_t *instructions;
+    const uint8_t *instructions_end;
+} cie_t;
+
+static bool
+cursor_read(cursor_t *c, void *out, size_t len)
+{
+    if (c->error || (size_t)(c->end - c->ptr) < len) {
+        c->error = true;
+        memset(out, 0, len);
+        return false;
+    }
+    memcpy(out, c->ptr, len);
+    c->ptr += len;
+    return true;
+}
+
+#    define DEFINE_READ(Name, Type)                                            \
+        static Type Name(cursor_t *c)                                          \
+        {                                                                      \
+            Type value;                                                        \
+            cursor_read(c, &value, sizeof(Type));                              \
+            return value;                                                      \
+        }
+
+DEFINE_READ(read_u8, uint8_t)
+DEFINE_READ(read_u16, uint16_t)
+DEFINE_READ(read_u32, uint32_t)
+DEFINE_READ(read_u64, uint64_t)
+
+static uint64_t
+read_uleb(cursor_t *c)
+{
+    uint64_t value = 0;
+    unsigned int shift = 0;
+    uint8_t byte;
+    do {
+        byte = read_u8(c);
+        if (shift < 64) {
+            value |= (uint64_t)(byte & 0x7f) << shift;
+        }
+        shift += 7;
+    } while ((byte & 0x80) && !c->error);
+    return value;
+}
+
+static int64_t
+read_sleb(cursor_t *c)
+{
+    uint64_t value = 0;
+    unsigned int shift = 0;
+    uint8_t byte;
+    do {
+        byte = read_u8(c);
+        if (shift < 64) {
+            value |= (uint64_t)(byte & 0x7f) << shift;
+        }
+        shift += 7;
+    } while ((byte & 0x80) && !c->error);
+    if (shift < 64 && (byte & 0x40)) {
+        value |= ~(uint64_t)0 << shift;
+    }
+    return (int64_t)value;
+}
+
+/**
+ * Reads a pointer in one of the `DW_EH_PE_*` encodings. Indirect pointers are
+ * not dereferenced, as we only skip over them.
+ */
+static uintptr_t
+read_encoded(cursor_t *c, uint8_t encoding, uintptr_t data_base)
+{
+    if (encoding == DW_EH_PE_omit) {
+        return 0;
+    }
+    uintptr_t pc = (uintptr_t)c->ptr;
+    uintptr_t value;
+    switch (encoding & 0x0f) {
+    case 0x00:
+        value = (uintptr_t)read_u64(c);
+        break;
+    case 0x01:
+        value = (uintptr_t)read_uleb(c);
+        break;
+    case 0x02:
+        value = read_u16(c);
+        break;
+    case 0x03:
+        value = read_u32(c);
+        break;
+    case 0x04:
+        value = (uintptr_t)read_u64(c);
+        break;
+    case 0x09:
+        value = (uintptr_t)read_sleb(c);
+        break;
+    case 0x0a:
+        value = (uintptr_t)(int16_t)read_u16(c);
+        break;
+    case 0x0b:
+        value = (uintptr_t)(int32_t)read_u32(c);
+        break;
+    case 0x0c:
+        value = (uintptr_t)read_u64(c);
+        break;
+    default:
+        c->error = true;
+        return 0;
+    }
+    switch (encoding & 0x70) {
+    case DW_EH_PE_absptr:
+        break;
+    case DW_EH_PE_pcrel:
+        value += pc;
+        break;
+    case DW_EH_PE_datarel:
+        value += data_base;
+        break;
+    default:
+        c->error = true;
+        return 0;
+    }
+    return value;
+}
+
+/**
+ * Reads the length of a CIE or FDE, and limits the cursor to that entry.
+ */
+static bool
+read_entry_length(cursor_t *c)
+{
+    uint64_t length = read_u32(c);
+    if (length == 0xffffffff) {
+        length = read_u64(c);
+    }
+    if (c->error || !length || length > (uint64_t)(c->end - c->ptr)) {
+        return false;
+    }
+    c->end = c->ptr + length;
+    return true;
+}
+
+static bool
+parse_cie(const uint8_t *ptr, const uint8_t *end, cie_t *cie)
+{
+    cursor_t c = { ptr, end, false };
+    if (!read_entry_length(&c) || read_u32(&c) != 0) {
+        return false;
+    }
+    uint8_t version = read_u8(&c);
+    if (version != 1 && version != 3 && version != 4) {
+        return false;
+    }
+    const char *augmentation = (const char *)c.ptr;
+    while (!c.error && read_u8(&c)) { }
+    if (version == 4) {
+        // address and segment selector size
+        read_u8(&c);
+        read_u8(&c);
+    }
+    cie->code_align = read_uleb(&c);
+    cie->data_align = read_sleb(&c);
+    if (version == 1) {
+        read_u8(&c);
+    } else {
+        read_uleb(&c);
+    }
+
+    cie->fde_encoding = DW_EH_PE_absptr;
+    cie->has_augmentation_data = augmentation[0] == 'z';
+    if (cie->has_augmentation_data) {
+        uint64_t length = read_uleb(&c);
+        if (c.error || length > (uint64_t)(c.end - c.ptr)) {
+            return false;
+        }
+        cursor_t data = { c.ptr, c.ptr + length, false };
+        for (const char *a = augmentation + 1; *a && !data.error; a++) {
+            if (*a == 'R') {
+                cie->fde_encoding = read_u8(&data);
+            } else if (*a == 'P') {
+                read_encoded(&data, read_u8(&data), 0);
+            } else if (*a == 'L') {
+                read_u8(&data);
+            } else if (*a != 'S' && *a != 'B' && *a != 'G') {
+                // the rest of the augmentation data is skipped anyway
+                break;
+            }
+        }
+        c.ptr += length;
+    } else if (augmentation[0]) {
+        return false;
+    }
+
+    cie->instructions = c.ptr;
+    cie->instructions_end = c.end;
+    return !c.error;
+}
+
+static void
+set_rule(cfi_state_t *state, uint64_t reg, int rule, int64_t offset)
+{
+    if (reg == DWARF_REG_RA) {
+        state->ra_rule = rule;
+        state->ra_offset = offset;
+    } else if (reg == DWARF_REG_FP) {
+        state->fp_rule = rule;
+        state->fp_offset = offset;
+    }
+}
+
+static void
+restore_rule(cfi_state_t *state, const cfi_state_t *initial, uint64_t reg)
+{
+    if (reg == DWARF_REG_RA) {
+        state->ra_rule = initial->ra_rule;
+        state->ra_offset = initial->ra_offset;
+    } else if (reg == DWARF_REG_FP) {
+        state->fp_rule = initial->fp_rule;
+        state->fp_offset = initial->fp_offset;
+    }
+}
+
+static bool
+fits_rule(int rule, int64_t offset)
+{
+    return rule == RULE_SAME
+        || (rule == RULE_OFFSET && offset != 0 && offset >= INT16_MIN
+            && offset <= INT16_MAX);
+}
+
+static cfi_row_t
+make_row(const cfi_state_t *state, uintptr_t loc, uintptr_t module_start)
+{
+    cfi_row_t row;
+    row.offset = (uint32_t)(loc - module_start);
+    row.cfa = CFA_INVALID;
+    row.ra_offset = 0;
+    row.fp_offset = 0;
+
+    bool valid = !state->cfa_expression
+        && (state->cfa_reg == DWARF_REG_SP || state->cfa_reg == DWARF_REG_FP)
+        && state->cfa_offset >= -(1 << 29) && state->cfa_offset < (1 << 29)
+        && fits_rule(state->ra_rule, state->ra_offset)
+        && fits_rule(state->fp_rule, state->fp_offset);
+#    if defined(__x86_64__)
+    // the return address is not an actual register on x86_64
+    valid = valid && state->ra_rule == RULE_OFFSET;
+#    endif
+    if (valid) {
+        row.cfa = (int32_t)(state->cfa_offset * 4)
+            | (state->cfa_reg == DWARF_REG_SP ? CFA_REG_SP : CFA_REG_FP);
+        row.ra_offset
+            = state->ra_rule == RULE_OFFSET ? (int16_t)state->ra_offset : 0;
+        row.fp_offset
+            = state->fp_rule == RULE_OFFSET ? (int16_t)state->fp_offset : 0;
+    }
+    return row;
+}
+
+static void
+push_row(row_builder_t *builder, const cfi_state_t *state, uintptr_t loc)
+{
+    if (builder->failed || loc < builder->module_start
+        || loc - builder->module_start > UINT32_MAX) {
+        return;
+    }
+    cfi_row_t row = make_row(state, loc, builder->module_start);
+    cfi_row_t *last = builder->len ? &builder->rows[builder->len - 1] : NULL;
+    if (last && last->offset == row.offset) {
+        // a row at the same offset replaces the previous one
+        builder->len--;
+        last = builder->len ? &builder->rows[builder->len - 1] : NULL;
+    } else if (last && last->offset > row.offset) {
+        // overlapping entries are ignored
+        return;
+    }
+    if (last && last->cfa == row.cfa && last->ra_offset == row.ra_offset
+        && last->fp_offset == row.fp_offset) {
+        // the same rules just extend the previous range
+        return;
+    }
+
+    if (builder->len == builder->capacity) {
+        size_t capacity = builder->capacity ? builder->capacity * 2 : 256;
+        cfi_row_t *rows = sentry_malloc(sizeof(cfi_row_t) * capacity);
+        if (!rows) {
+            builder->failed = true;
+            return;
+        }
+        if (builder->len) {
+            memcpy(rows, builder->rows, sizeof(cfi_row_t) * builder->len);
+        }
+        sentry_free(builder->rows);
+        builder->rows = rows;
+        builder->capacity = capacity;
+    }
+    builder->rows[builder->len++] = row;
+}
+
+/**
+ * Executes the call frame instructions from `c`, which either are the initial
+ * instructions of a CIE, when `builder` is `NULL`, or the instructions of an
+ * FDE, which emit a new row whenever the location advances.
+ */
+static bool
+execute_instructions(cursor_t *c, const cie_t *cie, cfi_state_t *state,
+    const cfi_state_t *initial, uintptr_t loc, row_builder_t *builder)
+{
+    cfi_state_t remembered[MAX_REMEMBERED_STATES];
+    size_t remembered_count = 0;
+
+    while (c->ptr < c->end && !c->error) {
+        uint8_t op = read_u8(c);
+        uint64_t delta = 0;
+        uint64_t reg;
+        switch (op >> 6) {
+        case 1: // DW_CFA_advance_loc
+            delta = op & 0x3f;
+            break;
+        case 2: // DW_CFA_offset
+            set_rule(state, op & 0x3f, RULE_OFFSET,
+                (int64_t)read_uleb(c) * cie->data_align);
+            continue;
+        case 3: // DW_CFA_restore
+            if (initial) {
+                restore_rule(state, initial, op & 0x3f);
+            }
+            continue;
+        default:
+            switch (op) {
+            case 0x00: // DW_CFA_nop
+                continue;
+            case 0x01: { // DW_CFA_set_loc
+                uintptr_t new_loc = read_encoded(c, cie->fde_encoding, 0);
+                if (builder) {
+                    push_row(builder, state, loc);
+                }
+                loc = new_loc;
+                continue;
+            }
+            case 0x02: // DW_CFA_advance_loc1
+                delta = read_u8(c);
+                break;
+            case 0x03: // DW_CFA_advance_loc2
+                delta = read_u16(c);
+                break;
+            case 0x04: // DW_CFA_advance_loc4
+                delta = read_u32(c);
+                break;
+            case 0x05: // DW_CFA_offset_extended
+                reg = read_uleb(c);
+                set_rule(state, reg, RULE_OFFSET,
+                    (int64_t)read_uleb(c) * cie->data_align);
+                continue;
+            case 0x06: // DW_CFA_restore_extended
+                reg = read_uleb(c);
+                if (initial) {
+                    restore_rule(state, initial, reg);
+                }
+                continue;
+            case 0x07: // DW_CFA_undefined
+                // an undefined return address marks the outermost frame
+                set_rule(state, read_uleb(c), RULE_UNSUPPORTED, 0);
+                continue;
+            case 0x08: // DW_CFA_same_value
+                set_rule(state, read_uleb(c), RULE_SAME, 0);
+                continue;
+            case 0x09: // DW_CFA_register
+                reg = read_uleb(c);
+                read_uleb(c);
+                set_rule(state, reg, RULE_UNSUPPORTED, 0);
+                continue;
+            case 0x0a: // DW_CFA_remember_state
+                if (remembered_count == MAX_REMEMBERED_STATES) {
+                    return false;
+                }
+                remembered[remembered_count++] = *state;
+                continue;
+            case 0x0b: // DW_CFA_restore_state
+                if (!remembered_count) {
+                    return false;
+                }
+                *state = remembered[--remembered_count];
+                continue;
+            case 0x0c: // DW_CFA_def_cfa
+                state->cfa_reg = read_uleb(c);
+                state->cfa_offset = (int64_t)read_uleb(c);
+                state->cfa_expression = false;
+                continue;
+            case 0x0d: // DW_CFA_def_cfa_register
+                state->cfa_reg = read_uleb(c);
+                state->cfa_expression = false;
+                continue;
+            case 0x0e: // DW_CFA_def_cfa_offset
+                state->cfa_offset = (int64_t)read_uleb(c);
+                continue;
+            case 0x0f: // DW_CFA_def_cfa_expression
+                c->ptr += read_uleb(c);
+                state->cfa_expression = true;
+                continue;
+            case 0x10: // DW_CFA_expression
+            case 0x16: // DW_CFA_val_expression
+                reg = read_uleb(c);
+                c->ptr += read_uleb(c);
+                set_rule(state, reg, RULE_UNSUPPORTED, 0);
+                continue;
+            case 0x11: // DW_CFA_offset_extended_sf
+                reg = read_uleb(c);
+                set_rule(
+                    state, reg, RULE_OFFSET, read_sleb(c) * cie->data_align);
+                continue;
+            case 0x12: // DW_CFA_def_cfa_sf
+                state->cfa_reg = read_uleb(c);
+                state->cfa_offset = read_sleb(c) * cie->data_align;
+                state->cfa_expression = false;
+                continue;
+            case 0x13: // DW_CFA_def_cfa_offset_sf
+                state->cfa_offset = read_sleb(c) * cie->data_align;
+                continue;
+            case 0x14: // DW_CFA_val_offset
+            case 0x15: // DW_CFA_val_offset_sf
+                reg = read_uleb(c);
+                if (op == 0x14) {
+                    read_uleb(c);
+                } else {
+                    read_sleb(c);
+                }
+                set_rule(state, reg, RULE_UNSUPPORTED, 0);
+                continue;
+            // DW_CFA_GNU_window_save / DW_CFA_AARCH64_negate_ra_state
+            case 0x2d:
+                continue;
+            case 0x2e: // DW_CFA_GNU_args_size
+                read_uleb(c);
+                continue;
+            case 0x2f: // DW_CFA_GNU_negative_offset_extended
+                reg = read_uleb(c);
+                set_rule(state, reg, RULE_OFFSET,
+                    -(int64_t)read_uleb(c) * cie->data_align);
+                continue;
+            default:
+                return false;
+            }
+        }
+
+        if (builder) {
+            push_row(builder, state, loc);
+        }
+        loc += delta * cie->code_align;
+    }
+
+    if (builder) {
+        push_row(builder, state, loc);
+    }
+    return !c->error && c->ptr <= c->end;
+}
+
+static void
+parse_fde(const uint8_t *ptr, const uint8_t *end, row_builder_t *builder)
+{
+    cursor_t c = { ptr, end, false };
+    if (!read_entry_length(&c)) {
+        return;
+    }
+    const uint8_t *cie_pointer_pos = c.ptr;
+    uint32_t cie_pointer = read_u32(&c);
+    // the CIE is located before the FDE, inside of the same module
+    if (c.error || !cie_pointer
+        || cie_pointer > (uintptr_t)cie_pointer_pos - builder->module_start) {
+        return;
+    }
+    cie_t cie;
+    if (!parse_cie(cie_pointer_pos - cie_pointer, end, &cie)) {
+        return;
+    }
+
+    uintptr_t pc_begin = read_encoded(&c, cie.fde_encoding, 0);
+    uintptr_t pc_range = read_encoded(&c, cie.fde_encoding & 0x0f, 0);
+    if (cie.has_augmentation_data) {
+        uint64_t length = read_uleb(&c);
+        if (length > (uint64_t)(c.end - c.ptr)) {
+            return;
+        }
+        c.ptr += length;
+    }
+    if (c.error) {
+        return;
+    }
+
+    cfi_state_t state;
+    memset(&state, 0, sizeof(state));
+    state.ra_rule = RULE_SAME;
+    state.fp_rule = RULE_SAME;
+    cursor_t initial_instructions
+        = { cie.instructions, cie.instructions_end, false };
+    if (!execute_instructions(
+            &initial_instructions, &cie, &state, NULL, pc_begin, NULL)) {
+        return;
+    }
+    cfi_state_t initial = state;
+    if (!execute_instructions(
+            &c, &cie, &state, &initial, pc_begin, builder)) {
+        // the rows we might have pushed are overridden by the invalid one
+        memset(&state, 0, sizeof(state));
+        state.cfa_expression = true;
+        push_row(builder, &state, pc_begin);
+    }
+
+    // the range after the FDE has no unwind info, unless the next FDE starts
+    // right there, which will replace this row
+    memset(&state, 0, sizeof(state));
+    state.cfa_expression = true;
+    push_row(builder, &state, pc_begin + pc_range);
+}
+
+static bool
+parse_eh_frame_hdr(
+    const uint8_t *hdr, const uint8_t *end, row_builder_t *builder)
+{
+    cursor_t c = { hdr, end, false };
+    uint8_t version = read_u8(&c);
+    uint8_t eh_frame_ptr_enc = read_u8(&c);
+    uint8_t fde_count_enc = read_u8(&c);
+    uint8_t table_enc = read_u8(&c);
+    if (c.error || version != 1
+        || table_enc != (DW_EH_PE_datarel | DW_EH_PE_sdata4)) {
+        return false;
+    }
+    read_encoded(&c, eh_frame_ptr_enc, (uintptr_t)hdr);
+    uintptr_t fde_count = read_encoded(&c, fde_count_enc, (uintptr_t)hdr);
+    if (c.error || fde_count > (uintptr_t)(c.end - c.ptr) / 8) {
+        return false;
+    }
+
+    // the table is sorted by the initial location of the FDEs, so the rows
+    // will come out sorted as well
+    for (uintptr_t i = 0; i < fde_count && !builder->failed; i++) {
+        read_u32(&c);
+        int32_t fde_offset = (int32_t)read_u32(&c);
+        const uint8_t *fde = hdr + fde_offset;
+        if (fde < (const uint8_t *)builder->module_start || fde >= end) {
+            continue;
+        }
+        parse_fde(fde, end, builder);
+    }
+    return !builder->failed;
+}
+
+static const uint8_t *
+find_eh_frame_hdr(uintptr_t start, uintptr_t end)
+{
+    sentry_memory_reader_t reader;
+    if (!sentry__memory_reader_init(&reader)) {
+        return NULL;
+    }
+    const Elf64_Ehdr *elf = (const Elf64_Ehdr *)start;
+    const uint8_t *rv = NULL;
+    if (!sentry__memory_reader_probe(&reader, start)
+        || memcmp(elf->e_ident, ELFMAG, SELFMAG) != 0
+        || elf->e_ident[EI_CLASS] != ELFCLASS64
+        || elf->e_phoff + (uint64_t)elf->e_phnum * sizeof(Elf64_Phdr)
+            > SENTRY_MEMORY_READER_PAGE_SIZE) {
+        goto done;
+    }
+
+    const Elf64_Phdr *phdrs = (const Elf64_Phdr *)(start + elf->e_phoff);
+    uintptr_t min_vaddr = UINTPTR_MAX;
+    const Elf64_Phdr *eh_frame_hdr = NULL;
+    for (int i = 0; i < elf->e_phnum; i++) {
+        if (phdrs[i].p_type == PT_LOAD && phdrs[i].p_vaddr < min_vaddr) {
+            min_vaddr = phdrs[i].p_vaddr;
+        } else if (phdrs[i].p_type == PT_GNU_EH_FRAME) {
+            eh_frame_hdr = &phdrs[i];
+        }
+    }
+    if (!eh_frame_hdr || min_vaddr == UINTPTR_MAX) {
+        goto done;
+    }
+    uintptr_t bias = start
+        - (min_vaddr & ~(uintptr_t)(SENTRY_MEMORY_READER_PAGE_SIZE - 1));
+    uintptr_t hdr = bias + eh_frame_hdr->p_vaddr;
+    if (hdr >= start && hdr < end
+        && sentry__memory_reader_probe(&reader, hdr)) {
+        rv = (const uint8_t *)hdr;
+    }
+
+done:
+    sentry__memory_reader_close(&reader);
+    return rv;
+}
+
+sentry_cfi_table_t *
+sentry__cfi_table_new(void)
+{
+    sentry_cfi_table_t *table = SENTRY_MAKE(sentry_cfi_table_t);
+    if (table) {
+        memset(table, 0, sizeof(sentry_cfi_table_t));
+        table->refcount = 1;
+    }
+    return table;
+}
+
+static void
+cfi_table_incref(void *ptr)
+{
+    sentry_cfi_table_t *table = ptr;
+    sentry__atomic_fetch_and_add(&table->refcount, 1);
+}
+
+static sentry_cfi_table_t *
+cfi_table_acquire(void)
+{
+    return sentry__published_acquire(&g_table, cfi_table_incref);
+}
+
+static void
+cfi_table_release(sentry_cfi_table_t *table)
+{
+    if (!table || sentry__atomic_fetch_and_add(&table->refcount, -1) != 1) {
+        return;
+    }
+    // freeing is not async-signal-safe, so a table that is released last by a
+    // signal handler is leaked instead.
+    if (!sentry__block_for_signal_handler()) {
+        return;
+    }
+    for (size_t i = 0; i < table->module_count; i++) {
+        cfi_rows_t *rows = table->modules[i].rows;
+        if (sentry__atomic_fetch_and_add(&rows->refcount, -1) == 1) {
+            sentry_free(rows->rows);
+            sentry_free(rows);
+        }
+    }
+    sentry_free(table->modules);
+    sentry_free(table);
+}
+
+static cfi_module_t *
+append_module(sentry_cfi_table_t *table)
+{
+    if (table->module_count == table->module_capacity) {
+        size_t capacity
+            = table->module_capacity ? table->module_capacity * 2 : 32;
+        cfi_module_t *modules = sentry_malloc(sizeof(cfi_module_t) * capacity);
+        if (!modules) {
+            return NULL;
+        }
+        if (table->module_count) {
+            memcpy(modules, table->modules,
+                sizeof(cfi_module_t) * table->module_count);
+        }
+        sentry_free(table->modules);
+        table->modules = modules;
+        table->module_capacity = capacity;
+    }
+    return &table->modules[table->module_count++];
+}
+
+void
+sentry__cfi_table_add_module(sentry_cfi_table_t *table, void *start, void *end)
+{
+    if (!table) {
+        return;
+    }
+    const uint8_t *hdr = find_eh_frame_hdr((uintptr_t)start, (uintptr_t)end);
+    if (!hdr) {
+        return;
+    }
+
+    row_builder_t builder;
+    memset(&builder, 0, sizeof(builder));
+    builder.module_start = (uintptr_t)start;
+    if (!parse_eh_frame_hdr(hdr, end, &builder) || !builder.len) {
+        sentry_free(builder.rows);
+        return;
+    }
+
+    cfi_rows_t *rows = SENTRY_MAKE(cfi_rows_t);
+    cfi_module_t *module = rows ? append_module(table) : NULL;
+    if (!module) {
+        sentry_free(rows);
+        sentry_free(builder.rows);
+        return;
+    }
+    rows->rows = builder.rows;
+    rows->count = builder.len;
+    rows->refcount = 1;
+    module->start = (uintptr_t)start;
+    module->end = (uintptr_t)end;
+    module->rows = rows;
+    SENTRY_TRACEF("computed %zu unwind table rows for module at %p",
+        builder.len, start);
+}
+
+bool
+sentry__cfi_table_reuse_module(
+    sentry_cfi_table_t *table, void *start, void *end)
+{
+    if (!table) {
+        return false;
+    }
+    sentry_cfi_table_t *published = cfi_table_acquire();
+    bool reused = false;
+    for (size_t i = 0; published && i < published->module_count; i++) {
+        const cfi_module_t *previous = &published->modules[i];
+        if (previous->start != (uintptr_t)start
+            || previous->end != (uintptr_t)end) {
+            continue;
+        }
+        cfi_module_t *module = append_module(table);
+        if (module) {
+            *module = *previous;
+            sentry__atomic_fetch_and_add(&module->rows->refcount, 1);
+            reused = true;
+        }
+        break;
+    }
+    cfi_table_release(published);
+    return reused;
+}
+
+static int
+compare_modules(const void *a, const void *b)
+{
+    uintptr_t start_a = ((const cfi_module_t *)a)->start;
+    uintptr_t start_b = ((const cfi_module_t *)b)->start;
+    return start_a < start_b ? -1 : start_a > start_b;
+}
+
+sentry_cfi_table_t *
+sentry__cfi_table_publish(sentry_cfi_table_t *table)
+{
+    if (table && table->module_count) {
+        qsort(table->modules, table->module_count, sizeof(cfi_module_t),
+            compare_modules);
+    }
+    long epoch;
+    sentry_cfi_table_t *previous
+        = sentry__published_exchange(&g_table, table, &epoch);
+    if (previous) {
+        previous->retired_epoch = epoch;
+    }
+    return previous;
+}
+
+void
+sentry__cfi_table_retire(sentry_cfi_table_t *table)
+{
+    if (!table) {
+        return;
+    }
+    sentry__published_wait(&g_table, table->retired_epoch);
+    cfi_table_release(table);
+}
+
+static const cfi_row_t *
+find_row(const sentry_cfi_table_t *table, uintptr_t pc)
+{
+    size_t lo = 0;
+    size_t hi = table->module_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (table->modules[mid].start <= pc) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (!lo || pc >= table->modules[lo - 1].end) {
+        return NULL;
+    }
+    const cfi_rows_t *rows = table->modules[lo - 1].rows;
+    uint32_t offset = (uint32_t)(pc - table->modules[lo - 1].start);
+
+    lo = 0;
+    hi = rows->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (rows->rows[mid].offset <= offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (!lo || (rows->rows[lo - 1].cfa & 3) == CFA_INVALID) {
+        return NULL;
+    }
+    return &rows->rows[lo - 1];
+}
+#endif
+
+/**
+ * An unwinder using the precomputed CFI tables, which starts from the
+ * registers of a `ucontext`. Frames without unwind info fall back to the frame
+ * pointer. It only does table lookups and validated memory reads and is thus
+ * async-signal-safe.
+ */
+size_t
+sentry__unwind_stack_cfi(
+    void *addr, const sentry_ucontext_t *uctx, void **ptrs, size_t max_frames)
+{
+#ifdef WITH_CFI_UNWINDER
+    if (addr || !uctx || !max_frames) {
+        return 0;
+    }
+    sentry_cfi_table_t *table = cfi_table_acquire();
+    if (!table) {
+        return 0;
+    }
+
+    const mcontext_t *mctx = &uctx->user_context->uc_mcontext;
+#    if defined(__x86_64__)
+    uintptr_t pc = (uintptr_t)mctx->gregs[REG_RIP];
+    uintptr_t sp = (uintptr_t)mctx->gregs[REG_RSP];
+    uintptr_t fp = (uintptr_t)mctx->gregs[REG_RBP];
+    uintptr_t lr = 0;
+#    else
+    uintptr_t pc = (uintptr_t)mctx->pc;
+    uintptr_t sp = (uintptr_t)mctx->sp;
+    uintptr_t fp = (uintptr_t)mctx->regs[29];
+    uintptr_t lr = (uintptr_t)mctx->regs[30];
+#    endif
+
+    sentry_memory_reader_t reader;
+    if (!sentry__memory_reader_init(&reader)) {
+        cfi_table_release(table);
+        return 0;
+    }
+
+    size_t frame_count = 0;
+    ptrs[frame_count++] = (void *)pc;
+    while (frame_count < max_frames) {
+        // return addresses point after the call instruction, which might
+        // already belong to the next function
+        const cfi_row_t *row = find_row(table, frame_count == 1 ? pc : pc - 1);
+        uintptr_t cfa;
+        uintptr_t ra;
+        uintptr_t next_fp = fp;
+        if (row) {
+            cfa = ((row->cfa & 3) == CFA_REG_SP ? sp : fp)
+                + (intptr_t)(row->cfa >> 2);
+            if (row->ra_offset) {
+                if (!sentry__memory_reader_read_ptr(
+                        &reader, cfa + row->ra_offset, &ra)) {
+                    break;
+                }
+            } else {
+                ra = lr;
+            }
+            if (row->fp_offset
+                && !sentry__memory_reader_read_ptr(
+                    &reader, cfa + row->fp_offset, &next_fp)) {
+                break;
+            }
+        } else {
+            // without unwind info, try the frame record at the frame pointer
+            if (fp < sp
+                || !sentry__memory_reader_read_ptr(&reader, fp, &next_fp)
+                || !sentry__memory_reader_read_ptr(
+                    &reader, fp + sizeof(uintptr_t), &ra)) {
+                break;
+            }
+            cfa = fp + 2 * sizeof(uintptr_t);
+        }
+
+        // the stack grows downwards, so the caller's frame needs to be above
+        if (!ra || cfa < sp || (cfa == sp && ra == pc)) {
+            break;
+        }
+        ptrs[frame_count++] = (void *)ra;
+        pc = ra;
+        lr = ra;
+        sp = cfa;
+        fp = next_fp;
+    }
+
+    sentry__memory_reader_close(&reader);
+    cfi_table_release(table);
+    return frame_count > 1 ? frame_count : 0;
+#else
+    (void)addr;
+    (void)uctx;
+    (void)ptrs;
+    (void)max_frames;
+    return 0;
+#endif
+}
+
+#ifndef WITH_CFI_UNWINDER
+sentry_cfi_table_t *
+sentry__cfi_table_new(void)
+{
+    return NULL;
+}
+
+void
+sentry__cfi_table_add_module(sentry_cfi_table_t *table, void *start, void *end)
+{
+    (void)table;
+    (void)start;
+    (void)end;
+}
+
+bool
+sentry__cfi_table_reuse_module(
+    sentry_cfi_table_t *table, void *start, void *end)
+{
+    (void)table;
+    (void)start;
+    (void)end;
+    return false;
+}
+
+sentry_cfi_table_t *
+sentry__cfi_table_publish(sentry_cfi_table_t *table)
+{
+    (void)table;
+    return NULL;
+}
+
+void
+sentry__cfi_table_retire(sentry_cfi_table_t *table)
+{
+    (void)table;
+}
+#endif
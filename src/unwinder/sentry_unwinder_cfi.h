@@ -0,0 +1,54 @@
+#ifndef SENTRY_UNWINDER_CFI_H_INCLUDED
+#define SENTRY_UNWINDER_CFI_H_INCLUDED
+
+#include "sentry_boot.h"
+
+/**
+ * A set of precomputed unwind tables for all the loaded modules.
+ *
+ * The DWARF CFI of a module (its `.eh_frame`, as indexed by `.eh_frame_hdr`)
+ * is evaluated once, when the modulefinder enumerates modules, into a sorted
+ * list of address ranges with their rules for the CFA, the return address and
+ * the frame pointer. The unwinder then only needs a binary search per frame.
+ */
+typedef struct sentry_cfi_table_s sentry_cfi_table_t;
+
+/**
+ * Creates a new, empty table.
+ */
+sentry_cfi_table_t *sentry__cfi_table_new(void);
+
+/**
+ * Evaluates the CFI of the loaded ELF module mapped at `start` to `end`, and
+ * adds it to the table. Modules without `.eh_frame_hdr` are ignored.
+ */
+void sentry__cfi_table_add_module(
+    sentry_cfi_table_t *table, void *start, void *end);
+
+/**
+ * Shares the rows of the module mapped at `start` to `end` from the currently
+ * published table with `table`, so modules that stay loaded do not need to be
+ * evaluated again when the module list is refreshed. Returns `false` if the
+ * published table has no rows for that module.
+ */
+bool sentry__cfi_table_reuse_module(
+    sentry_cfi_table_t *table, void *start, void *end);
+
+/**
+ * Replaces the table that is used by the unwinder, taking ownership of
+ * `table`, which can be `NULL` to clear it. This must only be called by the
+ * modulefinder, while holding its lock.
+ *
+ * Returns the previous table, which needs to be passed to
+ * `sentry__cfi_table_retire` after the lock is released.
+ */
+sentry_cfi_table_t *sentry__cfi_table_publish(sentry_cfi_table_t *table);
+
+/**
+ * Waits for the unwinders that might still be acquiring the replaced `table`,
+ * and drops the reference that was published. Unwinders that already acquired
+ * it keep it alive until they are done.
+ */
+void sentry__cfi_table_retire(sentry_cfi_table_t *table);
+
+#endif
@@ -0,0 +1,115 @@
+#include "sentry_boot.h"
+
+#include "sentry_module_index.h"
+#include "sentry_unwinder_memory.h"
+
+// frame records are expected to be within this distance of the stack pointer
+#define MAX_STACK_SIZE (8 * 1024 * 1024)
+
+#if defined(__x86_64__) || defined(__aarch64__)
+static size_t
+walk_frame_pointers(uintptr_t fp, uintptr_t sp, uintptr_t lr, void **ptrs,
+    size_t frame_idx, size_t max_frames)
+{
+    // return addresses outside of any known module mean that the chain of
+    // frame records is broken. without the modules, any readable chain would
+    // be accepted, so this rather leaves it to the other unwinders.
+    sentry_module_index_t *index = sentry__module_index_acquire();
+    if (!index) {
+        return 0;
+    }
+    sentry_memory_reader_t reader;
+    if (!sentry__memory_reader_init(&reader)) {
+        sentry__module_index_release(index);
+        return 0;
+    }
+    uintptr_t stack_end = sp + MAX_STACK_SIZE;
+
+    // a leaf function without a frame record of its own only has the return
+    // address to its caller in the link register. otherwise, the first frame
+    // record has saved the very same address.
+    uintptr_t saved_lr;
+    if (lr && frame_idx < max_frames && sentry__module_index_find(index, lr)
+        && !(fp >= sp && fp < stack_end
+            && sentry__memory_reader_read_ptr(
+                &reader, fp + sizeof(uintptr_t), &saved_lr)
+            && saved_lr == lr)) {
+        ptrs[frame_idx++] = (void *)lr;
+    }
+
+    // every frame record is a pair of the callers frame pointer and the return
+    // address, and frame records are at increasing addresses, as the stack
+    // grows downwards.
+    while (frame_idx < max_frames) {
+        uintptr_t next_fp;
+        uintptr_t return_addr;
+        if (fp < sp || fp >= stack_end
+            || !sentry__memory_reader_read_ptr(&reader, fp, &next_fp)
+            || !sentry__memory_reader_read_ptr(
+                &reader, fp + sizeof(uintptr_t), &return_addr)
+            || !return_addr || !sentry__module_index_find(index, return_addr)) {
+            break;
+        }
+        ptrs[frame_idx++] = (void *)return_addr;
+        if (next_fp <= fp) {
+            break;
+        }
+        sp = fp;
+        fp = next_fp;
+    }
+
+    sentry__module_index_release(index);
+    sentry__memory_reader_close(&reader);
+    return frame_idx;
+}
+#endif
+
+/**
+ * A frame pointer based unwinder for x86_64 and aarch64 Linux, which starts
+ * from the registers of a `ucontext`. It only uses syscalls to validate memory
+ * reads and is thus async-signal-safe.
+ *
+ * This only produces good stack traces for code compiled with frame pointers,
+ * so single-frame results are discarded to let other unwinders try. Every
+ * return address needs to be within a known module, so this also gives up as
+ * long as the module index has not been published.
+ *
+ * When the crash happens in a leaf function that has no frame record, its
+ * caller is only known on aarch64, from the link register. Though once a
+ * function with a frame record has returned from a call, the link register
+ * still points into that function, and adds a duplicate frame. On x86_64,
+ * the return address of such a leaf is somewhere on the stack, so its caller
+ * is missing from the stack trace.
+ */
+size_t
+sentry__unwind_stack_fp(
+    void *addr, const sentry_ucontext_t *uctx, void **ptrs, size_t max_frames)
+{
+#if defined(__x86_64__) || defined(__aarch64__)
+    if (addr || !uctx || !max_frames) {
+        return 0;
+    }
+
+    const mcontext_t *mctx = &uctx->user_context->uc_mcontext;
+#    if defined(__x86_64__)
+    ptrs[0] = (void *)mctx->gregs[REG_RIP];
+    uintptr_t fp = (uintptr_t)mctx->gregs[REG_RBP];
+    uintptr_t sp = (uintptr_t)mctx->gregs[REG_RSP];
+    uintptr_t lr = 0;
+#    else
+    ptrs[0] = (void *)mctx->pc;
+    uintptr_t fp = (uintptr_t)mctx->regs[29];
+    uintptr_t sp = (uintptr_t)mctx->sp;
+    uintptr_t lr = (uintptr_t)mctx->regs[30];
+#    endif
+
+    size_t frame_count = walk_frame_pointers(fp, sp, lr, ptrs, 1, max_frames);
+    return frame_count > 1 ? frame_count : 0;
+#else
+    (void)addr;
+    (void)uctx;
+    (void)ptrs;
+    (void)max_frames;
+    return 0;
+#endif
+}
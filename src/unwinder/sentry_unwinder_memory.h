@@ -0,0 +1,82 @@
+#ifndef SENTRY_UNWINDER_MEMORY_H_INCLUDED
+#define SENTRY_UNWINDER_MEMORY_H_INCLUDED
+
+#include "sentry_boot.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * This reads memory which might not be mapped, without risking a fault inside
+ * of a signal handler: `write` fails with `EFAULT` for unreadable memory, so
+ * every page is probed by writing from it into a pipe. The last readable page
+ * is remembered, so consecutive reads from the same page only need a single
+ * syscall.
+ */
+typedef struct {
+    int pipe_fds[2];
+    uintptr_t readable_page;
+} sentry_memory_reader_t;
+
+#define SENTRY_MEMORY_READER_PAGE_SIZE 4096
+
+static inline bool
+sentry__memory_reader_init(sentry_memory_reader_t *reader)
+{
+    reader->readable_page = 0;
+    return pipe2(reader->pipe_fds, O_CLOEXEC | O_NONBLOCK) == 0;
+}
+
+static inline void
+sentry__memory_reader_close(sentry_memory_reader_t *reader)
+{
+    close(reader->pipe_fds[0]);
+    close(reader->pipe_fds[1]);
+}
+
+static inline bool
+sentry__memory_reader_probe(sentry_memory_reader_t *reader, uintptr_t addr)
+{
+    uintptr_t page = addr & ~(uintptr_t)(SENTRY_MEMORY_READER_PAGE_SIZE - 1);
+    if (page == reader->readable_page) {
+        return true;
+    }
+    ssize_t rv;
+    do {
+        rv = write(reader->pipe_fds[1], (const void *)page, 1);
+    } while (rv < 0 && errno == EINTR);
+    if (rv != 1) {
+        // the pipe might be full, so drain it and try once more
+        char buf[256];
+        if (rv < 0 && errno == EAGAIN
+            && read(reader->pipe_fds[0], buf, sizeof(buf)) > 0) {
+            rv = write(reader->pipe_fds[1], (const void *)page, 1);
+        }
+        if (rv != 1) {
+            return false;
+        }
+    }
+    reader->readable_page = page;
+    return true;
+}
+
+/**
+ * Reads a pointer sized value from `addr`, returns `false` if the memory is
+ * not readable.
+ */
+static inline bool
+sentry__memory_reader_read_ptr(
+    sentry_memory_reader_t *reader, uintptr_t addr, uintptr_t *value_out)
+{
+    if (addr % sizeof(uintptr_t) != 0
+        || !sentry__memory_reader_probe(reader, addr)
+        || !sentry__memory_reader_probe(
+            reader, addr + sizeof(uintptr_t) - 1)) {
+        return false;
+    }
+    *value_out = *(const uintptr_t *)addr;
+    return true;
+}
+
+#endif
@@ -109,6 +109,152 @@ def test_inproc_crash_stdout(cmake):
     assert_crash(envelope)
 
 
+def test_inproc_prepared_crash_stdout(cmake):
+    tmp_path = cmake(
+        ["sentry_example"], {"SENTRY_BACKEND": "inproc", "SENTRY_TRANSPORT": "none"},
+    )
+
+    # without symbolication, the crash is written out of the prepared event
+    child = run(tmp_path, "sentry_example", ["no-symbolize"])
+    assert child.returncode == 0
+    database = tmp_path / ".sentry-native"
+    assert not list(database.glob("*.tmp"))
+
+    # the prepared event is only used once the scope has been flushed
+    child = run(
+        tmp_path,
+        "sentry_example",
+        ["attachment", "no-symbolize", "sleep-before-crash", "crash"],
+    )
+    assert child.returncode  # well, its a crash after all
+    assert not list(database.glob("*.tmp"))
+
+    output = check_output(tmp_path, "sentry_example", ["stdout", "no-setup"])
+    envelope = Envelope.deserialize(output)
+
+    # the prepared event starts out with the serialized scope, whereas the
+    # event built from scratch starts with its `event_id`
+    assert next(iter(envelope.get_event())) == "platform"
+
+    assert_meta(envelope, integration="inproc")
+    assert_breadcrumb(envelope)
+    assert_attachment(envelope)
+
+    assert_crash(envelope)
+
+
+def test_inproc_prepared_crash_local_scope_stdout(cmake):
+    tmp_path = cmake(
+        ["sentry_example"], {"SENTRY_BACKEND": "inproc", "SENTRY_TRANSPORT": "none"},
+    )
+
+    child = run(
+        tmp_path,
+        "sentry_example",
+        ["no-symbolize", "local-scope", "sleep-before-crash", "crash"],
+    )
+    assert child.returncode  # well, its a crash after all
+
+    output = check_output(tmp_path, "sentry_example", ["stdout", "no-setup"])
+    envelope = Envelope.deserialize(output)
+
+    event = envelope.get_event()
+    assert event["tags"]["local-tag"] == "local value"
+    assert event["tags"]["expected-tag"] == "some value"
+
+    assert_crash(envelope)
+
+
+@pytest.mark.skipif(sys.platform != "linux", reason="offloading needs linux")
+def test_inproc_offload_crash_stdout(cmake):
+    tmp_path = cmake(
+        ["sentry_example"], {"SENTRY_BACKEND": "inproc", "SENTRY_TRANSPORT": "none"},
+    )
+
+    child = run(tmp_path, "sentry_example", ["offload", "attachment", "crash"])
+    assert child.returncode  # well, its a crash after all
+
+    output = check_output(tmp_path, "sentry_example", ["stdout", "no-setup"])
+    envelope = Envelope.deserialize(output)
+
+    assert_meta(envelope, integration="inproc")
+    assert_breadcrumb(envelope)
+    assert_attachment(envelope)
+
+    assert_crash(envelope)
+
+
+@pytest.mark.skipif(sys.platform != "linux", reason="threads need linux")
+@pytest.mark.parametrize(
+    "run_args",
+    [
+        [],
+        # the prepared crash event
+        ["no-symbolize", "sleep-before-crash"],
+        # the crash event captured from a child process
+        ["offload"],
+    ],
+)
+def test_inproc_crash_threads_stdout(cmake, run_args):
+    tmp_path = cmake(
+        ["sentry_example"], {"SENTRY_BACKEND": "inproc", "SENTRY_TRANSPORT": "none"},
+    )
+
+    child = run(
+        tmp_path,
+        "sentry_example",
+        ["capture-threads", "spawn-threads"] + run_args + ["crash"],
+    )
+    assert child.returncode  # well, its a crash after all
+
+    output = check_output(tmp_path, "sentry_example", ["stdout", "no-setup"])
+    envelope = Envelope.deserialize(output)
+
+    assert_crash(envelope)
+
+    threads = envelope.get_event()["threads"]["values"]
+    # the main thread and the spawned ones, apart from any sentry workers
+    assert len(threads) >= 4
+    assert len(set(thread["id"] for thread in threads)) == len(threads)
+    crashed = [thread for thread in threads if thread["crashed"]]
+    assert len(crashed) == 1
+    assert crashed[0]["current"]
+    # the stack of the crashed thread is part of the exception
+    for thread in threads:
+        if not thread["crashed"]:
+            assert thread["stacktrace"]["frames"]
+
+
+@pytest.mark.skipif(sys.platform != "linux", reason="minidumps need linux")
+@pytest.mark.parametrize(
+    "run_args",
+    [
+        [],
+        # the prepared crash event
+        ["no-symbolize", "sleep-before-crash"],
+    ],
+)
+def test_inproc_minidump_stdout(cmake, run_args):
+    tmp_path = cmake(
+        ["sentry_example"], {"SENTRY_BACKEND": "inproc", "SENTRY_TRANSPORT": "none"},
+    )
+
+    child = run(
+        tmp_path,
+        "sentry_example",
+        ["capture-minidump", "capture-threads", "spawn-threads"]
+        + run_args
+        + ["crash"],
+    )
+    assert child.returncode  # well, its a crash after all
+
+    output = check_output(tmp_path, "sentry_example", ["stdout", "no-setup"])
+    envelope = Envelope.deserialize(output)
+
+    assert_crash(envelope)
+    assert_minidump(envelope)
+
+
 @pytest.mark.skipif(not has_breakpad, reason="test needs breakpad backend")
 def test_breakpad_crash_stdout(cmake):
     tmp_path = cmake(
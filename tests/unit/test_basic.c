@@ -1,4 +1,7 @@
 #include "sentry_core.h"
+#include "sentry_envelope.h"
+#include "sentry_path.h"
+#include "sentry_sync.h"
 #include "sentry_testsupport.h"
 #include <sentry.h>
 
@@ -96,3 +99,139 @@ SENTRY_TEST(sampling_before_send)
     // well, its random after all
     TEST_CHECK(called_beforesend > 50 && called_beforesend < 100);
 }
+
+typedef struct {
+    uint64_t called;
+    size_t image_counts[2];
+    bool found_allowed;
+    const char *allowed;
+} images_state_t;
+
+static void
+count_images(const sentry_envelope_t *envelope, void *data)
+{
+    images_state_t *state = data;
+    sentry_value_t event = sentry_envelope_get_event(envelope);
+    sentry_value_t images = sentry_value_get_by_key(
+        sentry_value_get_by_key(event, "debug_meta"), "images");
+    if (state->called < 2) {
+        state->image_counts[state->called] = sentry_value_get_length(images);
+    }
+    for (size_t i = 0; i < sentry_value_get_length(images); i++) {
+        const char *code_file = sentry_value_as_string(sentry_value_get_by_key(
+            sentry_value_get_by_index(images, i), "code_file"));
+        if (state->called == 1 && strstr(code_file, state->allowed)) {
+            state->found_allowed = true;
+        }
+    }
+    state->called += 1;
+}
+
+SENTRY_TEST(referenced_images_only)
+{
+    // the allow-list gets the last module which is not the test itself
+    sentry_value_t modules = sentry_get_modules_list();
+    size_t module_count = sentry_value_get_length(modules);
+    char allowed[256] = { 0 };
+    for (size_t i = 0; i < module_count; i++) {
+        const char *code_file = sentry_value_as_string(sentry_value_get_by_key(
+            sentry_value_get_by_index(modules, i), "code_file"));
+        const char *name = code_file;
+        for (const char *ptr = code_file; *ptr; ptr++) {
+            if (*ptr == '/' || *ptr == '\\') {
+                name = ptr + 1;
+            }
+        }
+        if (!strstr(name, "sentry_test_unit") && strlen(name) < 256) {
+            strcpy(allowed, name);
+        }
+    }
+    sentry_value_decref(modules);
+
+    images_state_t state;
+    memset(&state, 0, sizeof(images_state_t));
+    state.allowed = allowed;
+
+    sentry_options_t *options = sentry_options_new();
+    sentry_options_set_dsn(options, "https://foo@sentry.invalid/42");
+    sentry_options_set_transport(
+        options, sentry_new_function_transport(count_images, &state));
+    sentry_options_set_referenced_images_only(options, true);
+    sentry_options_add_debug_image(options, allowed);
+    TEST_CHECK(sentry_options_get_referenced_images_only(options));
+    sentry_init(options);
+
+    // events without frames still have all the images
+    sentry_capture_event(sentry_value_new_message_event(
+        SENTRY_LEVEL_INFO, "root", "Hello World!"));
+
+    sentry_value_t event = sentry_value_new_message_event(
+        SENTRY_LEVEL_INFO, "root", "Hello Frames!");
+    sentry_event_value_add_stacktrace(event, NULL, 0);
+    sentry_capture_event(event);
+
+    sentry_shutdown();
+
+    TEST_CHECK_INT_EQUAL(state.called, 2);
+    TEST_CHECK_INT_EQUAL(state.image_counts[0], module_count);
+    TEST_CHECK(state.image_counts[1] > 0);
+    TEST_CHECK(state.image_counts[1] < module_count);
+    TEST_CHECK(!allowed[0] || state.found_allowed);
+}
+
+static void
+count_envelopes(const sentry_envelope_t *UNUSED(envelope), void *data)
+{
+    volatile long *called = data;
+    sentry__atomic_fetch_and_add(called, 1);
+}
+
+SENTRY_TEST(basic_old_runs)
+{
+#ifdef __ANDROID__
+#    define PREFIX "/data/local/tmp/"
+#else
+#    define PREFIX ""
+#endif
+    sentry_path_t *db_path = sentry__path_from_str(PREFIX ".test-db-runs");
+    sentry__path_remove_all(db_path);
+
+    // a backlog of runs, as left behind by a crash loop
+    for (int i = 0; i < 3; i++) {
+        char run_name[16];
+        snprintf(run_name, sizeof(run_name), "old-%d.run", i);
+        sentry_path_t *run_path = sentry__path_join_str(db_path, run_name);
+        sentry__path_create_dir_all(run_path);
+        sentry_path_t *envelope_path
+            = sentry__path_join_str(run_path, "event.envelope");
+        sentry_envelope_t *envelope = sentry__envelope_new();
+        sentry__envelope_add_event(envelope,
+            sentry_value_new_message_event(
+                SENTRY_LEVEL_FATAL, "root", "Hello Crash!"));
+        TEST_CHECK(sentry_envelope_write_to_file(
+                       envelope, envelope_path->path)
+            == 0);
+        sentry_envelope_free(envelope);
+        sentry__path_free(envelope_path);
+        sentry__path_free(run_path);
+    }
+
+    volatile long called = 0;
+    sentry_options_t *options = sentry_options_new();
+    sentry_options_set_dsn(options, "https://foo@sentry.invalid/42");
+    sentry_options_set_database_path(options, PREFIX ".test-db-runs");
+    sentry_options_set_auto_session_tracking(options, false);
+    sentry_options_set_transport(options,
+        sentry_new_function_transport(count_envelopes, (void *)&called));
+    sentry_init(options);
+    // the remaining envelopes are sent on shutdown at the latest
+    sentry_shutdown();
+
+    TEST_CHECK_INT_EQUAL(sentry__atomic_fetch(&called), 3);
+    sentry_path_t *run_path = sentry__path_join_str(db_path, "old-0.run");
+    TEST_CHECK(!sentry__path_is_dir(run_path));
+    sentry__path_free(run_path);
+
+    sentry__path_remove_all(db_path);
+    sentry__path_free(db_path);
+}
@@ -0,0 +1,456 @@
+#include "sentry_alloc.h"
+#include "sentry_database.h"
+#include "sentry_envelope.h"
+#include "sentry_path.h"
+#include "sentry_segment_log.h"
+#include "sentry_session.h"
+#include "sentry_string.h"
+#include "sentry_sync.h"
+#include "sentry_testsupport.h"
+#include "sentry_value.h"
+#include <sentry.h>
+
+#ifdef SENTRY_PLATFORM_UNIX
+#    include <utime.h>
+#endif
+
+#ifdef __ANDROID__
+#    define PREFIX "/data/local/tmp/"
+#else
+#    define PREFIX ""
+#endif
+
+typedef struct {
+    size_t count;
+    sentry_segment_record_type_t types[32];
+    char payloads[32][8];
+} records_t;
+
+static void
+collect_record(sentry_segment_record_type_t type, const char *buf,
+    size_t buf_len, uint64_t UNUSED(timestamp), void *data)
+{
+    records_t *records = data;
+    if (records->count < 32) {
+        records->types[records->count] = type;
+        size_t len = buf_len < 7 ? buf_len : 7;
+        memcpy(records->payloads[records->count], buf, len);
+        records->payloads[records->count][len] = '\0';
+    }
+    records->count++;
+}
+
+SENTRY_TEST(segment_log_roundtrip)
+{
+    sentry_path_t *path = sentry__path_from_str(PREFIX ".test-segment.log");
+    sentry_segment_log_t *log = sentry__segment_log_new(path);
+    TEST_ASSERT(!!log);
+
+    TEST_CHECK(sentry__segment_log_append(
+        log, SENTRY_SEGMENT_RECORD_ENVELOPE, "env-1", 5, NULL));
+    TEST_CHECK(!sentry__segment_log_has_session(log));
+    TEST_CHECK(sentry__segment_log_append(
+        log, SENTRY_SEGMENT_RECORD_SESSION, "sess-1", 6, NULL));
+    TEST_CHECK(sentry__segment_log_has_session(log));
+    TEST_CHECK(sentry__segment_log_append(
+        log, SENTRY_SEGMENT_RECORD_SESSION_CLEAR, "", 0, NULL));
+    TEST_CHECK(!sentry__segment_log_has_session(log));
+    TEST_CHECK(sentry__segment_log_append(
+        log, SENTRY_SEGMENT_RECORD_ENVELOPE, "env-2", 5, NULL));
+    uint64_t removed_id = 0;
+    TEST_CHECK(sentry__segment_log_append(
+        log, SENTRY_SEGMENT_RECORD_ENVELOPE, "env-3", 5, &removed_id));
+    sentry__segment_log_remove(log, removed_id);
+    sentry__segment_log_free(log);
+
+    // a torn record at the end, as left behind by a power loss
+    TEST_CHECK(
+        sentry__path_append_buffer(path, "SLOG\1\0\0\0garbage", 15) == 0);
+
+    records_t records;
+    memset(&records, 0, sizeof(records));
+    TEST_CHECK_INT_EQUAL(
+        sentry__segment_log_read(path, collect_record, &records), 4);
+    TEST_CHECK_INT_EQUAL(records.count, 4);
+    TEST_CHECK_INT_EQUAL(records.types[0], SENTRY_SEGMENT_RECORD_ENVELOPE);
+    TEST_CHECK_STRING_EQUAL(records.payloads[0], "env-1");
+    TEST_CHECK_INT_EQUAL(records.types[1], SENTRY_SEGMENT_RECORD_SESSION);
+    TEST_CHECK_STRING_EQUAL(records.payloads[1], "sess-1");
+    TEST_CHECK_INT_EQUAL(
+        records.types[2], SENTRY_SEGMENT_RECORD_SESSION_CLEAR);
+    TEST_CHECK_STRING_EQUAL(records.payloads[3], "env-2");
+
+    sentry__path_remove(path);
+    sentry__path_free(path);
+}
+
+SENTRY_TEST(segment_log_compaction)
+{
+    sentry_path_t *path = sentry__path_from_str(PREFIX ".test-segment.log");
+    sentry_segment_log_t *log = sentry__segment_log_new(path);
+    TEST_ASSERT(!!log);
+
+    char session[4096];
+    memset(session, 's', sizeof(session));
+    TEST_CHECK(sentry__segment_log_append(
+        log, SENTRY_SEGMENT_RECORD_ENVELOPE, "env-1", 5, NULL));
+    // every session supersedes the previous one
+    for (int i = 0; i < 100; i++) {
+        TEST_CHECK(sentry__segment_log_append(log,
+            SENTRY_SEGMENT_RECORD_SESSION, session, sizeof(session), NULL));
+    }
+    TEST_CHECK(sentry__segment_log_append(
+        log, SENTRY_SEGMENT_RECORD_ENVELOPE, "env-2", 5, NULL));
+    sentry__segment_log_free(log);
+
+    TEST_CHECK(sentry__path_get_size(path) < 64 * 1024);
+
+    records_t records;
+    memset(&records, 0, sizeof(records));
+    sentry__segment_log_read(path, collect_record, &records);
+    TEST_CHECK(records.count < 20);
+    TEST_CHECK_INT_EQUAL(records.types[0], SENTRY_SEGMENT_RECORD_ENVELOPE);
+    TEST_CHECK_STRING_EQUAL(records.payloads[0], "env-1");
+    TEST_CHECK_INT_EQUAL(
+        records.types[records.count - 2], SENTRY_SEGMENT_RECORD_SESSION);
+    TEST_CHECK_INT_EQUAL(
+        records.types[records.count - 1], SENTRY_SEGMENT_RECORD_ENVELOPE);
+
+    sentry__path_remove(path);
+    sentry__path_free(path);
+}
+
+SENTRY_TEST(segment_log_compaction_all_dead)
+{
+    sentry_path_t *path = sentry__path_from_str(PREFIX ".test-segment.log");
+    sentry_segment_log_t *log = sentry__segment_log_new(path);
+    TEST_ASSERT(!!log);
+
+    // a single record which is large enough to be compacted on its own
+    size_t session_len = 96 * 1024;
+    char *session = sentry_malloc(session_len);
+    TEST_ASSERT(!!session);
+    memset(session, 's', session_len);
+    TEST_CHECK(sentry__segment_log_append(
+        log, SENTRY_SEGMENT_RECORD_SESSION, session, session_len, NULL));
+    sentry_free(session);
+    // the clear marker leaves no live record behind
+    TEST_CHECK(sentry__segment_log_append(
+        log, SENTRY_SEGMENT_RECORD_SESSION_CLEAR, "", 0, NULL));
+    TEST_CHECK_INT_EQUAL(sentry__path_get_size(path), 0);
+
+    // the truncated log is still appended to
+    TEST_CHECK(sentry__segment_log_append(
+        log, SENTRY_SEGMENT_RECORD_ENVELOPE, "env-1", 5, NULL));
+    sentry__segment_log_free(log);
+
+    records_t records;
+    memset(&records, 0, sizeof(records));
+    sentry__segment_log_read(path, collect_record, &records);
+    TEST_CHECK_INT_EQUAL(records.count, 1);
+    TEST_CHECK_STRING_EQUAL(records.payloads[0], "env-1");
+
+    sentry__path_remove(path);
+    sentry__path_free(path);
+}
+
+static void
+count_envelopes(const sentry_envelope_t *UNUSED(envelope), void *data)
+{
+    volatile long *called = data;
+    sentry__atomic_fetch_and_add(called, 1);
+}
+
+SENTRY_TEST(database_log_old_runs)
+{
+    sentry_path_t *db_path = sentry__path_from_str(PREFIX ".test-db-log");
+    sentry__path_remove_all(db_path);
+    sentry__path_create_dir_all(db_path);
+
+    // a run that crashed, without cleaning up its log
+    sentry_run_t *run = sentry__run_new(db_path);
+    TEST_ASSERT(!!run);
+    TEST_CHECK(sentry__run_open_log(run));
+    for (int i = 0; i < 2; i++) {
+        sentry_envelope_t *envelope = sentry__envelope_new();
+        sentry__envelope_add_event(envelope,
+            sentry_value_new_message_event(
+                SENTRY_LEVEL_FATAL, "root", "Hello Crash!"));
+        TEST_CHECK(sentry__run_write_envelope(run, envelope));
+        sentry_envelope_free(envelope);
+    }
+    sentry_path_t *run_path = sentry__path_clone(run->run_path);
+    sentry__run_free(run);
+
+    sentry_path_t *envelope_file = NULL;
+    sentry_pathiter_t *iter = sentry__path_iter_directory(run_path);
+    const sentry_path_t *file;
+    size_t file_count = 0;
+    while ((file = sentry__pathiter_next(iter)) != NULL) {
+        if (sentry__path_ends_with(file, ".envelope")) {
+            envelope_file = sentry__path_clone(file);
+        }
+        file_count++;
+    }
+    sentry__pathiter_free(iter);
+    // no file per envelope, only the log and the session record
+    TEST_CHECK(!envelope_file);
+    TEST_CHECK(file_count <= 2);
+    sentry__path_free(envelope_file);
+
+    volatile long called = 0;
+    sentry_options_t *options = sentry_options_new();
+    sentry_options_set_dsn(options, "https://foo@sentry.invalid/42");
+    sentry_options_set_database_path(options, PREFIX ".test-db-log");
+    sentry_options_set_database_log(options, true);
+    TEST_CHECK(sentry_options_get_database_log(options));
+    sentry_options_set_auto_session_tracking(options, false);
+    sentry_options_set_transport(options,
+        sentry_new_function_transport(count_envelopes, (void *)&called));
+    sentry_init(options);
+    sentry_shutdown();
+
+    TEST_CHECK_INT_EQUAL(sentry__atomic_fetch(&called), 2);
+    TEST_CHECK(!sentry__path_is_dir(run_path));
+
+    sentry__path_free(run_path);
+    sentry__path_remove_all(db_path);
+    sentry__path_free(db_path);
+}
+
+SENTRY_TEST(database_stale_tmp_files)
+{
+#ifndef SENTRY_PLATFORM_UNIX
+    SKIP_TEST();
+#else
+    sentry_path_t *db_path = sentry__path_from_str(PREFIX ".test-db-tmp");
+    sentry__path_remove_all(db_path);
+    sentry__path_create_dir_all(db_path);
+
+    // an interrupted write in a previous run
+    sentry_run_t *run = sentry__run_new(db_path);
+    TEST_ASSERT(!!run);
+    sentry_path_t *run_tmp
+        = sentry__path_join_str(run->run_path, "event.envelope.1.0.tmp");
+    TEST_CHECK_INT_EQUAL(sentry__path_touch(run_tmp), 0);
+    sentry__run_free(run);
+
+    // temporary files directly in the database, of which only the stale one
+    // is removed, as the other one might still be written
+    sentry_path_t *stale_tmp
+        = sentry__path_join_str(db_path, "last_crash.1.0.tmp");
+    sentry_path_t *fresh_tmp
+        = sentry__path_join_str(db_path, "last_crash.1.1.tmp");
+    TEST_CHECK_INT_EQUAL(sentry__path_touch(stale_tmp), 0);
+    TEST_CHECK_INT_EQUAL(sentry__path_touch(fresh_tmp), 0);
+    struct utimbuf times;
+    times.actime = times.modtime = 1;
+    TEST_CHECK_INT_EQUAL(utime(stale_tmp->path, &times), 0);
+
+    sentry_options_t *options = sentry_options_new();
+    sentry_options_set_database_path(options, PREFIX ".test-db-tmp");
+    sentry__process_old_runs(options, 0);
+    sentry_options_free(options);
+
+    TEST_CHECK(!sentry__path_is_file(run_tmp));
+    TEST_CHECK(!sentry__path_is_file(stale_tmp));
+    TEST_CHECK(sentry__path_is_file(fresh_tmp));
+
+    sentry__path_free(run_tmp);
+    sentry__path_free(stale_tmp);
+    sentry__path_free(fresh_tmp);
+    sentry__path_remove_all(db_path);
+    sentry__path_free(db_path);
+#endif
+}
+
+SENTRY_TEST(database_log_session_record)
+{
+    sentry_path_t *db_path = sentry__path_from_str(PREFIX ".test-db-log");
+    sentry__path_remove_all(db_path);
+    sentry__path_create_dir_all(db_path);
+
+    sentry_run_t *run = sentry__run_new(db_path);
+    TEST_ASSERT(!!run);
+    TEST_ASSERT(!!run->session_record);
+    TEST_CHECK(sentry__run_open_log(run));
+
+    sentry_session_t *session = SENTRY_MAKE(sentry_session_t);
+    TEST_ASSERT(!!session);
+    memset(session, 0, sizeof(sentry_session_t));
+    session->release = sentry__string_clone("test-release");
+    session->session_id = sentry_uuid_new_v4();
+    session->status = SENTRY_SESSION_STATUS_OK;
+    session->started_ms = sentry__msec_time();
+
+    // a distinct id that is too long for the record goes to the log
+    char did[SENTRY_SESSION_RECORD_STRING_MAX + 1];
+    memset(did, 'd', sizeof(did) - 1);
+    did[sizeof(did) - 1] = '\0';
+    session->distinct_id = sentry_value_new_string(did);
+    TEST_CHECK(sentry__run_write_session(run, session));
+    TEST_CHECK(sentry__segment_log_has_session(run->log));
+
+    // once it fits the record again, the logged session is cleared
+    sentry_value_decref(session->distinct_id);
+    session->distinct_id = sentry_value_new_null();
+    TEST_CHECK(sentry__run_write_session(run, session));
+    TEST_CHECK(!sentry__segment_log_has_session(run->log));
+    sentry__session_free(session);
+
+    sentry_path_t *log_path = sentry__path_join_str(run->run_path, "run.log");
+    sentry__run_free(run);
+
+    records_t records;
+    memset(&records, 0, sizeof(records));
+    sentry__segment_log_read(log_path, collect_record, &records);
+    TEST_CHECK_INT_EQUAL(records.count, 2);
+    TEST_CHECK_INT_EQUAL(records.types[0], SENTRY_SEGMENT_RECORD_SESSION);
+    TEST_CHECK_INT_EQUAL(
+        records.types[1], SENTRY_SEGMENT_RECORD_SESSION_CLEAR);
+
+    sentry__path_free(log_path);
+    sentry__path_remove_all(db_path);
+    sentry__path_free(db_path);
+}
+
+static bool
+write_event(sentry_run_t *run, sentry_level_t level, const char *message)
+{
+    sentry_value_t event
+        = sentry_value_new_message_event(level, "root", message);
+    sentry_uuid_t event_id = sentry_uuid_new_v4();
+    sentry_value_set_by_key(
+        event, "event_id", sentry__value_new_uuid(&event_id));
+    sentry_envelope_t *envelope = sentry__envelope_new();
+    sentry__envelope_add_event(envelope, event);
+    bool rv = sentry__run_write_envelope(run, envelope);
+    sentry_envelope_free(envelope);
+    return rv;
+}
+
+static size_t
+count_run_envelopes(const sentry_path_t *run_path)
+{
+    size_t count = 0;
+    sentry_pathiter_t *iter = sentry__path_iter_directory(run_path);
+    const sentry_path_t *file;
+    while ((file = sentry__pathiter_next(iter)) != NULL) {
+        if (sentry__path_ends_with(file, ".envelope")) {
+            count++;
+        }
+    }
+    sentry__pathiter_free(iter);
+    return count;
+}
+
+static void
+count_log_envelopes(sentry_segment_record_type_t type,
+    const char *UNUSED(buf), size_t UNUSED(buf_len),
+    uint64_t UNUSED(timestamp), void *data)
+{
+    if (type == SENTRY_SEGMENT_RECORD_ENVELOPE) {
+        *(size_t *)data += 1;
+    }
+}
+
+static void
+write_old_file(const sentry_path_t *run_dir, const char *filename, size_t size)
+{
+    sentry_path_t *path = sentry__path_join_str(run_dir, filename);
+    char *buf = sentry_malloc(size);
+    TEST_ASSERT(path && buf);
+    memset(buf, 'x', size);
+    TEST_CHECK_INT_EQUAL(sentry__path_write_buffer(path, buf, size), 0);
+    sentry_free(buf);
+    sentry__path_free(path);
+}
+
+static bool
+old_file_exists(const sentry_path_t *run_dir, const char *filename)
+{
+    sentry_path_t *path = sentry__path_join_str(run_dir, filename);
+    bool exists = sentry__path_is_file(path);
+    sentry__path_free(path);
+    return exists;
+}
+
+SENTRY_TEST(database_quota_old_runs)
+{
+    sentry_path_t *db_path = sentry__path_from_str(PREFIX ".test-db-quota");
+    sentry__path_remove_all(db_path);
+    sentry__path_create_dir_all(db_path);
+
+    // a previous run, which left a minidump and two envelopes behind
+    sentry_run_t *old_run = sentry__run_new(db_path);
+    TEST_ASSERT(!!old_run);
+    sentry_path_t *old_run_path = sentry__path_clone(old_run->run_path);
+    sentry__run_free(old_run);
+    write_old_file(old_run_path, "minidump.dmp", 2048);
+    write_old_file(old_run_path, "a.envelope", 1024);
+    write_old_file(old_run_path, "b.envelope", 1024);
+
+    // the previous run counts towards the quota right away
+    sentry_run_t *run = sentry__run_new(db_path);
+    TEST_ASSERT(!!run);
+    size_t evicted = sentry__database_evicted_count();
+    sentry__run_set_quota(run, 3500, 0, 0);
+    TEST_CHECK_INT_EQUAL(sentry__database_evicted_count() - evicted, 1);
+    TEST_CHECK(old_file_exists(old_run_path, "minidump.dmp"));
+    TEST_CHECK_INT_EQUAL(count_run_envelopes(old_run_path), 1);
+
+    // a released file does not count anymore
+    sentry__path_remove_all(old_run_path);
+    sentry__run_release_quota(run, old_run_path);
+    evicted = sentry__database_evicted_count();
+    TEST_CHECK(write_event(run, SENTRY_LEVEL_INFO, "info"));
+    TEST_CHECK_INT_EQUAL(sentry__database_evicted_count() - evicted, 0);
+    TEST_CHECK_INT_EQUAL(count_run_envelopes(run->run_path), 1);
+
+    sentry__path_free(old_run_path);
+    sentry__run_clean(run);
+    sentry__run_free(run);
+    sentry__path_remove_all(db_path);
+    sentry__path_free(db_path);
+}
+
+SENTRY_TEST(database_quota)
+{
+    sentry_path_t *db_path = sentry__path_from_str(PREFIX ".test-db-quota");
+    sentry__path_remove_all(db_path);
+    sentry__path_create_dir_all(db_path);
+
+    sentry_run_t *run = sentry__run_new(db_path);
+    TEST_ASSERT(!!run);
+    sentry__run_set_quota(run, 0, 3, 0);
+    size_t evicted = sentry__database_evicted_count();
+
+    TEST_CHECK(write_event(run, SENTRY_LEVEL_FATAL, "crash"));
+    for (int i = 0; i < 4; i++) {
+        TEST_CHECK(write_event(run, SENTRY_LEVEL_INFO, "info"));
+    }
+    // the crash is kept, even though it is the oldest one
+    TEST_CHECK_INT_EQUAL(count_run_envelopes(run->run_path), 3);
+    TEST_CHECK_INT_EQUAL(sentry__database_evicted_count() - evicted, 2);
+
+    // the same for the envelopes in the log, which are limited by size
+    TEST_CHECK(sentry__run_open_log(run));
+    sentry__run_set_quota(run, 4096, 0, 0);
+    evicted = sentry__database_evicted_count();
+    for (int i = 0; i < 20; i++) {
+        TEST_CHECK(write_event(run, SENTRY_LEVEL_INFO, "info"));
+    }
+    TEST_CHECK(sentry__database_evicted_count() - evicted > 0);
+    sentry_path_t *log_path = sentry__path_join_str(run->run_path, "run.log");
+    size_t log_envelopes = 0;
+    sentry__segment_log_read(log_path, count_log_envelopes, &log_envelopes);
+    TEST_CHECK(log_envelopes > 0);
+    // evicted records stay in the file until it is compacted, but are skipped
+    TEST_CHECK(log_envelopes < 20);
+
+    sentry__path_free(log_path);
+    sentry__run_clean(run);
+    sentry__run_free(run);
+    sentry__path_remove_all(db_path);
+    sentry__path_free(db_path);
+}
@@ -0,0 +1,91 @@
+#include "sentry_path.h"
+#include "sentry_testsupport.h"
+#include <sentry.h>
+
+#if defined(SENTRY_BACKEND_INPROC) && defined(SENTRY_PLATFORM_LINUX)
+#    include "backends/sentry_minidump_linux.h"
+#    include <fcntl.h>
+#    include <ucontext.h>
+#    include <unistd.h>
+#endif
+
+SENTRY_TEST(minidump_writer)
+{
+#if !defined(SENTRY_BACKEND_INPROC) || !defined(SENTRY_PLATFORM_LINUX)         \
+    || !SENTRY_MINIDUMP_SUPPORTED
+    SKIP_TEST();
+#else
+    sentry_path_t *path = sentry__path_from_str(".test-minidump.dmp");
+    int fd = open(path->path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    TEST_CHECK(fd >= 0);
+
+    sentry_value_t module_list = sentry_get_modules_list();
+    sentry_minidump_modules_t *modules
+        = sentry__minidump_modules_new(module_list);
+    TEST_CHECK(!!modules);
+
+    ucontext_t user_context;
+    TEST_CHECK(getcontext(&user_context) == 0);
+    char context[SENTRY_MINIDUMP_CONTEXT_SIZE];
+    sentry_minidump_thread_t thread;
+    thread.tid = 1;
+    thread.stack_pointer
+        = sentry__minidump_fill_context(context, &user_context);
+    thread.context = context;
+    TEST_CHECK(thread.stack_pointer != 0);
+
+    sentry_minidump_t dump;
+    memset(&dump, 0, sizeof(dump));
+    dump.fd = fd;
+    dump.crashed_tid = 1;
+    dump.signum = 11;
+    dump.threads = &thread;
+    dump.thread_count = 1;
+    dump.modules = modules;
+    TEST_CHECK(sentry__minidump_write(&dump));
+    close(fd);
+
+    size_t len = 0;
+    char *buf = sentry__path_read_to_buffer(path, &len);
+    TEST_CHECK(!!buf);
+    TEST_CHECK(len > 32);
+    TEST_CHECK(memcmp(buf, "MDMP", 4) == 0);
+    uint32_t stream_count;
+    memcpy(&stream_count, buf + 8, sizeof(stream_count));
+    TEST_CHECK_INT_EQUAL(stream_count, 5);
+
+    // the thread list references the context and the stack memory
+    uint32_t thread_list_rva = 0;
+    for (uint32_t i = 0; i < stream_count; i++) {
+        uint32_t entry[3];
+        memcpy(entry, buf + 32 + i * 12, sizeof(entry));
+        if (entry[0] == 3) {
+            thread_list_rva = entry[2];
+        }
+    }
+    TEST_CHECK(thread_list_rva > 0);
+    uint32_t thread_count;
+    memcpy(&thread_count, buf + thread_list_rva, sizeof(thread_count));
+    TEST_CHECK_INT_EQUAL(thread_count, 1);
+    uint64_t stack_start;
+    uint32_t stack_size, stack_rva, context_size, context_rva;
+    const char *raw_thread = buf + thread_list_rva + 4;
+    memcpy(&stack_start, raw_thread + 24, sizeof(stack_start));
+    memcpy(&stack_size, raw_thread + 32, sizeof(stack_size));
+    memcpy(&stack_rva, raw_thread + 36, sizeof(stack_rva));
+    memcpy(&context_size, raw_thread + 40, sizeof(context_size));
+    memcpy(&context_rva, raw_thread + 44, sizeof(context_rva));
+    TEST_CHECK(stack_start <= thread.stack_pointer);
+    TEST_CHECK(stack_size > 0);
+    TEST_CHECK(stack_rva + stack_size <= len);
+    TEST_CHECK_INT_EQUAL(context_size, SENTRY_MINIDUMP_CONTEXT_SIZE);
+    TEST_CHECK(memcmp(buf + context_rva, context, context_size) == 0);
+
+    sentry_free(buf);
+    sentry__minidump_modules_free(modules);
+    sentry_value_decref(module_list);
+    sentry__path_remove(path);
+    sentry__path_free(path);
+    sentry_clear_modulecache();
+#endif
+}
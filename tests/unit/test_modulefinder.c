@@ -1,9 +1,13 @@
+#include "sentry_module_index.h"
 #include "sentry_path.h"
+#include "sentry_string.h"
+#include "sentry_sync.h"
 #include "sentry_testsupport.h"
 #include <sentry.h>
 
 #ifdef SENTRY_PLATFORM_LINUX
 #    include "modulefinder/sentry_modulefinder_linux.h"
+#    include <dlfcn.h>
 #endif
 
 SENTRY_TEST(module_finder)
@@ -37,6 +41,193 @@ SENTRY_TEST(module_finder)
     sentry_clear_modulecache();
 }
 
+#ifdef SENTRY_PLATFORM_LINUX
+static sentry_value_t
+find_module(sentry_value_t modules, const char *name)
+{
+    for (size_t i = 0; i < sentry_value_get_length(modules); i++) {
+        sentry_value_t mod = sentry_value_get_by_index(modules, i);
+        const char *code_file
+            = sentry_value_as_string(sentry_value_get_by_key(mod, "code_file"));
+        if (strstr(code_file, name)) {
+            return mod;
+        }
+    }
+    return sentry_value_new_null();
+}
+
+/**
+ * Opens a library that is part of glibc, but not loaded by default, or returns
+ * `NULL` if all of them are already loaded or missing.
+ */
+static void *
+open_unloaded_library(void)
+{
+    const char *names[]
+        = { "libthread_db.so.1", "libanl.so.1", "libBrokenLocale.so.1" };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        void *handle = dlopen(names[i], RTLD_NOW | RTLD_NOLOAD);
+        if (handle) {
+            dlclose(handle);
+            continue;
+        }
+        handle = dlopen(names[i], RTLD_NOW | RTLD_LOCAL);
+        if (handle) {
+            return handle;
+        }
+    }
+    return NULL;
+}
+#endif
+
+SENTRY_TEST(module_finder_incremental)
+{
+#ifndef SENTRY_PLATFORM_LINUX
+    SKIP_TEST();
+#else
+    sentry_clear_modulecache();
+    sentry_value_t modules = sentry_get_modules_list();
+    sentry_value_t test_module = find_module(modules, "sentry_test_unit");
+    TEST_CHECK(!sentry_value_is_null(test_module));
+
+    // nothing was loaded, so this is the very same list
+    sentry_value_t same_modules = sentry_get_modules_list();
+    TEST_CHECK(same_modules._bits == modules._bits);
+    sentry_value_decref(same_modules);
+
+    void *handle = open_unloaded_library();
+    if (handle) {
+        // the list is refreshed without an explicit `sentry_clear_modulecache`,
+        // and the modules that were loaded before are not inspected again
+        sentry_value_t new_modules = sentry_get_modules_list();
+        TEST_CHECK(new_modules._bits != modules._bits);
+        TEST_CHECK(sentry_value_get_length(new_modules)
+            == sentry_value_get_length(modules) + 1);
+        TEST_CHECK(find_module(new_modules, "sentry_test_unit")._bits
+            == test_module._bits);
+        sentry_value_decref(new_modules);
+        dlclose(handle);
+    }
+
+    sentry_value_decref(modules);
+    sentry_clear_modulecache();
+#endif
+}
+
+SENTRY_TEST(module_finder_signal_handler)
+{
+#ifndef SENTRY_PLATFORM_LINUX
+    SKIP_TEST();
+#else
+    // without a cached list, the modules are read from `/proc/self/maps`
+    sentry_clear_modulecache();
+    sentry__enter_signal_handler();
+    sentry_value_t modules = sentry_get_modules_list();
+    sentry__leave_signal_handler();
+    TEST_CHECK(
+        !sentry_value_is_null(find_module(modules, "sentry_test_unit")));
+    sentry_value_decref(modules);
+
+    sentry_clear_modulecache();
+    modules = sentry_get_modules_list();
+    void *handle = open_unloaded_library();
+    if (handle) {
+        // a signal handler keeps using the cached list
+        sentry__enter_signal_handler();
+        sentry_value_t cached_modules = sentry_get_modules_list();
+        sentry__leave_signal_handler();
+        TEST_CHECK(cached_modules._bits == modules._bits);
+        sentry_value_decref(cached_modules);
+
+        sentry_value_t new_modules = sentry_get_modules_list();
+        TEST_CHECK(new_modules._bits != modules._bits);
+        sentry_value_decref(new_modules);
+        dlclose(handle);
+    }
+
+    sentry_value_decref(modules);
+    sentry_clear_modulecache();
+#endif
+}
+
+SENTRY_TEST(module_finder_id_cache)
+{
+#ifndef SENTRY_PLATFORM_LINUX
+    SKIP_TEST();
+#else
+#    ifdef __ANDROID__
+#        define PREFIX "/data/local/tmp/"
+#    else
+#        define PREFIX ""
+#    endif
+    sentry_path_t *db_path = sentry__path_from_str(PREFIX ".test-db-modules");
+    sentry_path_t *cache_path = sentry__path_join_str(db_path, "module-ids");
+    sentry__path_remove_all(db_path);
+    sentry_clear_modulecache();
+
+    sentry_options_t *options = sentry_options_new();
+    sentry_options_set_database_path(options, PREFIX ".test-db-modules");
+    sentry_init(options);
+    sentry_value_t modules = sentry_get_modules_list();
+    char *debug_id = sentry__string_clone(sentry_value_as_string(
+        sentry_value_get_by_key(find_module(modules, "sentry_test_unit"),
+            "debug_id")));
+    sentry_value_decref(modules);
+    sentry_shutdown();
+
+    // replace the cached id of the test binary, which proves that the next
+    // run reads it from the cache, instead of the file
+    char *contents = sentry__path_read_to_buffer(cache_path, NULL);
+    TEST_CHECK(contents && debug_id && strlen(debug_id) == 36);
+    char *cached_id = contents && debug_id ? strstr(contents, debug_id) : NULL;
+    TEST_CHECK(!!cached_id);
+    if (cached_id) {
+        memcpy(cached_id, "00000000-0000-0000-0000-000000000042", 36);
+        sentry__path_write_buffer(cache_path, contents, strlen(contents));
+    }
+    sentry_free(contents);
+    sentry_free(debug_id);
+
+    options = sentry_options_new();
+    sentry_options_set_database_path(options, PREFIX ".test-db-modules");
+    sentry_init(options);
+    modules = sentry_get_modules_list();
+    TEST_CHECK_STRING_EQUAL(
+        sentry_value_as_string(sentry_value_get_by_key(
+            find_module(modules, "sentry_test_unit"), "debug_id")),
+        "00000000-0000-0000-0000-000000000042");
+    sentry_value_decref(modules);
+    sentry_shutdown();
+
+    sentry__path_remove_all(db_path);
+    sentry__path_free(cache_path);
+    sentry__path_free(db_path);
+#endif
+}
+
+SENTRY_TEST(module_index)
+{
+    sentry_clear_modulecache();
+    TEST_CHECK(!sentry__module_index_acquire());
+
+    sentry_value_t modules = sentry_get_modules_list();
+    sentry_module_index_t *index = sentry__module_index_acquire();
+    TEST_CHECK(!!index);
+    const sentry_module_range_t *module = sentry__module_index_find(
+        index, (uintptr_t)(void *)&sentry__module_index_find);
+    TEST_CHECK(module && module->code_file
+        && strstr(module->code_file, "sentry_test_unit"));
+    TEST_CHECK(!sentry__module_index_find(index, 0));
+
+    // the index stays valid when the module cache is cleared concurrently
+    sentry_value_decref(modules);
+    sentry_clear_modulecache();
+    TEST_CHECK(!sentry__module_index_acquire());
+    TEST_CHECK(module && module->code_file
+        && strstr(module->code_file, "sentry_test_unit"));
+    sentry__module_index_release(index);
+}
+
 SENTRY_TEST(procmaps_parser)
 {
 #if !defined(SENTRY_PLATFORM_LINUX) || __SIZEOF_POINTER__ != 8
@@ -175,3 +366,38 @@ SENTRY_TEST(buildid_fallback)
     sentry__path_free(dir);
 #endif
 }
+
+SENTRY_TEST(module_prefetch)
+{
+    sentry_clear_modulecache();
+
+    // shutting down while the prefetch is still in flight
+    sentry_options_t *options = sentry_options_new();
+    sentry_options_set_prefetch_modules(options, true);
+    TEST_CHECK(sentry_options_get_prefetch_modules(options));
+    sentry_init(options);
+    sentry_shutdown();
+
+    sentry_module_index_t *index = sentry__module_index_acquire();
+    TEST_CHECK(!index);
+    sentry__module_index_release(index);
+
+    options = sentry_options_new();
+    sentry_options_set_prefetch_modules(options, true);
+    sentry_init(options);
+
+    // this waits for the prefetch, and then returns the very same list
+    sentry_value_t modules = sentry_get_modules_list();
+    TEST_CHECK(sentry_value_get_length(modules) > 0);
+    TEST_CHECK(sentry_value_is_frozen(modules));
+    sentry_value_t same_modules = sentry_get_modules_list();
+    TEST_CHECK(same_modules._bits == modules._bits);
+    sentry_value_decref(same_modules);
+    sentry_value_decref(modules);
+
+    index = sentry__module_index_acquire();
+    TEST_CHECK(!!index);
+    sentry__module_index_release(index);
+
+    sentry_shutdown();
+}
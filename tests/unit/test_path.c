@@ -197,3 +197,81 @@ SENTRY_TEST(path_directory)
     sentry__path_free(path_1);
     sentry__path_free(path_2);
 }
+
+SENTRY_TEST(path_filewriter)
+{
+    sentry_path_t *path = sentry__path_from_str(".sentry-test-filewriter");
+    TEST_ASSERT(!!path);
+    sentry__path_remove(path);
+
+    sentry_filewriter_t *writer = sentry__path_open_writer(path);
+    TEST_ASSERT(!!writer);
+    TEST_CHECK_INT_EQUAL(sentry__filewriter_write(writer, "foo", 3), 0);
+    TEST_CHECK_INT_EQUAL(sentry__filewriter_write(writer, "bar", 3), 0);
+    TEST_CHECK_INT_EQUAL(sentry__path_get_size(path), 6);
+
+    TEST_CHECK_INT_EQUAL(sentry__filewriter_truncate(writer), 0);
+    TEST_CHECK_INT_EQUAL(sentry__filewriter_write(writer, "baz", 3), 0);
+    sentry__filewriter_free(writer);
+
+    size_t size;
+    char *buf = sentry__path_read_to_buffer(path, &size);
+    TEST_CHECK_INT_EQUAL(size, 3);
+    TEST_CHECK(buf && memcmp(buf, "baz", 3) == 0);
+    sentry_free(buf);
+
+    sentry__path_remove(path);
+    sentry__path_free(path);
+}
+
+SENTRY_TEST(path_write_buffer_atomic)
+{
+    sentry_path_t *dir = sentry__path_from_str(".sentry-test-atomic");
+    TEST_ASSERT(!!dir);
+    sentry__path_remove_all(dir);
+    sentry__path_create_dir_all(dir);
+    sentry_path_t *path = sentry__path_join_str(dir, "file.json");
+    TEST_ASSERT(!!path);
+
+    sentry_options_t *options = sentry_options_new();
+    TEST_CHECK_INT_EQUAL(
+        sentry_options_get_durability(options), SENTRY_DURABILITY_CRASH);
+    sentry_options_free(options);
+
+    TEST_CHECK_INT_EQUAL(sentry__path_write_buffer(path, "foobar", 6), 0);
+    // the shorter content replaces the previous file entirely
+    sentry__path_set_durable(true);
+    TEST_CHECK(sentry__path_is_durable());
+    TEST_CHECK_INT_EQUAL(sentry__path_write_buffer(path, "baz", 3), 0);
+    TEST_CHECK_INT_EQUAL(sentry__path_sync_dir(dir), 0);
+    sentry__path_set_durable(false);
+
+    size_t size;
+    char *buf = sentry__path_read_to_buffer(path, &size);
+    TEST_CHECK_INT_EQUAL(size, 3);
+    TEST_CHECK(buf && memcmp(buf, "baz", 3) == 0);
+    sentry_free(buf);
+
+    // no temporary file is left behind
+    size_t file_count = 0;
+    sentry_pathiter_t *iter = sentry__path_iter_directory(dir);
+    while (sentry__pathiter_next(iter) != NULL) {
+        file_count++;
+    }
+    sentry__pathiter_free(iter);
+    TEST_CHECK_INT_EQUAL(file_count, 1);
+
+    // concurrent writers of the same file never share a temporary file
+    sentry_path_t *tmp_a = sentry__path_unique_tmp(path);
+    sentry_path_t *tmp_b = sentry__path_unique_tmp(path);
+    TEST_ASSERT(tmp_a && tmp_b);
+    TEST_CHECK(sentry__path_ends_with(tmp_a, ".tmp"));
+    TEST_CHECK_INT_EQUAL(sentry__path_touch(tmp_a), 0);
+    TEST_CHECK(!sentry__path_is_file(tmp_b));
+    sentry__path_free(tmp_a);
+    sentry__path_free(tmp_b);
+
+    sentry__path_free(path);
+    sentry__path_remove_all(dir);
+    sentry__path_free(dir);
+}
@@ -0,0 +1,247 @@
+#include "sentry_alloc.h"
+#include "sentry_backend.h"
+#include "sentry_options.h"
+#include "sentry_scope.h"
+#include "sentry_session.h"
+#include "sentry_sync.h"
+#include "sentry_testsupport.h"
+#include <sentry.h>
+
+SENTRY_TEST(scope_snapshot)
+{
+    sentry_set_tag("foo", "foo");
+
+    const sentry_scope_t *snapshot = sentry__scope_acquire();
+    TEST_CHECK(!!snapshot);
+    TEST_CHECK(sentry_value_is_frozen(snapshot->tags));
+
+    // acquiring again without any modification yields the same snapshot
+    const sentry_scope_t *same = sentry__scope_acquire();
+    TEST_CHECK(same == snapshot);
+    sentry__scope_release(same);
+
+    sentry_set_tag("bar", "bar");
+
+    // the previous snapshot is not affected by the modification
+    TEST_CHECK(sentry_value_is_null(
+        sentry_value_get_by_key(snapshot->tags, "bar")));
+    TEST_CHECK_STRING_EQUAL(sentry_value_as_string(sentry_value_get_by_key(
+                                snapshot->tags, "foo")),
+        "foo");
+
+    SENTRY_WITH_SCOPE (scope) {
+        TEST_CHECK(scope != snapshot);
+        TEST_CHECK_STRING_EQUAL(sentry_value_as_string(sentry_value_get_by_key(
+                                    scope->tags, "bar")),
+            "bar");
+    }
+
+    sentry__scope_release(snapshot);
+    sentry__scope_cleanup();
+}
+
+SENTRY_TEST(scope_snapshot_nested)
+{
+    sentry_value_t context = sentry_value_new_object();
+    sentry_value_incref(context);
+    sentry_set_context("foo", context);
+
+    const sentry_scope_t *snapshot = sentry__scope_acquire();
+    TEST_ASSERT(!!snapshot);
+    sentry_value_t frozen = sentry_value_get_by_key(snapshot->contexts, "foo");
+    TEST_CHECK(sentry_value_is_frozen(frozen));
+
+    // the nested value of the live scope can still be modified in place
+    TEST_CHECK(!sentry_value_is_frozen(context));
+    TEST_CHECK_INT_EQUAL(sentry_value_set_by_key(
+                             context, "bar", sentry_value_new_int32(42)),
+        0);
+    TEST_CHECK(sentry_value_is_null(sentry_value_get_by_key(frozen, "bar")));
+
+    sentry__scope_release(snapshot);
+    sentry_value_decref(context);
+    sentry__scope_cleanup();
+}
+
+static void
+count_flush_scope(sentry_backend_t *backend)
+{
+    sentry__atomic_fetch_and_add((volatile long *)backend->data, 1);
+}
+
+SENTRY_TEST(scope_flush_coalescing)
+{
+    volatile long flushes = 0;
+
+    sentry_options_t *options = sentry_options_new();
+    sentry_options_set_dsn(options, "https://foo@sentry.invalid/42");
+    sentry_options_set_auto_session_tracking(options, false);
+    // long enough to never elapse during the test
+    sentry_options_set_scope_flush_interval(options, 60 * 1000);
+    TEST_CHECK_INT_EQUAL(
+        sentry_options_get_scope_flush_interval(options), 60 * 1000);
+
+    sentry_backend_t *backend = SENTRY_MAKE(sentry_backend_t);
+    memset(backend, 0, sizeof(sentry_backend_t));
+    backend->flush_scope_func = count_flush_scope;
+    backend->data = (void *)&flushes;
+    sentry__backend_free(options->backend);
+    options->backend = backend;
+
+    sentry_init(options);
+    // `sentry_init` flushes the initial scope synchronously
+    TEST_CHECK_INT_EQUAL(sentry__atomic_fetch(&flushes), 1);
+
+    for (int i = 0; i < 10; i++) {
+        sentry_set_tag("foo", "bar");
+    }
+    TEST_CHECK_INT_EQUAL(sentry__atomic_fetch(&flushes), 1);
+
+    // shutting down flushes all the pending modifications at once
+    sentry_shutdown();
+    TEST_CHECK_INT_EQUAL(flushes, 2);
+}
+
+SENTRY_TEST(scope_flush_synchronous_backend)
+{
+    volatile long flushes = 0;
+
+    sentry_options_t *options = sentry_options_new();
+    sentry_options_set_dsn(options, "https://foo@sentry.invalid/42");
+    sentry_options_set_auto_session_tracking(options, false);
+    sentry_options_set_scope_flush_interval(options, 60 * 1000);
+
+    // a backend which can not flush the pending modifications when crashing
+    sentry_backend_t *backend = SENTRY_MAKE(sentry_backend_t);
+    memset(backend, 0, sizeof(sentry_backend_t));
+    backend->flush_scope_func = count_flush_scope;
+    backend->needs_synchronous_scope_flush = true;
+    backend->data = (void *)&flushes;
+    sentry__backend_free(options->backend);
+    options->backend = backend;
+
+    sentry_init(options);
+    for (int i = 0; i < 10; i++) {
+        sentry_set_tag("foo", "bar");
+    }
+    TEST_CHECK_INT_EQUAL(sentry__atomic_fetch(&flushes), 11);
+
+    sentry_shutdown();
+}
+
+static const char *
+tag_of(const sentry_scope_t *scope, const char *key)
+{
+    return sentry_value_as_string(sentry_value_get_by_key(scope->tags, key));
+}
+
+SENTRY_TEST(scope_local)
+{
+    sentry_set_tag("global", "global");
+    sentry_set_tag("override", "global");
+    sentry_add_breadcrumb(sentry_value_new_breadcrumb(NULL, "global"));
+
+    sentry_push_scope();
+    sentry_set_tag("override", "local");
+    sentry_set_tag("local", "local");
+    sentry_set_level(SENTRY_LEVEL_WARNING);
+    sentry_add_breadcrumb(sentry_value_new_breadcrumb(NULL, "local"));
+
+    SENTRY_WITH_CURRENT_SCOPE (scope) {
+        TEST_CHECK_STRING_EQUAL(tag_of(scope, "global"), "global");
+        TEST_CHECK_STRING_EQUAL(tag_of(scope, "override"), "local");
+        TEST_CHECK_STRING_EQUAL(tag_of(scope, "local"), "local");
+        TEST_CHECK(scope->level == SENTRY_LEVEL_WARNING);
+        TEST_CHECK_INT_EQUAL(sentry_value_get_length(scope->breadcrumbs), 2);
+    }
+    // the global scope is not affected by local modifications
+    SENTRY_WITH_SCOPE (scope) {
+        TEST_CHECK_STRING_EQUAL(tag_of(scope, "override"), "global");
+        TEST_CHECK(sentry_value_is_null(
+            sentry_value_get_by_key(scope->tags, "local")));
+        TEST_CHECK(scope->level == SENTRY_LEVEL_ERROR);
+        TEST_CHECK_INT_EQUAL(sentry_value_get_length(scope->breadcrumbs), 1);
+    }
+
+    sentry_push_scope();
+    sentry_set_tag("inner", "inner");
+    sentry_remove_tag("local");
+    SENTRY_WITH_CURRENT_SCOPE (scope) {
+        TEST_CHECK_STRING_EQUAL(tag_of(scope, "inner"), "inner");
+        TEST_CHECK_STRING_EQUAL(tag_of(scope, "override"), "local");
+        TEST_CHECK(sentry_value_is_null(
+            sentry_value_get_by_key(scope->tags, "local")));
+    }
+    sentry_pop_scope();
+
+    // popping restores the data of the outer local scope
+    SENTRY_WITH_CURRENT_SCOPE (scope) {
+        TEST_CHECK_STRING_EQUAL(tag_of(scope, "local"), "local");
+        TEST_CHECK(sentry_value_is_null(
+            sentry_value_get_by_key(scope->tags, "inner")));
+    }
+    sentry_pop_scope();
+
+    SENTRY_WITH_CURRENT_SCOPE (scope) {
+        TEST_CHECK_STRING_EQUAL(tag_of(scope, "override"), "global");
+        TEST_CHECK(sentry_value_is_null(
+            sentry_value_get_by_key(scope->tags, "local")));
+    }
+
+    sentry__scope_cleanup();
+}
+
+SENTRY_TEST(scope_local_session_user)
+{
+    sentry_options_t *options = sentry_options_new();
+    sentry_options_set_dsn(options, "https://foo@sentry.invalid/42");
+    sentry_options_set_release(options, "my_release");
+    sentry_init(options);
+
+    sentry_push_scope();
+    sentry_value_t user = sentry_value_new_object();
+    sentry_value_set_by_key(user, "id", sentry_value_new_string("42"));
+    sentry_set_user(user);
+    sentry_pop_scope();
+
+    // the session of the global scope is attributed to the local user
+    sentry_session_t *session
+        = sentry__end_current_session_with_status(SENTRY_SESSION_STATUS_OK);
+    TEST_ASSERT(!!session);
+    TEST_CHECK_STRING_EQUAL(
+        sentry_value_as_string(session->distinct_id), "42");
+    sentry__session_free(session);
+
+    sentry_shutdown();
+}
+
+#ifdef SENTRY_PLATFORM_WINDOWS
+static DWORD WINAPI
+#else
+static void *
+#endif
+push_scopes_thread(void *UNUSED(data))
+{
+    // the scopes are never popped, and are freed when the thread exits
+    sentry_push_scope();
+    sentry_set_tag("local", "local");
+    sentry_push_scope();
+    sentry_set_tag("inner", "inner");
+    return 0;
+}
+
+SENTRY_TEST(scope_local_thread_exit)
+{
+    sentry_threadid_t thread;
+    sentry__thread_init(&thread);
+    TEST_ASSERT(sentry__thread_spawn(&thread, push_scopes_thread, NULL) == 0);
+    sentry__thread_join(thread);
+    sentry__thread_free(&thread);
+
+    // the local scopes of the other thread never affected this one
+    SENTRY_WITH_CURRENT_SCOPE (scope) {
+        TEST_CHECK(sentry_value_is_null(
+            sentry_value_get_by_key(scope->tags, "local")));
+    }
+    sentry__scope_cleanup();
+}
@@ -1,6 +1,7 @@
 #include "sentry_envelope.h"
 #include "sentry_session.h"
 #include "sentry_testsupport.h"
+#include "sentry_utils.h"
 #include "sentry_value.h"
 #include <sentry.h>
 
@@ -142,3 +143,179 @@ SENTRY_TEST(count_sampled_events)
 
     TEST_CHECK_INT_EQUAL(assertion.called, 1);
 }
+
+SENTRY_TEST(session_record)
+{
+    sentry_session_record_t record;
+    memset(&record, 0, sizeof(record));
+    record.magic = SENTRY_SESSION_RECORD_MAGIC;
+    record.version = SENTRY_SESSION_RECORD_VERSION;
+
+    sentry_session_t session;
+    memset(&session, 0, sizeof(session));
+    session.release = "my_release";
+    session.environment = NULL;
+    session.session_id = sentry_uuid_new_v4();
+    session.distinct_id = sentry_value_new_string("foo@blabla.invalid");
+    uint64_t started_ms = sentry__msec_time() - 5000;
+    session.started_ms = started_ms;
+    session.duration_ms = (uint64_t)-1;
+    session.errors = 3;
+    session.status = SENTRY_SESSION_STATUS_OK;
+    session.init = true;
+
+    TEST_CHECK(sentry__session_to_record(&session, &record));
+    session.errors += 1;
+    TEST_CHECK(sentry__session_to_record(&session, &record));
+    TEST_CHECK_INT_EQUAL(record.errors, 4);
+
+    sentry_session_t *rt
+        = sentry__session_from_record((const char *)&record, sizeof(record));
+    TEST_CHECK(!!rt);
+    if (rt) {
+        TEST_CHECK_STRING_EQUAL(rt->release, "my_release");
+        TEST_CHECK(!rt->environment);
+        TEST_CHECK(!memcmp(&rt->session_id, &session.session_id,
+            sizeof(rt->session_id)));
+        TEST_CHECK_STRING_EQUAL(
+            sentry_value_as_string(rt->distinct_id), "foo@blabla.invalid");
+        TEST_CHECK(rt->started_ms == started_ms);
+        // the elapsed time at the last update, not at the time of restoring
+        TEST_CHECK(rt->duration_ms >= 5000 && rt->duration_ms < 65000);
+        TEST_CHECK_INT_EQUAL(rt->errors, 4);
+        TEST_CHECK(rt->status == SENTRY_SESSION_STATUS_OK);
+        TEST_CHECK(rt->init);
+        sentry__session_free(rt);
+    }
+
+    // a session that does not fit leaves the record untouched
+    char long_release[SENTRY_SESSION_RECORD_STRING_MAX + 1];
+    memset(long_release, 'a', sizeof(long_release) - 1);
+    long_release[sizeof(long_release) - 1] = '\0';
+    session.release = long_release;
+    TEST_CHECK(!sentry__session_to_record(&session, &record));
+    TEST_CHECK_STRING_EQUAL(record.release, "my_release");
+
+    // a record with an update in progress is torn, and does not yield a session
+    TEST_CHECK_INT_EQUAL(record.sequence & 1, 0);
+    record.sequence |= 1;
+    TEST_CHECK(
+        !sentry__session_from_record((const char *)&record, sizeof(record)));
+    record.sequence++;
+
+    record.active = 0;
+    TEST_CHECK(
+        !sentry__session_from_record((const char *)&record, sizeof(record)));
+
+    sentry_value_decref(session.distinct_id);
+}
+
+static void
+send_aggregates_envelope(const sentry_envelope_t *envelope, void *data)
+{
+    uint64_t *called = data;
+    *called += 1;
+
+    TEST_CHECK_INT_EQUAL(sentry__envelope_get_item_count(envelope), 1);
+
+    const sentry_envelope_item_t *item = sentry__envelope_get_item(envelope, 0);
+    TEST_CHECK_STRING_EQUAL(
+        sentry_value_as_string(sentry__envelope_item_get_header(item, "type")),
+        "sessions");
+
+    size_t buf_len;
+    const char *buf = sentry__envelope_item_get_payload(item, &buf_len);
+    sentry_value_t sessions = sentry__value_from_json(buf, buf_len);
+
+    sentry_value_t aggregates = sentry_value_get_by_key(sessions, "aggregates");
+    TEST_CHECK_INT_EQUAL(sentry_value_get_length(aggregates), 2);
+    for (size_t i = 0; i < sentry_value_get_length(aggregates); i++) {
+        sentry_value_t bucket = sentry_value_get_by_index(aggregates, i);
+        TEST_CHECK_INT_EQUAL(
+            sentry_value_get_type(sentry_value_get_by_key(bucket, "started")),
+            SENTRY_VALUE_TYPE_STRING);
+        sentry_value_t did = sentry_value_get_by_key(bucket, "did");
+        if (sentry_value_is_null(did)) {
+            TEST_CHECK_INT_EQUAL(sentry_value_as_int32(
+                                     sentry_value_get_by_key(bucket, "exited")),
+                2);
+            TEST_CHECK_INT_EQUAL(sentry_value_as_int32(sentry_value_get_by_key(
+                                     bucket, "errored")),
+                1);
+            TEST_CHECK(sentry_value_is_null(
+                sentry_value_get_by_key(bucket, "crashed")));
+        } else {
+            TEST_CHECK_STRING_EQUAL(sentry_value_as_string(did), "swatinem");
+            TEST_CHECK_INT_EQUAL(sentry_value_as_int32(sentry_value_get_by_key(
+                                     bucket, "crashed")),
+                1);
+            TEST_CHECK(sentry_value_is_null(
+                sentry_value_get_by_key(bucket, "exited")));
+        }
+    }
+
+    sentry_value_t attrs = sentry_value_get_by_key(sessions, "attrs");
+    TEST_CHECK_STRING_EQUAL(
+        sentry_value_as_string(sentry_value_get_by_key(attrs, "release")),
+        "my_release");
+
+    sentry_value_decref(sessions);
+}
+
+SENTRY_TEST(session_aggregates)
+{
+    uint64_t called = 0;
+    sentry_options_t *options = sentry_options_new();
+    sentry_options_set_dsn(options, "https://foo@sentry.invalid/42");
+    sentry_options_set_transport(options,
+        sentry_new_function_transport(send_aggregates_envelope, &called));
+    sentry_options_set_release(options, "my_release");
+    sentry_options_set_auto_session_tracking(options, false);
+    sentry_init(options);
+
+    sentry_record_request_session(SENTRY_REQUEST_SESSION_EXITED, NULL);
+    sentry_record_request_session(SENTRY_REQUEST_SESSION_ERRORED, NULL);
+    sentry_record_request_session(SENTRY_REQUEST_SESSION_EXITED, NULL);
+    sentry_record_request_session(SENTRY_REQUEST_SESSION_CRASHED, "swatinem");
+
+    sentry_shutdown();
+
+    TEST_CHECK_INT_EQUAL(called, 1);
+}
+
+static void
+count_aggregates(const sentry_envelope_t *envelope, void *data)
+{
+    size_t *count = data;
+    const sentry_envelope_item_t *item = sentry__envelope_get_item(envelope, 0);
+    size_t buf_len;
+    const char *buf = sentry__envelope_item_get_payload(item, &buf_len);
+    sentry_value_t sessions = sentry__value_from_json(buf, buf_len);
+    *count += sentry_value_get_length(
+        sentry_value_get_by_key(sessions, "aggregates"));
+    sentry_value_decref(sessions);
+}
+
+SENTRY_TEST(session_aggregates_limit)
+{
+    size_t count = 0;
+    sentry_options_t *options = sentry_options_new();
+    sentry_options_set_dsn(options, "https://foo@sentry.invalid/42");
+    sentry_options_set_transport(
+        options, sentry_new_function_transport(count_aggregates, &count));
+    sentry_options_set_release(options, "my_release");
+    sentry_options_set_auto_session_tracking(options, false);
+    sentry_init(options);
+
+    for (int i = 0; i < 1100; i++) {
+        char distinct_id[16];
+        snprintf(distinct_id, sizeof(distinct_id), "user-%d", i);
+        sentry_record_request_session(
+            SENTRY_REQUEST_SESSION_EXITED, distinct_id);
+    }
+
+    sentry_shutdown();
+
+    TEST_CHECK(count > 0);
+    TEST_CHECK(count <= 1000);
+}
@@ -28,3 +28,61 @@ SENTRY_TEST(symbolizer)
     sentry__symbolize(((char *)(void *)&test_function) + 1, asserter, &called);
     TEST_CHECK_INT_EQUAL(called, 1);
 }
+
+#if defined(SENTRY_PLATFORM_LINUX)
+__attribute__((noinline)) static void
+static_test_function(void)
+{
+    printf("Something else here\n");
+}
+#endif
+
+static void
+batch_asserter(const sentry_frame_info_t *info, size_t index, void *data)
+{
+    int *called = data;
+    TEST_CHECK(index == 0 || index == 2);
+    if (index == 0) {
+        TEST_CHECK(info->symbol && strstr(info->symbol, "test_function") != 0);
+        TEST_CHECK(info->symbol_addr == &test_function);
+    }
+    called[index] += 1;
+}
+
+SENTRY_TEST(symbolizer_batch)
+{
+    int called[3] = { 0, 0, 0 };
+    void *addrs[3] = { ((char *)(void *)&test_function) + 1, NULL,
+        ((char *)(void *)&test_function) + 2 };
+    sentry__symbolize_batch(addrs, 3, batch_asserter, called);
+    TEST_CHECK_INT_EQUAL(called[0], 1);
+    TEST_CHECK_INT_EQUAL(called[1], 0);
+    TEST_CHECK_INT_EQUAL(called[2], 1);
+    sentry__symbolizer_cleanup();
+}
+
+#if defined(SENTRY_PLATFORM_LINUX)
+static void
+static_asserter(const sentry_frame_info_t *info, void *data)
+{
+    int *called = data;
+    TEST_CHECK(info->symbol
+        && strcmp(info->symbol, "static_test_function") == 0);
+    TEST_CHECK(info->symbol_addr == &static_test_function);
+    *called += 1;
+}
+#endif
+
+SENTRY_TEST(symbolizer_static_function)
+{
+#if !defined(SENTRY_PLATFORM_LINUX)
+    SKIP_TEST();
+#else
+    // local symbols are only found in `.symtab`, not by `dladdr`
+    int called = 0;
+    sentry__symbolize(
+        ((char *)(void *)&static_test_function) + 1, static_asserter, &called);
+    TEST_CHECK_INT_EQUAL(called, 1);
+    sentry__symbolizer_cleanup();
+#endif
+}
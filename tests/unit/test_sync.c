@@ -131,3 +131,34 @@ SENTRY_TEST(task_queue)
     // was instructed to shut down
     TEST_CHECK(executed_after_shutdown);
 }
+
+static void
+incref_counter(void *ptr)
+{
+    (*(long *)ptr)++;
+}
+
+SENTRY_TEST(published_pointer)
+{
+    sentry_published_t published = SENTRY__PUBLISHED_INIT;
+    TEST_CHECK(!sentry__published_acquire(&published, incref_counter));
+
+    long first = 1;
+    long epoch;
+    TEST_CHECK(!sentry__published_exchange(&published, &first, &epoch));
+    sentry__published_wait(&published, epoch);
+    TEST_CHECK(sentry__published_acquire(&published, incref_counter) == &first);
+    TEST_CHECK_INT_EQUAL(first, 2);
+
+    long second = 1;
+    long next_epoch;
+    TEST_CHECK(
+        sentry__published_exchange(&published, &second, &next_epoch) == &first);
+    TEST_CHECK(next_epoch != epoch);
+    // there are no readers left, so this returns right away
+    sentry__published_wait(&published, next_epoch);
+    TEST_CHECK(
+        sentry__published_acquire(&published, incref_counter) == &second);
+    TEST_CHECK_INT_EQUAL(first, 2);
+    TEST_CHECK_INT_EQUAL(second, 2);
+}
@@ -2,6 +2,10 @@
 #include "sentry_testsupport.h"
 #include <sentry.h>
 
+#if defined(SENTRY_PLATFORM_LINUX) && !defined(SENTRY_PLATFORM_ANDROID)
+#    include <ucontext.h>
+#endif
+
 #define MAX_FRAMES 128
 
 TEST_VISIBLE size_t
@@ -65,3 +69,189 @@ SENTRY_TEST(unwinder)
         }
     }
 }
+
+#if defined(SENTRY_PLATFORM_LINUX) && !defined(SENTRY_PLATFORM_ANDROID)
+TEST_VISIBLE size_t
+invoke_ucontext_unwinder(void **backtrace)
+{
+    ucontext_t user_context;
+    TEST_CHECK(getcontext(&user_context) == 0);
+    sentry_ucontext_t uctx;
+    memset(&uctx, 0, sizeof(uctx));
+    uctx.user_context = &user_context;
+    return sentry_unwind_stack_from_ucontext(&uctx, backtrace, MAX_FRAMES);
+}
+
+TEST_VISIBLE size_t
+call_ucontext_unwinder(void **backtrace)
+{
+    size_t frame_count = invoke_ucontext_unwinder(backtrace);
+    // this assertion here makes sure the call is not a tail call.
+    TEST_CHECK(frame_count > 0);
+    return frame_count;
+}
+
+#    ifdef SENTRY_WITH_UNWINDER_FP
+size_t sentry__unwind_stack_fp(void *addr, const sentry_ucontext_t *uctx,
+    void **ptrs, size_t max_frames);
+
+TEST_VISIBLE size_t
+invoke_fp_unwinder(void **backtrace)
+{
+    ucontext_t user_context;
+    TEST_CHECK(getcontext(&user_context) == 0);
+    sentry_ucontext_t uctx;
+    memset(&uctx, 0, sizeof(uctx));
+    uctx.user_context = &user_context;
+    return sentry__unwind_stack_fp(NULL, &uctx, backtrace, MAX_FRAMES);
+}
+
+TEST_VISIBLE size_t
+call_fp_unwinder(void **backtrace)
+{
+    size_t frame_count = invoke_fp_unwinder(backtrace);
+    // this assertion here makes sure the call is not a tail call.
+    TEST_CHECK(frame_count > 0);
+    return frame_count;
+}
+#    endif
+
+#    ifdef SENTRY_WITH_UNWINDER_CFI
+size_t sentry__unwind_stack_cfi(void *addr, const sentry_ucontext_t *uctx,
+    void **ptrs, size_t max_frames);
+
+TEST_VISIBLE size_t
+invoke_cfi_unwinder(void **backtrace)
+{
+    ucontext_t user_context;
+    TEST_CHECK(getcontext(&user_context) == 0);
+    sentry_ucontext_t uctx;
+    memset(&uctx, 0, sizeof(uctx));
+    uctx.user_context = &user_context;
+    return sentry__unwind_stack_cfi(NULL, &uctx, backtrace, MAX_FRAMES);
+}
+
+/**
+ * Unwinds with both the CFI and the default unwinder from the same function,
+ * so both stack traces have the same callers above it.
+ */
+TEST_VISIBLE void
+call_cfi_and_default_unwinder(void **backtrace, size_t *frame_count,
+    void **expected, size_t *expected_count)
+{
+    *frame_count = invoke_cfi_unwinder(backtrace);
+    *expected_count = invoke_unwinder(expected);
+    TEST_CHECK(*frame_count > 0);
+}
+#    endif
+
+static void
+get_symbol_addr(const sentry_frame_info_t *info, void *data)
+{
+    *(void **)data = info->symbol_addr;
+}
+
+static void *
+symbol_addr_of(void *addr)
+{
+    void *symbol_addr = NULL;
+    sentry__symbolize(addr, get_symbol_addr, &symbol_addr);
+    return symbol_addr;
+}
+#endif
+
+SENTRY_TEST(unwinder_fp)
+{
+#if !defined(SENTRY_WITH_UNWINDER_FP) || defined(SENTRY_PLATFORM_ANDROID)      \
+    || !(defined(__x86_64__) || defined(__aarch64__))
+    SKIP_TEST();
+#else
+    void *backtrace[MAX_FRAMES] = { 0 };
+
+    // every return address needs to be in a known module
+    sentry_clear_modulecache();
+    TEST_CHECK_INT_EQUAL(invoke_fp_unwinder(backtrace), 0);
+
+    // this file is built with frame pointers, so the frame records lead up
+    // to the test runner at least
+    sentry_value_decref(sentry_get_modules_list());
+    size_t frame_count = call_fp_unwinder(backtrace);
+    TEST_CHECK(frame_count >= 4);
+    TEST_CHECK(symbol_addr_of(backtrace[0]) == (void *)&invoke_fp_unwinder);
+    TEST_CHECK(symbol_addr_of(backtrace[1]) == (void *)&call_fp_unwinder);
+    TEST_CHECK(
+        symbol_addr_of(backtrace[2]) == (void *)&test_sentry_unwinder_fp);
+
+    sentry_clear_modulecache();
+#endif
+}
+
+SENTRY_TEST(unwinder_ucontext)
+{
+#if !defined(SENTRY_WITH_UNWINDER_CFI) || defined(SENTRY_PLATFORM_ANDROID)     \
+    || !(defined(__x86_64__) || defined(__aarch64__))
+    SKIP_TEST();
+#else
+    // the ucontext unwinders need the modules, which the CFI unwinder always
+    // has tables for
+    sentry_value_decref(sentry_get_modules_list());
+
+    void *backtrace[MAX_FRAMES] = { 0 };
+    size_t frame_count = call_ucontext_unwinder(backtrace);
+    // the function that captured the context, its caller, this test, and
+    // the test runner
+    TEST_CHECK(frame_count >= 4);
+    TEST_CHECK(
+        symbol_addr_of(backtrace[0]) == (void *)&invoke_ucontext_unwinder);
+    TEST_CHECK(
+        symbol_addr_of(backtrace[1]) == (void *)&call_ucontext_unwinder);
+
+    sentry_clear_modulecache();
+#endif
+}
+
+SENTRY_TEST(unwinder_cfi)
+{
+#if !defined(SENTRY_WITH_UNWINDER_CFI) || defined(SENTRY_PLATFORM_ANDROID)     \
+    || !(defined(__x86_64__) || defined(__aarch64__))
+    SKIP_TEST();
+#else
+    void *backtrace[MAX_FRAMES] = { 0 };
+
+    // the unwind tables are only built when enumerating the modules
+    sentry_clear_modulecache();
+    TEST_CHECK_INT_EQUAL(invoke_cfi_unwinder(backtrace), 0);
+
+    sentry_value_decref(sentry_get_modules_list());
+    void *expected[MAX_FRAMES] = { 0 };
+    size_t frame_count = 0;
+    size_t expected_count = 0;
+    call_cfi_and_default_unwinder(
+        backtrace, &frame_count, expected, &expected_count);
+    TEST_CHECK(frame_count >= 4);
+    TEST_CHECK(symbol_addr_of(backtrace[0]) == (void *)&invoke_cfi_unwinder);
+    TEST_CHECK(
+        symbol_addr_of(backtrace[1]) == (void *)&call_cfi_and_default_unwinder);
+
+    // above the common function, both stack traces need to have the very same
+    // callers, in the same order
+    size_t common = expected_count;
+    for (size_t i = 0; i < expected_count; i++) {
+        if (symbol_addr_of(expected[i])
+            == (void *)&call_cfi_and_default_unwinder) {
+            common = i;
+            break;
+        }
+    }
+    TEST_CHECK(common < expected_count);
+    if (common < expected_count) {
+        TEST_CHECK_INT_EQUAL(frame_count - 1, expected_count - common);
+        for (size_t i = 2; i < frame_count && common + i - 1 < expected_count;
+             i++) {
+            TEST_CHECK(backtrace[i] == expected[common + i - 1]);
+        }
+    }
+
+    sentry_clear_modulecache();
+#endif
+}
@@ -150,7 +150,8 @@ SENTRY_TEST(page_allocator)
         p_after[i] = (i + 10) % 255;
     }
 
-    /* free is a noop after page allocator was enabled */
+    /* free is a noop for memory allocated before the page allocator was
+       enabled, and recycles the block otherwise */
     sentry_free(p_before);
     sentry_free(p_after);
 
@@ -159,6 +160,10 @@ SENTRY_TEST(page_allocator)
         TEST_CHECK_INT_EQUAL((unsigned char)p_after[i], (i + 10) % 255);
     }
 
+    char *p_recycled = sentry_malloc(size);
+    TEST_CHECK(p_recycled == p_after);
+    sentry_free(p_recycled);
+
     sentry__page_allocator_disable();
 
     /* now we can free p_before though */
@@ -166,6 +171,63 @@ SENTRY_TEST(page_allocator)
 #endif
 }
 
+SENTRY_TEST(page_allocator_reserve)
+{
+#ifndef SENTRY_PLATFORM_UNIX
+    SKIP_TEST();
+#else
+    sentry__page_allocator_reserve(256 * 1024);
+    sentry__page_allocator_enable();
+
+    sentry_page_allocator_stats_t stats;
+    sentry__page_allocator_get_stats(&stats);
+    TEST_CHECK_INT_EQUAL(stats.reserved_bytes, 256 * 1024);
+    size_t mapped_bytes = stats.mapped_bytes;
+
+    void *small[100];
+    for (size_t i = 0; i < 100; i++) {
+        small[i] = sentry_malloc(100);
+        TEST_CHECK(!!small[i]);
+    }
+    void *large = sentry_malloc(100 * 1024);
+    TEST_CHECK(!!large);
+
+    sentry__page_allocator_get_stats(&stats);
+    TEST_CHECK_INT_EQUAL(stats.mapped_bytes, mapped_bytes);
+    TEST_CHECK_INT_EQUAL(stats.overflow_maps, 0);
+    TEST_CHECK_INT_EQUAL(stats.allocations, 101);
+    size_t high_water_bytes = stats.high_water_bytes;
+    TEST_CHECK(high_water_bytes >= 100 * 100 + 100 * 1024);
+
+    for (size_t i = 0; i < 100; i++) {
+        sentry_free(small[i]);
+    }
+    sentry_free(large);
+
+    sentry__page_allocator_get_stats(&stats);
+    TEST_CHECK_INT_EQUAL(stats.frees, 101);
+    TEST_CHECK_INT_EQUAL(stats.in_use_bytes, 0);
+    TEST_CHECK_INT_EQUAL(stats.high_water_bytes, high_water_bytes);
+
+    // repeated allocations are served from the free lists
+    for (size_t i = 0; i < 1000; i++) {
+        sentry_free(sentry_malloc(100 * 1024));
+    }
+    sentry__page_allocator_get_stats(&stats);
+    TEST_CHECK_INT_EQUAL(stats.mapped_bytes, mapped_bytes);
+    TEST_CHECK_INT_EQUAL(stats.high_water_bytes, high_water_bytes);
+
+    // exhausting the reservation maps more memory
+    void *huge = sentry_malloc(512 * 1024);
+    TEST_CHECK(!!huge);
+    sentry__page_allocator_get_stats(&stats);
+    TEST_CHECK_INT_EQUAL(stats.overflow_maps, 1);
+    sentry_free(huge);
+
+    sentry__page_allocator_disable();
+#endif
+}
+
 SENTRY_TEST(os)
 {
     sentry_value_t os = sentry__get_os_context();
@@ -434,3 +434,23 @@ SENTRY_TEST(value_collections_leak)
     TEST_CHECK_INT_EQUAL(sentry_value_refcount(obj), 1);
     sentry_value_decref(obj);
 }
+
+SENTRY_TEST(value_msgpack_buffer)
+{
+    sentry_value_t value = sentry_value_new_object();
+    sentry_value_set_by_key(value, "message", sentry_value_new_string("foo"));
+
+    size_t size;
+    char *expected = sentry_value_to_msgpack(value, &size);
+
+    char buf[64];
+    TEST_CHECK_INT_EQUAL(
+        sentry__value_to_msgpack_buffer(value, buf, sizeof(buf)), size);
+    TEST_CHECK(memcmp(buf, expected, size) == 0);
+
+    // too small buffers fail
+    TEST_CHECK_INT_EQUAL(sentry__value_to_msgpack_buffer(value, buf, 4), 0);
+
+    sentry_free(expected);
+    sentry_value_decref(value);
+}